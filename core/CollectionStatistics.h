@@ -0,0 +1,35 @@
+#pragma once
+
+#include "../typedefs.h"
+
+// BM25 用到的文档集合统计量. 多个分片各自只有部分文档，分片之间的分数要可比较，
+// 需要把各分片的统计量相加后作为全局统计量交给每个分片计算分数.
+struct CollectionStatistics
+{
+    uint64_t doc_count = 0;
+    uint64_t total_word_count = 0;
+    std::unordered_map<std::string, uint64_t> doc_freqs; // term -> 包含它的文档数
+
+    double avgWordCount() const
+    {
+        return doc_count == 0 ? 0.0 : 1.0 * total_word_count / doc_count;
+    }
+
+    // 没有统计到的 term 返回空
+    std::optional<uint64_t> docFreq(const std::string& word) const
+    {
+        auto iter = doc_freqs.find(word);
+        if (iter == doc_freqs.end())
+            return std::nullopt;
+        return iter->second;
+    }
+
+    void merge(const CollectionStatistics& other)
+    {
+        doc_count += other.doc_count;
+        total_word_count += other.total_word_count;
+        for (const auto& [word, freq] : other.doc_freqs)
+            doc_freqs[word] += freq;
+    }
+};
+using CollectionStatisticsPtr = std::shared_ptr<const CollectionStatistics>;
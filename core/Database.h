@@ -4,13 +4,21 @@
 #include "typedefs.h"
 #include "Document.h"
 #include "Trie.h"
+#include "CollectionStatistics.h"
 #include "searcher/QueryStatistics.h"
+#include "searcher/QueryCache.h"
+#include "executor/FilterCache.h"
+#include "utils/RoaringBitmap.h"
+#include "storage/DocumentStore.h"
 #include "utils/ContainerUtils.h"
+#include <shared_mutex>
 
 class Database {
 public:
     // 如果 new_database == false, 那么尝试反序列化.
-    explicit Database(std::filesystem::path location, bool new_database = false) : database_path(std::move(location)), is_new_database(new_database)
+    // analyzer_config 只对新数据库生效，已有数据库沿用建索引时持久化的分词配置.
+    explicit Database(std::filesystem::path location, bool new_database = false, const AnalyzerConfig& analyzer_config = {})
+        : database_path(std::move(location)), is_new_database(new_database), analyzer(analyzer_config)
     {
         if (!exists(database_path))
             std::filesystem::create_directory(database_path);
@@ -19,7 +27,12 @@ public:
             THROW(DatabaseOccupiedException());
 
         if (!new_database)
+        {
+            deserializeAnalyzer();
             deserialize();
+            if (DocumentStore::exists(database_path))
+                document_store = std::make_unique<DocumentStore>(database_path);
+        }
     }
 
     bool is_a_new_database() const
@@ -32,9 +45,61 @@ public:
         return database_path;
     }
 
+    // 索引与查询共用的分词器
+    const Analyzer& getAnalyzer() const
+    {
+        return analyzer;
+    }
+
+    // 文档集合每发生一次变化（增加、删除、清空）加一，用于判断缓存的查询结果是否过期
+    uint64_t getGeneration() const
+    {
+        return generation;
+    }
+
+    // 查询在整个执行期间持有，replaceIndexWith 替换索引时不会看到新旧混合的数据
+    std::shared_lock<std::shared_mutex> lockIndexShared() const
+    {
+        return std::shared_lock(index_swap_lock);
+    }
+
+    QueryCache& getQueryCache()
+    {
+        return query_cache;
+    }
+
+    FilterCache& getFilterCache()
+    {
+        return filter_cache;
+    }
+
+    // 在 database 目录下保存文档原文的压缩副本，之后建索引的文档由 store 提供高亮文本与下载.
+    // 需要在开始建索引、查询之前调用.
+    void enableDocumentStore()
+    {
+        if (document_store)
+            return;
+        document_store = std::make_unique<DocumentStore>(database_path);
+        if (is_new_database)
+            document_store->clear();
+    }
+
+    // 未启用时返回 nullptr
+    DocumentStore* getDocumentStore() const
+    {
+        return document_store.get();
+    }
+
+    // doc_id 用尽(超过 MAX_DOC_ID)时抛出 Poco::LimitExceededException，不分配新的 doc_id
     size_t newDocId()
     {
-        return next_doc_id++;
+        size_t doc_id = next_doc_id.load();
+        do
+        {
+            if (doc_id > MAX_DOC_ID)
+                THROW(Poco::LimitExceededException("doc id exhausted, rebuild the database to compact doc ids"));
+        } while (!next_doc_id.compare_exchange_weak(doc_id, doc_id + 1));
+        return doc_id;
     }
 
     size_t maxAllocatedDocId() const
@@ -42,39 +107,65 @@ public:
         return next_doc_id - 1;
     }
 
+    // 遍历全部文档，调用方在一次查询中只取一次
     double getAvgWordCount() const
     {
-        static size_t old_sum = 0, old_count = 0, old_max_mallocated_id = 0;
-
         std::lock_guard<std::mutex> guard(document_map_lock);
-        // 优化性能: 保存 total + size 来计算 avg.
-        if (old_max_mallocated_id == maxAllocatedDocId() && old_count == document_map.size())
-            return old_sum / old_count;
+        if (document_table.empty())
+            return 0.0;
+        return 1.0 * document_table.getTotalWordCount() / document_table.size();
+    }
 
-        size_t sum = 0, count = document_map.size();
-        for (const auto& iter : document_map)
+    // 当前文档集合的统计量以及 words 中每个词的文档频率，用于分片之间合并出全局的 BM25 统计量
+    CollectionStatistics collectStatistics(const std::vector<std::string>& words) const
+    {
+        CollectionStatistics stats;
         {
-            sum += iter.second->getWordCount();
+            std::lock_guard<std::mutex> guard(document_map_lock);
+            stats.doc_count = document_table.size();
+            stats.total_word_count = document_table.getTotalWordCount();
         }
+        for (const auto& word : words)
         {
-            old_sum = sum;
-            old_count = count;
-            old_max_mallocated_id = maxAllocatedDocId();
+            auto term_ptr = findTerm(word);
+            stats.doc_freqs[word] = term_ptr ? term_ptr->posting_list.size() : 0;
         }
-
-        return sum * 1.0 / count;
+        return stats;
     }
 
     size_t getDocumentCount() const
     {
         std::lock_guard<std::mutex> guard(document_map_lock);
-        return document_map.size();
+        return document_table.size();
     }
 
-    void addDocument(size_t doc_id, const std::string& doc_path, size_t word_count, const std::unordered_map<Key, Value>& kvs)
+    // 粗略估计索引常驻内存的字节数（倒排表与文档元数据），用于多个 database 之间的内存预算，不含缓存与 trie.
+    // 随增删增量维护，调用代价是常数，不会阻塞建索引与查询
+    uint64_t estimateMemoryBytes() const
     {
+        uint64_t bytes;
+        {
+            std::lock_guard<std::mutex> guard(term_map_lock);
+            bytes = term_memory_bytes;
+        }
+        {
+            std::lock_guard<std::mutex> guard(document_map_lock);
+            bytes += document_table.estimateMemoryBytes();
+        }
+        return bytes;
+    }
+
+    void addDocument(size_t doc_id, const std::string& doc_path, size_t word_count, std::unordered_map<Key, Value> kvs)
+    {
+        if (!std::filesystem::is_regular_file(doc_path))
+            THROW(FileTypeUnmatchException());
+        auto modify_time = getModifiedLastDateTime(doc_path);
+        auto kv_row = std::make_shared<const KVMap>(std::move(kvs));
+
         std::lock_guard<std::mutex> guard(document_map_lock);
-        document_map.emplace(doc_id, std::make_shared<Document>(doc_id, doc_path, word_count, kvs));
+        if (!document_table.contains(doc_id))
+            document_table.add(doc_id, doc_path, modify_time, word_count, std::move(kv_row));
+        ++generation; // 文档的 terms 此时已经全部加入
     }
 
     void deleteDocument(size_t doc_id)
@@ -82,21 +173,59 @@ public:
         DocumentPtr document_ptr = findDocument(doc_id);
         {
             std::lock_guard<std::mutex> guard(document_map_lock);
-            document_map.erase(doc_id);
+            document_table.remove(doc_id);
+            deleted_doc_ids.add(doc_id);
+            ++generation;
         }
+        if (document_store)
+            document_store->remove(doc_id);
         tidyTerm(document_ptr);
     }
 
+    // 已分配但被删除的 doc_id，NOT 查询用 [1, maxAllocatedDocId()] 减去它得到全集
+    RoaringBitmap getDeletedDocIds() const
+    {
+        std::lock_guard<std::mutex> guard(document_map_lock);
+        return deleted_doc_ids;
+    }
+
+    // 取出文档的全部元数据，查询的热路径使用下面按列读取的函数
     DocumentPtr findDocument(size_t doc_id) const
     {
         std::lock_guard<std::mutex> guard(document_map_lock);
-        auto document_ptr = document_map.find(doc_id);
-        if (document_ptr == document_map.end())
+        if (!document_table.contains(doc_id))
+            return nullptr;
+        return std::make_shared<Document>(doc_id, document_table.getPath(doc_id), document_table.getModifyTime(doc_id),
+                                          document_table.getWordCount(doc_id), document_table.getKvs(doc_id),
+                                          document_table.getAnnotations(doc_id));
+    }
+
+    bool containsDocument(size_t doc_id) const
+    {
+        std::lock_guard<std::mutex> guard(document_map_lock);
+        return document_table.contains(doc_id);
+    }
+
+    // 文档已被删除时返回 std::nullopt
+    std::optional<size_t> getWordCount(size_t doc_id) const
+    {
+        std::lock_guard<std::mutex> guard(document_map_lock);
+        if (!document_table.contains(doc_id))
+            return std::nullopt;
+        return document_table.getWordCount(doc_id);
+    }
+
+    // 文档已被删除时返回 nullptr，没有 kv 时返回空表
+    KVRow findKvs(size_t doc_id) const
+    {
+        std::lock_guard<std::mutex> guard(document_map_lock);
+        if (!document_table.contains(doc_id))
             return nullptr;
-        return document_ptr->second;
+        return document_table.getKvs(doc_id);
     }
 
-    void addTerm(const std::string& word, size_t doc_id, size_t offset_in_file)
+    // position 是该词在文档分词结果中的序号，缺省时该词不参与短语/邻近查询
+    void addTerm(const std::string& word, size_t doc_id, size_t offset_in_file, std::optional<uint32_t> position = std::nullopt)
     {
         trie.add(word);
 
@@ -105,6 +234,7 @@ public:
         if (term_ptr == nullptr)
         {
             term_ptr = std::make_shared<Term>(word);
+            term_memory_bytes += estimateTermBytes(word, *term_ptr);
         }
         auto &posting_list = term_ptr->posting_list;
         auto &statistics_list = term_ptr->statistics_list;
@@ -117,11 +247,20 @@ public:
             posting_list.insert(doc_iter, doc_id);
             // 如果想要插入一个空的 TermStatisticsWithInDoc，use {{}} or TermStatisticsWithInDoc{} instead of {}, 因为 insert 支持插入 std::initializer_list，{} 会被当做一个空的初始化列表从而不插入任何东西
             statistics_list.insert(statistics_list.begin() + stat_offset, TermStatisticsWithInDoc{});
+            term_memory_bytes += sizeof(size_t) + sizeof(TermStatisticsWithInDoc);
         }
 
         auto &offset_set = statistics_list[stat_offset].offsets_in_file;
         assert(!offset_set.contains(offset_in_file));
         offset_set.emplace(offset_in_file);
+        term_memory_bytes += TERM_OFFSET_BYTES;
+
+        if (position.has_value())
+        {
+            auto &positions = statistics_list[stat_offset].positions;
+            positions.insert(std::upper_bound(positions.begin(), positions.end(), *position), *position);
+            term_memory_bytes += sizeof(uint32_t);
+        }
     }
 
     std::vector<std::string> matchTerm(const std::string& word, int expected_num) const
@@ -144,7 +283,7 @@ public:
             return;
         std::unique_ptr<Reader> reader = std::make_unique<TxtLineReader>(document_ptr->getPath().string());
         StringInFiles res;
-        extractWords(reader, res);
+        analyzer.analyze(reader, res);
         for (const auto& sif : res)
             tidyTerm(sif.str);
     }
@@ -157,14 +296,16 @@ public:
         if (iter == term_map.end())
             return;
         const auto& posting_list = iter->second->posting_list;
+        auto old_bytes = estimateTermBytes(iter->first, *iter->second);
         std::unordered_set<size_t> index_to_delete;
         for (size_t i = 0; i < posting_list.size(); i++)
         {
-            if (findDocument(posting_list[i]) == nullptr)
+            if (!containsDocument(posting_list[i]))
                 index_to_delete.emplace(i);
         }
         removeElements(iter->second->posting_list, index_to_delete);
         removeElements(iter->second->statistics_list, index_to_delete);
+        term_memory_bytes = term_memory_bytes - old_bytes + estimateTermBytes(iter->first, *iter->second);
 
         if (iter->second->posting_list.empty())
             trie.remove(iter->first);
@@ -218,26 +359,102 @@ public:
     {
         std::scoped_lock sl(term_map_lock, document_map_lock, query_stat_map_lock, document_freq_map_lock);
         term_map.clear();
-        document_map.clear();
+        term_memory_bytes = 0;
+        document_table.clear();
+        deleted_doc_ids = RoaringBitmap();
         query_stat_map.clear();
         document_freq_map.clear();
         trie.clear();
         next_doc_id = 1;
+        ++generation;
+        query_cache.clear();
+        filter_cache.clear();
+        if (document_store)
+            document_store->clear();
+    }
+
+    // 用 shadow 中重新建好的索引整体替换当前索引，替换前的索引交给 shadow 随之销毁.
+    // 查询统计保留；doc_id 重新分配，按 doc_id 记录的频率统计清空.
+    // 两者都启用了 document store 时一并替换，shadow 目录在其销毁后由调用方删除.
+    // 返回前新索引已经持久化，之后崩溃不会留下与 store 不一致的 meta.
+    void replaceIndexWith(Database& shadow)
+    {
+        assert(&shadow != this && shadow.database_path != database_path);
+        std::unique_lock swap_lock(index_swap_lock);
+        std::scoped_lock sl(term_map_lock, document_map_lock, document_freq_map_lock, shadow.term_map_lock, shadow.document_map_lock);
+        std::swap(term_map, shadow.term_map);
+        std::swap(term_memory_bytes, shadow.term_memory_bytes);
+        document_table.swap(shadow.document_table);
+        std::swap(deleted_doc_ids, shadow.deleted_doc_ids);
+        trie.swap(shadow.trie);
+        next_doc_id = shadow.next_doc_id.exchange(next_doc_id);
+        document_freq_map.clear();
+
+        // 先写好新的 meta，移动 store 之后立即改名生效，两者不一致的窗口只有两次 rename 之间
+        auto meta_tmp_path = writeMeta(database_path);
+        if (document_store && shadow.document_store)
+        {
+            // 先把旧 store 移出 database 目录，否则它销毁时会覆盖新 store 的索引文件
+            document_store->moveTo(shadow.database_path / "replaced");
+            shadow.document_store->moveTo(database_path);
+            std::swap(document_store, shadow.document_store);
+        }
+        if (meta_tmp_path)
+            std::filesystem::rename(*meta_tmp_path, database_path / "meta");
+
+        ++generation;
+        query_cache.clear();
+        filter_cache.clear();
+    }
+
+    // 把索引与文档原文写入 dir，得到可以直接作为 database 目录打开的一致副本. 不修改本 database 的文件.
+    // 返回与本 database 共享（硬链接）、之后还会在末尾追加的文件及其在快照中的有效长度
+    std::unordered_map<std::string, uint64_t> saveSnapshot(const std::filesystem::path& dir) const
+    {
+        auto index_lock = lockIndexShared();
+        std::filesystem::create_directories(dir);
+        serializeIndex(dir);
+        serializeAnalyzer(dir);
+        std::unordered_map<std::string, uint64_t> shared_lengths;
+        // 在 meta 之后生成：store 中多出的文档不会被引用
+        if (document_store)
+            shared_lengths.emplace("store.data", document_store->snapshotTo(dir));
+        return shared_lengths;
+    }
+
+    // 持久化索引与分词器配置. store 的索引随 meta 一起写入，不只在 store 析构时写入
+    void serialize() {
+        serializeIndex(database_path);
+        serializeAnalyzer(database_path);
+        if (document_store)
+            document_store->serialize();
+    }
+
+    // 析构时不再持久化，用于随后整体删除的 database，例如替换索引之后的影子索引
+    void discard()
+    {
+        discarded = true;
+        if (document_store)
+            document_store->discard();
     }
 
     ~Database() {
-        serialize();
+        if (!discarded)
+            serialize();
     }
 
 private:
     // 这两个变量不需要持久化
     bool is_new_database;
+    bool discarded = false;
     std::filesystem::path database_path;
 
     TermMap term_map;
+    uint64_t term_memory_bytes = 0; // term_map 的估计内存，由 term_map_lock 保护
     mutable std::mutex term_map_lock;
 
-    DocumentMap document_map;
+    DocumentTable document_table;
+    RoaringBitmap deleted_doc_ids; // 由 document_map_lock 保护，启动时从 document_table 推出，不需要持久化
     mutable std::mutex document_map_lock;
 
     QueryStatisticsMap query_stat_map;
@@ -248,14 +465,42 @@ private:
 
     Trie trie; // self thread-safe
 
+    Analyzer analyzer; // 构造后只读
+
+    mutable std::shared_mutex index_swap_lock;
+    std::atomic_uint64_t generation = 0;
+    QueryCache query_cache; // self thread-safe
+    FilterCache filter_cache; // self thread-safe
+    std::unique_ptr<DocumentStore> document_store; // self thread-safe, 可选
+
+    static constexpr uint64_t TERM_OFFSET_BYTES = 48; // offsets_in_file 中的一个节点
+
+    static uint64_t estimateTermBytes(const std::string& word, const Term& term)
+    {
+        uint64_t bytes = 64 + 2 * word.size() + term.posting_list.size() * sizeof(size_t);
+        for (const auto& stat : term.statistics_list)
+            bytes += sizeof(TermStatisticsWithInDoc) + stat.positions.size() * sizeof(uint32_t) + stat.offsets_in_file.size() * TERM_OFFSET_BYTES;
+        return bytes;
+    }
+
     // TODO: 需要持久化 trie, query_stat_map
-    void serialize() {
+    // 先写入临时文件再改名，崩溃时磁盘上总有一份完整的 meta
+    void serializeIndex(const std::filesystem::path& dir) const {
         std::scoped_lock sl(term_map_lock, document_map_lock);
+        if (auto tmp_path = writeMeta(dir))
+            std::filesystem::rename(*tmp_path, dir / "meta");
+    }
 
-        std::ofstream fout(database_path.string() + "/meta");
+    // 把索引写入 dir 下的临时文件并返回其路径，写入失败时返回空，原有的 meta 保持不变.
+    // caller holds term_map_lock, document_map_lock
+    std::optional<std::filesystem::path> writeMeta(const std::filesystem::path& dir) const {
+        auto tmp_path = dir / "meta.tmp";
+        std::ofstream fout(tmp_path, std::ios::binary | std::ios::trunc);
         WriteBuffer buf;
         WriteBufferHelper helper(buf);
 
+        helper.writeNumber(META_MAGIC);
+        helper.writeNumber(META_FORMAT_VERSION);
         helper.writeNumber(next_doc_id.load());
 
         helper.writeNumber(term_map.size());
@@ -265,13 +510,37 @@ private:
             pair.second->serialize(helper);
         }
 
-        helper.writeNumber(document_map.size());
-        for (const auto& pair : document_map)
-        {
-            helper.writeNumber(pair.first);
-            pair.second->serialize(helper);
-        }
+        helper.writeNumber(document_table.size());
+        document_table.forEach([&](size_t doc_id) {
+            helper.writeNumber(doc_id);
+            serializeDocument(helper, doc_id);
+        });
         buf.dumpAllToStream(fout);
+        fout.close();
+        if (!fout)
+            return std::nullopt;
+        return tmp_path;
+    }
+
+    void serializeAnalyzer(const std::filesystem::path& dir) const
+    {
+        std::ofstream fout(dir / "analyzer");
+        WriteBuffer buf;
+        WriteBufferHelper helper(buf);
+        analyzer.getConfig().serialize(helper);
+        buf.dumpAllToStream(fout);
+    }
+
+    void deserializeAnalyzer()
+    {
+        std::ifstream fin(database_path.string() + "/analyzer");
+        if (!fin.is_open())
+            return;
+
+        ReadBuffer buf;
+        buf.readAllFromStream(fin);
+        ReadBufferHelper helper(buf);
+        analyzer = Analyzer(AnalyzerConfig::deserialize(helper));
     }
 
     void deserialize() {
@@ -285,21 +554,91 @@ private:
         buf.readAllFromStream(fin);
         ReadBufferHelper helper(buf);
 
+        // 旧格式无法迁移：缺少的词位置只能重新分词得到
+        if (helper.readNumber<uint64_t>() != META_MAGIC)
+            THROW(Poco::DataFormatException("meta of " + database_path.string()
+                                            + " was written before format versions were recorded, remove it and rebuild the index"));
+        auto version = helper.readNumber<uint32_t>();
+        // 版本 1 的纯文本文档不按 '"', '{', '}', ':' 切分；unicode_segment 本来就把它们视为分隔符，词没有变化
+        bool compatible = version == 1 && analyzer.getConfig().unicode_segment;
+        if (version != META_FORMAT_VERSION && !compatible)
+            THROW(Poco::DataFormatException("meta of " + database_path.string() + " has format version " + std::to_string(version)
+                                            + ", expected " + std::to_string(META_FORMAT_VERSION) + ", remove it and rebuild the index"));
         next_doc_id = helper.readNumber<size_t>();
 
         auto size = helper.readNumber<size_t>();
         for (size_t i = 0; i < size; i++)
         {
             auto term_name = helper.readString();
-            term_map.emplace(term_name, Term::deserialize(helper));
+            auto term = Term::deserialize(helper);
+            term_memory_bytes += estimateTermBytes(term_name, *term);
+            term_map.emplace(std::move(term_name), std::move(term));
         }
 
         size = helper.readNumber<size_t>();
         for (size_t i = 0; i < size; i++)
         {
-            auto doc_id = helper.readNumber<size_t>();
-            document_map.emplace(doc_id, Document::deserialize(helper));
+            helper.readNumber<size_t>(); // doc_id，与 deserializeDocument 读出的相同
+            deserializeDocument(helper);
         }
+
+        for (size_t doc_id = 1; doc_id < next_doc_id; doc_id++)
+            if (!document_table.contains(doc_id))
+                deleted_doc_ids.add(doc_id);
+    }
+
+    // 文档的格式：doc_id, path, kvs, modify_time, word_count. 评论与评分还没有持久化
+    // caller holds document_map_lock
+    void serializeDocument(WriteBufferHelper& helper, size_t doc_id) const
+    {
+        helper.writeNumber(doc_id);
+        helper.writeString(document_table.getPath(doc_id).string());
+        auto kvs = document_table.getKvs(doc_id);
+        helper.writeNumber(kvs->size());
+        for (const auto& [key, value] : *kvs)
+        {
+            key.serialize(helper);
+            value.serialize(helper);
+        }
+        helper.writeDateTime(document_table.getModifyTime(doc_id));
+        helper.writeNumber(document_table.getWordCount(doc_id));
+    }
+
+    // caller holds document_map_lock
+    void deserializeDocument(ReadBufferHelper& helper)
+    {
+        auto doc_id = helper.readNumber<size_t>();
+        std::filesystem::path path(helper.readString());
+
+        auto size = helper.readNumber<size_t>();
+        KVMap kvs;
+        bool keys_exceeded = false;
+        for (size_t i = 0; i < size; i++)
+        {
+            // 字典由所有 database 共用，已满时与建索引时一样丢弃该文档的 kv，而不是让整个 database 无法加载
+            std::optional<Key> key;
+            try
+            {
+                key = Key::deserialize(helper); // 抛出时字段名已经读出，继续读 value
+            }
+            catch (const Poco::LimitExceededException&)
+            {
+                keys_exceeded = true;
+            }
+            auto value = Value::deserialize(helper);
+            if (key)
+                kvs.emplace(std::move(*key), std::move(value));
+        }
+        if (keys_exceeded)
+        {
+            httpLog("too many distinct json keys, kvs are dropped. file_path - " + path.string());
+            kvs.clear();
+        }
+
+        auto modify_time = helper.readDateTime();
+        auto word_count = helper.readNumber<size_t>();
+        // 不检查源文件：replica 与从快照加载的 database 所在机器上没有源文件，已删除的文件由 daemon 对比目录后删除
+        document_table.add(doc_id, path, modify_time, word_count, std::make_shared<const KVMap>(std::move(kvs)));
     }
 
     std::atomic_size_t next_doc_id = 1;
@@ -3,31 +3,28 @@
 #include "Term.h"
 #include "storage/Reader.h"
 #include "extractor/Extractor.h"
-#include "DocumentInfo.h"
-#include "core/Key.h"
-#include "core/Value.h"
+#include "DocumentTable.h"
 
 class Document;
 using DocumentPtr = std::shared_ptr<Document>;
-using DocumentMap = std::unordered_map<size_t, DocumentPtr>;
 
+// 一个文档的元数据，由 Database::findDocument 从 DocumentTable 中取出. 评论与评分写入与 DocumentTable 共享的 DocumentAnnotations.
+// 只保存建索引时记录的 modify_time，不访问源文件；源文件可能不在本机（replica）
 class Document {
 public:
+    // 直接由本机文件构造，只用于不经过 Database 的场合
     Document(size_t doc_id, std::filesystem::path origin_path_, size_t word_count_, std::unordered_map<Key, Value> kvs_)
-            : id(doc_id), origin_path(std::move(origin_path_)), kvs(std::move(kvs_)) {
+            : Document(doc_id, std::move(origin_path_), DateTime(), word_count_, std::make_shared<const KVMap>(std::move(kvs_)),
+                       std::make_shared<DocumentAnnotations>()) {
         if (!is_regular_file(origin_path))
             THROW(FileTypeUnmatchException());
-        info.modify_time = getModifiedLastDateTime(origin_path);
-        info.word_count = word_count_;
+        modify_time = getModifiedLastDateTime(origin_path);
     }
 
-    Document(size_t doc_id, std::filesystem::path origin_path_, const DateTime& modify_time_, size_t word_count_, std::unordered_map<Key, Value> kvs_)
-            : id(doc_id), origin_path(std::move(origin_path_)), kvs(std::move(kvs_)) {
-        if (!is_regular_file(origin_path))
-            THROW(FileTypeUnmatchException());
-        info.modify_time = modify_time_;
-        info.word_count = word_count_;
-    }
+    Document(size_t doc_id, std::filesystem::path origin_path_, const DateTime& modify_time_, size_t word_count_, KVRow kvs_,
+             DocumentAnnotationsPtr annotations_)
+            : id(doc_id), origin_path(std::move(origin_path_)), modify_time(modify_time_), word_count(word_count_),
+              kvs(std::move(kvs_)), annotations(std::move(annotations_)) {}
 
     size_t getId() const
     {
@@ -46,62 +43,56 @@ public:
 
     DateTime getModifyTime() const
     {
-        return info.modify_time;
+        return modify_time;
     }
 
     size_t getWordCount() const
     {
-        return info.word_count;
+        return word_count;
     }
 
     void addComment(const std::string& user_id, const DateTime& comment_time, const std::string& comment)
     {
-        std::lock_guard lg(info_lock);
-        info.comments.emplace(user_id, std::make_pair(comment_time, comment));
+        std::lock_guard lg(annotations->lock);
+        annotations->comments.emplace(user_id, std::make_pair(comment_time, comment));
     }
 
     auto getComments() const
     {
-        std::lock_guard lg(info_lock);
-        return info.comments;
+        std::lock_guard lg(annotations->lock);
+        return annotations->comments;
     }
 
     std::tuple<size_t, double> getRatingStat() const
     {
-        std::lock_guard<std::mutex> guard(info_lock);
-        double sum_rating = std::accumulate(info.ratings.begin(), info.ratings.end(), 0.0, [](double init, const std::pair<std::string, double>& id_with_rating) {
+        std::lock_guard<std::mutex> guard(annotations->lock);
+        const auto& ratings = annotations->ratings;
+        double sum_rating = std::accumulate(ratings.begin(), ratings.end(), 0.0, [](double init, const std::pair<std::string, double>& id_with_rating) {
             return init + id_with_rating.second;
         });
-        size_t size = info.ratings.size();
+        size_t size = ratings.size();
         return {size, sum_rating / (size == 0 ? 1 : size)};
     }
 
     void setRating(const std::string& user_id, double rating)
     {
-        std::lock_guard<std::mutex> guard(info_lock);
+        std::lock_guard<std::mutex> guard(annotations->lock);
         if (rating == 0)
-            info.ratings.erase(user_id);
+            annotations->ratings.erase(user_id);
         else
-            info.ratings[user_id] = rating;
-    }
-
-    std::unordered_map<Key, Value> getKvs() const
-    {
-        std::lock_guard<std::mutex> guard(kvs_lock);
-        return kvs;
+            annotations->ratings[user_id] = rating;
     }
 
-    void addKV(const Key& key, Value value)
+    // kvs 在建索引后不再修改
+    const std::unordered_map<Key, Value>& getKvs() const
     {
-        std::lock_guard<std::mutex> guard(kvs_lock);
-        kvs.emplace(key, value);
+        return *kvs;
     }
 
     Value findKV(const Key &key) const
     {
-        std::lock_guard<std::mutex> guard(kvs_lock);
-        auto iter = kvs.find(key);
-        if (iter == kvs.end())
+        auto iter = kvs->find(key);
+        if (iter == kvs->end())
             return {};
         return iter->second;
     }
@@ -158,45 +149,38 @@ public:
         return fix_utf8(res);
     }
 
-    void serialize(WriteBufferHelper &helper) const
+    // 只打开一次文件，依次读取多个区间 (offset, len)；越过文件尾的区间整体左移，尽量输出 len 个字节.
+    std::vector<std::string> getStrings(const std::vector<std::pair<size_t, size_t>>& ranges) const
     {
-        helper.writeNumber(id);
-        helper.writeString(origin_path.string());
+        auto file_len = file_size(origin_path);
+        int fd = ::open(origin_path.c_str(), O_RDONLY);
+        if (fd < 0)
+            THROW(Poco::FileNotFoundException());
+
+        std::vector<std::string> res;
+        std::string buf;
+        for (auto [offset, len] : ranges)
         {
-            std::lock_guard lg(kvs_lock);
-            helper.writeNumber(kvs.size());
-            for (const auto& pair : kvs)
+            if (offset + len > file_len)
+                offset = file_len > len ? file_len - len : 0;
+            buf.resize(len);
+            ssize_t read_number = ::pread(fd, buf.data(), len, static_cast<off_t>(offset));
+            if (read_number < 0)
             {
-                pair.first.serialize(helper);
-                pair.second.serialize(helper);
+                ::close(fd);
+                THROW(Poco::ReadFileException());
             }
+            res.push_back(fix_utf8(buf.substr(0, read_number)));
         }
-        info.serialize(helper);
-    }
-
-    static DocumentPtr deserialize(ReadBufferHelper &helper)
-    {
-        auto id = helper.readNumber<size_t>();
-        std::filesystem::path path(helper.readString());
-
-        auto size = helper.readNumber<size_t>();
-        std::unordered_map<Key, Value> kvs;
-        for (size_t i = 0; i < size; i++)
-        {
-            kvs.emplace(Key::deserialize(helper), Value::deserialize(helper));
-        }
-
-        auto info = DocumentInfo::deserialize(helper);
-        return std::make_shared<Document>(id, path, info.modify_time, info.word_count, kvs);
+        ::close(fd);
+        return res;
     }
 
 private:
     size_t id;
     std::filesystem::path origin_path;
-
-    mutable std::mutex kvs_lock;
-    std::unordered_map<Key, Value> kvs;
-
-    mutable std::mutex info_lock;
-    DocumentInfo info;
+    DateTime modify_time;
+    size_t word_count;
+    KVRow kvs;
+    DocumentAnnotationsPtr annotations;
 };
\ No newline at end of file
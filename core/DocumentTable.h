@@ -0,0 +1,232 @@
+#pragma once
+
+#include "../typedefs.h"
+#include "core/Key.h"
+#include "core/Value.h"
+#include "utils/TimeUtils.h"
+#include <deque>
+
+using KVMap = std::unordered_map<Key, Value>;
+using KVRow = std::shared_ptr<const KVMap>; // 建索引后只读，查询持有期间不需要加锁
+
+// 用户对文档的评论与评分. 大多数文档没有，第一次访问时创建
+struct DocumentAnnotations
+{
+    std::mutex lock;
+    // user_name -> comment/rating
+    std::unordered_multimap<std::string, std::pair<DateTime, std::string>> comments;
+    std::unordered_map<std::string, double> ratings;
+};
+using DocumentAnnotationsPtr = std::shared_ptr<DocumentAnnotations>;
+
+// 文档所在目录的字符串池，同一目录下的文档共用一份目录名
+class PathTable
+{
+public:
+    PathTable() = default;
+    PathTable(const PathTable&) = delete; // ids 指向 dirs 中的字符串
+    PathTable(PathTable&&) = default;
+    PathTable& operator=(PathTable&&) = default;
+
+    uint32_t intern(const std::string& dir)
+    {
+        auto iter = ids.find(dir);
+        if (iter != ids.end())
+            return iter->second;
+        auto id = static_cast<uint32_t>(dirs.size());
+        bytes += 64 + 2 * dir.size();
+        const auto& stored = dirs.emplace_back(dir); // deque 追加不会移动已有元素，string_view 保持有效
+        ids.emplace(stored, id);
+        return id;
+    }
+
+    const std::string& get(uint32_t id) const
+    {
+        return dirs[id];
+    }
+
+    size_t size() const
+    {
+        return dirs.size();
+    }
+
+    // 目录名与索引的估计内存
+    uint64_t getBytes() const
+    {
+        return bytes;
+    }
+
+    void clear()
+    {
+        ids.clear();
+        dirs.clear();
+        bytes = 0;
+    }
+
+private:
+    std::deque<std::string> dirs;
+    std::unordered_map<std::string_view, uint32_t> ids;
+    uint64_t bytes = 0;
+};
+
+// 按 doc_id 稠密存放的文档元数据（struct of arrays），下标就是 doc_id，查询中取词数、修改时间、kvs 都是一次数组访问.
+// 被删除的 doc_id 留空位，doc_id 不复用，空位只占几个字节. 自身不加锁，由 Database 保护.
+class DocumentTable
+{
+public:
+    void add(size_t doc_id, const std::filesystem::path& path, const DateTime& modify_time, size_t word_count, KVRow kvs)
+    {
+        if (doc_id >= alive.size())
+            resize(doc_id + 1);
+        if (alive[doc_id])
+            remove(doc_id);
+
+        alive[doc_id] = true;
+        word_counts[doc_id] = static_cast<uint32_t>(word_count);
+        modify_times[doc_id] = modify_time.internal().timestamp().epochTime();
+        dir_ids[doc_id] = paths.intern(path.parent_path().string());
+        file_names[doc_id] = path.filename().string();
+        kv_rows[doc_id] = kvs && !kvs->empty() ? std::move(kvs) : nullptr;
+        row_bytes += estimateRowBytes(doc_id);
+        ++count;
+        total_word_count += word_count;
+    }
+
+    // 返回 doc_id 之前是否存在
+    bool remove(size_t doc_id)
+    {
+        if (!contains(doc_id))
+            return false;
+        row_bytes -= estimateRowBytes(doc_id);
+        alive[doc_id] = false;
+        total_word_count -= word_counts[doc_id];
+        word_counts[doc_id] = 0;
+        std::string().swap(file_names[doc_id]);
+        kv_rows[doc_id].reset();
+        annotations.erase(doc_id);
+        --count;
+        return true;
+    }
+
+    bool contains(size_t doc_id) const
+    {
+        return doc_id < alive.size() && alive[doc_id];
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    uint64_t getTotalWordCount() const
+    {
+        return total_word_count;
+    }
+
+    // 以下按 doc_id 读取的函数要求 contains(doc_id)
+    size_t getWordCount(size_t doc_id) const
+    {
+        return word_counts[doc_id];
+    }
+
+    DateTime getModifyTime(size_t doc_id) const
+    {
+        return DateTime(modify_times[doc_id]);
+    }
+
+    std::filesystem::path getPath(size_t doc_id) const
+    {
+        return std::filesystem::path(paths.get(dir_ids[doc_id])) / file_names[doc_id];
+    }
+
+    // 没有 kv 的文档返回共享的空表
+    KVRow getKvs(size_t doc_id) const
+    {
+        static const KVRow empty_kvs = std::make_shared<const KVMap>();
+        return kv_rows[doc_id] ? kv_rows[doc_id] : empty_kvs;
+    }
+
+    DocumentAnnotationsPtr getAnnotations(size_t doc_id) const
+    {
+        auto& ptr = annotations[doc_id];
+        if (!ptr)
+            ptr = std::make_shared<DocumentAnnotations>();
+        return ptr;
+    }
+
+    // 按 doc_id 升序遍历存在的文档
+    template <typename Func>
+    void forEach(Func&& func) const
+    {
+        for (size_t doc_id = 0; doc_id < alive.size(); doc_id++)
+            if (alive[doc_id])
+                func(doc_id);
+    }
+
+    void clear()
+    {
+        DocumentTable().swap(*this);
+    }
+
+    void swap(DocumentTable& other)
+    {
+        std::swap(alive, other.alive);
+        std::swap(word_counts, other.word_counts);
+        std::swap(modify_times, other.modify_times);
+        std::swap(dir_ids, other.dir_ids);
+        std::swap(file_names, other.file_names);
+        std::swap(kv_rows, other.kv_rows);
+        std::swap(paths, other.paths);
+        std::swap(annotations, other.annotations);
+        std::swap(count, other.count);
+        std::swap(total_word_count, other.total_word_count);
+        std::swap(row_bytes, other.row_bytes);
+    }
+
+    // 粗略估计常驻内存的字节数：各列的容量、文件名与目录名、kvs. 后两者随增删维护，不遍历文档
+    uint64_t estimateMemoryBytes() const
+    {
+        return alive.capacity() / 8 + word_counts.capacity() * sizeof(uint32_t) + modify_times.capacity() * sizeof(int64_t)
+             + dir_ids.capacity() * sizeof(uint32_t) + file_names.capacity() * sizeof(std::string) + kv_rows.capacity() * sizeof(KVRow)
+             + paths.getBytes() + row_bytes;
+    }
+
+private:
+    // 一个文档在各列之外占用的堆内存
+    uint64_t estimateRowBytes(size_t doc_id) const
+    {
+        uint64_t bytes = file_names[doc_id].capacity() > 15 ? file_names[doc_id].capacity() : 0; // 超出 SSO 时才在堆上
+        if (kv_rows[doc_id])
+            bytes += 64 + kv_rows[doc_id]->size() * 96;
+        return bytes;
+    }
+
+    void resize(size_t size)
+    {
+        size = std::max(size, alive.size() * 3 / 2); // 顺序分配 doc_id 时均摊扩容
+        alive.resize(size);
+        word_counts.resize(size);
+        modify_times.resize(size);
+        dir_ids.resize(size);
+        file_names.resize(size);
+        kv_rows.resize(size);
+    }
+
+    std::vector<bool> alive;
+    std::vector<uint32_t> word_counts;
+    std::vector<int64_t> modify_times; // 秒，与 getModifiedLastDateTime 的精度相同
+    std::vector<uint32_t> dir_ids; // -> paths
+    std::vector<std::string> file_names;
+    std::vector<KVRow> kv_rows; // 没有 kv 时为空
+    PathTable paths;
+    mutable std::unordered_map<size_t, DocumentAnnotationsPtr> annotations; // 按需创建
+
+    size_t count = 0;
+    uint64_t total_word_count = 0;
+    uint64_t row_bytes = 0; // estimateRowBytes 之和
+};
@@ -35,9 +35,6 @@ std::string valueTypeToString(ValueType type)
     THROW(UnreachableException());
 }
 
-template<typename T>
-using ValueArrayHandler = std::function<void(std::vector<T>* /* data */)>;
-
 template<typename T>
 auto EmptyValueArrayHandler = [](std::vector<T>*) -> void {};
 
@@ -45,7 +42,7 @@ template<typename T>
 auto PanicValueArrayHandler = [](std::vector<T>*) -> void { THROW(UnreachableException(std::string("in PanicValueArrayHandler(), T is ") + typeid(T).name())); };
 
 template<typename T>
-bool checkType(ValueType type)
+constexpr bool checkType(ValueType type)
 {
     if (std::is_same_v<T, Bool> && type == ValueType::Bool)
         return true;
@@ -58,54 +55,79 @@ bool checkType(ValueType type)
     return false;
 }
 
-class DynamicArray
+// Number 数组的 sum/min/max/count，空数组的 min/max 无意义
+struct NumberStats
 {
-public:
-    DynamicArray(ValueType type_) : type(type_) {
-        safe_new();
-    }
+    Number sum = 0;
+    Number min = 0;
+    Number max = 0;
+    size_t count = 0;
+};
 
-    ValueType getType() const
-    {
-        return type;
-    }
+// 一次遍历同时求 sum/min/max. 每种统计用 NUMBER_STATS_LANES 个独立的累加器，打断循环间的依赖，
+// 编译器可以把内层循环展开成 SIMD 指令（不需要 -ffast-math）. 求和顺序与逐个累加不同，结果可能差最后几位
+constexpr size_t NUMBER_STATS_LANES = 4;
 
-    void* getData() {
-        return data;
-    }
+NumberStats computeNumberStats(const std::vector<Number>& values)
+{
+    NumberStats stats;
+    stats.count = values.size();
+    if (values.empty())
+        return stats;
+
+    const Number* data = values.data();
+    const size_t n = values.size();
+    Number sum[NUMBER_STATS_LANES] = {};
+    Number lo[NUMBER_STATS_LANES], hi[NUMBER_STATS_LANES];
+    std::fill(std::begin(lo), std::end(lo), data[0]);
+    std::fill(std::begin(hi), std::end(hi), data[0]);
 
-    DynamicArray(const DynamicArray& rhs)
+    size_t i = 0;
+    for (; i + NUMBER_STATS_LANES <= n; i += NUMBER_STATS_LANES)
+    {
+        for (size_t j = 0; j < NUMBER_STATS_LANES; j++)
+        {
+            Number x = data[i + j];
+            sum[j] += x;
+            lo[j] = x < lo[j] ? x : lo[j];
+            hi[j] = hi[j] < x ? x : hi[j];
+        }
+    }
+    for (; i < n; i++)
     {
-        type = rhs.type;
-        safe_copy(rhs.data);
+        sum[0] += data[i];
+        lo[0] = data[i] < lo[0] ? data[i] : lo[0];
+        hi[0] = hi[0] < data[i] ? data[i] : hi[0];
     }
 
-    DynamicArray(DynamicArray&& rhs) noexcept
+    stats.sum = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+    stats.min = *std::min_element(std::begin(lo), std::end(lo));
+    stats.max = *std::max_element(std::begin(hi), std::end(hi));
+    return stats;
+}
+
+// 元素类型相同的数组. 按元素类型分派时使用 visit 或 applyHandler，handler 在编译期确定，不经过 std::function.
+// Number 数组在构造（建索引、反序列化）时算好 NumberStats，HAVING 中的 sum/avg/min/max 不再遍历数组
+class DynamicArray
+{
+public:
+    DynamicArray(ValueType type_) : arrays(makeArrays(type_)) {}
+
+    template<typename T>
+    explicit DynamicArray(std::vector<T> values) : arrays(std::move(values))
     {
-        type = rhs.type;
-        data = rhs.data;
-        rhs.data = nullptr;
+        refreshStats();
     }
 
-    DynamicArray& operator=(const DynamicArray& rhs)
+    ValueType getType() const
     {
-        if (this == &rhs)
-            return *this;
-        safe_delete();
-        type = rhs.type;
-        safe_copy(rhs.data);
-        return *this;
+        // 与 ValueType 中 Bool, Number, String, DateTime 的顺序相同
+        return static_cast<ValueType>(arrays.index() + 1);
     }
 
-    DynamicArray& operator=(DynamicArray&& rhs) noexcept
+    size_t size() const
     {
-        if (this == &rhs)
-            return *this;
-        safe_delete();
-        type = rhs.type;
-        data = rhs.data;
-        rhs.data = nullptr;
-        return *this;
+        return std::visit([](const auto& vec) { return vec.size(); }, arrays);
     }
 
     bool operator<=>(const DynamicArray& rhs) const
@@ -113,132 +135,98 @@ public:
         THROW(UnreachableException()); // 作为 Value 的数组不该被比较大小
     }
 
-    // select and apply correct handler
-    void applyHandler(const ValueArrayHandler<Bool>& bool_handler,
-                      const ValueArrayHandler<Number>& number_handler,
-                      const ValueArrayHandler<String>& string_handler,
-                      const ValueArrayHandler<DateTime>& datetime_handler) const
+    // 以 const std::vector<T>& 调用 visitor
+    template<typename Visitor>
+    decltype(auto) visit(Visitor&& visitor) const
     {
-        switch (type)
+        return std::visit(std::forward<Visitor>(visitor), arrays);
+    }
+
+    // select and apply correct handler，handler 以 std::vector<T>* 为参数
+    template<typename BoolHandler, typename NumberHandler, typename StringHandler, typename DateTimeHandler>
+    void applyHandler(BoolHandler&& bool_handler,
+                      NumberHandler&& number_handler,
+                      StringHandler&& string_handler,
+                      DateTimeHandler&& datetime_handler)
+    {
+        switch (getType())
         {
-            case ValueType::Null:
-                THROW(Poco::NotImplementedException());
-                break;
             case ValueType::Bool:
-                bool_handler((std::vector<Bool>*)data);
+                bool_handler(&std::get<std::vector<Bool>>(arrays));
                 break;
             case ValueType::Number:
-                number_handler((std::vector<Number>*)data);
+                number_handler(&std::get<std::vector<Number>>(arrays));
+                refreshStats(); // handler 可能修改了数组
                 break;
             case ValueType::String:
-                string_handler((std::vector<String>*)data);
+                string_handler(&std::get<std::vector<String>>(arrays));
                 break;
             case ValueType::DateTime:
-                datetime_handler((std::vector<DateTime>*)data);
+                datetime_handler(&std::get<std::vector<DateTime>>(arrays));
                 break;
+            default:
+                THROW(UnreachableException());
         }
     }
 
     template<typename T>
-    std::vector<T>* getRealArrayRef() const
+    const std::vector<T>& getRealArrayRef() const
     {
-        if (!checkType<T>(type))
+        if (!checkType<T>(getType()))
             THROW(Poco::LogicException("DynamicArray::getRealArrayRef type error"));
-        return (std::vector<T>*)data;
+        return std::get<std::vector<T>>(arrays);
     }
 
-    template<typename T>
-    T get(size_t i) const
+    // 只有 Number 数组可以调用
+    const NumberStats& getNumberStats() const
     {
-        std::vector<T>* array_ref = getRealArrayRef<T>();
-        if (array_ref->size() <= i)
-            THROW(Poco::RangeException("get i >= array size " + std::to_string(i) + " vs " + std::to_string(array_ref->size())));
-        return array_ref->operator[](i);
+        if (getType() != ValueType::Number)
+            THROW(Poco::LogicException("DynamicArray::getNumberStats type error"));
+        return number_stats;
     }
 
     template<typename T>
-    std::vector<T> getRealArray() const
+    T get(size_t i) const
     {
-        return *getRealArrayRef<T>();
+        const auto& array_ref = getRealArrayRef<T>();
+        if (array_ref.size() <= i)
+            THROW(Poco::RangeException("get i >= array size " + std::to_string(i) + " vs " + std::to_string(array_ref.size())));
+        return array_ref[i];
     }
 
-    ~DynamicArray()
+    template<typename T>
+    std::vector<T> getRealArray() const
     {
-        safe_delete();
+        return getRealArrayRef<T>();
     }
 
     void serialize(WriteBufferHelper& helper) const
     {
-        helper.writeNumber<ValueType>(type);
-        switch (type)
-        {
-            case ValueType::Null:
-                THROW(Poco::NotImplementedException());
-                break;
-            case ValueType::Bool:
-                helper.writeLinearContainer(*(std::vector<Bool>*)data);
-                break;
-            case ValueType::Number:
-                helper.writeLinearContainer(*(std::vector<Number>*)data);
-                break;
-            case ValueType::String:
-                helper.writeLinearContainer(*(std::vector<String>*)data);
-                break;
-            case ValueType::DateTime:
-                helper.writeLinearContainer(*(std::vector<DateTime>*)data);
-                break;
-        }
+        helper.writeNumber<ValueType>(getType());
+        visit([&helper](const auto& vec) { helper.writeLinearContainer(vec); });
     }
 
     static DynamicArray deserialize(ReadBufferHelper& helper)
     {
         ValueType type = helper.readNumber<ValueType>();
-        DynamicArray ret(type);
-        void* data = ret.data;
         switch (type)
         {
-            case ValueType::Null:
-                THROW(Poco::NotImplementedException());
-                break;
             case ValueType::Bool:
-                *(std::vector<Bool>*)data = helper.readLinearContainer<std::vector, Bool>();
-                break;
+                return DynamicArray(helper.readLinearContainer<std::vector, Bool>());
             case ValueType::Number:
-                *(std::vector<Number>*)data = helper.readLinearContainer<std::vector, Number>();
-                break;
+                return DynamicArray(helper.readLinearContainer<std::vector, Number>());
             case ValueType::String:
-                *(std::vector<String>*)data = helper.readLinearContainer<std::vector, String>();
-                break;
+                return DynamicArray(helper.readLinearContainer<std::vector, String>());
             case ValueType::DateTime:
-                *(std::vector<DateTime>*)data = helper.readLinearContainer<std::vector, DateTime>();
-                break;
+                return DynamicArray(helper.readLinearContainer<std::vector, DateTime>());
+            default:
+                THROW(Poco::NotImplementedException());
         }
-        return ret;
     }
 
     bool operator==(const DynamicArray& rhs) const
     {
-        if (type != rhs.type)
-            return false;
-        switch (type)
-        {
-            case ValueType::Null:
-                THROW(Poco::NotImplementedException());
-                break;
-            case ValueType::Bool:
-                return *(std::vector<Bool>*)data == *(std::vector<Bool>*)rhs.data;
-                break;
-            case ValueType::Number:
-                return *(std::vector<Number>*)data == *(std::vector<Number>*)rhs.data;
-                break;
-            case ValueType::String:
-                return *(std::vector<String>*)data == *(std::vector<String>*)rhs.data;
-                break;
-            case ValueType::DateTime:
-                return *(std::vector<DateTime>*)data == *(std::vector<DateTime>*)rhs.data;
-                break;
-        }
-        return false;
+        return arrays == rhs.arrays;
     }
 
     bool operator!=(const DynamicArray& rhs) const
@@ -247,73 +235,31 @@ public:
     }
 
 private:
-    void safe_copy(void *rhs_data)
-    {
-        safe_new();
-        switch (type)
-        {
-            case ValueType::Null:
-                THROW(Poco::NotImplementedException());
-                break;
-            case ValueType::Bool:
-                *(std::vector<Bool>*)data = *(std::vector<Bool>*)rhs_data;
-                break;
-            case ValueType::Number:
-                *(std::vector<Number>*)data = *(std::vector<Number>*)rhs_data;
-                break;
-            case ValueType::String:
-                *(std::vector<String>*)data = *(std::vector<String>*)rhs_data;
-                break;
-            case ValueType::DateTime:
-                *(std::vector<DateTime>*)data = *(std::vector<DateTime>*)rhs_data;
-                break;
-        }
-    }
+    using Arrays = std::variant<std::vector<Bool>, std::vector<Number>, std::vector<String>, std::vector<DateTime>>;
 
-    void safe_new()
+    static Arrays makeArrays(ValueType type)
     {
         switch (type)
         {
-            case ValueType::Null:
-                THROW(Poco::NotImplementedException());
-                break;
             case ValueType::Bool:
-                data = new std::vector<Bool>;
-                break;
+                return std::vector<Bool>();
             case ValueType::Number:
-                data = new std::vector<Number>;
-                break;
+                return std::vector<Number>();
             case ValueType::String:
-                data = new std::vector<String>;
-                break;
+                return std::vector<String>();
             case ValueType::DateTime:
-                data = new std::vector<DateTime>;
-                break;
+                return std::vector<DateTime>();
+            default:
+                THROW(Poco::NotImplementedException());
         }
     }
 
-    void safe_delete()
+    void refreshStats()
     {
-        switch (type)
-        {
-            case ValueType::Null:
-                THROW(Poco::NotImplementedException());
-                break;
-            case ValueType::Bool:
-                delete (std::vector<Bool>*)data;
-                break;
-            case ValueType::Number:
-                delete (std::vector<Number>*)data;
-                break;
-            case ValueType::String:
-                delete (std::vector<String>*)data;
-                break;
-            case ValueType::DateTime:
-                delete (std::vector<DateTime>*)data;
-                break;
-        }
+        if (const auto* numbers = std::get_if<std::vector<Number>>(&arrays))
+            number_stats = computeNumberStats(*numbers);
     }
 
-    ValueType type;
-    void* data = nullptr;
+    Arrays arrays;
+    NumberStats number_stats; // 只对 Number 数组有效，由 arrays 决定，不参与比较和序列化
 };
\ No newline at end of file
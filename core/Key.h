@@ -2,61 +2,186 @@
 
 #include "../typedefs.h"
 #include "utils/SerializeUtils.h"
+#include <deque>
+#include <shared_mutex>
 
 
-// 使用 Key 来表示 a.b.c 这种 json 中的子对象名
-class Key
+// 进程内所有建过索引的 json 子对象名的字典. 每个名字只保存一次，按 token 组成一棵树，Key 只是指向其中一个条目的指针，
+// 比较与哈希都是整数运算. 条目在进程结束前不会删除，数量不超过 KEY_DICTIONARY_MAX_ENTRIES.
+// 只有建索引时出现的字段名（以及从持久化的索引中读出的）才会加入字典；查询中的字段名只查找，不存在时不加入.
+class KeyDictionary
 {
 public:
-    Key(const char* str) : Key(std::string(str)) { }
+    struct Entry
+    {
+        uint32_t id;
+        const Entry* parent; // 根的 parent 为 nullptr
+        std::string path; // a.b.c，最后一个 token 是 path 在 parent->path 之后的部分
+        mutable std::unordered_map<std::string, const Entry*> children; // 由 KeyDictionary::lock 保护
+
+        std::string_view token() const
+        {
+            std::string_view view(path);
+            return parent->path.empty() ? view : view.substr(parent->path.size() + 1);
+        }
+    };
 
-    Key(const std::string& str)
+    static KeyDictionary& instance()
     {
-        Poco::StringTokenizer tk(str, ".", Poco::StringTokenizer::Options::TOK_TRIM);
-        for (const auto& token : tk)
+        static KeyDictionary dictionary;
+        return dictionary;
+    }
+
+    // 空名字
+    const Entry* root() const
+    {
+        return &entries.front();
+    }
+
+    // 不存在时加入，字典已满时抛出 Poco::LimitExceededException
+    const Entry* child(const Entry* parent, const std::string& token)
+    {
+        if (auto entry = findChild(parent, token))
+            return entry;
+        std::unique_lock ul(lock);
+        auto& entry = parent->children[token];
+        if (!entry)
         {
+            if (entries.size() >= max_entries)
+            {
+                parent->children.erase(token);
+                THROW(Poco::LimitExceededException("too many distinct json keys"));
+            }
+            auto path = parent->path.empty() ? token : parent->path + '.' + token;
+            entry = &entries.emplace_back(Entry{static_cast<uint32_t>(entries.size()), parent, std::move(path), {}});
+            by_path.emplace(entry->path, entry);
+        }
+        return entry;
+    }
+
+    // 按 . 切分并去掉首尾空白，出现空的 token 时抛出异常. 规范形式（a.b.c）的字符串不需要切分
+    const Entry* find(const std::string& path)
+    {
+        if (auto entry = findPath(path))
+            return entry;
+        const Entry* entry = root();
+        for (const auto& token : tokenize(path))
+            entry = child(entry, token);
+        return entry;
+    }
+
+    // 与 find 相同，但不加入字典，不存在时返回 nullptr
+    const Entry* lookup(const std::string& path) const
+    {
+        if (auto entry = findPath(path))
+            return entry;
+        const Entry* entry = root();
+        for (const auto& token : tokenize(path))
+            if (!(entry = findChild(entry, token)))
+                return nullptr;
+        return entry;
+    }
+
+    size_t size() const
+    {
+        std::shared_lock sl(lock);
+        return entries.size();
+    }
+
+private:
+    KeyDictionary()
+    {
+        entries.emplace_back(Entry{0, nullptr, "", {}});
+        by_path.emplace("", &entries.front());
+    }
+
+    static std::vector<std::string> tokenize(const std::string& path)
+    {
+        Poco::StringTokenizer tk(path, ".", Poco::StringTokenizer::Options::TOK_TRIM);
+        for (const auto& token : tk)
             if (token.empty())
                 THROW(Poco::LogicException("Key format error"));
-            tokens.push_back(token);
-        }
+        return {tk.begin(), tk.end()};
+    }
+
+    const Entry* findPath(const std::string& path) const
+    {
+        std::shared_lock sl(lock);
+        auto iter = by_path.find(path);
+        return iter == by_path.end() ? nullptr : iter->second;
+    }
+
+    const Entry* findChild(const Entry* parent, const std::string& token) const
+    {
+        std::shared_lock sl(lock);
+        auto iter = parent->children.find(token);
+        return iter == parent->children.end() ? nullptr : iter->second;
+    }
+
+    const size_t max_entries = KEY_DICTIONARY_MAX_ENTRIES;
+    mutable std::shared_mutex lock;
+    std::deque<Entry> entries; // deque 追加时不移动已有条目，Key 中的指针保持有效
+    std::unordered_map<std::string_view, const Entry*> by_path; // 条目的规范 path，指向 entries 中的字符串
+};
+
+// 使用 Key 来表示 a.b.c 这种 json 中的子对象名
+class Key
+{
+public:
+    Key(const char* str) : Key(std::string(str)) { }
+
+    // 不存在时加入 KeyDictionary，只用于建索引时出现的字段名. 查询中的字段名使用 Key::lookup
+    Key(const std::string& str) : entry(KeyDictionary::instance().find(str)) {}
+
+    // 只查找建过索引的字段名，不存在时返回空
+    static std::optional<Key> lookup(const std::string& str)
+    {
+        if (auto entry = KeyDictionary::instance().lookup(str))
+            return Key(entry);
+        return std::nullopt;
     }
 
     void push_back(const std::string& token)
     {
-        tokens.push_back(token);
+        entry = KeyDictionary::instance().child(entry, token);
     }
 
     void pop_back()
     {
-        if (tokens.empty())
+        if (!entry->parent)
             THROW(Poco::RangeException());
-        tokens.pop_back();
+        entry = entry->parent;
     }
 
-    auto begin() const
+    // 从第一层开始的各个 token
+    std::vector<std::string> tokens() const
     {
-        return tokens.begin();
+        std::vector<std::string> res;
+        for (auto node = entry; node->parent; node = node->parent)
+            res.emplace_back(node->token());
+        std::reverse(res.begin(), res.end());
+        return res;
     }
 
-    auto end() const
+    bool empty() const
     {
-        return tokens.end();
+        return !entry->parent;
     }
 
-    std::string string() const
+    // 在 KeyDictionary 中的编号，只在本进程内有效，持久化时使用 string()
+    uint32_t getId() const
     {
-        if (tokens.empty())
-            return "";
-        std::string ret;
-        for (int i = 0; i < tokens.size() - 1; i++)
-            ret += tokens[i] + '.';
-            ret += tokens.back();
-        return ret;
+        return entry->id;
+    }
+
+    const std::string& string() const
+    {
+        return entry->path;
     }
 
     bool operator==(const Key& rhs) const
     {
-        return tokens == rhs.tokens;
+        return entry == rhs.entry;
     }
 
     void serialize(WriteBufferHelper& helper) const
@@ -70,7 +195,9 @@ public:
     }
 
 private:
-    std::vector<std::string> tokens;
+    explicit Key(const KeyDictionary::Entry* entry_) : entry(entry_) {}
+
+    const KeyDictionary::Entry* entry;
 };
 
 namespace std
@@ -80,7 +207,7 @@ namespace std
     {
         std::size_t operator()(const Key& key) const
         {
-            return Poco::hashRange(key.begin(), key.end());
+            return key.getId();
         }
     };
-}
\ No newline at end of file
+}
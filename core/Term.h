@@ -9,6 +9,7 @@
 struct TermStatisticsWithInDoc
 {
     std::set<size_t> offsets_in_file;
+    std::vector<uint32_t> positions; // 词在文档分词结果中的序号，升序，用于短语/邻近查询
 };
 
 using PostingList = std::vector<size_t>;
@@ -26,13 +27,17 @@ struct Term {
 
     Term(std::string word_) : word(std::move(word_)) {}
 
+    // 格式变化时需要递增 META_FORMAT_VERSION
     void serialize(WriteBufferHelper &helper) const
     {
         helper.writeString(word);
         helper.writeLinearContainer(posting_list);
         helper.writeNumber(statistics_list.size());
         for (const auto& stat : statistics_list)
+        {
             helper.writeSetContainer(stat.offsets_in_file);
+            helper.writeLinearContainer(stat.positions);
+        }
     }
 
     static TermPtr deserialize(ReadBufferHelper &helper)
@@ -42,7 +47,11 @@ struct Term {
         term->posting_list = helper.readLinearContainer<std::vector, size_t>();
         auto size = helper.readNumber<size_t>();
         for (size_t i = 0; i < size; i++)
-            term->statistics_list.push_back(TermStatisticsWithInDoc{.offsets_in_file = helper.readSetContainer<std::set, size_t>()});
+        {
+            auto offsets_in_file = helper.readSetContainer<std::set, size_t>();
+            auto positions = helper.readLinearContainer<std::vector, uint32_t>();
+            term->statistics_list.push_back(TermStatisticsWithInDoc{.offsets_in_file = std::move(offsets_in_file), .positions = std::move(positions)});
+        }
         return term;
     }
 };
@@ -107,6 +107,14 @@ public:
         root = new TrieNode(nullptr, nextNodeId(), false);
     }
 
+    // 用于整体替换索引，两棵树的节点交换所有权
+    void swap(Trie &other)
+    {
+        std::scoped_lock sl(roots_lock, other.roots_lock);
+        std::swap(root, other.root);
+        node_id = other.node_id.exchange(node_id);
+    }
+
     std::string print() const
     {
         std::shared_lock lg(roots_lock);
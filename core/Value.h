@@ -12,127 +12,148 @@ using Values = std::vector<Value>;
 
 struct ArrayLabel {};
 
+// 标量直接保存在 variant 中（字符串使用 std::string 自带的短字符串优化），数组保存为按元素类型区分的 DynamicArray.
+// 类型由 variant 的下标得到，不再单独保存
 class Value
 {
 public:
-    Value() : type(ValueType::Null)
-    {
-
-    }
+    Value() = default;
 
     // 以此法构造的 Value 是一个数组，元素应该稍后被填充，元素的类型用 ValueType 表示（注意，非数组的 Value 元素类型也是用 ValueType 表示，需要用 isArray() 加以区分）
-    Value(ArrayLabel, ValueType type_) : is_array(true), type(type_), var(DynamicArray(type))
-    {
-        // 在未正确实现拷贝构造函数时，DynamicArray 必须原地构造
-//        var.emplace<DynamicArray>(type);
-    }
+    Value(ArrayLabel, ValueType type_) : var(DynamicArray(type_)) {}
 
-    Value(ArrayLabel, ValueType type_, DynamicArray da) : is_array(true), type(type_), var(std::move(da))
+    Value(ArrayLabel, ValueType type_, DynamicArray da) : var(std::move(da))
     {
-        // 在未正确实现拷贝构造函数时，DynamicArray 必须原地构造
-//        var.emplace<DynamicArray>(type);
+        assert(std::get<DynamicArray>(var).getType() == type_);
     }
 
-    Value(bool b) : type(ValueType::Bool), var(b)
-    {
+    // 直接以元素构造数组
+    template<typename T>
+    Value(ArrayLabel, std::vector<T> values) : var(DynamicArray(std::move(values))) {}
 
-    }
+    Value(bool b) : var(b) {}
 
     // NOTE: 如果不为字符串常量特化，那么构造函数传入字符串常量会匹配到 bool 形参
     Value(const char* str) : Value(std::string(str)) {}
 
-    Value(const std::string& string) : type(ValueType::String), var(string)
-    {
+    Value(const std::string& string) : var(string) {}
 
-    }
+    Value(int i) : var(double(i)) {}
 
-    Value(int i) : type(ValueType::Number), var(double(i))
-    {
+    Value(double decimal) : var(decimal) {}
 
-    }
-
-    Value(double decimal) : type(ValueType::Number), var(decimal)
-    {
-
-    }
-
-    Value(DateTime date_time) : type(ValueType::DateTime), var(date_time)
-    {
-
-    }
+    Value(DateTime date_time) : var(date_time) {}
 
     ValueType getValueType() const
     {
-        return type;
+        if (isArray())
+            return std::get<DynamicArray>(var).getType();
+        // monostate, bool, double, string, DateTime 与 ValueType 的顺序相同
+        return static_cast<ValueType>(var.index());
     }
 
     bool isNull() const
     {
-        return type == ValueType::Null;
+        return getValueType() == ValueType::Null;
     }
 
     bool isBool() const
     {
-        return type == ValueType::Bool;
+        return getValueType() == ValueType::Bool;
     }
 
     bool isNumber() const
     {
-        return type == ValueType::Number;
+        return getValueType() == ValueType::Number;
     }
 
     bool isString() const
     {
-        return type == ValueType::String;
+        return getValueType() == ValueType::String;
     }
 
     bool isDateTime() const
     {
-        return type == ValueType::DateTime;
+        return getValueType() == ValueType::DateTime;
     }
 
     bool isArray() const
     {
-        return is_array;
+        return std::holds_alternative<DynamicArray>(var);
     }
 
     template<typename T>
     T as(size_t i = 0) const
     {
-        if (!checkType<T>(type))
+        if (!checkType<T>(getValueType()))
             THROW(Poco::LogicException("Value type error"));
-        if (i == 0 && !is_array)
+        if (i == 0 && !isArray())
             return std::get<T>(var);
-        if (is_array)
+        if (isArray())
         {
             return get<DynamicArray>(var).get<T>(i);
         }
         THROW(UnreachableException());
     }
 
-    void doArrayHandler(const ValueArrayHandler<Bool>& bool_handler,
-                        const ValueArrayHandler<Number>& number_handler,
-                        const ValueArrayHandler<String>& string_handler,
-                        const ValueArrayHandler<DateTime>& datetime_handler) const
+    // 标量的引用，不拷贝字符串
+    template<typename T>
+    const T& ref() const
     {
-        if (!is_array)
-            THROW(QueryException("only array value can call doArrayHandler()"));
-        get<DynamicArray>(var).applyHandler(bool_handler, number_handler, string_handler, datetime_handler);
+        if (isArray() || !checkType<T>(getValueType()))
+            THROW(Poco::LogicException("Value type error"));
+        return std::get<T>(var);
     }
 
+    // 数组元素的引用，元素类型不符时抛出异常
     template<typename T>
-    void doArrayHandler(const ValueArrayHandler<T>& array_handler) const
+    const std::vector<T>& asArray() const
     {
-        if (!is_array)
+        if (!isArray())
+            THROW(QueryException("only array value can call asArray()"));
+        return get<DynamicArray>(var).getRealArrayRef<T>();
+    }
+
+    // Number 数组预先算好的统计值
+    const NumberStats& numberStats() const
+    {
+        if (!isArray())
+            THROW(QueryException("only array value can call numberStats()"));
+        return get<DynamicArray>(var).getNumberStats();
+    }
+
+    // 以 const std::vector<T>& 调用 visitor，T 为数组的元素类型
+    template<typename Visitor>
+    decltype(auto) visitArray(Visitor&& visitor) const
+    {
+        if (!isArray())
+            THROW(QueryException("only array value can call visitArray()"));
+        return get<DynamicArray>(var).visit(std::forward<Visitor>(visitor));
+    }
+
+    // 以 std::vector<T>* 调用与元素类型对应的 handler，用于填充数组
+    template<typename BoolHandler, typename NumberHandler, typename StringHandler, typename DateTimeHandler>
+    void doArrayHandler(BoolHandler&& bool_handler,
+                        NumberHandler&& number_handler,
+                        StringHandler&& string_handler,
+                        DateTimeHandler&& datetime_handler)
+    {
+        if (!isArray())
             THROW(QueryException("only array value can call doArrayHandler()"));
+        get<DynamicArray>(var).applyHandler(bool_handler, number_handler, string_handler, datetime_handler);
+    }
+
+    template<typename T, typename Handler>
+    void doArrayHandler(Handler&& array_handler)
+    {
         if constexpr (std::is_same_v<T, Bool>)
-            get<DynamicArray>(var).applyHandler(array_handler, PanicValueArrayHandler<Number>, PanicValueArrayHandler<String>, PanicValueArrayHandler<DateTime>);
+            doArrayHandler(array_handler, PanicValueArrayHandler<Number>, PanicValueArrayHandler<String>, PanicValueArrayHandler<DateTime>);
         else if constexpr (std::is_same_v<T, Number>)
-            get<DynamicArray>(var).applyHandler(PanicValueArrayHandler<Bool>, array_handler, PanicValueArrayHandler<String>, PanicValueArrayHandler<DateTime>);
+            doArrayHandler(PanicValueArrayHandler<Bool>, array_handler, PanicValueArrayHandler<String>, PanicValueArrayHandler<DateTime>);
         else if constexpr (std::is_same_v<T, String>)
-            get<DynamicArray>(var).applyHandler(PanicValueArrayHandler<Bool>, PanicValueArrayHandler<Number>, array_handler, PanicValueArrayHandler<DateTime>);
+            doArrayHandler(PanicValueArrayHandler<Bool>, PanicValueArrayHandler<Number>, array_handler, PanicValueArrayHandler<DateTime>);
         else if constexpr (std::is_same_v<T, DateTime>)
-            get<DynamicArray>(var).applyHandler(PanicValueArrayHandler<Bool>, PanicValueArrayHandler<Number>, PanicValueArrayHandler<String>, array_handler);
+            doArrayHandler(PanicValueArrayHandler<Bool>, PanicValueArrayHandler<Number>, PanicValueArrayHandler<String>, array_handler);
         else
             THROW(UnreachableException());
     }
@@ -140,11 +161,11 @@ public:
 
     void serialize(WriteBufferHelper& helper) const
     {
-        helper.writeNumber<bool>(is_array);
-        helper.writeNumber<ValueType>(type);
-        if (!is_array)
+        helper.writeNumber<bool>(isArray());
+        helper.writeNumber<ValueType>(getValueType());
+        if (!isArray())
         {
-            switch (type)
+            switch (getValueType())
             {
                 case ValueType::Null:
                     THROW(Poco::NotImplementedException());
@@ -180,17 +201,14 @@ public:
                     THROW(Poco::NotImplementedException());
                 case ValueType::Bool:
                     return Value(helper.readNumber<Bool>());
-                    break;
                 case ValueType::Number:
                     return Value(helper.readNumber<Number>());
-                    break;
                 case ValueType::String:
                     return Value(helper.readString());
-                    break;
                 case ValueType::DateTime:
                     return Value(helper.readDateTime());
-                    break;
             }
+            THROW(Poco::DataFormatException("unknown value type " + std::to_string(static_cast<int>(type))));
         }
         else
         {
@@ -200,55 +218,55 @@ public:
 
     bool operator<(const Value& rhs) const
     {
-        if (type != rhs.type || is_array || rhs.is_array || isNull() || isBool())
+        if (getValueType() != rhs.getValueType() || isArray() || rhs.isArray() || isNull() || isBool())
             THROW(Poco::InvalidArgumentException("Value operator< invalid argument for " +
-                totalType(is_array, type) + " vs " +
-                totalType(rhs.is_array, rhs.type)));
+                totalType(isArray(), getValueType()) + " vs " +
+                totalType(rhs.isArray(), rhs.getValueType())));
         return var < rhs.var;
     }
 
     bool operator<=(const Value& rhs) const
     {
-        if (type != rhs.type || is_array || rhs.is_array || isNull() || isBool())
+        if (getValueType() != rhs.getValueType() || isArray() || rhs.isArray() || isNull() || isBool())
             THROW(Poco::InvalidArgumentException("Value operator<= invalid argument for " +
-                                                 totalType(is_array, type) + " vs " +
-                                                 totalType(rhs.is_array, rhs.type)));
+                                                 totalType(isArray(), getValueType()) + " vs " +
+                                                 totalType(rhs.isArray(), rhs.getValueType())));
         return var <= rhs.var;
     }
 
     bool operator>(const Value& rhs) const
     {
-        if (type != rhs.type || is_array || rhs.is_array || isNull() || isBool())
+        if (getValueType() != rhs.getValueType() || isArray() || rhs.isArray() || isNull() || isBool())
             THROW(Poco::InvalidArgumentException("Value operator> invalid argument for " +
-                                                 totalType(is_array, type) + " vs " +
-                                                 totalType(rhs.is_array, rhs.type)));
+                                                 totalType(isArray(), getValueType()) + " vs " +
+                                                 totalType(rhs.isArray(), rhs.getValueType())));
         return var > rhs.var;
     }
 
     bool operator>=(const Value& rhs) const
     {
-        if (type != rhs.type || is_array || rhs.is_array || isNull() || isBool())
+        if (getValueType() != rhs.getValueType() || isArray() || rhs.isArray() || isNull() || isBool())
             THROW(Poco::InvalidArgumentException("Value operator>= invalid argument for " +
-                                                 totalType(is_array, type) + " vs " +
-                                                 totalType(rhs.is_array, rhs.type)));
+                                                 totalType(isArray(), getValueType()) + " vs " +
+                                                 totalType(rhs.isArray(), rhs.getValueType())));
         return var >= rhs.var;
     }
 
     bool operator!=(const Value& rhs) const
     {
-        if (type != rhs.type)
+        if (getValueType() != rhs.getValueType())
             THROW(Poco::InvalidArgumentException("Value operator!= invalid argument for " +
-                                                 totalType(is_array, type) + " vs " +
-                                                 totalType(rhs.is_array, rhs.type)));
+                                                 totalType(isArray(), getValueType()) + " vs " +
+                                                 totalType(rhs.isArray(), rhs.getValueType())));
         return var != rhs.var;
     }
 
     bool operator==(const Value& rhs) const
     {
-        if (type != rhs.type)
+        if (getValueType() != rhs.getValueType())
             THROW(Poco::InvalidArgumentException("Value operator== invalid argument for " +
-                                                 totalType(is_array, type) + " vs " +
-                                                 totalType(rhs.is_array, rhs.type)));
+                                                 totalType(isArray(), getValueType()) + " vs " +
+                                                 totalType(rhs.isArray(), rhs.getValueType())));
         return var == rhs.var;
     }
 
@@ -260,7 +278,5 @@ private:
         return valueTypeToString(type_);
     }
 
-    bool is_array = false;
-    ValueType type;
-    std::variant<bool, double, std::string, DateTime, DynamicArray> var;
+    std::variant<std::monostate, bool, double, std::string, DateTime, DynamicArray> var;
 };
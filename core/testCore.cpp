@@ -174,6 +174,85 @@ TEST(database, AddFind)
     Database::destroyDatabase(ROOT_PATH + "/database1");
 }
 
+TEST(database, ReplaceIndex)
+{
+    Database db(ROOT_PATH + "/database1", true);
+    db.addTerm("old", db.newDocId(), 0);
+    db.addDocument(1, ROOT_PATH + "/articles/ABC.txt", 1, {});
+
+    {
+        Database shadow(ROOT_PATH + "/database1/rebuild", true);
+        for (int i = 0; i < 2; i++)
+        {
+            auto doc_id = shadow.newDocId();
+            shadow.addTerm("new", doc_id, 0);
+            shadow.addDocument(doc_id, ROOT_PATH + "/articles/ABC.txt", 1, {});
+        }
+
+        auto generation = db.getGeneration();
+        db.replaceIndexWith(shadow);
+        EXPECT_GT(db.getGeneration(), generation);
+        // 旧索引交给 shadow
+        EXPECT_NE(shadow.findTerm("old"), nullptr);
+        EXPECT_EQ(shadow.maxAllocatedDocId(), 1);
+    }
+
+    EXPECT_EQ(db.findTerm("old"), nullptr);
+    ASSERT_NE(db.findTerm("new"), nullptr);
+    EXPECT_EQ(db.findTerm("new")->posting_list.size(), 2);
+    EXPECT_EQ(db.getDocumentCount(), 2);
+    EXPECT_EQ(db.maxAllocatedDocId(), 2);
+    EXPECT_EQ(db.matchTerm("ne", 1), std::vector<std::string>{"new"});
+
+    // 替换后已经持久化，不需要等到 db 析构
+    {
+        Database reopened(ROOT_PATH + "/database1");
+        EXPECT_EQ(reopened.getDocumentCount(), 2);
+        EXPECT_NE(reopened.findTerm("new"), nullptr);
+    }
+
+    Database::destroyDatabase(ROOT_PATH + "/database1");
+}
+
+TEST(DocumentTable, base)
+{
+    DocumentTable table;
+    auto kvs = std::make_shared<const KVMap>(KVMap{{"a.b", Value(1)}});
+    table.add(1, "/data/docs/a.txt", DateTime(100), 10, nullptr);
+    table.add(3, "/data/docs/b.json", DateTime(200), 20, kvs);
+    table.add(4, "/data/other/c.txt", DateTime(300), 30, nullptr);
+
+    EXPECT_EQ(table.size(), 3);
+    EXPECT_EQ(table.getTotalWordCount(), 60);
+    EXPECT_FALSE(table.contains(2));
+    EXPECT_FALSE(table.contains(100));
+    EXPECT_EQ(table.getPath(3), "/data/docs/b.json");
+    EXPECT_EQ(table.getPath(4), "/data/other/c.txt");
+    EXPECT_EQ(table.getModifyTime(3), DateTime(200));
+    EXPECT_EQ(table.getWordCount(4), 30);
+    EXPECT_EQ(table.getKvs(3), kvs); // 共享而不拷贝
+    EXPECT_TRUE(table.getKvs(1)->empty());
+
+    // 评论与评分在多次取出之间共享
+    table.getAnnotations(1)->ratings["user"] = 4.0;
+    EXPECT_EQ(table.getAnnotations(1)->ratings.at("user"), 4.0);
+
+    EXPECT_TRUE(table.remove(1));
+    EXPECT_FALSE(table.remove(1));
+    EXPECT_EQ(table.size(), 2);
+    EXPECT_EQ(table.getTotalWordCount(), 50);
+    EXPECT_TRUE(table.getAnnotations(1)->ratings.empty());
+
+    std::vector<size_t> doc_ids;
+    table.forEach([&doc_ids](size_t doc_id) { doc_ids.push_back(doc_id); });
+    EXPECT_EQ(doc_ids, (std::vector<size_t>{3, 4}));
+
+    DocumentTable other;
+    other.swap(table);
+    EXPECT_TRUE(table.empty());
+    EXPECT_EQ(other.getPath(3), "/data/docs/b.json");
+}
+
 TEST(document, GetString)
 {
     Document document(1, ROOT_PATH + "/articles/WhenYouAreOld.txt", 0, {});
@@ -309,6 +388,14 @@ TEST(Value, base)
                  UnreachableException);
 
     ASSERT_EQ(v7.as<String>(1), "world");
+
+    Value v8(ArrayLabel{}, std::vector<Number>{1, 2, 3});
+    ASSERT_EQ(v8.getValueType(), ValueType::Number);
+    ASSERT_EQ(v8.asArray<Number>().size(), 3);
+    ASSERT_EQ(v8.visitArray([](const auto& vec) { return vec.size(); }), 3);
+    EXPECT_THROW(v8.asArray<String>(), Poco::Exception);
+    EXPECT_THROW(v3.visitArray([](const auto& vec) { return vec.size(); }), QueryException);
+    ASSERT_EQ(v2.ref<String>(), "hello");
 }
 
 TEST(Key, base)
@@ -320,9 +407,8 @@ TEST(Key, base)
     }
     Key key("a.b.c");
     EXPECT_EQ(key.string(), "a.b.c");
-    EXPECT_EQ(*key.begin(), "a");
-    EXPECT_EQ(*++key.begin(), "b");
-    EXPECT_EQ(*--key.end(), "c");
+    EXPECT_EQ(key.tokens(), std::vector<std::string>({"a", "b", "c"}));
+    EXPECT_TRUE(Key("").tokens().empty());
 
     std::unordered_map<Key, int> map;
     map.emplace("a.c", 100);
@@ -335,6 +421,40 @@ TEST(Key, base)
     EXPECT_EQ(map[Key("t.c")], 300);
 }
 
+TEST(Key, intern)
+{
+    Key key1("x.y.z");
+    Key key2(" x . y.z ");
+    EXPECT_EQ(key1, key2);
+    EXPECT_EQ(key1.getId(), key2.getId());
+    EXPECT_EQ(key2.string(), "x.y.z");
+
+    // push_back/pop_back 与按字符串构造得到同一个 Key
+    Key key3("");
+    EXPECT_TRUE(key3.empty());
+    key3.push_back("x");
+    key3.push_back("y");
+    key3.push_back("z");
+    EXPECT_EQ(key3, key1);
+    key3.pop_back();
+    EXPECT_EQ(key3, Key("x.y"));
+    key3.pop_back();
+    key3.pop_back();
+    EXPECT_EQ(key3, Key(""));
+    EXPECT_THROW(key3.pop_back(), Poco::RangeException);
+
+    auto size = KeyDictionary::instance().size();
+    Key key4("x.y.z");
+    EXPECT_EQ(KeyDictionary::instance().size(), size);
+
+    // 查询中的字段名只查找，不加入字典
+    EXPECT_EQ(Key::lookup(" x.y . z"), key1);
+    EXPECT_EQ(Key::lookup("x.y.never-indexed"), std::nullopt);
+    EXPECT_EQ(Key::lookup("never-indexed"), std::nullopt);
+    EXPECT_THROW(Key::lookup("x..y"), Poco::LogicException);
+    EXPECT_EQ(KeyDictionary::instance().size(), size);
+}
+
 TEST(keyValue, SerializeAndDeserialize)
 {
     WriteBuffer wbuf;
@@ -450,6 +570,136 @@ TEST(database, TidyTerm)
     Database::destroyDatabase(ROOT_PATH + "/database1");
 }
 
+TEST(database, EstimateMemoryBytes)
+{
+    uint64_t empty_bytes, two_docs_bytes;
+    {
+        Database db(ROOT_PATH + "/database1", true);
+        empty_bytes = db.estimateMemoryBytes();
+        db.addDocument(1, ROOT_PATH + "/articles/ABC.txt", 2, {{"k", Value(1)}});
+        db.addTerm("hello", 1, 1, 0);
+        db.addTerm("hello", 1, 30, 1);
+        db.addDocument(2, ROOT_PATH + "/articles/ABC.txt", 1, {});
+        db.addTerm("hello", 2, 1, 0);
+        two_docs_bytes = db.estimateMemoryBytes();
+        EXPECT_GT(two_docs_bytes, empty_bytes);
+    }
+
+    // 随增删增量维护，与重新加载时计算的结果相同
+    Database db(ROOT_PATH + "/database1", false);
+    EXPECT_EQ(db.estimateMemoryBytes(), two_docs_bytes);
+    db.deleteDocument(1);
+    EXPECT_LT(db.estimateMemoryBytes(), two_docs_bytes);
+    db.clear();
+    EXPECT_EQ(db.estimateMemoryBytes(), empty_bytes);
+
+    Database::destroyDatabase(ROOT_PATH + "/database1");
+}
+
+TEST(database, MetaFormatVersion)
+{
+    auto path = ROOT_PATH + "/database1";
+    {
+        Database db(path, true);
+        db.addDocument(1, ROOT_PATH + "/articles/ABC.txt", 1, {});
+        db.addTerm("hello", 1, 1, 0);
+    }
+    {
+        Database db(path, false);
+        ASSERT_NE(db.findTerm("hello"), nullptr);
+    }
+
+    auto writeMetaHeader = [&](std::initializer_list<uint64_t> numbers) {
+        std::ofstream fout(path + "/meta", std::ios::binary | std::ios::trunc);
+        for (auto number : numbers)
+            fout.write(reinterpret_cast<const char *>(&number), sizeof(number));
+    };
+    // 没有版本号的旧格式，以 next_doc_id 开头
+    writeMetaHeader({2, 0, 0});
+    ASSERT_THROW(Database(path, false), Poco::DataFormatException);
+    writeMetaHeader({META_MAGIC, META_FORMAT_VERSION + 1, 0});
+    ASSERT_THROW(Database(path, false), Poco::DataFormatException);
+
+    // 版本 1 只在分词结果没有变化时(unicode_segment)仍可读取
+    auto writeVersion1Meta = [&]() {
+        WriteBuffer buf;
+        WriteBufferHelper helper(buf);
+        helper.writeNumber(META_MAGIC);
+        helper.writeNumber(uint32_t(1));
+        helper.writeNumber(size_t(1)); // next_doc_id
+        helper.writeNumber(size_t(0)); // terms
+        helper.writeNumber(size_t(0)); // documents
+        std::ofstream fout(path + "/meta", std::ios::binary | std::ios::trunc);
+        buf.dumpAllToStream(fout);
+    };
+    writeVersion1Meta();
+    ASSERT_THROW(Database(path, false), Poco::DataFormatException);
+    Database::destroyDatabase(path);
+    {
+        Database db(path, true, AnalyzerConfig::standard());
+    }
+    writeVersion1Meta();
+    ASSERT_NO_THROW(Database(path, false));
+
+    Database::destroyDatabase(path);
+}
+
+TEST(database, Discard)
+{
+    auto path = ROOT_PATH + "/database-discarded";
+    std::filesystem::remove_all(path);
+    {
+        Database db(path, true);
+        db.enableDocumentStore();
+        db.addTerm("hello", 1, 1, 0);
+        db.discard();
+    }
+    EXPECT_FALSE(std::filesystem::exists(path + "/meta"));
+    EXPECT_FALSE(std::filesystem::exists(path + "/store.index"));
+    std::filesystem::remove_all(path);
+}
+
+// 会填满进程内的字段名字典，必须是最后一个 test suite
+TEST(keyDictionary, FullOnLoad)
+{
+    auto path = ROOT_PATH + "/database-keys";
+    std::filesystem::remove_all(path);
+    {
+        Database db(path, true);
+        db.addDocument(1, ROOT_PATH + "/articles/ABC.txt", 1, {{"known", 1}});
+        db.addDocument(2, ROOT_PATH + "/articles/ABC.txt", 1, {{"known", 2}, {"fresh", 3}});
+    }
+    // 改写为字典中没有的字段名
+    std::string meta;
+    {
+        std::ifstream fin(path + "/meta", std::ios::binary);
+        meta.assign(std::istreambuf_iterator<char>(fin), {});
+    }
+    auto pos = meta.find("fresh");
+    ASSERT_NE(pos, std::string::npos);
+    meta.replace(pos, 5, "stale");
+    std::ofstream(path + "/meta", std::ios::binary | std::ios::trunc) << meta;
+
+    for (size_t i = KeyDictionary::instance().size(); i <= KEY_DICTIONARY_MAX_ENTRIES; i++)
+    {
+        try
+        {
+            Key("filler" + std::to_string(i));
+        }
+        catch (const Poco::LimitExceededException&)
+        {
+            break;
+        }
+    }
+    ASSERT_EQ(KeyDictionary::instance().size(), KEY_DICTIONARY_MAX_ENTRIES);
+
+    Database db(path, false);
+    EXPECT_EQ(db.findKvs(1)->at("known"), Value(1));
+    EXPECT_TRUE(db.findKvs(2)->empty());
+    db.discard();
+    std::filesystem::remove_all(path);
+}
+
 int main()
 {
     testing::InitGoogleTest();
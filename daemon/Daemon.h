@@ -3,6 +3,10 @@
 #include "core/Database.h"
 #include "indexer/Indexer.h"
 #include "utils/FileSystemUtils.h"
+#include "IndexJob.h"
+#include "utils/TokenBucket.h"
+#include "IndexScheduler.h"
+#include "IndexingExecutor.h"
 
 namespace std
 {
@@ -19,6 +23,8 @@ namespace std
 using FileToDocId = std::unordered_map<std::string, size_t>;
 
 // 监听索引中的文件变化，以单条索引中的每个文件为粒度 ———— 最细粒度.
+// index_lock 保证同一时刻只有一个线程在索引；paths_lock 只保护 paths，持有时间很短，
+// 因此索引过程中 getPaths、removePath 等查询不会被阻塞.
 class FileSystemDaemon {
 public:
     explicit FileSystemDaemon(Database& db_) : db(db_), indexer(db_) {
@@ -26,24 +32,113 @@ public:
             deserialize();
     }
 
+    // 单独使用时定时调用：按优先级处理各 path，直到本 database 的预算用完.
+    // 多个 database 由 FileSystemDaemons 统一调度.
     void run()
     {
-        std::lock_guard lg(paths_lock);
-        for (const auto& path : paths)
+        auto budget = IndexBudget::perDatabase();
+        for (const auto& path_priority : getPathPriorities())
         {
-            smartIndexAndRecord(path.first);
+            if (budget.exhausted() || !indexPathWithBudget(path_priority.path, budget))
+                break;
+        }
+    }
+
+    // 在 budget 内索引 path，未处理完的文件留到下一轮. 后台任务正在索引时不阻塞，返回 false
+    bool indexPathWithBudget(const std::string& path, IndexBudget& budget)
+    {
+        std::unique_lock lk(index_lock, std::try_to_lock);
+        if (!lk.owns_lock())
+            return false;
+        auto path_budget = budget.slicePerPath();
+        smartIndexAndRecord(path, nullptr, &path_budget);
+        budget.charge(path_budget);
+        return true;
+    }
+
+    // 各 path 的调度优先级，按优先级降序
+    std::vector<PathPriority> getPathPriorities() const
+    {
+        auto document_freq = db.getAllDocumentFreq();
+        auto now = std::chrono::steady_clock::now();
+
+        std::vector<PathPriority> priorities;
+        {
+            std::lock_guard lg(paths_lock);
+            for (const auto& [path, indexed_documents] : paths)
+            {
+                uint64_t query_freq = 0;
+                for (const auto& [_, doc_id] : indexed_documents)
+                {
+                    if (auto iter = document_freq.find(doc_id); iter != document_freq.end())
+                        query_freq += iter->second.second;
+                }
+                const auto& state = path_states[path];
+                double seconds_since_change = std::chrono::duration<double>(now - state.last_change).count();
+                priorities.push_back({path, indexPriority(seconds_since_change, query_freq, state.backlog), state.backlog});
+            }
         }
+        std::stable_sort(priorities.begin(), priorities.end(), [](const auto& a, const auto& b) { return a.priority > b.priority; });
+        return priorities;
     }
 
-    void rebuildAllPaths()
+    // 各 path 尚未索引的文件总数
+    uint64_t getBacklog() const
     {
         std::lock_guard lg(paths_lock);
-        db.clear();
-        for (auto& path : paths)
+        uint64_t backlog = 0;
+        for (const auto& [_, state] : path_states)
+            backlog += state.backlog;
+        return backlog;
+    }
+
+    // 在 database 目录下的 rebuild 子目录中建立影子索引，完成后整体替换当前索引，重建期间旧索引照常提供查询.
+    // 读取文件的速度受 rebuild_throttle 限制，避免占满磁盘和 CPU. 任务被取消时丢弃影子索引.
+    void rebuildAllPaths(IndexJob* job = nullptr)
+    {
+        std::lock_guard lg(index_lock);
+        StopWatch rebuild_timer;
+        auto shadow_path = db.getPath() / "rebuild";
+        std::filesystem::remove_all(shadow_path);
+
+        std::unordered_map<std::string, FileToDocId> rebuilt_paths;
         {
-            path.second.clear();
-            smartIndexAndRecord(path.first);
+            Database shadow(shadow_path, true, db.getAnalyzer().getConfig());
+            if (db.getDocumentStore())
+                shadow.enableDocumentStore();
+            Indexer shadow_indexer(shadow);
+
+            for (const auto& path : getPathList())
+            {
+                if (job && job->isCancelled())
+                    break;
+                auto& indexed_documents = rebuilt_paths[path];
+                if (exists(std::filesystem::path(path)))
+                    indexChanges(shadow, shadow_indexer, path, indexed_documents, &directory_cache, job, &rebuild_throttle);
+            }
+
+            if (job && job->isCancelled())
+                httpLog("rebuildAllPaths cancelled, shadow index discarded");
+            else
+            {
+                db.replaceIndexWith(shadow);
+                // 重建期间新增的 path 还没有索引，doc_id 已失效，交给下一轮 run
+                std::lock_guard paths_lg(paths_lock);
+                for (auto& [path, indexed_documents] : paths)
+                {
+                    auto iter = rebuilt_paths.find(path);
+                    indexed_documents = iter == rebuilt_paths.end() ? FileToDocId{} : std::move(iter->second);
+                }
+                for (auto& [_, state] : path_states)
+                    state.backlog = 0;
+                // meta 已经按新的 doc_id 写入，listen 必须紧随其后，否则崩溃重启时旧的 doc_id 会删错文档
+                writePaths();
+            }
+            // 此时 shadow 持有旧索引或被取消的索引，目录随后删除，不必写盘
+            shadow.discard();
         }
+        std::filesystem::remove_all(shadow_path);
+        httpLog("rebuildAllPaths cost " + std::to_string(rebuild_timer.elapsedSeconds()) + "s");
     }
 
     // NOTE: 这些方法应该被 http 调用
@@ -51,17 +146,51 @@ public:
     // e.g. '/a' includes '/a/b'
 
     // NOTE: 即使 path 当前不存在，也可以预添加
-    void addPath(const std::filesystem::path& path)
+    void addPath(const std::filesystem::path& path, IndexJob* job = nullptr)
     {
-        std::lock_guard lg(paths_lock);
-        paths.emplace(path.string(), FileToDocId{});
-        smartIndexAndRecord(path);
+        {
+            std::lock_guard lg(paths_lock);
+            paths.emplace(path.string(), FileToDocId{});
+        }
+        std::lock_guard lg(index_lock);
+        smartIndexAndRecord(path, job);
     }
 
+    // 在后台线程执行 addPath，立即返回任务 id. path 立即记录，即使任务还未执行
+    uint64_t submitAddPath(const std::filesystem::path& path)
+    {
+        {
+            std::lock_guard lg(paths_lock);
+            paths.emplace(path.string(), FileToDocId{});
+        }
+        return jobs.submit(IndexJobType::AddPath, path.string(), [this, path](IndexJob& job) {
+            addPath(path, &job);
+        });
+    }
+
+    uint64_t submitRebuildAllPaths()
+    {
+        return jobs.submit(IndexJobType::RebuildAll, "", [this](IndexJob& job) {
+            rebuildAllPaths(&job);
+        });
+    }
+
+    std::optional<IndexJobProgress> getJob(uint64_t job_id) const
+    {
+        return jobs.getJob(job_id);
+    }
+
+    std::vector<IndexJobProgress> getJobs() const
+    {
+        return jobs.getJobs();
+    }
+
+    // 正在索引的 path 被移除时，索引结果不再写回
     void removePath(const std::filesystem::path& path)
     {
         std::lock_guard lg(paths_lock);
         paths.erase(path);
+        path_states.erase(path);
     }
 
     auto getPaths() const
@@ -73,12 +202,11 @@ public:
     // 获取文件类型的统计信息：每种类型对应的数量
     std::unordered_map<std::string, uint64_t> getTypeStatistics() const
     {
-        std::lock_guard lg(paths_lock);
         std::unordered_map<std::string, uint64_t> types;
 
-        for (const auto& path : paths)
+        for (const auto& path : getPathList())
         {
-            for (const auto& file_path : gatherExistedFiles(path.first))
+            for (const auto& file_path : DirectoryWalker(GATHER_FILES_THREADS, &directory_cache).walk(path).files)
             {
                 auto extension = std::filesystem::path(file_path).extension();
                 ++types[extension];
@@ -90,14 +218,30 @@ public:
 
     ~FileSystemDaemon()
     {
+        jobs.stop();
         serialize();
     }
 
 private:
+    std::vector<std::string> getPathList() const
+    {
+        std::lock_guard lg(paths_lock);
+        std::vector<std::string> path_list;
+        path_list.reserve(paths.size());
+        for (const auto& path : paths)
+            path_list.push_back(path.first);
+        return path_list;
+    }
+
     void serialize() {
         std::lock_guard lg(paths_lock);
+        writePaths();
+    }
 
-        std::ofstream fout(db.getPath().string() + "/listen");
+    // 先写临时文件再改名，崩溃时 listen 要么是旧的要么是新的. caller holds paths_lock
+    void writePaths() const {
+        auto listen_path = db.getPath() / "listen", tmp_path = db.getPath() / "listen.tmp";
+        std::ofstream fout(tmp_path, std::ios::binary | std::ios::trunc);
         WriteBuffer buf;
         WriteBufferHelper helper(buf);
 
@@ -114,6 +258,11 @@ private:
             }
         }
         buf.dumpAllToStream(fout);
+        fout.close();
+        if (!fout)
+            httpLog("failed to write " + tmp_path.string());
+        else
+            std::filesystem::rename(tmp_path, listen_path);
     }
 
     void deserialize() {
@@ -143,17 +292,59 @@ private:
         }
     }
 
-    // 只对发生变化的(新)文件重新索引，并删除过时 doc_id.
-    // not thread-safe, caller promise.
-    void smartIndexAndRecord(const std::filesystem::path& path)
+    // caller holds index_lock. 在 path 的记录副本上修改，结束后再写回 paths.
+    void smartIndexAndRecord(const std::filesystem::path& path, IndexJob* job = nullptr, IndexBudget* budget = nullptr)
     {
         if (!exists(path))
             return;
 
         StopWatch index_timer;
 //        std::cout << "[smartIndex " << path.string() << "]" << std::endl;
-        std::unordered_map<std::string, size_t>& indexed_documents = paths[path];
-        std::unordered_set<std::string> existed_files = gatherExistedFiles(path);
+        FileToDocId indexed_documents;
+        {
+            std::lock_guard lg(paths_lock);
+            auto iter = paths.find(path.string());
+            if (iter == paths.end())
+                return;
+            indexed_documents = iter->second;
+        }
+
+        auto changes = indexChanges(db, indexer, path, indexed_documents, &directory_cache, job, nullptr, budget);
+
+        {
+            std::lock_guard lg(paths_lock);
+            if (auto iter = paths.find(path.string()); iter != paths.end())
+            {
+                iter->second = std::move(indexed_documents);
+                auto& state = path_states[path.string()];
+                state.backlog = changes.backlog;
+                if (changes.changed)
+                    state.last_change = std::chrono::steady_clock::now();
+            }
+        }
+
+        httpLog("smartIndexAndRecord cost " + std::to_string(index_timer.elapsedSeconds()) + "s, path -- " + path.string()
+                + (changes.backlog ? ", backlog " + std::to_string(changes.backlog) : ""));
+    }
+
+    struct IndexChanges
+    {
+        bool changed = false; // 是否发现了新增、修改或删除的文件
+        uint64_t backlog = 0; // 预算用完时还未索引的文件数
+    };
+
+    // 只对发生变化的(新)文件重新索引，并删除过时 doc_id. indexed_documents 是 path 在 target_db 中的记录.
+    // throttle 不为空时按文件大小限速；budget 不为空时用完即停止. 无法读取的目录中已索引的文件保持原状，不视为删除.
+    static IndexChanges indexChanges(Database& target_db, Indexer& target_indexer, const std::filesystem::path& path,
+                                     FileToDocId& indexed_documents, DirectoryCache* directory_cache,
+                                     IndexJob* job = nullptr, TokenBucket* throttle = nullptr, IndexBudget* budget = nullptr)
+    {
+        StopWatch walk_timer;
+        auto walk_result = DirectoryWalker(GATHER_FILES_THREADS, directory_cache).walk(path);
+        const auto& existed_files = walk_result.files;
+        auto old_size = indexed_documents.size();
+        if (job)
+            job->addScanned(existed_files.size());
 
         std::vector<std::string> files_to_index;
 
@@ -172,21 +363,26 @@ private:
         {
             auto old_file_path = iter->first;
             auto old_doc_id = iter->second;
+            // 2.0. 所在目录本次无法读取，状态未知，保留
+            if (!existed_files.contains(old_file_path) && walk_result.isInFailedDirectory(old_file_path))
+            {
+                ++iter;
+            }
             // 2.1. 已删除
-            if (!existed_files.contains(old_file_path))
+            else if (!existed_files.contains(old_file_path))
             {
 //                std::cout << "\tdeleted file: " << old_file_path << std::endl;
-                db.deleteDocument(old_doc_id);
+                target_db.deleteDocument(old_doc_id);
                 iter = indexed_documents.erase(iter);
             }
             // 2.2. 已修改
-            else if (auto document_ptr = db.findDocument(old_doc_id))
+            else if (auto document_ptr = target_db.findDocument(old_doc_id))
             {
                 if (document_ptr->getModifyTime() < getModifiedLastDateTime(old_file_path))
                 {
 //                    std::cout << "\toutdated file: " << old_file_path << std::endl;
                     // 前半段删除就索引数据，逻辑同 2.1.
-                    db.deleteDocument(old_doc_id);
+                    target_db.deleteDocument(old_doc_id);
                     iter = indexed_documents.erase(iter);
                     // 后半段重新索引，逻辑同 1.
                     files_to_index.push_back(old_file_path);
@@ -202,47 +398,141 @@ private:
             }
         }
 
+        IndexChanges changes{.changed = !files_to_index.empty() || indexed_documents.size() != old_size};
+        if (budget)
+            budget->consume(walk_timer.elapsedSeconds());
+
         // 3. (重新)索引文件
-        for (const auto& file_path : files_to_index)
+        if (job)
+            job->addToIndex(files_to_index.size());
+        for (size_t i = 0; i < files_to_index.size(); i++)
         {
-            if (indexed_documents.size() >= MAX_FILE_NUMBER_EVERY_INDEX)
+            const auto& file_path = files_to_index[i];
+            // 遍历与检查修改时间也计入耗时，大目录可能一个文件都来不及索引；前几个文件不受时间预算限制，积压才能逐轮减少
+            if (budget && budget->exhausted(i < DAEMON_PATH_MIN_FILES_PER_CYCLE))
             {
-                httpLog("Reach MAX_FILE_NUMBER_EVERY_INDEX in path -- " + path.string());
+                changes.backlog = files_to_index.size() - i;
                 break;
             }
-            size_t doc_id = indexer.indexFile(file_path);
+            if (job && job->isCancelled())
+                break;
+            std::error_code ec;
+            auto bytes = std::filesystem::file_size(file_path, ec);
+            if (ec)
+                bytes = 0;
+            if (throttle)
+                throttle->acquire(static_cast<double>(bytes));
+
+            StopWatch file_timer;
+            size_t doc_id = target_indexer.indexFile(file_path);
+            if (budget)
+                budget->consume(file_timer.elapsedSeconds(), bytes, 1);
             if (doc_id == 0) // indexer 决定不索引此文档 --> 文档为空或者文档类型被过滤
+            {
+                if (job)
+                    job->addSkipped();
                 continue;
+            }
+            if (job)
+                job->addIndexed(bytes);
             indexed_documents.emplace(file_path, doc_id);
         }
-
-        httpLog("smartIndexAndRecord cost " + std::to_string(index_timer.elapsedSeconds()) + "s, path -- " + path.string());
+        return changes;
     }
 
     Database& db;
     Indexer indexer;
 
+    std::mutex index_lock;
+    mutable DirectoryCache directory_cache;
+    TokenBucket rebuild_throttle{REBUILD_MAX_BYTES_PER_SECOND, REBUILD_BURST_BYTES};
     mutable std::mutex paths_lock;
     // directory(/file)_path -> (file_path -> doc_id)
     std::unordered_map<std::string, FileToDocId> paths;
+
+    // 调度用的状态，不持久化，由 paths_lock 保护
+    struct PathState
+    {
+        std::chrono::steady_clock::time_point last_change = std::chrono::steady_clock::now();
+        uint64_t backlog = 0;
+    };
+    mutable std::unordered_map<std::string, PathState> path_states;
+
+    IndexJobQueue jobs; // 最后构造、最先停止，任务执行时其他成员均有效
 };
 
+// 定时器线程只负责为每个 database 排入本轮的 path 任务，索引由共用的 IndexingExecutor 执行.
+// 各 database 的队列轮流执行，每次一个 path，因此一个 database 积压不会推迟其他 database 发现变化.
 class FileSystemDaemons
 {
 public:
+    explicit FileSystemDaemons(size_t thread_num = DAEMON_THREADS) : executor(thread_num) {}
+
     void add(std::shared_ptr<FileSystemDaemon> daemon_ptr)
     {
-        daemon_ptrs.push_back(std::move(daemon_ptr));
+        std::lock_guard lg(lock);
+        entries.push_back({std::move(daemon_ptr), executor.addQueue()});
     }
 
+    // 不再定时索引该 database，返回时它的索引任务都已结束或被丢弃
+    void remove(const std::shared_ptr<FileSystemDaemon>& daemon_ptr)
+    {
+        std::optional<size_t> queue_id;
+        {
+            std::lock_guard lg(lock);
+            auto iter = std::find_if(entries.begin(), entries.end(), [&](const Entry& entry) { return entry.daemon == daemon_ptr; });
+            if (iter == entries.end())
+                return;
+            queue_id = iter->queue_id;
+            entries.erase(iter);
+        }
+        executor.removeQueue(*queue_id);
+    }
+
+    // 每个 database 本轮的 path 按优先级排队，共用本轮预算. 上一轮还没有执行完的 database 本轮不再排队.
+    // 预算用完或正在执行后台任务时跳过剩余 path，积压的文件留到下一轮.
     void run(Poco::Timer& timer)
     {
         if (timer.skipped() > 1)
             httpLog("daemon skipp time too much: " + std::to_string(timer.skipped()));
-        for (auto& daemon_ptr : daemon_ptrs)
-            daemon_ptr->run();
+
+        std::lock_guard lg(lock); // remove 返回后不会再向被移除的队列提交任务
+        for (const auto& entry : entries)
+        {
+            if (!executor.isIdle(entry.queue_id))
+                continue;
+            auto cycle = std::make_shared<Cycle>();
+            for (const auto& path_priority : entry.daemon->getPathPriorities())
+            {
+                // 同一队列的任务不会并发执行，cycle 不需要加锁
+                executor.submit(entry.queue_id, [daemon = entry.daemon, path = path_priority.path, cycle] {
+                    if (cycle->busy || cycle->budget.exhausted())
+                        return;
+                    cycle->busy = !daemon->indexPathWithBudget(path, cycle->budget);
+                });
+            }
+        }
+    }
+
+    void waitIdle()
+    {
+        executor.waitIdle();
     }
 
 private:
-    std::vector<std::shared_ptr<FileSystemDaemon>> daemon_ptrs;
+    struct Entry
+    {
+        std::shared_ptr<FileSystemDaemon> daemon;
+        size_t queue_id;
+    };
+
+    struct Cycle
+    {
+        IndexBudget budget = IndexBudget::perDatabase();
+        bool busy = false;
+    };
+
+    std::mutex lock; // 保护 entries
+    std::vector<Entry> entries;
+    IndexingExecutor executor; // 最后构造、最先析构，析构时等待正在执行的任务结束
 };
\ No newline at end of file
@@ -0,0 +1,309 @@
+#pragma once
+
+#include "../typedefs.h"
+#include "Daemon.h"
+
+// 按需加载的 database：第一次访问时打开并交给 FileSystemDaemons 定时索引，
+// 没有请求持有、空闲超过 idle_timeout，或所有已加载 database 的估计内存超出预算时（最久未访问的先卸载）
+// 由定时器调用的 run 持久化并卸载. 卸载期间的文件变化在下次加载后由定时索引补上.
+// read_only 时（复制的 replica）database 不参与定时索引，索引只通过复制替换.
+class DatabaseRegistry
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Tenant
+    {
+        // 先析构 daemon：它持有 db 的引用
+        std::shared_ptr<Database> db;
+        std::shared_ptr<FileSystemDaemon> daemon;
+    };
+
+    // 加载完成、交出 Lease 之前调用，例如 replica 在第一次查询前拉取最新快照. 调用时持有该 database 的 load_lock
+    using LoadHook = std::function<void(const std::string&, const std::shared_ptr<Tenant>&)>;
+
+private:
+    struct Slot
+    {
+        std::mutex load_lock; // 同一 database 的加载与卸载串行执行；持有期间可以再获取 registry 的 lock，反之不行
+        std::shared_ptr<Tenant> tenant; // 以下由 registry 的 lock 保护
+        size_t leases = 0;
+        Clock::time_point last_access;
+        uint64_t memory_bytes = 0;
+    };
+    using SlotPtr = std::shared_ptr<Slot>;
+
+public:
+    // 持有期间 database 不会被卸载，析构时归还
+    class Lease
+    {
+    public:
+        Lease(DatabaseRegistry& registry_, SlotPtr slot_, std::shared_ptr<Tenant> tenant_)
+            : registry(&registry_), slot(std::move(slot_)), tenant(std::move(tenant_)) {}
+
+        Lease(Lease&& other) noexcept
+            : registry(std::exchange(other.registry, nullptr)), slot(std::move(other.slot)), tenant(std::move(other.tenant)) {}
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        Lease& operator=(Lease&&) = delete;
+
+        ~Lease()
+        {
+            if (registry)
+                registry->release(*slot);
+        }
+
+        Database& getDatabase() const { return *tenant->db; }
+        FileSystemDaemon& getDaemon() const { return *tenant->daemon; }
+
+    private:
+        friend class DatabaseRegistry;
+
+        DatabaseRegistry* registry;
+        SlotPtr slot;
+        std::shared_ptr<Tenant> tenant;
+    };
+
+    DatabaseRegistry(std::filesystem::path root_, FileSystemDaemons& daemons_, std::chrono::seconds idle_timeout_ = std::chrono::seconds(DATABASE_IDLE_SECONDS),
+                     uint64_t memory_budget_ = DATABASE_MEMORY_BUDGET_BYTES, bool read_only_ = false)
+        : root(std::move(root_)), daemons(daemons_), idle_timeout(idle_timeout_), memory_budget(memory_budget_), read_only(read_only_)
+    {
+        if (!std::filesystem::exists(root))
+            std::filesystem::create_directories(root);
+    }
+
+    DatabaseRegistry(const DatabaseRegistry&) = delete;
+    DatabaseRegistry& operator=(const DatabaseRegistry&) = delete;
+
+    // 所有 Lease 归还后才能析构
+    ~DatabaseRegistry()
+    {
+        for (auto& [_, slot] : slots)
+            if (slot->tenant)
+                unload(*slot);
+    }
+
+    // 在第一次 acquire 之前设置
+    void setLoadHook(LoadHook hook)
+    {
+        load_hook = std::move(hook);
+    }
+
+    // 需要时加载，加载失败抛出异常
+    Lease acquire(const std::string& db_name)
+    {
+        SlotPtr slot;
+        {
+            std::lock_guard lg(lock);
+            auto& slot_ref = slots[db_name];
+            if (!slot_ref)
+                slot_ref = std::make_shared<Slot>();
+            slot = slot_ref;
+            ++slot->leases; // 加载期间也不能被卸载
+            slot->last_access = Clock::now();
+        }
+
+        std::shared_ptr<Tenant> tenant;
+        std::optional<uint64_t> loaded_bytes;
+        try
+        {
+            std::lock_guard load_lg(slot->load_lock);
+            {
+                std::lock_guard lg(lock);
+                tenant = slot->tenant;
+            }
+            if (!tenant)
+            {
+                tenant = load(db_name);
+                if (load_hook)
+                    load_hook(db_name, tenant);
+                auto memory_bytes = tenant->db->estimateMemoryBytes();
+                std::lock_guard lg(lock);
+                slot->tenant = tenant;
+                slot->memory_bytes = memory_bytes;
+                memory_used += memory_bytes;
+                loaded_bytes = memory_bytes;
+            }
+        }
+        catch (...)
+        {
+            release(*slot);
+            throw;
+        }
+
+        // 超出内存预算时由定时器调用的 run 卸载其他 database，不在请求线程中执行
+        if (loaded_bytes)
+            httpLog("database " + db_name + " loaded, estimated " + std::to_string(*loaded_bytes) + " bytes");
+        return Lease(*this, slot, std::move(tenant));
+    }
+
+    // 卸载空闲超时的 database，之后按最久未访问的顺序卸载，直到估计内存不超过预算.
+    // 被 Lease 持有或有未结束后台任务的 database 不会被卸载. 返回卸载的数量.
+    size_t evict(Clock::time_point now)
+    {
+        struct Candidate
+        {
+            std::string name;
+            SlotPtr slot;
+            Clock::time_point last_access;
+        };
+        std::vector<Candidate> candidates;
+        uint64_t memory;
+        {
+            std::lock_guard lg(lock);
+            for (const auto& [name, slot] : slots)
+                if (slot->tenant && slot->leases == 0)
+                    candidates.push_back({name, slot, slot->last_access});
+            memory = memory_used;
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.last_access < b.last_access; });
+
+        size_t evicted = 0;
+        for (const auto& [name, slot, last_access] : candidates)
+        {
+            bool idle = now - last_access >= idle_timeout;
+            if (!idle && memory <= memory_budget)
+                break;
+            if (auto freed = tryUnload(name, *slot))
+            {
+                memory -= std::min(memory, *freed);
+                ++evicted;
+            }
+        }
+        return evicted;
+    }
+
+    // 供定时器调用：刷新已加载 database 的估计内存并执行 evict
+    void run(Poco::Timer&)
+    {
+        refreshMemory();
+        evict(Clock::now());
+    }
+
+    void refreshMemory()
+    {
+        std::vector<std::pair<SlotPtr, std::shared_ptr<Tenant>>> loaded;
+        {
+            std::lock_guard lg(lock);
+            for (const auto& [_, slot] : slots)
+                if (slot->tenant)
+                    loaded.emplace_back(slot, slot->tenant);
+        }
+        for (const auto& [slot, tenant] : loaded)
+        {
+            auto memory_bytes = tenant->db->estimateMemoryBytes();
+            std::lock_guard lg(lock);
+            if (slot->tenant != tenant)
+                continue; // 期间已被卸载
+            memory_used = memory_used - slot->memory_bytes + memory_bytes;
+            slot->memory_bytes = memory_bytes;
+        }
+    }
+
+    // 对每个已加载的 database 调用 fn，调用期间持有它的 Lease
+    void forEachLoaded(const std::function<void(const std::string&, const std::shared_ptr<Tenant>&)>& fn)
+    {
+        std::vector<std::pair<std::string, Lease>> leases;
+        {
+            std::lock_guard lg(lock);
+            for (const auto& [name, slot] : slots)
+            {
+                if (!slot->tenant)
+                    continue;
+                ++slot->leases;
+                leases.emplace_back(name, Lease(*this, slot, slot->tenant));
+            }
+        }
+        for (const auto& [name, lease] : leases)
+            fn(name, lease.tenant);
+    }
+
+    bool isLoaded(const std::string& db_name) const
+    {
+        std::lock_guard lg(lock);
+        auto iter = slots.find(db_name);
+        return iter != slots.end() && iter->second->tenant;
+    }
+
+    size_t getLoadedCount() const
+    {
+        std::lock_guard lg(lock);
+        return std::count_if(slots.begin(), slots.end(), [](const auto& pair) { return pair.second->tenant != nullptr; });
+    }
+
+    uint64_t getMemoryBytes() const
+    {
+        std::lock_guard lg(lock);
+        return memory_used;
+    }
+
+private:
+    std::shared_ptr<Tenant> load(const std::string& db_name)
+    {
+        auto path = root / db_name;
+        // 目录中已有持久化的索引时沿用，否则新建
+        bool new_database = !std::filesystem::exists(path / "meta");
+        auto tenant = std::make_shared<Tenant>();
+        tenant->db = std::make_shared<Database>(path, new_database, AnalyzerConfig::standard());
+        tenant->db->enableDocumentStore();
+        tenant->daemon = std::make_shared<FileSystemDaemon>(*tenant->db);
+        if (!read_only)
+            daemons.add(tenant->daemon);
+        return tenant;
+    }
+
+    // 返回释放的估计内存；期间又被获取或仍有后台任务时放弃
+    std::optional<uint64_t> tryUnload(const std::string& db_name, Slot& slot)
+    {
+        std::lock_guard load_lg(slot.load_lock);
+        {
+            std::lock_guard lg(lock);
+            if (!slot.tenant || slot.leases > 0)
+                return std::nullopt;
+        }
+        // 后台任务只在 Lease 持有期间提交，但执行可能持续到请求结束之后
+        auto jobs = slot.tenant->daemon->getJobs();
+        if (std::any_of(jobs.begin(), jobs.end(), [](const IndexJobProgress& job) { return !job.isFinished(); }))
+            return std::nullopt;
+
+        auto freed = unload(slot);
+        httpLog("database " + db_name + " unloaded, freed estimated " + std::to_string(freed) + " bytes");
+        return freed;
+    }
+
+    // caller holds slot.load_lock（析构时除外）
+    uint64_t unload(Slot& slot)
+    {
+        std::shared_ptr<Tenant> tenant;
+        uint64_t freed;
+        {
+            std::lock_guard lg(lock);
+            tenant = std::exchange(slot.tenant, nullptr);
+            freed = std::exchange(slot.memory_bytes, 0);
+            memory_used -= std::min(memory_used, freed);
+        }
+        // 先停止定时索引，之后 daemon、db 依次析构并持久化
+        daemons.remove(tenant->daemon);
+        tenant.reset();
+        return freed;
+    }
+
+    void release(Slot& slot)
+    {
+        std::lock_guard lg(lock);
+        --slot.leases;
+        slot.last_access = Clock::now();
+    }
+
+    const std::filesystem::path root;
+    FileSystemDaemons& daemons;
+    const std::chrono::seconds idle_timeout;
+    const uint64_t memory_budget;
+    const bool read_only;
+    LoadHook load_hook;
+
+    mutable std::mutex lock;
+    std::unordered_map<std::string, SlotPtr> slots; // 卸载后保留，记录只增不减
+    uint64_t memory_used = 0;
+};
@@ -0,0 +1,313 @@
+#pragma once
+
+#include "../typedefs.h"
+#include "utils/JsonWriter.h"
+#include "utils/TimeUtils.h"
+#include <condition_variable>
+#include <map>
+
+enum class IndexJobType
+{
+    AddPath,
+    RebuildAll,
+};
+
+enum class IndexJobState
+{
+    Queued,
+    Running,
+    Succeeded,
+    Failed,
+    Cancelled,
+};
+
+std::string toString(IndexJobType type)
+{
+    return type == IndexJobType::AddPath ? "add-path" : "rebuild-all";
+}
+
+std::string toString(IndexJobState state)
+{
+    switch (state)
+    {
+        case IndexJobState::Queued: return "queued";
+        case IndexJobState::Running: return "running";
+        case IndexJobState::Succeeded: return "succeeded";
+        case IndexJobState::Failed: return "failed";
+        case IndexJobState::Cancelled: return "cancelled";
+    }
+    return "unknown";
+}
+
+// 某一时刻任务状态的拷贝，用于返回给 http 请求
+struct IndexJobProgress
+{
+    uint64_t id = 0;
+    IndexJobType type = IndexJobType::AddPath;
+    std::string path;
+    IndexJobState state = IndexJobState::Queued;
+    std::string error;
+
+    uint64_t files_scanned = 0;  // 遍历到的文件数
+    uint64_t files_to_index = 0; // 新增或修改、需要(重新)索引的文件数
+    uint64_t files_indexed = 0;  // 已建立索引的文件数
+    uint64_t files_skipped = 0;  // 读取后被 indexer 跳过的文件数(空文件或类型被过滤)
+    uint64_t bytes_indexed = 0;
+    double elapsed_seconds = 0;
+
+    double bytesPerSecond() const
+    {
+        return elapsed_seconds > 0 ? bytes_indexed / elapsed_seconds : 0;
+    }
+
+    uint64_t filesProcessed() const
+    {
+        return files_indexed + files_skipped;
+    }
+
+    // 按已处理文件的速度估计剩余时间，还没有处理任何文件时无法估计
+    std::optional<double> etaSeconds() const
+    {
+        auto processed = filesProcessed();
+        if (state != IndexJobState::Running || processed == 0 || files_to_index < processed)
+            return std::nullopt;
+        return elapsed_seconds / processed * (files_to_index - processed);
+    }
+
+    bool isFinished() const
+    {
+        return state != IndexJobState::Queued && state != IndexJobState::Running;
+    }
+};
+
+void writeJson(JsonWriter &writer, const IndexJobProgress &progress)
+{
+    writer.beginObject()
+          .key("job_id").value(progress.id)
+          .key("type").value(toString(progress.type))
+          .key("path").value(progress.path)
+          .key("state").value(toString(progress.state))
+          .key("error").value(progress.error)
+          .key("files_scanned").value(progress.files_scanned)
+          .key("files_to_index").value(progress.files_to_index)
+          .key("files_indexed").value(progress.files_indexed)
+          .key("files_skipped").value(progress.files_skipped)
+          .key("bytes_indexed").value(progress.bytes_indexed)
+          .key("bytes_per_second").value(progress.bytesPerSecond())
+          .key("elapsed_seconds").value(progress.elapsed_seconds)
+          .key("eta_seconds");
+    if (auto eta = progress.etaSeconds())
+        writer.value(*eta);
+    else
+        writer.null();
+    writer.endObject();
+}
+
+// 后台索引任务. 计数器由执行任务的线程更新，http 线程随时读取.
+class IndexJob
+{
+public:
+    IndexJob(uint64_t id_, IndexJobType type_, std::string path_) : id(id_), type(type_), path(std::move(path_)) {}
+
+    uint64_t getId() const { return id; }
+
+    void addScanned(uint64_t n) { files_scanned += n; }
+    void addToIndex(uint64_t n) { files_to_index += n; }
+
+    void addIndexed(uint64_t bytes)
+    {
+        ++files_indexed;
+        bytes_indexed += bytes;
+    }
+
+    void addSkipped() { ++files_skipped; }
+
+    void cancel() { cancelled = true; }
+    bool isCancelled() const { return cancelled; }
+
+    void start()
+    {
+        std::lock_guard lg(lock);
+        state = IndexJobState::Running;
+        start_time = std::chrono::steady_clock::now();
+    }
+
+    void finish(IndexJobState state_, std::string error_ = "")
+    {
+        std::lock_guard lg(lock);
+        if (state == IndexJobState::Running)
+            finish_time = std::chrono::steady_clock::now();
+        state = state_;
+        error = std::move(error_);
+    }
+
+    IndexJobProgress progress() const
+    {
+        IndexJobProgress result;
+        result.id = id;
+        result.type = type;
+        result.path = path;
+        result.files_scanned = files_scanned;
+        result.files_to_index = files_to_index;
+        result.files_indexed = files_indexed;
+        result.files_skipped = files_skipped;
+        result.bytes_indexed = bytes_indexed;
+
+        std::lock_guard lg(lock);
+        result.state = state;
+        result.error = error;
+        if (state != IndexJobState::Queued && start_time)
+        {
+            auto end = state == IndexJobState::Running ? std::chrono::steady_clock::now() : finish_time.value_or(*start_time);
+            result.elapsed_seconds = std::chrono::duration<double>(end - *start_time).count();
+        }
+        return result;
+    }
+
+private:
+    const uint64_t id;
+    const IndexJobType type;
+    const std::string path;
+
+    std::atomic_uint64_t files_scanned = 0, files_to_index = 0, files_indexed = 0, files_skipped = 0,
+                       bytes_indexed = 0;
+    std::atomic_bool cancelled = false;
+
+    mutable std::mutex lock;
+    IndexJobState state = IndexJobState::Queued;
+    std::string error;
+    std::optional<std::chrono::steady_clock::time_point> start_time, finish_time;
+};
+
+// 单个后台线程按提交顺序执行索引任务，http 请求只负责提交并立即返回任务 id.
+// 最近 INDEX_JOB_HISTORY_SIZE 个已结束的任务保留状态以供查询.
+class IndexJobQueue
+{
+public:
+    using Task = std::function<void(IndexJob&)>;
+
+    IndexJobQueue() : worker([this] { work(); }) {}
+
+    ~IndexJobQueue()
+    {
+        stop();
+    }
+
+    uint64_t submit(IndexJobType type, const std::string& path, Task task)
+    {
+        std::lock_guard lg(lock);
+        if (stopped)
+            THROW(Poco::IllegalStateException("index job queue has been stopped"));
+        auto job = std::make_shared<IndexJob>(++last_id, type, path);
+        jobs.emplace(job->getId(), job);
+        pending.emplace_back(job, std::move(task));
+        cv.notify_one();
+        return job->getId();
+    }
+
+    std::optional<IndexJobProgress> getJob(uint64_t id) const
+    {
+        std::lock_guard lg(lock);
+        auto iter = jobs.find(id);
+        if (iter == jobs.end())
+            return std::nullopt;
+        return iter->second->progress();
+    }
+
+    // 按提交顺序返回保留的所有任务
+    std::vector<IndexJobProgress> getJobs() const
+    {
+        std::lock_guard lg(lock);
+        std::vector<IndexJobProgress> result;
+        result.reserve(jobs.size());
+        for (const auto& [_, job] : jobs)
+            result.push_back(job->progress());
+        return result;
+    }
+
+    // 取消排队中的任务，通知正在执行的任务尽快结束，并等待后台线程退出
+    void stop()
+    {
+        {
+            std::lock_guard lg(lock);
+            if (stopped)
+                return;
+            stopped = true;
+            for (auto& [job, _] : pending)
+                job->finish(IndexJobState::Cancelled);
+            pending.clear();
+            if (running)
+                running->cancel();
+        }
+        cv.notify_one();
+        worker.join();
+    }
+
+private:
+    void work()
+    {
+        while (true)
+        {
+            std::shared_ptr<IndexJob> job;
+            Task task;
+            {
+                std::unique_lock lk(lock);
+                cv.wait(lk, [this] { return stopped || !pending.empty(); });
+                if (stopped)
+                    return;
+                std::tie(job, task) = std::move(pending.front());
+                pending.pop_front();
+                running = job;
+            }
+
+            job->start();
+            try
+            {
+                task(*job);
+                job->finish(job->isCancelled() ? IndexJobState::Cancelled : IndexJobState::Succeeded);
+            }
+            catch (Poco::Exception& e)
+            {
+                job->finish(IndexJobState::Failed, e.displayText());
+            }
+            catch (std::exception& e)
+            {
+                job->finish(IndexJobState::Failed, e.what());
+            }
+            if (job->progress().state == IndexJobState::Failed)
+                httpLog("index job " + std::to_string(job->getId()) + " failed: " + job->progress().error);
+
+            std::lock_guard lg(lock);
+            running.reset();
+            pruneFinished();
+        }
+    }
+
+    // caller holds lock
+    void pruneFinished()
+    {
+        size_t finished = 0;
+        for (const auto& [_, job] : jobs)
+            finished += job->progress().isFinished();
+        for (auto iter = jobs.begin(); iter != jobs.end() && finished > INDEX_JOB_HISTORY_SIZE;)
+        {
+            if (iter->second->progress().isFinished())
+            {
+                iter = jobs.erase(iter);
+                --finished;
+            }
+            else
+                ++iter;
+        }
+    }
+
+    mutable std::mutex lock;
+    std::condition_variable cv;
+    bool stopped = false;
+    uint64_t last_id = 0;
+    std::deque<std::pair<std::shared_ptr<IndexJob>, Task>> pending;
+    std::shared_ptr<IndexJob> running;
+    std::map<uint64_t, std::shared_ptr<IndexJob>> jobs; // id -> job
+
+    std::thread worker; // 最后初始化，保证启动时其他成员已经构造完成
+};
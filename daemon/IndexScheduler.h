@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../typedefs.h"
+#include <cmath>
+
+// 一轮定时索引中允许使用的资源：耗时（CPU）、读取的字节数（IO）、索引的文件数.
+// 任一项用尽即停止，剩余的文件留到下一轮继续.
+class IndexBudget
+{
+public:
+    IndexBudget(double seconds_, uint64_t bytes_, uint64_t files_)
+        : limit_seconds(seconds_), limit_bytes(bytes_), limit_files(files_) {}
+
+    static IndexBudget perDatabase()
+    {
+        return IndexBudget(DAEMON_DB_SECONDS_PER_CYCLE, DAEMON_DB_BYTES_PER_CYCLE, DAEMON_DB_FILES_PER_CYCLE);
+    }
+
+    // 从剩余额度中划出一份给单个 path，不超过 path 自己的配额
+    IndexBudget slicePerPath() const
+    {
+        return IndexBudget(std::min(DAEMON_PATH_SECONDS_PER_CYCLE, std::max(0.0, limit_seconds - used_seconds)),
+                           std::min(DAEMON_PATH_BYTES_PER_CYCLE, limit_bytes - std::min(limit_bytes, used_bytes)),
+                           std::min(DAEMON_PATH_FILES_PER_CYCLE, limit_files - std::min(limit_files, used_files)));
+    }
+
+    // ignore_seconds 时只看字节数与文件数，用于保证每轮的最少进度
+    bool exhausted(bool ignore_seconds = false) const
+    {
+        return (!ignore_seconds && used_seconds >= limit_seconds) || used_bytes >= limit_bytes || used_files >= limit_files;
+    }
+
+    void consume(double seconds, uint64_t bytes = 0, uint64_t files = 0)
+    {
+        used_seconds += seconds;
+        used_bytes += bytes;
+        used_files += files;
+    }
+
+    // 把 slice 的用量计入自身
+    void charge(const IndexBudget& slice)
+    {
+        consume(slice.used_seconds, slice.used_bytes, slice.used_files);
+    }
+
+    double getUsedSeconds() const { return used_seconds; }
+    uint64_t getUsedBytes() const { return used_bytes; }
+    uint64_t getUsedFiles() const { return used_files; }
+
+private:
+    double limit_seconds;
+    uint64_t limit_bytes;
+    uint64_t limit_files;
+
+    double used_seconds = 0;
+    uint64_t used_bytes = 0;
+    uint64_t used_files = 0;
+};
+
+// path 的调度优先级，越大越先处理.
+// 最近发生变化的 path 最优先（按 DAEMON_RECENT_CHANGE_HALF_LIFE_SECONDS 衰减），其次是其中文档被查询得多的 path；
+// 上一轮没有处理完的 path 额外加分，保证积压在之后几轮内完成.
+double indexPriority(double seconds_since_change, uint64_t query_freq, uint64_t backlog)
+{
+    double recency = std::exp2(-std::max(0.0, seconds_since_change) / DAEMON_RECENT_CHANGE_HALF_LIFE_SECONDS);
+    return 4 * recency + std::log10(1.0 + static_cast<double>(query_freq)) + (backlog > 0 ? 1 : 0);
+}
+
+struct PathPriority
+{
+    std::string path;
+    double priority;
+    uint64_t backlog;
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "../typedefs.h"
+#include "utils/TimeUtils.h"
+#include <condition_variable>
+#include <deque>
+
+// 所有 database 共用的索引线程池. 每个 database 一个任务队列，同一队列的任务按顺序执行、同一时刻最多一个在执行；
+// 空闲线程从上次选中队列的下一个开始轮询，因此积压严重的 database 不会推迟其他 database 的索引.
+class IndexingExecutor
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit IndexingExecutor(size_t thread_num = DAEMON_THREADS)
+    {
+        for (size_t i = 0; i < std::max<size_t>(1, thread_num); i++)
+            workers.emplace_back([this] { work(); });
+    }
+
+    IndexingExecutor(const IndexingExecutor&) = delete;
+    IndexingExecutor& operator=(const IndexingExecutor&) = delete;
+
+    // 丢弃未执行的任务，等待正在执行的任务结束
+    ~IndexingExecutor()
+    {
+        {
+            std::lock_guard lg(lock);
+            stopped = true;
+            for (auto& queue : queues)
+                queue.tasks.clear();
+        }
+        cv.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    // 返回新队列的编号，优先复用已移除队列的编号
+    size_t addQueue()
+    {
+        std::lock_guard lg(lock);
+        if (!free_queues.empty())
+        {
+            size_t queue_id = free_queues.back();
+            free_queues.pop_back();
+            return queue_id;
+        }
+        queues.emplace_back();
+        return queues.size() - 1;
+    }
+
+    // 丢弃队列中未执行的任务并等待正在执行的任务结束，之后编号可以被 addQueue 复用.
+    // 调用方保证移除后不再向该队列提交任务.
+    void removeQueue(size_t queue_id)
+    {
+        std::unique_lock lk(lock);
+        auto& queue = queues.at(queue_id);
+        queue.tasks.clear();
+        idle_cv.wait(lk, [&] { return !queue.running; });
+        free_queues.push_back(queue_id);
+    }
+
+    void submit(size_t queue_id, Task task)
+    {
+        {
+            std::lock_guard lg(lock);
+            queues.at(queue_id).tasks.push_back(std::move(task));
+        }
+        cv.notify_one();
+    }
+
+    // 队列中没有等待或正在执行的任务
+    bool isIdle(size_t queue_id) const
+    {
+        std::lock_guard lg(lock);
+        const auto& queue = queues.at(queue_id);
+        return queue.tasks.empty() && !queue.running;
+    }
+
+    void waitIdle()
+    {
+        std::unique_lock lk(lock);
+        idle_cv.wait(lk, [this] {
+            return std::all_of(queues.begin(), queues.end(), [](const Queue& queue) { return queue.tasks.empty() && !queue.running; });
+        });
+    }
+
+private:
+    struct Queue
+    {
+        std::deque<Task> tasks;
+        bool running = false;
+    };
+
+    // caller holds lock. 从 next_queue 开始找第一个有任务且没有任务在执行的队列
+    std::optional<size_t> pickQueue() const
+    {
+        for (size_t i = 0; i < queues.size(); i++)
+        {
+            size_t index = (next_queue + i) % queues.size();
+            if (!queues[index].tasks.empty() && !queues[index].running)
+                return index;
+        }
+        return std::nullopt;
+    }
+
+    void work()
+    {
+        std::unique_lock lk(lock);
+        while (true)
+        {
+            std::optional<size_t> index;
+            cv.wait(lk, [&] { return stopped || (index = pickQueue()).has_value(); });
+            if (stopped)
+                return;
+
+            auto& queue = queues[*index];
+            auto task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            queue.running = true;
+            next_queue = *index + 1;
+
+            lk.unlock();
+            try
+            {
+                task();
+            }
+            catch (Poco::Exception& e)
+            {
+                httpLog("indexing task failed: " + e.displayText());
+            }
+            catch (std::exception& e)
+            {
+                httpLog(std::string("indexing task failed: ") + e.what());
+            }
+            lk.lock();
+
+            queues[*index].running = false;
+            // 同一队列的下一个任务可能在等待本任务结束
+            cv.notify_all();
+            idle_cv.notify_all();
+        }
+    }
+
+    mutable std::mutex lock;
+    std::condition_variable cv, idle_cv;
+    std::deque<Queue> queues; // deque: 增加队列时不移动已有队列
+    std::vector<size_t> free_queues;
+    size_t next_queue = 0;
+    bool stopped = false;
+
+    std::vector<std::thread> workers;
+};
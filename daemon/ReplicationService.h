@@ -0,0 +1,149 @@
+#pragma once
+
+#include "../typedefs.h"
+#include "DatabaseRegistry.h"
+#include "storage/Replication.h"
+
+// primary 端：定时为已加载且索引发生变化的 database 生成快照
+class SnapshotPublishers
+{
+public:
+    explicit SnapshotPublishers(DatabaseRegistry& registry_) : registry(registry_) {}
+
+    void run(Poco::Timer&)
+    {
+        publishAll();
+    }
+
+    void publishAll()
+    {
+        std::lock_guard lg(lock);
+        registry.forEachLoaded([this](const std::string& db_name, const std::shared_ptr<DatabaseRegistry::Tenant>& tenant) {
+            auto& entry = publishers[db_name];
+            if (entry.tenant.lock() != tenant) // 卸载后重新加载，database 对象已经不同
+                entry = Entry{tenant, std::make_unique<SnapshotPublisher>(*tenant->db)};
+            try
+            {
+                if (auto version = entry.publisher->publish())
+                    httpLog("database " + db_name + " published snapshot " + std::to_string(*version));
+            }
+            catch (Poco::Exception& e)
+            {
+                httpLog("database " + db_name + " failed to publish snapshot: " + e.displayText());
+            }
+            catch (std::exception& e)
+            {
+                httpLog("database " + db_name + " failed to publish snapshot: " + e.what());
+            }
+        });
+    }
+
+private:
+    struct Entry
+    {
+        std::weak_ptr<DatabaseRegistry::Tenant> tenant;
+        std::unique_ptr<SnapshotPublisher> publisher;
+    };
+
+    DatabaseRegistry& registry;
+    std::mutex lock;
+    std::unordered_map<std::string, Entry> publishers;
+};
+
+// replica 端：database 加载时、交出 Lease 之前先同步一次，之后定时为已加载的 database 拉取 primary 的最新快照.
+// 失败时保留当前索引，下一轮重试
+class SnapshotFollowers
+{
+public:
+    using SourceFactory = std::function<std::unique_ptr<ReplicationSource>(const std::string& db_name)>;
+
+    SnapshotFollowers(DatabaseRegistry& registry_, SourceFactory make_source_) : registry(registry_), make_source(std::move(make_source_))
+    {
+        registry.setLoadHook([this](const std::string& db_name, const std::shared_ptr<DatabaseRegistry::Tenant>& tenant) {
+            syncOne(db_name, tenant);
+        });
+    }
+
+    ~SnapshotFollowers()
+    {
+        registry.setLoadHook(nullptr);
+    }
+
+    void run(Poco::Timer&)
+    {
+        syncAll();
+    }
+
+    void syncAll()
+    {
+        registry.forEachLoaded([this](const std::string& db_name, const std::shared_ptr<DatabaseRegistry::Tenant>& tenant) {
+            syncOne(db_name, tenant);
+        });
+    }
+
+    // 尚未复制过或没有加载时返回空
+    std::optional<uint64_t> getAppliedVersion(const std::string& db_name)
+    {
+        std::shared_ptr<Entry> entry;
+        {
+            std::lock_guard lg(lock);
+            auto iter = followers.find(db_name);
+            if (iter == followers.end())
+                return std::nullopt;
+            entry = iter->second;
+        }
+        std::lock_guard sync_lg(entry->sync_lock);
+        if (!entry->follower || entry->tenant.expired())
+            return std::nullopt;
+        return entry->follower->getAppliedVersion();
+    }
+
+private:
+    struct Entry
+    {
+        std::mutex sync_lock; // 同一 database 的同步串行执行，不同 database 之间互不阻塞
+        std::weak_ptr<DatabaseRegistry::Tenant> tenant;
+        std::unique_ptr<ReplicationSource> source; // 为空表示该 database 没有 primary
+        std::unique_ptr<SnapshotFollower> follower;
+    };
+
+    void syncOne(const std::string& db_name, const std::shared_ptr<DatabaseRegistry::Tenant>& tenant)
+    {
+        std::shared_ptr<Entry> entry;
+        {
+            std::lock_guard lg(lock);
+            auto& entry_ref = followers[db_name];
+            if (!entry_ref)
+                entry_ref = std::make_shared<Entry>();
+            entry = entry_ref;
+        }
+
+        std::lock_guard sync_lg(entry->sync_lock);
+        try
+        {
+            if (entry->tenant.lock() != tenant) // 卸载后重新加载，database 对象已经不同
+            {
+                entry->tenant = tenant;
+                entry->follower.reset();
+                entry->source = make_source(db_name);
+                if (entry->source)
+                    entry->follower = std::make_unique<SnapshotFollower>(*tenant->db, *entry->source);
+            }
+            if (entry->follower && entry->follower->sync())
+                httpLog("database " + db_name + " replicated snapshot " + std::to_string(entry->follower->getAppliedVersion()));
+        }
+        catch (Poco::Exception& e)
+        {
+            httpLog("database " + db_name + " failed to replicate: " + e.displayText());
+        }
+        catch (std::exception& e)
+        {
+            httpLog("database " + db_name + " failed to replicate: " + e.what());
+        }
+    }
+
+    DatabaseRegistry& registry;
+    SourceFactory make_source;
+    std::mutex lock; // 只保护 followers
+    std::unordered_map<std::string, std::shared_ptr<Entry>> followers;
+};
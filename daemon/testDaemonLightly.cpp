@@ -1,4 +1,6 @@
 #include "Daemon.h"
+#include "DatabaseRegistry.h"
+#include <future>
 
 TEST(Daemon, gatherExistedFiles)
 {
@@ -52,6 +54,49 @@ TEST(Daemon, gatherExistedFilesEmpty)
     EXPECT_EQ(files.empty(), true);
 }
 
+TEST(Daemon, directoryWalker)
+{
+    auto root = ROOT_PATH + "/articles-walk";
+    std::filesystem::remove_all(root);
+    for (const auto& dir : {"/a/b/c", "/a/d", "/e"})
+        std::filesystem::create_directories(root + dir);
+    for (const auto& file : {"/1.txt", "/a/2.txt", "/a/b/c/3.json", "/a/d/4.md", "/e/ignored.csv"})
+        std::ofstream(root + file) << "hello";
+    std::filesystem::create_directory_symlink(root + "/a", root + "/e/link");
+
+    std::unordered_set<std::string> expected_files{root + "/1.txt", root + "/a/2.txt", root + "/a/b/c/3.json", root + "/a/d/4.md"};
+    EXPECT_EQ(DirectoryWalker(1).walk(root).files, expected_files);
+    EXPECT_EQ(DirectoryWalker(4).walk(root + "/").files.size(), expected_files.size());
+
+    // 目录 mtime 足够早时条目被缓存，目录发生变化后重新读取
+    auto past = std::filesystem::file_time_type::clock::now() - std::chrono::hours(1);
+    for (const auto& dir : {"", "/a", "/a/b", "/a/b/c", "/a/d", "/e"})
+        std::filesystem::last_write_time(root + dir, past);
+    DirectoryCache cache;
+    EXPECT_EQ(DirectoryWalker(4, &cache).walk(root).files, expected_files);
+    EXPECT_EQ(cache.size(), 6);
+
+    std::ofstream(root + "/a/d/5.txt") << "world";
+    expected_files.insert(root + "/a/d/5.txt");
+    EXPECT_EQ(DirectoryWalker(4, &cache).walk(root).files, expected_files);
+
+    std::filesystem::remove_all(root + "/a/b");
+    auto result = DirectoryWalker(4, &cache).walk(root);
+    EXPECT_EQ(result.files.size(), 4);
+    EXPECT_TRUE(result.failed_directories.empty());
+    EXPECT_EQ(cache.size(), 4); // a/b、a/b/c 已删除
+
+    std::filesystem::remove_all(root);
+}
+
+TEST(Daemon, walkResultFailedDirectory)
+{
+    WalkResult result{.failed_directories = {"/a/b"}};
+    EXPECT_TRUE(result.isInFailedDirectory("/a/b/c.txt"));
+    EXPECT_FALSE(result.isInFailedDirectory("/a/bc.txt"));
+    EXPECT_FALSE(result.isInFailedDirectory("/a/b"));
+}
+
 TEST(Daemon, bigFiles)
 {
     Database db(ROOT_PATH + "/database1", true);
@@ -65,12 +110,75 @@ TEST(Daemon, bigFiles)
     Poco::TimerCallback<FileSystemDaemons> callback(daemons, &FileSystemDaemons::run);
     timer.start(callback);
 
-    // 测试初始化
+    // 测试初始化：文件数不再被截断
     file_system_daemon->addPath(ROOT_PATH + "/articles-cnn");
     sleep(interval_seconds * 3);
-    EXPECT_EQ(db.maxAllocatedDocId(), 5000);
+    EXPECT_EQ(file_system_daemon->getBacklog(), 0);
+    EXPECT_EQ(db.maxAllocatedDocId(), 6015);
+
+    EXPECT_EQ(file_system_daemon->getPaths()[ROOT_PATH + "/articles-cnn"].size(), 6015);
+}
+
+TEST(Daemon, indexBudget)
+{
+    auto root = ROOT_PATH + "/articles-budget";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directory(root);
+
+    Database db(ROOT_PATH + "/database1", true);
+    FileSystemDaemon daemon(db);
+    daemon.addPath(root);
+    for (int i = 0; i < 5; i++)
+        std::ofstream(root + "/" + std::to_string(i) + ".txt") << "hello world";
+
+    // 预算用完后剩余文件留到下一轮
+    IndexBudget budget(60, 1 << 30, 2);
+    EXPECT_TRUE(daemon.indexPathWithBudget(root, budget));
+    EXPECT_EQ(budget.getUsedFiles(), 2);
+    EXPECT_TRUE(budget.exhausted());
+    EXPECT_EQ(daemon.getBacklog(), 3);
+    EXPECT_EQ(db.getDocumentCount(), 2);
+
+    IndexBudget next_budget(60, 1 << 30, 100);
+    EXPECT_TRUE(daemon.indexPathWithBudget(root, next_budget));
+    EXPECT_EQ(daemon.getBacklog(), 0);
+    EXPECT_EQ(db.getDocumentCount(), 5);
 
-    EXPECT_EQ(file_system_daemon->getPaths()[ROOT_PATH + "/articles-cnn"].size(), 5000);
+    std::filesystem::remove_all(root);
+}
+
+TEST(Daemon, indexBudgetScanExceedsSlice)
+{
+    auto root = ROOT_PATH + "/articles-budget";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directory(root);
+
+    Database db(ROOT_PATH + "/database1", true);
+    FileSystemDaemon daemon(db);
+    daemon.addPath(root);
+    const uint64_t files = DAEMON_PATH_MIN_FILES_PER_CYCLE * 2 + 1;
+    for (uint64_t i = 0; i < files; i++)
+        std::ofstream(root + "/" + std::to_string(i) + ".txt") << "hello world";
+
+    // 时间预算在扫描后就已用完，每轮仍至少索引 DAEMON_PATH_MIN_FILES_PER_CYCLE 个文件
+    uint64_t backlog = files;
+    for (int cycle = 0; cycle < 3; cycle++)
+    {
+        IndexBudget budget(0, 1 << 30, 100);
+        EXPECT_TRUE(daemon.indexPathWithBudget(root, budget));
+        EXPECT_EQ(daemon.getBacklog(), backlog - std::min(backlog, DAEMON_PATH_MIN_FILES_PER_CYCLE));
+        backlog = daemon.getBacklog();
+    }
+    EXPECT_EQ(db.getDocumentCount(), files);
+
+    std::filesystem::remove_all(root);
+}
+
+TEST(Daemon, indexPriority)
+{
+    EXPECT_GT(indexPriority(0, 0, 0), indexPriority(3600, 0, 0));
+    EXPECT_GT(indexPriority(3600, 1000, 0), indexPriority(3600, 10, 0));
+    EXPECT_GT(indexPriority(3600, 0, 100), indexPriority(3600, 0, 0));
 }
 
 TEST(Daemon, deserialize)
@@ -94,6 +202,212 @@ TEST(Daemon, deserialize)
     ASSERT_EQ(paths.contains("/c"), false);
 }
 
+TEST(Daemon, rebuildPersistsPaths)
+{
+    auto root = ROOT_PATH + "/articles-rebuild";
+    auto db_path = ROOT_PATH + "/database1", crashed_path = ROOT_PATH + "/database-crashed";
+    std::filesystem::remove_all(root);
+    std::filesystem::remove_all(db_path);
+    std::filesystem::create_directory(root);
+    for (int i = 0; i < 3; i++)
+        std::ofstream(root + "/" + std::to_string(i) + ".txt") << "hello world " << i;
+
+    {
+        Database db(db_path, true);
+        FileSystemDaemon daemon(db);
+        daemon.addPath(root);
+        std::ofstream(root + "/0.txt") << "hello again";
+        std::filesystem::last_write_time(root + "/0.txt", std::filesystem::last_write_time(root + "/0.txt") + std::chrono::seconds(10));
+        daemon.addPath(root); // 0.txt 重新索引为 doc 4
+        daemon.rebuildAllPaths(); // doc_id 重新分配为 1 ~ 3
+
+        // 模拟重建后崩溃：析构之前复制 database 目录
+        std::filesystem::remove_all(crashed_path);
+        std::filesystem::copy(db_path, crashed_path, std::filesystem::copy_options::recursive);
+    }
+
+    Database db(crashed_path, false);
+    FileSystemDaemon daemon(db);
+    auto files = daemon.getPaths()[root];
+    ASSERT_EQ(files.size(), 3);
+    EXPECT_EQ(db.maxAllocatedDocId(), 3);
+    for (const auto& [file_path, doc_id] : files)
+    {
+        auto document_ptr = db.findDocument(doc_id);
+        ASSERT_NE(document_ptr, nullptr) << file_path;
+        EXPECT_EQ(document_ptr->getPath(), file_path);
+    }
+
+    std::filesystem::remove_all(root);
+    std::filesystem::remove_all(crashed_path);
+}
+
+TEST(IndexJob, queue)
+{
+    IndexJobQueue queue;
+    auto ok = queue.submit(IndexJobType::AddPath, "/a", [](IndexJob& job) {
+        job.addScanned(3);
+        job.addToIndex(3);
+        job.addIndexed(10);
+        job.addIndexed(20);
+        job.addSkipped();
+    });
+    auto bad = queue.submit(IndexJobType::RebuildAll, "", [](IndexJob&) {
+        THROW(Poco::IOException("disk error"));
+    });
+    while (!queue.getJob(bad)->isFinished())
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    auto ok_job = queue.getJob(ok);
+    ASSERT_TRUE(ok_job.has_value());
+    EXPECT_EQ(ok_job->state, IndexJobState::Succeeded);
+    EXPECT_EQ(ok_job->files_scanned, 3);
+    EXPECT_EQ(ok_job->files_indexed, 2);
+    EXPECT_EQ(ok_job->files_skipped, 1);
+    EXPECT_EQ(ok_job->filesProcessed(), 3);
+    EXPECT_EQ(ok_job->bytes_indexed, 30);
+    EXPECT_EQ(queue.getJob(bad)->state, IndexJobState::Failed);
+    EXPECT_FALSE(queue.getJob(bad)->error.empty());
+    EXPECT_FALSE(queue.getJob(bad + 1).has_value());
+    EXPECT_EQ(queue.getJobs().size(), 2);
+
+    // stop 通知正在执行的任务取消，排队中的任务不再执行
+    auto endless = queue.submit(IndexJobType::AddPath, "/b", [](IndexJob& job) {
+        while (!job.isCancelled())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    });
+    auto queued = queue.submit(IndexJobType::AddPath, "/c", [](IndexJob&) {});
+    while (queue.getJob(endless)->state != IndexJobState::Running)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    queue.stop();
+    EXPECT_EQ(queue.getJob(endless)->state, IndexJobState::Cancelled);
+    EXPECT_EQ(queue.getJob(queued)->state, IndexJobState::Cancelled);
+}
+
+TEST(IndexingExecutor, fairness)
+{
+    IndexingExecutor executor(1);
+    auto a = executor.addQueue(), b = executor.addQueue();
+
+    std::mutex order_lock;
+    std::string order;
+    auto record = [&](char name) {
+        return [&, name] {
+            std::lock_guard lg(order_lock);
+            order.push_back(name);
+        };
+    };
+
+    // 第一个任务阻塞唯一的线程，等所有任务入队后再放行
+    std::promise<void> gate;
+    auto gate_future = gate.get_future();
+    executor.submit(a, [&] {
+        gate_future.wait();
+        record('a')();
+    });
+    for (int i = 0; i < 2; i++)
+        executor.submit(a, record('a'));
+    for (int i = 0; i < 3; i++)
+        executor.submit(b, record('b'));
+    gate.set_value();
+    executor.waitIdle();
+
+    // 两个队列轮流执行
+    EXPECT_EQ(order, "ababab");
+    EXPECT_TRUE(executor.isIdle(a));
+    EXPECT_TRUE(executor.isIdle(b));
+}
+
+TEST(IndexingExecutor, serialPerQueue)
+{
+    IndexingExecutor executor(4);
+    auto queue = executor.addQueue();
+    std::atomic_int running = 0, max_running = 0;
+    for (int i = 0; i < 20; i++)
+    {
+        executor.submit(queue, [&] {
+            max_running = std::max(max_running.load(), ++running);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            --running;
+        });
+    }
+    executor.waitIdle();
+    EXPECT_EQ(max_running, 1);
+}
+
+TEST(DatabaseRegistry, leaseAndEvict)
+{
+    auto root = ROOT_PATH + "/database-registry";
+    auto articles = ROOT_PATH + "/articles-registry";
+    std::filesystem::remove_all(root);
+    std::filesystem::remove_all(articles);
+    std::filesystem::create_directories(articles);
+    std::ofstream(articles + "/1.txt") << "hello registry";
+
+    FileSystemDaemons daemons(1);
+    auto now = DatabaseRegistry::Clock::now();
+    {
+        DatabaseRegistry registry(root, daemons, std::chrono::seconds(60), 1024 * 1024 * 1024);
+        EXPECT_FALSE(registry.isLoaded("a"));
+        {
+            auto lease = registry.acquire("a");
+            EXPECT_TRUE(registry.isLoaded("a"));
+            lease.getDaemon().addPath(articles);
+            EXPECT_EQ(lease.getDatabase().getDocumentCount(), 1);
+            // 持有 Lease 时不会被卸载
+            EXPECT_EQ(registry.evict(now + std::chrono::hours(1)), 0);
+        }
+        EXPECT_EQ(registry.evict(DatabaseRegistry::Clock::now()), 0);
+        EXPECT_EQ(registry.evict(DatabaseRegistry::Clock::now() + std::chrono::seconds(61)), 1);
+        EXPECT_FALSE(registry.isLoaded("a"));
+
+        // 重新加载时恢复持久化的索引
+        EXPECT_EQ(registry.acquire("a").getDatabase().getDocumentCount(), 1);
+        EXPECT_GT(registry.getMemoryBytes(), 0);
+    }
+
+    // 超出内存预算时卸载最久未访问的 database
+    DatabaseRegistry registry(root, daemons, std::chrono::seconds(60), 1);
+    registry.acquire("a");
+    {
+        auto lease = registry.acquire("b");
+        // 加载时不在请求线程中卸载其他 database，由定时器执行
+        EXPECT_TRUE(registry.isLoaded("a"));
+        EXPECT_EQ(registry.evict(DatabaseRegistry::Clock::now()), 1);
+        EXPECT_FALSE(registry.isLoaded("a"));
+        EXPECT_TRUE(registry.isLoaded("b"));
+    }
+    EXPECT_EQ(registry.getLoadedCount(), 1);
+
+    std::filesystem::remove_all(articles);
+}
+
+TEST(DatabaseRegistry, loadHook)
+{
+    auto root = ROOT_PATH + "/database-registry";
+    std::filesystem::remove_all(root);
+
+    FileSystemDaemons daemons(1);
+    DatabaseRegistry registry(root, daemons, std::chrono::seconds(60), 1024 * 1024 * 1024, true);
+    std::vector<std::string> loaded;
+    // 在交出 Lease 之前调用，例如 replica 先应用最新快照
+    registry.setLoadHook([&loaded, &registry](const std::string& db_name, const std::shared_ptr<DatabaseRegistry::Tenant>& tenant) {
+        EXPECT_FALSE(registry.isLoaded(db_name));
+        tenant->db->addTerm("hook", tenant->db->newDocId(), 0);
+        loaded.push_back(db_name);
+    });
+    {
+        auto lease = registry.acquire("a");
+        EXPECT_NE(lease.getDatabase().findTerm("hook"), nullptr);
+    }
+    registry.acquire("a");
+    EXPECT_EQ(loaded, std::vector<std::string>{"a"});
+
+    registry.evict(DatabaseRegistry::Clock::now() + std::chrono::seconds(61));
+    registry.acquire("a");
+    EXPECT_EQ(loaded.size(), 2);
+}
+
 int main()
 {
     testing::InitGoogleTest();
@@ -9,12 +9,7 @@ Value sumFunction(const Value& value)
     if (!value.isNumber())
         THROW(Poco::InvalidArgumentException("sumFunction() only handle NumberArray type"));
 
-    Number init = 0;
-    value.doArrayHandler<Number>([&init](std::vector<Number>* vec){
-        for (Number number : *vec)
-            init += number;
-    });
-    return init;
+    return value.numberStats().sum;
 }
 
 Value countFunction(const Value& value)
@@ -22,12 +17,7 @@ Value countFunction(const Value& value)
     if (value.isNull())
         THROW(Poco::InvalidArgumentException("countFunction() can't handle NullArray type"));
 
-    int cnt = 0;
-    value.doArrayHandler([&cnt](std::vector<Bool>* vec){ cnt = vec->size(); },
-                         [&cnt](std::vector<Number>* vec){ cnt = vec->size(); },
-                         [&cnt](std::vector<String>* vec){ cnt = vec->size(); },
-                         [&cnt](std::vector<DateTime>* vec){ cnt = vec->size(); });
-    return cnt;
+    return static_cast<Number>(value.visitArray([](const auto& vec) { return vec.size(); }));
 }
 
 Value avgFunction(const Value& value)
@@ -35,79 +25,45 @@ Value avgFunction(const Value& value)
     if (!value.isNumber())
         THROW(Poco::InvalidArgumentException("avgFunction() only handle NumberArray type"));
 
-    Value sum = sumFunction(value);
-    Value count = countFunction(value);
-    return sum.as<Number>() / count.as<Number>();
+    const auto& stats = value.numberStats();
+    return stats.sum / static_cast<Number>(stats.count);
 }
 
 Value maxFunction(const Value& value)
 {
     if (!(value.isNumber() || value.isString() || value.isDateTime()))
         THROW(Poco::InvalidArgumentException("maxFunction() only handle Number/String/DateTime Array type"));
-    Value max;
-
-    value.doArrayHandler(PanicValueArrayHandler<Bool>,
-                         [&max](std::vector<Number>* vec) {
-                             if (vec->empty())
-                                 return;
-                             max = vec->at(0);
-                             for (int i = 1; i < vec->size(); i++)
-                                 if (max < vec->at(i))
-                                     max = vec->at(i);
-                         },
-                         [&max](std::vector<String>* vec) {
-                             if (vec->empty())
-                                 return;
-                             max = vec->at(0);
-                             for (int i = 1; i < vec->size(); i++)
-                                 if (max < vec->at(i))
-                                     max = vec->at(i);
-                         },
-                         [&max](std::vector<DateTime>* vec) {
-                             if (vec->empty())
-                                 return;
-                             max = vec->at(0);
-                             for (int i = 1; i < vec->size(); i++)
-                                 if (max < vec->at(i))
-                                     max = vec->at(i);
-                         });
 
-    return max;
+    // 空数组返回 Null，相同的最大值取第一个
+    if (value.isNumber())
+    {
+        const auto& stats = value.numberStats();
+        return stats.count ? Value(stats.max) : Value();
+    }
+    return value.visitArray([]<typename T>(const std::vector<T>& vec) -> Value {
+        if constexpr (std::is_same_v<T, Bool>)
+            THROW(UnreachableException());
+        else
+            return vec.empty() ? Value() : Value(*std::max_element(vec.begin(), vec.end()));
+    });
 }
 
 Value minFunction(const Value& value)
 {
     if (!(value.isNumber() || value.isString() || value.isDateTime()))
         THROW(Poco::InvalidArgumentException("minFunction() only handle Number/String/DateTime Array type"));
-    Value min;
 
-    value.doArrayHandler(PanicValueArrayHandler<Bool>,
-                         [&min](std::vector<Number>* vec) {
-                             if (vec->empty())
-                                 return;
-                             min = vec->at(0);
-                             for (int i = 1; i < vec->size(); i++)
-                                 if (min > vec->at(i))
-                                     min = vec->at(i);
-                         },
-                         [&min](std::vector<String>* vec) {
-                             if (vec->empty())
-                                 return;
-                             min = vec->at(0);
-                             for (int i = 1; i < vec->size(); i++)
-                                 if (min > vec->at(i))
-                                     min = vec->at(i);
-                         },
-                         [&min](std::vector<DateTime>* vec) {
-                             if (vec->empty())
-                                 return;
-                             min = vec->at(0);
-                             for (int i = 1; i < vec->size(); i++)
-                                 if (min > vec->at(i))
-                                     min = vec->at(i);
-                         });
-
-    return min;
+    if (value.isNumber())
+    {
+        const auto& stats = value.numberStats();
+        return stats.count ? Value(stats.min) : Value();
+    }
+    return value.visitArray([]<typename T>(const std::vector<T>& vec) -> Value {
+        if constexpr (std::is_same_v<T, Bool>)
+            THROW(UnreachableException());
+        else
+            return vec.empty() ? Value() : Value(*std::min_element(vec.begin(), vec.end()));
+    });
 }
 
 Value valueFunction(const Value& value)
@@ -117,7 +73,7 @@ Value valueFunction(const Value& value)
     return value;
 }
 
-using AggregateFunction = std::function<Value(const Value&)>;
+using AggregateFunction = Value (*)(const Value&);
 
 AggregateFunction getAggByName(std::string agg_name)
 {
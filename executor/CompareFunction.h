@@ -33,7 +33,8 @@ bool compareNotEqual(const Value& v1, const Value& v2)
     return v1 != v2;
 }
 
-bool compareIn(const Value& v1, const Value& v2)
+// <single> in <array>：v2 中是否有与 v1 相等的元素
+bool arrayContains(const Value& v1, const Value& v2)
 {
     if (v1.getValueType() != v2.getValueType())
         THROW(Poco::InvalidArgumentException("Value type isn't compatible in compareIn(): " +
@@ -42,109 +43,34 @@ bool compareIn(const Value& v1, const Value& v2)
     if (v1.isArray() || !v2.isArray())
         THROW(Poco::InvalidArgumentException("we need <single> compareIn <array>"));
 
-    std::function<void(std::vector<Number>*)> numberHandler = PanicValueArrayHandler<Number>;
-    std::function<void(std::vector<String>*)> stringHandler = PanicValueArrayHandler<String>;
-    std::function<void(std::vector<DateTime>*)> datetimeHandler = PanicValueArrayHandler<DateTime>;
-
-    bool isIn = false;
-    switch (v1.getValueType())
-    {
-        case ValueType::Null:
-            return true;
-            THROW(Poco::NotImplementedException()); // TODO: 未实现是因为未确定 null in tuple(null) 的意义
-        case ValueType::Bool:
-            THROW(UnreachableException()); // 未实现是因为 doArrayHandler 不支持 bool
-        case ValueType::Number:
-            numberHandler = [v1, &isIn](std::vector<Number>* vec) {
-                for (Number number : *vec)
-                    if (v1.as<Number>() == number)
-                    {
-                        isIn = true;
-                        break;
-                    }
-            };
-        case ValueType::String:
-            stringHandler = [v1, &isIn](std::vector<String>* vec) {
-                for (String string : *vec)
-                    if (v1.as<String>() == string)
-                    {
-                        isIn = true;
-                        break;
-                    }
-            };
-        case ValueType::DateTime:
-            datetimeHandler = [v1, &isIn](std::vector<DateTime>* vec) {
-                for (DateTime dateTime : *vec)
-                    if (v1.as<DateTime>() == dateTime)
-                    {
-                        isIn = true;
-                        break;
-                    }
-            };
-    }
-
-    v2.doArrayHandler(PanicValueArrayHandler<Bool>, numberHandler, stringHandler, datetimeHandler);
-
-    return isIn;
+    return v2.visitArray([&v1]<typename T>(const std::vector<T>& vec) {
+        if constexpr (std::is_same_v<T, Bool>)
+        {
+            THROW(UnreachableException()); // 未实现是因为查询语法中没有 bool 数组
+            return false;
+        }
+        else
+        {
+            return std::find(vec.begin(), vec.end(), v1.ref<T>()) != vec.end();
+        }
+    });
 }
 
-// TODO: compareIn/NotIn 的唯一区别在于函数体内的所有 true/false 都是相反的 -> 可抽取公共函数
+bool compareIn(const Value& v1, const Value& v2)
+{
+    if (v1.isNull() && v2.isNull()) // TODO: 未确定 null in tuple(null) 的意义
+        return true;
+    return arrayContains(v1, v2);
+}
 
 bool compareNotIn(const Value& v1, const Value& v2)
 {
-    if (v1.getValueType() != v2.getValueType())
-        THROW(Poco::InvalidArgumentException("Value type isn't compatible in compareIn(): " +
-                                             valueTypeToString(v1.getValueType()) + " vs " +
-                                             valueTypeToString(v2.getValueType())));
-    if (v1.isArray() || !v2.isArray())
-        THROW(Poco::InvalidArgumentException("we need <single> compareIn <array>"));
-
-    std::function<void(std::vector<Number>*)> numberHandler = PanicValueArrayHandler<Number>;
-    std::function<void(std::vector<String>*)> stringHandler = PanicValueArrayHandler<String>;
-    std::function<void(std::vector<DateTime>*)> datetimeHandler = PanicValueArrayHandler<DateTime>;
-
-    bool isNotIn = true;
-    switch (v1.getValueType())
-    {
-        case ValueType::Null:
-            return false;
-            THROW(Poco::NotImplementedException()); // TODO: 未实现是因为未确定 null in tuple(null) 的意义
-        case ValueType::Bool:
-            THROW(UnreachableException()); // 未实现是因为 doArrayHandler 不支持 bool
-        case ValueType::Number:
-            numberHandler = [v1, &isNotIn](std::vector<Number>* vec) {
-                for (Number number : *vec)
-                    if (v1.as<Number>() == number)
-                    {
-                        isNotIn = false;
-                        break;
-                    }
-            };
-        case ValueType::String:
-            stringHandler = [v1, &isNotIn](std::vector<String>* vec) {
-                for (String string : *vec)
-                    if (v1.as<String>() == string)
-                    {
-                        isNotIn = false;
-                        break;
-                    }
-            };
-        case ValueType::DateTime:
-            datetimeHandler = [v1, &isNotIn](std::vector<DateTime>* vec) {
-                for (DateTime dateTime : *vec)
-                    if (v1.as<DateTime>() == dateTime)
-                    {
-                        isNotIn = false;
-                        break;
-                    }
-            };
-    }
-
-    v2.doArrayHandler(PanicValueArrayHandler<Bool>, numberHandler, stringHandler, datetimeHandler);
-
-    return isNotIn;
+    if (v1.isNull() && v2.isNull())
+        return false;
+    return !arrayContains(v1, v2);
 }
-using CompareFunction = std::function<bool(const Value&, const Value&)>;
+
+using CompareFunction = bool (*)(const Value&, const Value&);
 
 CompareFunction getCompByType(TokenType comp_type)
 {
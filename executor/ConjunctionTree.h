@@ -17,7 +17,17 @@ struct ConjunctionNode {
         return *this;
     }
 
+    // 与 addChild 相同，但 child 的生命周期由当前节点管理
+    ConjunctionNode& adoptChild(ConjunctionNode* child)
+    {
+        owned_children.emplace_back(child);
+        return addChild(child);
+    }
+
     std::vector<ConjunctionNode*> children;
+
+private:
+    std::vector<std::shared_ptr<ConjunctionNode>> owned_children;
 };
 
 class ConjunctionTree
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "../typedefs.h"
+#include "utils/RoaringBitmap.h"
+
+// 一个 term 或 HAVING predicate 对应的文档集合.
+// term 的 bitmap 一次性算完 (complete)；predicate 的 bitmap 随着查询逐步填充，evaluated 记录哪些文档已经算过.
+class FilterBitmap
+{
+public:
+    // 完整的 bitmap
+    explicit FilterBitmap(RoaringBitmap matched_) : complete(true), matched(std::move(matched_)) {}
+
+    // 逐步填充的 bitmap
+    FilterBitmap() : complete(false) {}
+
+    size_t getBytes() const
+    {
+        std::lock_guard lg(lock);
+        return evaluated.getBytes() + matched.getBytes();
+    }
+
+    // 只对 complete bitmap 有效
+    const RoaringBitmap& getMatched() const
+    {
+        assert(complete);
+        return matched;
+    }
+
+    // 未计算过时返回 std::nullopt
+    std::optional<bool> test(size_t doc_id) const
+    {
+        if (complete)
+            return matched.contains(doc_id);
+        std::lock_guard lg(lock);
+        if (!evaluated.contains(doc_id))
+            return std::nullopt;
+        return matched.contains(doc_id);
+    }
+
+    void record(size_t doc_id, bool is_matched)
+    {
+        if (complete)
+            return;
+        std::lock_guard lg(lock);
+        evaluated.add(doc_id);
+        if (is_matched)
+            matched.add(doc_id);
+    }
+
+private:
+    const bool complete;
+    mutable std::mutex lock;
+    RoaringBitmap evaluated;
+    RoaringBitmap matched;
+};
+using FilterBitmapPtr = std::shared_ptr<FilterBitmap>;
+
+// 跨查询复用的 term/predicate bitmap 缓存，按占用字节数做 LRU 淘汰.
+// key 形如 "term:<word>" 或 "having:<predicate>"，条目记录生成时的 generation，索引变化后自然失效.
+class FilterCache
+{
+public:
+    explicit FilterCache(size_t capacity_bytes_ = FILTER_CACHE_CAPACITY_BYTES, size_t min_admission_cost_ = FILTER_CACHE_MIN_ADMISSION_COST)
+        : capacity_bytes(capacity_bytes_), min_admission_cost(min_admission_cost_) {}
+
+    FilterBitmapPtr get(const std::string& key, uint64_t generation)
+    {
+        std::lock_guard lg(lock);
+        auto iter = entries.find(key);
+        if (iter == entries.end() || iter->second.generation != generation)
+        {
+            if (iter != entries.end())
+                erase(iter);
+            ++misses;
+            return nullptr;
+        }
+        lru_list.splice(lru_list.begin(), lru_list, iter->second.lru_iter);
+        ++hits;
+        return iter->second.bitmap;
+    }
+
+    // cost 是重新计算该 bitmap 需要处理的文档数，代价太小的不值得占用缓存.
+    // 逐步填充的 bitmap 在缓存期间会变大，调用方通过 bytes 预估它最终占用的空间.
+    // 返回是否被缓存.
+    bool put(const std::string& key, uint64_t generation, const FilterBitmapPtr& bitmap, size_t cost, std::optional<size_t> bytes = std::nullopt)
+    {
+        size_t charged_bytes = std::max(bytes.value_or(0), bitmap->getBytes());
+        if (cost < min_admission_cost || charged_bytes > capacity_bytes)
+            return false;
+
+        std::lock_guard lg(lock);
+        if (auto iter = entries.find(key); iter != entries.end())
+            erase(iter);
+
+        while (used_bytes + charged_bytes > capacity_bytes)
+            erase(entries.find(lru_list.back()));
+
+        lru_list.push_front(key);
+        entries.emplace(key, Entry{.generation = generation, .bitmap = bitmap, .bytes = charged_bytes, .lru_iter = lru_list.begin()});
+        used_bytes += charged_bytes;
+        return true;
+    }
+
+    void clear()
+    {
+        std::lock_guard lg(lock);
+        entries.clear();
+        lru_list.clear();
+        used_bytes = 0;
+    }
+
+    size_t getUsedBytes() const
+    {
+        std::lock_guard lg(lock);
+        return used_bytes;
+    }
+
+    uint64_t getHits() const
+    {
+        return hits;
+    }
+
+    uint64_t getMisses() const
+    {
+        return misses;
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t generation;
+        FilterBitmapPtr bitmap;
+        size_t bytes; // 计入 used_bytes 的空间
+        std::list<std::string>::iterator lru_iter;
+    };
+
+    // caller holds lock
+    void erase(std::unordered_map<std::string, Entry>::iterator iter)
+    {
+        used_bytes -= iter->second.bytes;
+        lru_list.erase(iter->second.lru_iter);
+        entries.erase(iter);
+    }
+
+    const size_t capacity_bytes;
+    const size_t min_admission_cost;
+
+    mutable std::mutex lock;
+    std::list<std::string> lru_list; // 头部是最近使用的 key
+    std::unordered_map<std::string, Entry> entries;
+    size_t used_bytes = 0;
+
+    std::atomic_uint64_t hits = 0, misses = 0;
+};
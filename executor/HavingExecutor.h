@@ -4,7 +4,6 @@
 
 #include <utility>
 #include "ConjunctionTree.h"
-#include "utils/DynamicBitSet.h"
 #include "Predicate.h"
 
 /*
@@ -27,33 +26,74 @@ public:
             return {true, doc_ids_};
         }
         auto doc_ids = std::any_cast<DocIds>(doc_ids_);
+        prepareBitmaps(root.ptr());
+
         DocIds ret;
         for (size_t doc_id : doc_ids)
         {
-            auto document_ptr = db.findDocument(doc_id);
-            if (!document_ptr)
+            // kvs 建索引后只读，共享而不拷贝
+            auto kvs = db.findKvs(doc_id);
+            if (!kvs)
                 continue;
 
-            auto kvs = document_ptr->getKvs();
-            if (determinePredicate(kvs, root.ptr()))
+            if (determinePredicate(doc_id, *kvs, root.ptr()))
                 ret.emplace(doc_id);
         }
         return {true, ret};
     }
 
+    void clear() override
+    {
+        bitmaps.clear();
+    }
+
 private:
-    bool determinePredicate(const std::unordered_map<Key, Value>& kvs, const ConjunctionNode *node) const
+    // 为每个可缓存的 predicate 找到（或创建）它在 FilterCache 中的 bitmap，同一次执行中复用
+    void prepareBitmaps(const ConjunctionNode *node)
+    {
+        if (auto leaf = dynamic_cast<const LeafNode<Predicate>*>(node))
+        {
+            const auto& key = leaf->data.getCacheKey();
+            if (key.empty() || bitmaps.contains(leaf))
+                return;
+
+            auto& filter_cache = db.getFilterCache();
+            const auto generation = db.getGeneration();
+            auto bitmap = filter_cache.get(key, generation);
+            if (!bitmap)
+            {
+                bitmap = std::make_shared<FilterBitmap>();
+                // bitmap 跨批次、跨查询逐步覆盖全部文档，代价按全部文档数估计，而不是本批次的文档数.
+                // 未被接纳时 bitmap 只在本次执行中使用. 空间按两个覆盖全部文档的位图预估.
+                filter_cache.put(key, generation, bitmap, db.maxAllocatedDocId(), db.maxAllocatedDocId() / 8 * 2);
+            }
+            bitmaps.emplace(leaf, bitmap);
+            return;
+        }
+        for (const ConjunctionNode *child : node->children)
+            prepareBitmaps(child);
+    }
+
+    bool determinePredicate(size_t doc_id, const KVMap& kvs, const ConjunctionNode *node) const
     {
         if (auto leaf = dynamic_cast<const LeafNode<Predicate>*>(node))
         {
             assert(leaf->children.empty());
-            return leaf->data.determine(kvs);
+            auto bitmap_iter = bitmaps.find(leaf);
+            if (bitmap_iter != bitmaps.end())
+                if (auto cached = bitmap_iter->second->test(doc_id))
+                    return *cached;
+
+            bool res = leaf->data.determine(kvs);
+            if (bitmap_iter != bitmaps.end())
+                bitmap_iter->second->record(doc_id, res);
+            return res;
         }
         else if (auto inter = dynamic_cast<const InterNode*>(node))
         {
             std::vector<bool> children_doc_ids;
             for (ConjunctionNode *child_node : node->children)
-                children_doc_ids.push_back(determinePredicate(kvs, child_node));
+                children_doc_ids.push_back(determinePredicate(doc_id, kvs, child_node));
 
             assert(!children_doc_ids.empty()); // AND, OR 至少有一个操作对象
             assert(inter->type != ConjunctionType::NOT || children_doc_ids.size() == 1); // NOT 只有一个操作对象
@@ -85,4 +125,5 @@ private:
     }
 
     ConjunctionTree root;
+    std::unordered_map<const ConjunctionNode*, FilterBitmapPtr> bitmaps;
 };
\ No newline at end of file
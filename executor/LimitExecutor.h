@@ -15,7 +15,7 @@ terms : terms 'AND' terms
 class LimitExecutor : public Executor
 {
 public:
-    LimitExecutor(Database& db_, uint64_t limit_ = 100) : Executor(db_), original_limit(limit_), limit(limit_) {}
+    LimitExecutor(Database& db_, uint64_t limit_ = SEARCH_MAX_RESULTS) : Executor(db_), original_limit(limit_), limit(limit_) {}
 
     // return doc ids
     std::pair<bool, std::any> execute(const std::any& input) override
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "../typedefs.h"
+
+// 短语/邻近查询，作为 ConjunctionTree 的叶子节点数据
+// "a b c"         -> words = {a, b, c}, slop = 0, in_order = true
+// 'a' NEAR/3 'b'  -> words = {a, b}, slop = 3, in_order = false
+struct PhraseQuery
+{
+    std::vector<std::string> words;
+    size_t slop = 0; // 允许夹在词之间的其他词的总数
+    bool in_order = true;
+};
+
+// 每个词在同一文档中的位置列表（升序），判断是否存在满足 slop 的一组位置.
+// 调用方保证 lists 非空且每个列表非空.
+bool matchPositions(const std::vector<const std::vector<uint32_t>*>& lists, size_t slop, bool in_order)
+{
+    assert(!lists.empty());
+    const size_t n = lists.size();
+    if (n == 1)
+        return !lists[0]->empty();
+
+    if (in_order)
+    {
+        // 对每个起点，后续每个词贪心地取最靠前的位置，此时跨度最小
+        std::vector<size_t> cursors(n, 0);
+        for (uint32_t start : *lists[0])
+        {
+            uint32_t prev = start;
+            bool found = true;
+            for (size_t i = 1; i < n; i++)
+            {
+                const auto& list = *lists[i];
+                auto& cursor = cursors[i];
+                // 起点单调递增，游标不需要回退
+                while (cursor < list.size() && list[cursor] <= prev)
+                    cursor++;
+                if (cursor == list.size())
+                    return false; // 更靠后的起点同样找不到
+                prev = list[cursor];
+                if (prev - start - i > slop)
+                {
+                    found = false;
+                    break;
+                }
+            }
+            if (found)
+                return true;
+        }
+        return false;
+    }
+
+    // 无序：同一个词出现多次时（列表相同）需要落在不同的位置上，按列表分组记录需要的位置数.
+    // 不同的词不会出现在同一个位置，合并后用滑动窗口求包含每组所需位置数的最小窗口
+    std::vector<const std::vector<uint32_t>*> groups;
+    std::vector<size_t> needed;
+    for (const auto* list : lists)
+    {
+        auto iter = std::find(groups.begin(), groups.end(), list);
+        if (iter == groups.end())
+        {
+            groups.push_back(list);
+            needed.push_back(1);
+        }
+        else
+            needed[iter - groups.begin()]++;
+    }
+
+    using Position = std::pair<uint32_t, size_t>; // (position, group index)
+    std::vector<Position> merged;
+    for (size_t i = 0; i < groups.size(); i++)
+    {
+        if (groups[i]->size() < needed[i])
+            return false;
+        for (uint32_t pos : *groups[i])
+            merged.emplace_back(pos, i);
+    }
+    std::sort(merged.begin(), merged.end());
+
+    std::vector<size_t> counts(groups.size(), 0);
+    size_t satisfied = 0;
+    for (size_t left = 0, right = 0; right < merged.size(); right++)
+    {
+        auto group = merged[right].second;
+        if (++counts[group] == needed[group])
+            satisfied++;
+        while (satisfied == groups.size())
+        {
+            // n 个词占 n 个不同的位置，至少跨 n - 1
+            if (merged[right].first - merged[left].first <= slop + n - 1)
+                return true;
+            auto left_group = merged[left++].second;
+            if (counts[left_group]-- == needed[left_group])
+                satisfied--;
+        }
+    }
+    return false;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../typedefs.h"
+#include "core/Key.h"
 #include "AggregateFunction.h"
 #include "CompareFunction.h"
 
@@ -13,17 +14,28 @@ where : aggExpr CmpOp valueList;
 
 class Predicate {
 public:
-    Predicate(const AggregateFunction& agg_, const String& id_, const CompareFunction& compare_, const Value& value_)
-        : agg(agg_), id(id_), compare(compare_), value(value_) {}
+    // cache_key 唯一描述该 predicate，非空时其结果会被 FilterCache 跨查询复用.
+    // id 在构造时转为 Key，评估每个文档时只需要按整数查找. id 来自查询，只查找不加入 KeyDictionary，
+    // 没有任何文档含有该字段时为空
+    Predicate(const AggregateFunction& agg_, const String& id_, const CompareFunction& compare_, const Value& value_, std::string cache_key_ = "")
+        : agg(agg_), has_id(!id_.empty()), id(has_id ? Key::lookup(id_) : std::nullopt), compare(compare_), value(value_),
+          cache_key(std::move(cache_key_)) {}
+
+    const std::string& getCacheKey() const
+    {
+        return cache_key;
+    }
 
     bool determine(const std::unordered_map<Key, Value>& kvs) const
     {
         // 无参聚合函数
-        if (id.empty())
+        if (!has_id)
             return compare(agg(Value{}), value);
 
         // 单参聚合函数
-        auto iter = kvs.find(id);
+        if (!id)
+            return false;
+        auto iter = kvs.find(*id);
         if (iter == kvs.end())
             return false;
         if (agg == nullptr)
@@ -35,7 +47,9 @@ public:
 
 private:
     AggregateFunction agg;
-    String id;
+    bool has_id;
+    std::optional<Key> id;
     CompareFunction compare;
     Value value;
+    std::string cache_key;
 };
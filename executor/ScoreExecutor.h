@@ -5,22 +5,26 @@
 
 /*
  by BM25 algorithm.
- TODO: 现在的模型只能处理 AND terms 查询，对于 OR、NOT 等条件，BM25 的评分将偏失
+ word_freq 只包含查询中的肯定词（不含 NOT 下的词），文档不包含的词贡献 0 分
+ global_stats 不为空时用它代替本 database 的文档数、平均词数和文档频率，使多个分片的分数可以比较
 */
 class ScoreExecutor : public Executor
 {
 public:
     // word_freq 表示 word 在 query 中的词频
-    ScoreExecutor(Database& db_, const std::unordered_map<std::string, double>& word_freq_) : Executor(db_), word_freq(word_freq_) {}
+    ScoreExecutor(Database& db_, const std::unordered_map<std::string, double>& word_freq_, CollectionStatisticsPtr global_stats_ = nullptr)
+        : Executor(db_), word_freq(word_freq_), global_stats(std::move(global_stats_)) {}
 
     std::pair<bool, std::any> execute(const std::any &doc_ids_) override
     {
         auto doc_ids = std::any_cast<DocIds>(doc_ids_);
         Scores scores; // score -> doc_id
 
+        double doc_count = global_stats ? global_stats->doc_count : db.getDocumentCount();
+        double avg_word_count = global_stats ? global_stats->avgWordCount() : db.getAvgWordCount();
         for (size_t doc_id : doc_ids)
         {
-            std::optional<double> score = determineScore(doc_id);
+            std::optional<double> score = determineScore(doc_id, doc_count, avg_word_count);
             if (!score.has_value()) // document 已被删除
                 continue;
             scores.emplace(score.value(), doc_id);
@@ -32,10 +36,10 @@ public:
 
 private:
     // 计算查询与指定文档的相关性
-    std::optional<double> determineScore(size_t doc_id) const
+    std::optional<double> determineScore(size_t doc_id, double doc_count, double avg_word_count) const
     {
-        auto document_ptr = db.findDocument(doc_id);
-        if (!document_ptr)
+        auto word_count = db.getWordCount(doc_id);
+        if (!word_count.has_value())
             return std::nullopt;
 
         double score = 0.0;
@@ -50,18 +54,19 @@ private:
             }
 
             // 1.单词权重
-            double df = term_ptr->posting_list.size();
+            std::optional<uint64_t> global_df = global_stats ? global_stats->docFreq(word) : std::nullopt;
+            double df = global_df.value_or(term_ptr->posting_list.size());
             if (df == 0) // TODO: 如果没有任何文档包含此单词（纯 AND terms 不会出现此情况），降低其权重为最低
-                df = db.getDocumentCount();
-            double idf = log((db.getDocumentCount() - df + 0.5) / (df + 0.5));
+                df = doc_count;
+            double idf = log((doc_count - df + 0.5) / (df + 0.5));
 
             // 2.单词与文档的相关性
             auto tf_iter = std::lower_bound(term_ptr->posting_list.begin(), term_ptr->posting_list.end(), doc_id);
             double tf = 0.0;
-            if (tf_iter != term_ptr->posting_list.end())
-                tf = 1.0 * term_ptr->statistics_list[tf_iter - term_ptr->posting_list.begin()].offsets_in_file.size() / document_ptr->getWordCount();
+            if (tf_iter != term_ptr->posting_list.end() && *tf_iter == doc_id) // OR 查询中文档不一定包含每个词
+                tf = 1.0 * term_ptr->statistics_list[tf_iter - term_ptr->posting_list.begin()].offsets_in_file.size() / *word_count;
 
-            double K = k1 * (1 - b + b * (document_ptr->getWordCount() / db.getAvgWordCount()));
+            double K = k1 * (1 - b + b * (*word_count / avg_word_count));
             double sqd = (k1 + 1) * tf / (K + tf);
 
             // 3.单词与查询的相关性
@@ -77,4 +82,5 @@ private:
 
     const double k1 = 1.5, k3 = 1.5, b = 0.75;
     std::unordered_map<std::string, double> word_freq;
+    CollectionStatisticsPtr global_stats;
 };
\ No newline at end of file
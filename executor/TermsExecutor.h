@@ -4,13 +4,16 @@
 
 #include <utility>
 #include "ConjunctionTree.h"
-#include "utils/DynamicBitSet.h"
+#include "PositionalIntersect.h"
+#include "utils/RoaringBitmap.h"
 
 /*
 terms : terms 'AND' terms
     | terms 'OR' terms
     | 'NOT' terms
     | '(' terms ')'
+    | '"' term+ '"'
+    | term 'NEAR/k' term
     | term
     ;
 */
@@ -22,61 +25,85 @@ public:
     // return doc ids
     std::pair<bool, std::any> execute(const std::any& input) override
     {
-        const size_t bit_set_size = db.maxAllocatedDocId();
-
-        size_t cut_num = bit_set_size;
+        size_t cut_num = db.maxAllocatedDocId();
         try {
             cut_num = std::any_cast<size_t>(input);
         } catch (const std::bad_any_cast& e) {}
 
-        DynamicBitSet doc_ids_res(bit_set_size);
-        if (!root) // output all doc_id
-            doc_ids_res.fill_range(last_cut_begin, last_cut_begin + cut_num);
-        else
-            doc_ids_res = recursiveExecute(root.ptr(), bit_set_size, cut_num);
+        // 整棵树只求值一次，之后按 cut_num 分批输出 —— 按 posting list 下标切分只对单个 term 成立，
+        // 对 AND/OR/NOT 会在不同 term 的不同文档区间上求值.
+        if (!matched_doc_ids.has_value())
+            matched_doc_ids = (!root ? allDocIds() : recursiveExecute(root.ptr())).toVector(); // !root: output all doc_id
 
-        if (doc_ids_res.empty())
+        if (last_cut_begin >= matched_doc_ids->size())
             return {false, {}};
 
+        auto cut_begin = matched_doc_ids->begin() + last_cut_begin;
+        auto cut_end = matched_doc_ids->begin() + std::min(last_cut_begin + cut_num, matched_doc_ids->size());
         last_cut_begin += cut_num;
 
-        return {true, doc_ids_res.toUnorderedSet(1)};
+        return {true, DocIds(cut_begin, cut_end)};
+    }
+
+    // 将多个词以同一种逻辑连接词组合成一个节点，例如 CJK 查询被切成的多个二元组. 返回的节点由调用方管理.
+    static ConjunctionNode* makeNode(const std::vector<std::string>& words, ConjunctionType type = ConjunctionType::AND)
+    {
+        if (words.size() == 1)
+            return new LeafNode<std::string>(words[0]);
+        auto inter = new InterNode(type);
+        for (const auto& word : words)
+            inter->adoptChild(new LeafNode<std::string>(word));
+        return inter;
+    }
+
+    static ConjunctionTree makeTree(const std::vector<std::string>& words, ConjunctionType type = ConjunctionType::AND)
+    {
+        return {makeNode(words, type), true};
     }
 
 private:
-    DynamicBitSet recursiveExecute(const ConjunctionNode *node, const size_t bit_set_size, size_t cut_num)
+    RoaringBitmap recursiveExecute(const ConjunctionNode *node)
     {
         if (auto leaf = dynamic_cast<const LeafNode<std::string>*>(node))
         {
             assert(leaf->children.empty());
             auto term_ptr = db.findTerm(leaf->data);
             if (!term_ptr)
-                return DynamicBitSet(bit_set_size);
+                return {};
 
-            return DynamicBitSet(bit_set_size, term_ptr->posting_list, last_cut_begin, last_cut_begin + cut_num);
+            return termBitmap(*term_ptr);
+        }
+        else if (auto phrase = dynamic_cast<const LeafNode<PhraseQuery>*>(node))
+        {
+            return executePhrase(phrase->data);
         }
         else if (auto inter = dynamic_cast<const InterNode*>(node))
         {
-            std::vector<DynamicBitSet> children_doc_ids;
+            std::vector<RoaringBitmap> children_doc_ids;
             for (ConjunctionNode *child_node : node->children)
-                children_doc_ids.push_back(recursiveExecute(child_node, bit_set_size, cut_num));
+                children_doc_ids.push_back(recursiveExecute(child_node));
 
             assert(!children_doc_ids.empty()); // AND, OR 至少有一个操作对象
             assert(inter->type != ConjunctionType::NOT || children_doc_ids.size() == 1); // NOT 只有一个操作对象
 
-            DynamicBitSet ret(children_doc_ids[0]);
+            RoaringBitmap ret;
             switch (inter->type)
             {
                 case ConjunctionType::AND:
-                    for (int i = 1; i < children_doc_ids.size(); i++)
+                    // 从最小的集合开始求交，中间结果尽快变小
+                    std::sort(children_doc_ids.begin(), children_doc_ids.end(), [](const RoaringBitmap& a, const RoaringBitmap& b) {
+                        return a.cardinality() < b.cardinality();
+                    });
+                    ret = std::move(children_doc_ids[0]);
+                    for (int i = 1; i < children_doc_ids.size() && !ret.empty(); i++)
                         ret &= children_doc_ids[i];
                     break;
                 case ConjunctionType::OR:
-                    for (int i = 1; i < children_doc_ids.size(); i++)
-                        ret |= children_doc_ids[i];
+                    for (auto& child_doc_ids : children_doc_ids)
+                        ret |= child_doc_ids;
                     break;
                 case ConjunctionType::NOT:
-                    ret.flip();
+                    ret = allDocIds() - children_doc_ids[0];
                     break;
                 default:
                     THROW(UnreachableException());
@@ -90,12 +117,73 @@ private:
         THROW(UnreachableException());
     }
 
+    // 未被删除的所有文档，NOT 的全集
+    RoaringBitmap allDocIds() const
+    {
+        return RoaringBitmap::range(1, db.maxAllocatedDocId() + 1) - db.getDeletedDocIds();
+    }
+
+    // 热门 term 的 bitmap 跨查询复用，避免每次都从 posting list 构造
+    RoaringBitmap termBitmap(const Term& term) const
+    {
+        auto& filter_cache = db.getFilterCache();
+        const std::string key = "term:" + term.word;
+        const auto generation = db.getGeneration();
+        if (auto bitmap = filter_cache.get(key, generation))
+            return bitmap->getMatched();
+
+        RoaringBitmap res(term.posting_list);
+        filter_cache.put(key, generation, std::make_shared<FilterBitmap>(RoaringBitmap(res).runOptimize()), term.posting_list.size());
+        return res;
+    }
+
+    // 先按 AND 求出候选文档，只对候选文档比对位置
+    RoaringBitmap executePhrase(const PhraseQuery& phrase) const
+    {
+        RoaringBitmap res;
+        if (phrase.words.empty())
+            return res;
+
+        std::vector<TermPtr> term_ptrs;
+        for (const auto& word : phrase.words)
+        {
+            auto term_ptr = db.findTerm(word);
+            if (!term_ptr)
+                return res;
+            term_ptrs.push_back(term_ptr);
+        }
+
+        RoaringBitmap candidates = termBitmap(*term_ptrs[0]);
+        for (size_t i = 1; i < term_ptrs.size() && !candidates.empty(); i++)
+            candidates &= termBitmap(*term_ptrs[i]);
+
+        std::vector<const std::vector<uint32_t>*> position_lists(term_ptrs.size());
+        candidates.forEach([&](uint32_t doc_id) {
+            bool has_positions = true;
+            for (size_t i = 0; i < term_ptrs.size(); i++)
+            {
+                const auto& posting_list = term_ptrs[i]->posting_list;
+                auto doc_iter = std::lower_bound(posting_list.begin(), posting_list.end(), doc_id);
+                if (doc_iter == posting_list.end() || *doc_iter != doc_id) // 候选来自缓存，期间文档可能已被删除
+                    return;
+                position_lists[i] = &term_ptrs[i]->statistics_list[doc_iter - posting_list.begin()].positions;
+                has_positions &= !position_lists[i]->empty();
+            }
+            if (has_positions && matchPositions(position_lists, phrase.slop, phrase.in_order))
+                res.add(doc_id);
+        });
+        return res;
+    }
+
     void clear() override
     {
         last_cut_begin = 0;
+        matched_doc_ids.reset();
     }
 private:
     ConjunctionTree root;
-    // 只适用于 vecotrization model + single term 场景下，不支持 conjunction term 查询（幸好queryparser也不支持）
+    // vectorization model 下已经输出的文档数
     size_t last_cut_begin = 0;
+    // 整棵树的求值结果，在 clear() 之前复用
+    std::optional<std::vector<size_t>> matched_doc_ids;
 };
\ No newline at end of file
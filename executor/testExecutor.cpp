@@ -43,8 +43,7 @@ TEST(ScoreExecutor, base)
     }
 }
 
-// BUG: 注意， vectorization model 的引入导致不支持非 single term 的测试
-TEST(DISABLED_termsExecutor, base)
+TEST(termsExecutor, base)
 {
     Database db(ROOT_PATH + "/database1", true);
 
@@ -109,6 +108,67 @@ TEST(DISABLED_termsExecutor, base)
     }
 }
 
+TEST(PositionalIntersect, base)
+{
+    std::vector<uint32_t> a{1, 7, 20}, b{2, 9, 30}, c{3, 8};
+    using Lists = std::vector<const std::vector<uint32_t>*>;
+
+    // "a b c" 只在 1 2 3 处相邻
+    EXPECT_TRUE(matchPositions(Lists{&a, &b, &c}, 0, true));
+    // "b a" 不相邻
+    EXPECT_FALSE(matchPositions(Lists{&b, &a}, 0, true));
+    // "c a" 最近的一组 3 _ _ _ 7 中间隔了三个词
+    EXPECT_FALSE(matchPositions(Lists{&c, &a}, 2, true));
+    EXPECT_TRUE(matchPositions(Lists{&c, &a}, 3, true));
+
+    // NEAR：不要求顺序
+    std::vector<uint32_t> d{10}, e{4};
+    EXPECT_TRUE(matchPositions(Lists{&d, &c}, 1, false)); // 8 _ 10
+    EXPECT_FALSE(matchPositions(Lists{&d, &c}, 0, false));
+    EXPECT_FALSE(matchPositions(Lists{&e, &d}, 4, false)); // 4 _ _ _ _ _ 10
+    EXPECT_TRUE(matchPositions(Lists{&e, &d}, 5, false));
+
+    // 同一个词出现两次时需要两个不同的位置
+    std::vector<uint32_t> f{5};
+    EXPECT_FALSE(matchPositions(Lists{&f, &f}, 10, false));
+    EXPECT_FALSE(matchPositions(Lists{&f, &f}, 10, true));
+    EXPECT_TRUE(matchPositions(Lists{&a, &a}, 5, false)); // 1 _ _ _ _ _ 7
+    EXPECT_FALSE(matchPositions(Lists{&a, &a}, 4, false));
+    EXPECT_TRUE(matchPositions(Lists{&a, &b, &a}, 4, false)); // 1 2 _ _ _ _ 7
+    EXPECT_FALSE(matchPositions(Lists{&a, &b, &a}, 3, false));
+}
+
+TEST(FilterCache, base)
+{
+    auto term_a = std::make_shared<FilterBitmap>(RoaringBitmap(std::vector<size_t>{1, 5, 100}));
+    const size_t term_bytes = term_a->getBytes();
+    // 容量只够放下 term_a 和预估 2 * term_bytes 的 predicate 中的一个
+    FilterCache cache(term_bytes * 2 + 1, 2);
+
+    EXPECT_FALSE(cache.put("term:a", 1, term_a, 1)); // 代价太小，不缓存
+    EXPECT_TRUE(cache.put("term:a", 1, term_a, 3));
+    ASSERT_EQ(cache.get("term:a", 1), term_a);
+    EXPECT_EQ(cache.get("term:a", 1)->getMatched().toVector(), std::vector<size_t>({1, 5, 100}));
+    EXPECT_EQ(cache.get("term:a", 2), nullptr); // 索引变化
+
+    // predicate 的 bitmap 逐步填充
+    auto having = std::make_shared<FilterBitmap>();
+    EXPECT_EQ(having->test(3), std::nullopt);
+    having->record(3, true);
+    having->record(4, false);
+    EXPECT_EQ(having->test(3), true);
+    EXPECT_EQ(having->test(4), false);
+    EXPECT_EQ(having->test(200), std::nullopt);
+
+    // 超出容量时淘汰最久未使用的条目，按 put 时计入的空间释放
+    EXPECT_TRUE(cache.put("having:x", 2, having, 10, term_bytes * 2));
+    EXPECT_EQ(cache.getUsedBytes(), term_bytes * 2);
+    having->record(5, true);
+    EXPECT_TRUE(cache.put("term:a", 2, term_a, 3));
+    EXPECT_EQ(cache.get("having:x", 2), nullptr);
+    EXPECT_EQ(cache.getUsedBytes(), term_bytes);
+}
+
 TEST(CompareFunction, base)
 {
     {
@@ -202,11 +262,38 @@ TEST(AggregateFunction, base)
         EXPECT_THROW(maxFunction(arr1).as<Bool>(), Poco::InvalidArgumentException);
         EXPECT_THROW(minFunction(arr1).as<Bool>(), Poco::InvalidArgumentException);
     }
+    {
+        // 长度不是累加器个数的整数倍，最值落在尾部
+        std::vector<Number> values;
+        for (int i = 0; i < 1003; i++)
+            values.push_back(i % 7);
+        values.back() = -5;
+        values[1001] = 42;
+        Value arr1(ArrayLabel{}, values);
+        EXPECT_EQ(sumFunction(arr1).as<Number>(), std::accumulate(values.begin(), values.end(), 0.0));
+        EXPECT_EQ(countFunction(arr1).as<Number>(), 1003);
+        EXPECT_EQ(maxFunction(arr1).as<Number>(), 42);
+        EXPECT_EQ(minFunction(arr1).as<Number>(), -5);
+
+        Value empty(ArrayLabel{}, ValueType::Number);
+        EXPECT_EQ(sumFunction(empty).as<Number>(), 0);
+        EXPECT_TRUE(maxFunction(empty).isNull());
+        EXPECT_TRUE(minFunction(empty).isNull());
+    }
     {
         EXPECT_THROW(Value(ArrayLabel{}, ValueType::Null), Poco::NotImplementedException);
     }
 }
 
+TEST(Predicate, unknownKey)
+{
+    // 查询中没有被索引过的字段名不加入 KeyDictionary，也不会匹配任何文档
+    auto size = KeyDictionary::instance().size();
+    Predicate predicate(valueFunction, "predicate-unknown-key", compareEqual, Value(1));
+    EXPECT_EQ(KeyDictionary::instance().size(), size);
+    EXPECT_FALSE(predicate.determine({{"known", Value(1)}}));
+}
+
 TEST(havingExecutor, base)
 {
     Database db(ROOT_PATH + "/database1", true);
@@ -242,6 +329,36 @@ TEST(havingExecutor, base)
     }
 }
 
+TEST(havingExecutor, filterCache)
+{
+    Database db(ROOT_PATH + "/database-having-cache", true);
+    auto path = ROOT_PATH + "/articles/ABC.txt";
+    for (size_t i = 0; i < FILTER_CACHE_MIN_ADMISSION_COST * 2; i++)
+        db.addDocument(db.newDocId(), path, 1, {{"n", Value(static_cast<Number>(i))}});
+
+    // 分批执行，每批的文档数都小于接纳阈值
+    std::vector<DocIds> batches(4);
+    for (size_t doc_id = 1; doc_id <= db.maxAllocatedDocId(); doc_id++)
+        batches[doc_id % batches.size()].insert(doc_id);
+
+    LeafNode<Predicate> l1(Predicate(valueFunction, "n", compareGreaterOrEqual, Value(static_cast<Number>(10)), "having:VALUE(n)>=10"));
+    auto run = [&] {
+        size_t matched = 0;
+        for (const auto& batch : batches)
+        {
+            HavingExecutor executor(db, &l1);
+            matched += std::any_cast<DocIds>(executor.execute(batch).second).size();
+        }
+        return matched;
+    };
+
+    auto& cache = db.getFilterCache();
+    EXPECT_EQ(run(), FILTER_CACHE_MIN_ADMISSION_COST * 2 - 10);
+    auto hits = cache.getHits();
+    EXPECT_EQ(run(), FILTER_CACHE_MIN_ADMISSION_COST * 2 - 10);
+    EXPECT_EQ(cache.getHits(), hits + batches.size());
+}
+
 TEST(LimitExecutor, base)
 {
     Database db(ROOT_PATH + "/database1", true);
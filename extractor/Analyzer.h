@@ -0,0 +1,273 @@
+#pragma once
+
+#include "typedefs.h"
+#include "ExtractUtils.h"
+#include "utils/SerializeUtils.h"
+
+// 索引所有类型的文档与分析查询都使用同一组分隔符，查询词才能切出与文档中相同的词
+const std::string SEPARATORS = " \"{}:,.\t\n";
+
+enum class CJKSegmentMode
+{
+    None, // CJK 字符与其他字符一样拼成一个词
+    Bigram, // 连续的 CJK 字符切成重叠的二元组：中华人民 -> 中华 华人 人民
+    Dictionary // 按词典正向最大匹配，未命中的字单独成词
+};
+
+// 分词配置跟随 database 持久化，索引时和查询时必须使用同一份配置
+struct AnalyzerConfig
+{
+    bool lowercase = false; // ASCII 大小写折叠
+    bool unicode_segment = false; // 按 Unicode 标点、空白切分，不再丢弃多字节字符
+    CJKSegmentMode cjk_mode = CJKSegmentMode::None;
+    std::string dictionary_path; // cjk_mode == Dictionary 时使用，每行一个词
+
+    // 默认配置保持原来的 ASCII 分隔符切分行为
+    static AnalyzerConfig legacy()
+    {
+        return {};
+    }
+
+    static AnalyzerConfig standard()
+    {
+        return AnalyzerConfig{.lowercase = true, .unicode_segment = true, .cjk_mode = CJKSegmentMode::Bigram};
+    }
+
+    bool isLegacy() const
+    {
+        return !lowercase && !unicode_segment && cjk_mode == CJKSegmentMode::None;
+    }
+
+    void serialize(WriteBufferHelper &helper) const
+    {
+        helper.writeNumber(lowercase);
+        helper.writeNumber(unicode_segment);
+        helper.writeNumber(cjk_mode);
+        helper.writeString(dictionary_path);
+    }
+
+    static AnalyzerConfig deserialize(ReadBufferHelper &helper)
+    {
+        AnalyzerConfig config;
+        config.lowercase = helper.readNumber<bool>();
+        config.unicode_segment = helper.readNumber<bool>();
+        config.cjk_mode = helper.readNumber<CJKSegmentMode>();
+        config.dictionary_path = helper.readString();
+        return config;
+    }
+};
+
+// 分词链：切分 -> CJK 切词 -> 大小写折叠. 产出的每个词都带有它在文件中的字节偏移.
+// Analyzer 构造后只读，可以被多个线程共享.
+class Analyzer
+{
+public:
+    explicit Analyzer(AnalyzerConfig config_ = {}) : config(std::move(config_))
+    {
+        if (config.cjk_mode == CJKSegmentMode::Dictionary)
+            loadDictionary();
+    }
+
+    const AnalyzerConfig& getConfig() const
+    {
+        return config;
+    }
+
+    // 对整篇文档分词
+    void analyze(const std::unique_ptr<Reader>& reader, StringInFiles& res) const
+    {
+        reader->reset();
+        while (true)
+        {
+            auto line = reader->readUntil();
+            if (line.str.empty())
+                break;
+            analyzeText(line.str, line.offset_in_file, res);
+        }
+    }
+
+    // 对一段文本分词，offset_in_file 是 text[0] 在文件中的偏移
+    void analyzeText(const std::string& text, size_t offset_in_file, StringInFiles& res) const
+    {
+        if (config.isLegacy())
+        {
+            extractWordsInLine(text, offset_in_file, res, SEPARATORS);
+            return;
+        }
+
+        std::string token;
+        size_t token_begin = 0;
+        std::vector<std::pair<size_t, size_t>> cjk_run; // (begin, len) of each CJK char
+
+        auto flushToken = [&]() {
+            if (!token.empty())
+                emit(token, offset_in_file + token_begin, res);
+            token.clear();
+        };
+        auto flushCJKRun = [&]() {
+            if (!cjk_run.empty())
+                segmentCJK(text, cjk_run, offset_in_file, res);
+            cjk_run.clear();
+        };
+
+        for (size_t i = 0; i < text.size();)
+        {
+            uint32_t code_point = 0;
+            size_t len = decodeUtf8(text, i, code_point);
+            if (len == 0) // 非法编码的字节视为分隔符
+            {
+                flushToken();
+                flushCJKRun();
+                i++;
+                continue;
+            }
+
+            if (isSeparator(code_point))
+            {
+                flushToken();
+                flushCJKRun();
+            }
+            else if (config.cjk_mode != CJKSegmentMode::None && isCJK(code_point))
+            {
+                flushToken();
+                cjk_run.emplace_back(i, len);
+            }
+            else
+            {
+                flushCJKRun();
+                if (token.empty())
+                    token_begin = i;
+                token.append(text, i, len);
+            }
+            i += len;
+        }
+        flushToken();
+        flushCJKRun();
+    }
+
+    // 查询时分词，保证与索引时得到同样的词
+    std::vector<std::string> analyzeQuery(const std::string& text) const
+    {
+        StringInFiles res;
+        analyzeText(text, 0, res);
+        std::vector<std::string> words;
+        for (const auto& sif : res)
+            words.push_back(sif.str);
+        return words;
+    }
+
+private:
+    static bool isCJK(uint32_t cp)
+    {
+        return (cp >= 0x4E00 && cp <= 0x9FFF) // CJK Unified Ideographs
+            || (cp >= 0x3400 && cp <= 0x4DBF) // Extension A
+            || (cp >= 0xF900 && cp <= 0xFAFF) // Compatibility Ideographs
+            || (cp >= 0x3040 && cp <= 0x30FF) // Hiragana, Katakana
+            || (cp >= 0xAC00 && cp <= 0xD7AF) // Hangul Syllables
+            || (cp >= 0x20000 && cp <= 0x2FA1F); // Extension B ~ F
+    }
+
+    static bool isUnicodeSeparator(uint32_t cp)
+    {
+        return (cp >= 0x0080 && cp <= 0x00BF) // Latin-1 控制符与标点
+            || (cp >= 0x2000 && cp <= 0x206F) // General Punctuation，含 ’ “ ” …
+            || (cp >= 0x3000 && cp <= 0x303F) // CJK 标点：、。《》「」
+            || (cp >= 0xFE30 && cp <= 0xFE4F) // CJK Compatibility Forms
+            || (cp >= 0xFF00 && cp <= 0xFF0F) // 全角标点：！＂＃ ... ／
+            || (cp >= 0xFF1A && cp <= 0xFF20) // ：；＜＝＞？＠
+            || (cp >= 0xFF3B && cp <= 0xFF40)
+            || (cp >= 0xFF5B && cp <= 0xFF65)
+            || cp == 0xFEFF; // BOM
+    }
+
+    bool isSeparator(uint32_t cp) const
+    {
+        if (cp < 0x80)
+        {
+            auto ch = static_cast<char>(cp);
+            if (SEPARATORS.find(ch) != std::string::npos || Poco::Ascii::isSpace(ch) || !Poco::Ascii::isPrintable(ch))
+                return true;
+            // 只有字母数字以及 '_', '-' 组成单词，例如 web-app, max_size
+            return config.unicode_segment && !Poco::Ascii::isAlphaNumeric(ch) && ch != '_' && ch != '-';
+        }
+        return config.unicode_segment && isUnicodeSeparator(cp);
+    }
+
+    void emit(std::string word, size_t offset_in_file, StringInFiles& res) const
+    {
+        if (config.lowercase)
+            for (auto& ch : word)
+                ch = static_cast<char>(Poco::Ascii::toLower(ch));
+        res.emplace_back(word, offset_in_file);
+    }
+
+    void segmentCJK(const std::string& text, const std::vector<std::pair<size_t, size_t>>& run, size_t offset_in_file, StringInFiles& res) const
+    {
+        auto substr = [&text, &run](size_t first, size_t count) {
+            size_t begin = run[first].first;
+            size_t end = run[first + count - 1].first + run[first + count - 1].second;
+            return text.substr(begin, end - begin);
+        };
+
+        if (config.cjk_mode == CJKSegmentMode::Bigram || !dictionary)
+        {
+            if (run.size() == 1)
+            {
+                emit(substr(0, 1), offset_in_file + run[0].first, res);
+                return;
+            }
+            for (size_t i = 0; i + 1 < run.size(); i++)
+                emit(substr(i, 2), offset_in_file + run[i].first, res);
+            return;
+        }
+
+        // 正向最大匹配
+        for (size_t i = 0; i < run.size();)
+        {
+            size_t matched = 1;
+            for (size_t len = std::min(max_word_chars, run.size() - i); len >= 2; len--)
+            {
+                if (dictionary->contains(substr(i, len)))
+                {
+                    matched = len;
+                    break;
+                }
+            }
+            emit(substr(i, matched), offset_in_file + run[i].first, res);
+            i += matched;
+        }
+    }
+
+    void loadDictionary()
+    {
+        std::ifstream fin(config.dictionary_path);
+        if (!fin.is_open())
+        {
+            httpLog("can't open analyzer dictionary, fallback to bigram -- " + config.dictionary_path);
+            return;
+        }
+        auto words = std::make_shared<std::unordered_set<std::string>>();
+        std::string word;
+        while (std::getline(fin, word))
+        {
+            trimInPlace(word, [](char ch) { return Poco::Ascii::isSpace(ch); });
+            if (word.empty())
+                continue;
+            size_t chars = 0;
+            for (size_t i = 0; i < word.size(); chars++)
+            {
+                uint32_t code_point;
+                size_t len = decodeUtf8(word, i, code_point);
+                i += len ? len : 1;
+            }
+            max_word_chars = std::max(max_word_chars, chars);
+            words->insert(word);
+        }
+        if (!words->empty())
+            dictionary = words;
+    }
+
+    AnalyzerConfig config;
+    std::shared_ptr<const std::unordered_set<std::string>> dictionary; // Analyzer 按值传递给 Extractor，词典共享
+    size_t max_word_chars = 1;
+};
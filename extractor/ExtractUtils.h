@@ -3,49 +3,52 @@
 #include "core/Value.h"
 #include "utils/JsonUtils.h"
 
-void extractWords(const std::unique_ptr<Reader>& reader, StringInFiles& res, const std::string& separators = " ,.\t\n")
+// 对一行文本按 separators 切分，offset_in_file 是该行首字符在文件中的偏移
+void extractWordsInLine(const std::string& str, size_t offset_in_file, StringInFiles& res, const std::string& separators = " ,.\t\n")
 {
-    reader->reset();
-    while(true)
-    {
-        auto line = reader->readUntil();
-        if (line.str.empty())
-            break;
-
-        // this split logic is referred to Poco::StringTokenizer.
-        auto str = line.str;
-        size_t offset_in_file = line.offset_in_file;
-
-        auto begin = str.begin(), end = str.end();
-        auto it = str.begin();
-
-        std::string token;
-        for (; it != end; ++it)
-        {
-            if (separators.find(*it) != std::string::npos)
-            {
-                size_t old_token_size = token.size();
-                size_t left_trim_number = trimInPlace(token, [](char ch) {
-                    return Poco::Ascii::isSpace(ch) || !Poco::Ascii::isPrintable(ch);
-                }).first;
-                if (!token.empty()) res.emplace_back(token, offset_in_file + (it - begin) - old_token_size + left_trim_number);
-                token.clear();
-            }
-            else
-            {
-                token += *it;
-            }
-        }
+    // this split logic is referred to Poco::StringTokenizer.
+    auto begin = str.begin(), end = str.end();
+    auto it = str.begin();
 
-        if (!token.empty())
+    std::string token;
+    for (; it != end; ++it)
+    {
+        if (separators.find(*it) != std::string::npos)
         {
             size_t old_token_size = token.size();
             size_t left_trim_number = trimInPlace(token, [](char ch) {
                 return Poco::Ascii::isSpace(ch) || !Poco::Ascii::isPrintable(ch);
             }).first;
             if (!token.empty()) res.emplace_back(token, offset_in_file + (it - begin) - old_token_size + left_trim_number);
+            token.clear();
+        }
+        else
+        {
+            token += *it;
         }
     }
+
+    if (!token.empty())
+    {
+        size_t old_token_size = token.size();
+        size_t left_trim_number = trimInPlace(token, [](char ch) {
+            return Poco::Ascii::isSpace(ch) || !Poco::Ascii::isPrintable(ch);
+        }).first;
+        if (!token.empty()) res.emplace_back(token, offset_in_file + (it - begin) - old_token_size + left_trim_number);
+    }
+}
+
+void extractWords(const std::unique_ptr<Reader>& reader, StringInFiles& res, const std::string& separators = " ,.\t\n")
+{
+    reader->reset();
+    while(true)
+    {
+        auto line = reader->readUntil();
+        if (line.str.empty())
+            break;
+
+        extractWordsInLine(line.str, line.offset_in_file, res, separators);
+    }
 }
 
 // for json format
@@ -71,47 +74,14 @@ void extractKvs(const std::unique_ptr<Reader>& reader, std::unordered_map<Key, V
         {
             if (value.empty())
                 continue;
-            ValueType type;
             if (value[0].is_boolean())
-                type = ValueType::Bool;
+                res.emplace(key, Value(ArrayLabel{}, value.get<std::vector<Bool>>()));
             else if (value[0].is_number())
-                type = ValueType::Number;
+                res.emplace(key, Value(ArrayLabel{}, value.get<std::vector<Number>>()));
             else if (value[0].is_string())
-                type = ValueType::String;
+                res.emplace(key, Value(ArrayLabel{}, value.get<std::vector<String>>()));
             else
                 THROW(UnreachableException());
-
-            Value v(ArrayLabel{}, type);
-
-            ValueArrayHandler<Bool> hb;
-            ValueArrayHandler<Number> hn;
-            ValueArrayHandler<String> hs;
-            ValueArrayHandler<DateTime> hd = PanicValueArrayHandler<DateTime>;
-
-            if (type == ValueType::Bool)
-            {
-                hb = [vec0 = value.get<std::vector<Bool>>()](std::vector<Bool>* vec) {
-                    vec->insert(vec->end(), vec0.begin(), vec0.end());
-                };
-            }
-            else if (type == ValueType::Number)
-            {
-                hn = [vec0 = value.get<std::vector<Number>>()](std::vector<Number>* vec) {
-                    vec->insert(vec->end(), vec0.begin(), vec0.end());
-                };
-            }
-            else if (type == ValueType::String)
-            {
-                hs = [vec0 = value.get<std::vector<String>>()](std::vector<String>* vec) {
-                    vec->insert(vec->end(), vec0.begin(), vec0.end());
-                };
-            }
-            else
-                THROW(UnreachableException());
-
-            v.doArrayHandler(hb, hn, hs, hd);
-
-            res.emplace(key, v);
         }
         else if (value.is_null())
         {
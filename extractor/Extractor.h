@@ -4,6 +4,7 @@
 
 #include "typedefs.h"
 #include "ExtractUtils.h"
+#include "Analyzer.h"
 
 class Extractor {
 public:
@@ -13,12 +14,12 @@ public:
 
 class WordExtractor : public Extractor {
 public:
-    explicit WordExtractor(std::unique_ptr<Reader> reader_) : reader(std::move(reader_)) {}
+    explicit WordExtractor(std::unique_ptr<Reader> reader_, Analyzer analyzer_ = Analyzer()) : reader(std::move(reader_)), analyzer(std::move(analyzer_)) {}
 
     ExtractResult extract() override
     {
         StringInFiles res;
-        extractWords(reader, res);
+        analyzer.analyze(reader, res);
 
         if (res.empty())
             return ExtractResult{};
@@ -27,16 +28,17 @@ public:
 
 private:
     std::unique_ptr<Reader> reader;
+    Analyzer analyzer;
 };
 
 class JsonExtractor : public Extractor {
 public:
-    explicit JsonExtractor(std::unique_ptr<Reader> reader_) : reader(std::move(reader_)) {}
+    explicit JsonExtractor(std::unique_ptr<Reader> reader_, Analyzer analyzer_ = Analyzer()) : reader(std::move(reader_)), analyzer(std::move(analyzer_)) {}
 
     ExtractResult extract() override
     {
         StringInFiles word_res;
-        extractWords(reader, word_res, " \"{}:,.\t\n");
+        analyzer.analyze(reader, word_res);
 
         std::unordered_map<Key, Value> kv_res;
 
@@ -49,6 +51,11 @@ public:
             httpLog(std::string("json parse error, but words are saved.") + j.what() + " file_path - " + reader->getFilePath().string());
             kv_res.clear();
         }
+        catch (const Poco::LimitExceededException& e)
+        {
+            httpLog("too many distinct json keys, but words are saved. " + e.displayText() + " file_path - " + reader->getFilePath().string());
+            kv_res.clear();
+        }
 
         if (word_res.empty())
             return ExtractResult{};
@@ -57,4 +64,5 @@ public:
 
 private:
     std::unique_ptr<Reader> reader;
+    Analyzer analyzer;
 };
\ No newline at end of file
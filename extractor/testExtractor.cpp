@@ -35,6 +35,38 @@ TEST(extractor, WordExtractor)
     ASSERT_EQ(sifs[10].offset_in_file, 30);
 }
 
+TEST(extractor, Analyzer)
+{
+    {
+        Analyzer analyzer; // legacy
+        auto words = analyzer.analyzeQuery("Hello,World.");
+        ASSERT_EQ(words, std::vector<std::string>({"Hello", "World"}));
+
+        // 纯文本与 json 文档按同样的分隔符切分，查询切出的词在两种文档中都能找到
+        StringInFiles sifs;
+        analyzer.analyzeText("{\"title\": \"key:value\"}", 0, sifs);
+        ASSERT_EQ(sifs.size(), 3);
+        ASSERT_EQ(sifs[1].str, "key");
+        ASSERT_EQ(sifs[1].offset_in_file, 11);
+        ASSERT_EQ(analyzer.analyzeQuery("key:value"), std::vector<std::string>({"key", "value"}));
+    }
+
+    {
+        Analyzer analyzer(AnalyzerConfig::standard());
+        ASSERT_EQ(analyzer.analyzeQuery("Web-App (max_size)!"), std::vector<std::string>({"web-app", "max_size"}));
+        ASSERT_EQ(analyzer.analyzeQuery("中华人民"), std::vector<std::string>({"中华", "华人", "人民"}));
+        ASSERT_EQ(analyzer.analyzeQuery("我，你"), std::vector<std::string>({"我", "你"}));
+
+        StringInFiles sifs;
+        analyzer.analyzeText("Go语言。", 10, sifs);
+        ASSERT_EQ(sifs.size(), 2);
+        ASSERT_EQ(sifs[0].str, "go");
+        ASSERT_EQ(sifs[0].offset_in_file, 10);
+        ASSERT_EQ(sifs[1].str, "语言");
+        ASSERT_EQ(sifs[1].offset_in_file, 12);
+    }
+}
+
 int main()
 {
     testing::InitGoogleTest();
@@ -110,22 +110,29 @@ public:
 
         db.addDocumentDownloadFreq(doc_id);
         auto file_path = document_ptr->getPath();
-        std::ifstream file(file_path.string());
-        if (!file.is_open())
+
+        // 以二进制附件下载，浏览器不会把 json 文本文件解析成对象（曾经靠在末尾追加 '.' 规避）
+        const std::string download_type = "application/octet-stream";
+        const std::string download_name = file_path.filename().string();
+
+        // 优先使用 database 中保存的副本：与索引的内容一致，也不依赖原文件是否还在
+        auto document_store = db.getDocumentStore();
+        if (auto size = document_store ? document_store->getSize(doc_id) : std::nullopt)
         {
-            auto& out = makeResponseOK(response, content_type);
-            out << makeStandardResponse(-1, InvalidParameterMessage, nlohmann::json::object());
+            auto mtime = static_cast<time_t>(document_ptr->getModifyTime().internal().timestamp().epochTime());
+            sendRangedResponse(request, response, *size, mtime, download_type, download_name,
+                               [document_store, doc_id](std::ostream &out, uint64_t offset, uint64_t len) {
+                                   document_store->forEachBlock(doc_id, offset, len, [&out](const std::string& block) { out << block; });
+                               });
+            return;
         }
-        else
-        {
-            response.setContentType("text/html;charset=UTF-8");
-            response.set("Content-Disposition", "attachment; filename=\"" + document_ptr->getPath().filename().string() + "\"");
-            response.setStatus(HTTPResponse::HTTP_OK);
-            auto& out = response.send();
 
-            Poco::StreamCopier::copyStream(file, out);
-            out << '.'; // fix `json text file` downloading `[object Object]` bug.
-        }
+        // 没有保存副本时读取原文件
+        if (sendFileResponse(request, response, file_path, download_type, download_name))
+            return;
+
+        auto& out = makeResponseOK(response, content_type);
+        out << makeStandardResponse(-1, InvalidParameterMessage, nlohmann::json::object());
     }
 
 private:
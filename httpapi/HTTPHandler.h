@@ -1,6 +1,14 @@
 #pragma once
 #include "../typedefs.h"
-#include "daemon/Daemon.h"
+#include "daemon/DatabaseRegistry.h"
+#include "utils/JsonWriter.h"
+#include "StaticAssetCache.h"
+#include "utils/ConcurrencyLimiter.h"
+#include <Poco/Net/HTTPServerRequestImpl.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 
 using namespace Poco::Net;
 
@@ -8,6 +16,8 @@ const char * InvalidParameterMessage = R"(请求失败-参数错误)";
 const char * NotFoundMessage = R"(你来到了没有知识的荒原)";
 const char * IllegalAccessMessage = R"(非法访问，请登录)";
 const char * SuccessMessage = R"(请求成功)";
+const char * ServiceBusyMessage = R"(服务繁忙，请稍后重试)";
+const char * DatabaseUnavailableMessage = R"(数据库加载失败，请稍后重试)";
 
 std::string makeStandardResponse(int status, const std::string& msg, const nlohmann::json& data)
 {
@@ -26,19 +36,347 @@ std::string makeStandardResponse(int status, const std::string& msg, const nlohm
     return oss.str();
 }
 
-std::ostream& makeResponseOK(HTTPServerResponse &response, const std::string& content_type = "text/html;charset=UTF-8")
+void setAccessControlHeaders(HTTPServerResponse &response)
 {
-    // NOTE: setStatus、setContentType 应该发生在 send 之前
-    response.setStatus(HTTPResponse::HTTP_OK);
-    response.setContentType(content_type);
     response.set("Access-Control-Allow-Methods", "PUT, GET, HEAD, POST, DELETE, OPTIONS");
     response.set("Access-Control-Allow-Origin", "*");
     response.set("Access-Control-Allow-Headers", "*");
     response.set("Access-Control-Allow-Credentials", "true");
+}
+
+std::ostream& makeResponseOK(HTTPServerResponse &response, const std::string& content_type = "text/html;charset=UTF-8")
+{
+    // NOTE: setStatus、setContentType 应该发生在 send 之前
+    response.setStatus(HTTPResponse::HTTP_OK);
+    response.setContentType(content_type);
+    setAccessControlHeaders(response);
 
     return response.send();
 }
 
+// 分块传输：响应边生成边发送，不需要先在内存中拼出完整内容并计算长度
+std::ostream& makeStreamingResponseOK(HTTPServerResponse &response, const std::string& content_type = "text/html;charset=UTF-8")
+{
+    response.setChunkedTransferEncoding(true);
+    return makeResponseOK(response, content_type);
+}
+
+// 与 makeStandardResponse 格式相同，但直接写入 out；write_data 向 data 对象中写入字段
+template<typename WriteData>
+void writeStandardResponse(std::ostream& out, int status, const std::string& msg, WriteData&& write_data)
+{
+    JsonWriter writer(out);
+    writer.beginObject()
+          .key("status").value(status)
+          .key("msg").value(msg)
+          .key("data").beginObject();
+    write_data(writer);
+    writer.endObject().endObject();
+}
+
+// 单个字节区间 [begin, end]
+struct ByteRange
+{
+    uint64_t begin;
+    uint64_t end;
+};
+
+// 解析 Range 头，只支持单个区间: "bytes=a-b"、"bytes=a-"、"bytes=-n".
+// 语法错误或多区间时返回 std::nullopt（按规范忽略 Range，返回整个文件）；
+// 区间不可满足时返回 begin > end 的 ByteRange.
+std::optional<ByteRange> parseByteRange(const std::string &header, uint64_t file_size)
+{
+    const std::string prefix = "bytes=";
+    if (!header.starts_with(prefix) || header.find(',') != std::string::npos)
+        return std::nullopt;
+    auto spec = header.substr(prefix.size());
+    auto dash = spec.find('-');
+    if (dash == std::string::npos)
+        return std::nullopt;
+    auto first = spec.substr(0, dash), last = spec.substr(dash + 1);
+    auto isNumber = [](const std::string &str) {
+        return !str.empty() && str.size() <= 18 && std::all_of(str.begin(), str.end(), [](char ch) { return Poco::Ascii::isDigit(ch); });
+    };
+
+    if (first.empty()) // 最后 n 个字节
+    {
+        if (!isNumber(last))
+            return std::nullopt;
+        uint64_t suffix = std::stoull(last);
+        if (suffix == 0 || file_size == 0)
+            return ByteRange{1, 0};
+        return ByteRange{file_size - std::min(suffix, file_size), file_size - 1};
+    }
+    if (!isNumber(first) || (!last.empty() && !isNumber(last)))
+        return std::nullopt;
+    uint64_t begin = std::stoull(first);
+    uint64_t end = last.empty() ? UINT64_MAX : std::stoull(last);
+    if (end < begin)
+        return std::nullopt;
+    if (begin >= file_size)
+        return ByteRange{1, 0};
+    return ByteRange{begin, std::min(end, file_size - 1)};
+}
+
+// RFC 7231 IMF-fixdate，例如 "Sun, 06 Nov 1994 08:49:37 GMT"
+std::string formatHttpDate(time_t time)
+{
+    struct tm tm{};
+    gmtime_r(&time, &tm);
+    char buf[64];
+    size_t len = strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return {buf, len};
+}
+
+// 发送文件 [offset, offset + len)：Linux 下用 sendfile(2) 从文件直接写入 socket，否则经由输出流复制
+void sendFileBody(HTTPServerRequest &request, std::ostream &out, int fd, uint64_t offset, uint64_t len)
+{
+#ifdef __linux__
+    if (auto *request_impl = dynamic_cast<HTTPServerRequestImpl *>(&request); request_impl && request_impl->socket().impl())
+    {
+        out.flush(); // 确保响应头已经写入 socket
+        int socket_fd = request_impl->socket().impl()->sockfd();
+        auto file_offset = static_cast<off_t>(offset);
+        while (len > 0)
+        {
+            ssize_t sent = ::sendfile(socket_fd, fd, &file_offset, std::min<uint64_t>(len, 1 << 30));
+            if (sent < 0 && errno == EINTR)
+                continue;
+            if (sent <= 0) // 客户端断开或发送超时
+                return;
+            len -= sent;
+        }
+        return;
+    }
+#endif
+    std::vector<char> buf(64 * 1024);
+    while (len > 0)
+    {
+        ssize_t read_number = ::pread(fd, buf.data(), std::min<uint64_t>(len, buf.size()), static_cast<off_t>(offset));
+        if (read_number <= 0)
+            return;
+        out.write(buf.data(), read_number);
+        offset += read_number;
+        len -= read_number;
+    }
+}
+
+// Content-Disposition 的附件头. filename 中的控制字符去掉，'"'、'\' 与非 ASCII 字符替换为 '_'；
+// 名字被改动时再附上 RFC 5987 的 filename*=UTF-8''<percent-encoded>，支持的客户端按它显示原名
+std::string makeContentDisposition(const std::string &download_name)
+{
+    std::string fallback, encoded;
+    for (unsigned char ch : download_name)
+    {
+        if (ch < 0x20 || ch == 0x7f)
+            continue;
+        fallback.push_back(ch == '"' || ch == '\\' || ch >= 0x80 ? '_' : static_cast<char>(ch));
+        if (Poco::Ascii::isAlphaNumeric(ch) || std::string_view("!#$&+-.^_`|~").find(ch) != std::string_view::npos)
+            encoded.push_back(static_cast<char>(ch));
+        else
+        {
+            encoded.push_back('%');
+            encoded.push_back("0123456789ABCDEF"[ch >> 4]);
+            encoded.push_back("0123456789ABCDEF"[ch & 15]);
+        }
+    }
+    auto header = "attachment; filename=\"" + fallback + "\"";
+    if (fallback != download_name)
+        header += "; filename*=UTF-8''" + encoded;
+    return header;
+}
+
+// 解析 HTTP 日期：RFC 7231 的 IMF-fixdate，以及仍需接受的 RFC 850 与 asctime 格式. 无法解析时返回 std::nullopt
+std::optional<time_t> parseHttpDate(const std::string &str)
+{
+    for (const char *format : {"%a, %d %b %Y %H:%M:%S GMT", "%A, %d-%b-%y %H:%M:%S GMT", "%a %b %e %H:%M:%S %Y"})
+    {
+        struct tm tm{};
+        const char *end = strptime(str.c_str(), format, &tm);
+        if (end && *end == '\0')
+            return timegm(&tm);
+    }
+    return std::nullopt;
+}
+
+// If-None-Match 是 "*" 或逗号分隔的实体标签列表，按弱比较（忽略 W/ 前缀）判断其中是否有 etag
+bool matchEntityTag(const std::string &header, const std::string &etag)
+{
+    auto opaque = [](std::string_view tag) { return tag.starts_with("W/") ? tag.substr(2) : tag; };
+    Poco::StringTokenizer tokens(header, ",", Poco::StringTokenizer::TOK_TRIM | Poco::StringTokenizer::TOK_IGNORE_EMPTY);
+    return std::any_of(tokens.begin(), tokens.end(), [&](const std::string &tag) {
+        return tag == "*" || opaque(tag) == opaque(etag);
+    });
+}
+
+// If-None-Match 存在时忽略 If-Modified-Since；日期无法解析时按没有该条件处理
+bool isNotModified(const HTTPServerRequest &request, const std::string &etag, time_t last_modified)
+{
+    if (request.has("If-None-Match"))
+        return matchEntityTag(request.get("If-None-Match"), etag);
+    if (!request.has("If-Modified-Since"))
+        return false;
+    auto since = parseHttpDate(request.get("If-Modified-Since"));
+    return since && last_modified <= *since;
+}
+
+// If-Range 是强实体标签或日期，都要求完全一致，否则说明内容已经变化，应当返回整个内容
+bool isRangeApplicable(const HTTPServerRequest &request, const std::string &etag, time_t last_modified)
+{
+    if (!request.has("If-Range"))
+        return true;
+    const auto &value = request.get("If-Range");
+    if (value.starts_with('"'))
+        return value == etag;
+    auto date = parseHttpDate(value);
+    return date && *date == last_modified;
+}
+
+// 发送 size 字节的内容，支持 Range 断点续传与 ETag/Last-Modified 条件请求. write_body(out, offset, len) 写出 [offset, offset + len).
+// download_name 非空时以附件形式下载.
+template <typename WriteBody>
+void sendRangedResponse(HTTPServerRequest &request, HTTPServerResponse &response, uint64_t size, time_t mtime,
+                        const std::string &content_type, const std::string &download_name, WriteBody &&write_body)
+{
+    const std::string etag = "\"" + std::to_string(size) + "-" + std::to_string(mtime) + "\"";
+
+    setAccessControlHeaders(response);
+    response.setContentType(content_type);
+    response.set("ETag", etag);
+    response.set("Last-Modified", formatHttpDate(mtime));
+    response.set("Accept-Ranges", "bytes");
+    response.set("Cache-Control", "no-cache"); // 允许缓存，但每次都要向服务器验证
+    if (!download_name.empty())
+        response.set("Content-Disposition", makeContentDisposition(download_name));
+
+    if (isNotModified(request, etag, mtime))
+    {
+        response.setStatus(HTTPResponse::HTTP_NOT_MODIFIED);
+        response.setContentLength(0);
+        response.send();
+        return;
+    }
+
+    ByteRange range{0, size - 1};
+    bool partial = false;
+    if (request.has("Range") && isRangeApplicable(request, etag, mtime))
+    {
+        if (auto requested = parseByteRange(request.get("Range"), size))
+        {
+            if (requested->begin > requested->end)
+            {
+                response.setStatus(HTTPResponse::HTTP_REQUESTED_RANGE_NOT_SATISFIABLE);
+                response.set("Content-Range", "bytes */" + std::to_string(size));
+                response.setContentLength(0);
+                response.send();
+                return;
+            }
+            range = *requested;
+            partial = true;
+        }
+    }
+
+    uint64_t len = size == 0 ? 0 : range.end - range.begin + 1;
+    if (partial)
+    {
+        response.setStatus(HTTPResponse::HTTP_PARTIAL_CONTENT);
+        response.set("Content-Range", "bytes " + std::to_string(range.begin) + "-" + std::to_string(range.end) + "/" + std::to_string(size));
+    }
+    else
+        response.setStatus(HTTPResponse::HTTP_OK);
+    response.setContentLength64(static_cast<int64_t>(len));
+
+    auto &out = response.send();
+    if (request.getMethod() != "HEAD")
+        write_body(out, range.begin, len);
+}
+
+// 发送文件，文件无法打开时返回 false，此时还没有发送任何内容
+bool sendFileResponse(HTTPServerRequest &request, HTTPServerResponse &response, const std::filesystem::path &path,
+                      const std::string &content_type, const std::string &download_name = "")
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    sendRangedResponse(request, response, st.st_size, st.st_mtime, content_type, download_name,
+                       [&request, fd](std::ostream &out, uint64_t offset, uint64_t len) { sendFileBody(request, out, fd, offset, len); });
+    ::close(fd);
+    return true;
+}
+
+// 包装开销大的 handler：执行前向 limiter 申请许可，排队已满或等待超时直接返回 503，避免占满所有工作线程
+class LimitedHandler : public HTTPRequestHandler
+{
+public:
+    LimitedHandler(HTTPRequestHandler *handler_, ConcurrencyLimiter &limiter_, std::chrono::milliseconds wait_)
+        : handler(handler_), limiter(limiter_), wait(wait_) {}
+
+    void handleRequest(HTTPServerRequest &request, HTTPServerResponse &response) override
+    {
+        if (!limiter.tryAcquire(wait))
+        {
+            httpLog("too many heavy requests, rejected " + request.getURI());
+            response.setStatus(HTTPResponse::HTTP_SERVICE_UNAVAILABLE);
+            response.setContentType("application/json; charset=utf-8");
+            response.set("Retry-After", "1");
+            setAccessControlHeaders(response);
+            response.send() << makeStandardResponse(-1, ServiceBusyMessage, nlohmann::json::object());
+            return;
+        }
+
+        // handler 抛出异常时也要归还许可
+        struct Releaser
+        {
+            ConcurrencyLimiter &limiter;
+            ~Releaser() { limiter.release(); }
+        } releaser{limiter};
+        handler->handleRequest(request, response);
+    }
+
+private:
+    std::unique_ptr<HTTPRequestHandler> handler;
+    ConcurrencyLimiter &limiter;
+    std::chrono::milliseconds wait;
+};
+
+// 请求处理期间持有 database 的 Lease，handler 析构后 database 才可能被卸载
+class LeasedHandler : public HTTPRequestHandler
+{
+public:
+    LeasedHandler(HTTPRequestHandler *handler_, DatabaseRegistry::Lease lease_)
+        : lease(std::move(lease_)), handler(handler_) {}
+
+    void handleRequest(HTTPServerRequest &request, HTTPServerResponse &response) override
+    {
+        handler->handleRequest(request, response);
+    }
+
+private:
+    DatabaseRegistry::Lease lease; // 在 handler 之后析构
+    std::unique_ptr<HTTPRequestHandler> handler;
+};
+
+// database 加载失败
+class DatabaseUnavailableHandler : public HTTPRequestHandler
+{
+public:
+    void handleRequest(HTTPServerRequest &request, HTTPServerResponse &response) override
+    {
+        response.setStatus(HTTPResponse::HTTP_SERVICE_UNAVAILABLE);
+        response.setContentType("application/json; charset=utf-8");
+        response.set("Retry-After", "1");
+        setAccessControlHeaders(response);
+        response.send() << makeStandardResponse(-1, DatabaseUnavailableMessage, nlohmann::json::object());
+    }
+};
+
 class HelloHandler : public HTTPRequestHandler
 {
 public:
@@ -73,32 +411,85 @@ public:
 class GetFileHandler : public HTTPRequestHandler
 {
 public:
+    GetFileHandler(const StaticAssetCache &asset_cache_) : asset_cache(asset_cache_) {}
+
     void handleRequest(HTTPServerRequest &request, HTTPServerResponse &response) override
     {
-        std::string content_type = "text/html;charset=UTF-8";
         auto uri_path = Poco::URI(request.getURI()).getPath();
-        if (uri_path.ends_with(".css"))
-            content_type = "text/css; charset=utf-8";
-        if (uri_path.ends_with(".js"))
-            content_type = "text/javascript; charset=utf-8";
 
-        httpLog("getFile " + uri_path + " content-type=" + content_type);
+        if (const auto *asset = asset_cache.find(uri_path))
+        {
+            sendAsset(request, response, *asset);
+            return;
+        }
+
+        httpLog("getFile from disk " + uri_path);
 
-        if (std::filesystem::path(uri_path).is_relative())
+        // 只有超过缓存大小限制的文件才从磁盘读取，同样不允许访问资源目录之外的文件
+        if (std::filesystem::path(uri_path).is_relative() || uri_path.find("..") != std::string::npos)
         {
             response.redirect("http://localhost:8080/notfound.html");
             return;
         }
 
-        std::ifstream file(RESOURCE_PATH + uri_path);
-        if (!file.is_open())
-        {
+        if (!sendFileResponse(request, response, RESOURCE_PATH + uri_path, StaticAssetCache::contentType(uri_path)))
             response.redirect("http://localhost:8080/notfound.html");
+    }
+
+private:
+    static void sendAsset(HTTPServerRequest &request, HTTPServerResponse &response, const StaticAsset &asset)
+    {
+        // Range 请求（例如音频拖动进度）只对未压缩的内容生效
+        bool use_gzip = !asset.gzip_body.empty() && !request.has("Range") && StaticAssetCache::acceptsGzip(request.get("Accept-Encoding", ""));
+        const std::string &body = use_gzip ? asset.gzip_body : asset.body;
+        const std::string &etag = use_gzip ? asset.gzip_etag : asset.etag;
+
+        setAccessControlHeaders(response);
+        response.setContentType(asset.content_type);
+        response.set("ETag", etag);
+        response.set("Cache-Control", asset.cache_control);
+        response.set("Accept-Ranges", "bytes");
+        if (!asset.gzip_body.empty())
+            response.set("Vary", "Accept-Encoding");
+        if (use_gzip)
+            response.set("Content-Encoding", "gzip");
+
+        if (request.has("If-None-Match") && matchEntityTag(request.get("If-None-Match"), etag))
+        {
+            response.setStatus(HTTPResponse::HTTP_NOT_MODIFIED);
+            response.setContentLength(0);
+            response.send();
+            return;
         }
-        else
+
+        size_t begin = 0, len = body.size();
+        response.setStatus(HTTPResponse::HTTP_OK);
+        if (request.has("Range") && (!request.has("If-Range") || request.get("If-Range") == etag))
         {
-            auto& out = makeResponseOK(response, content_type);
-            Poco::StreamCopier::copyStream(file, out);
+            if (auto range = parseByteRange(request.get("Range"), body.size()))
+            {
+                if (range->begin > range->end)
+                {
+                    response.setStatus(HTTPResponse::HTTP_REQUESTED_RANGE_NOT_SATISFIABLE);
+                    response.set("Content-Range", "bytes */" + std::to_string(body.size()));
+                    response.setContentLength(0);
+                    response.send();
+                    return;
+                }
+                begin = range->begin;
+                len = range->end - range->begin + 1;
+                response.setStatus(HTTPResponse::HTTP_PARTIAL_CONTENT);
+                response.set("Content-Range", "bytes " + std::to_string(range->begin) + "-" + std::to_string(range->end) + "/" + std::to_string(body.size()));
+            }
         }
+        if (request.getMethod() == "HEAD")
+        {
+            response.setContentLength64(static_cast<int64_t>(len));
+            response.send();
+            return;
+        }
+        response.sendBuffer(body.data() + begin, len);
     }
+
+    const StaticAssetCache &asset_cache;
 };
@@ -6,18 +6,23 @@
 #include "UserHTTPHandler.h"
 #include "StatisticsHTTPHandler.h"
 #include "DocumentHTTPHandler.h"
+#include "ReplicationHTTPHandler.h"
+#include "ServerConfig.h"
 
-using DatabasePtr = std::shared_ptr<Database>;
-using FileSystemDaemonPtr = std::shared_ptr<FileSystemDaemon>;
 class HTTPHandlerFactory : public Poco::Net::HTTPRequestHandlerFactory
 {
 public:
-    HTTPHandlerFactory(std::unordered_map<std::string, std::pair<DatabasePtr, FileSystemDaemonPtr>> user_data_) : user_data(std::move(user_data_)) {}
+    // user_databases: username -> database 名，database 在第一次被访问时由 registry 加载.
+    // distributed_searcher 不为空时作为协调节点，/start-query 分发到各分片
+    HTTPHandlerFactory(std::unordered_map<std::string, std::string> user_databases_, DatabaseRegistry &registry_, const StaticAssetCache &asset_cache_,
+                       const ServerConfig &config, DistributedSearcher *distributed_searcher_ = nullptr)
+        : user_databases(std::move(user_databases_)), registry(registry_), asset_cache(asset_cache_), distributed_searcher(distributed_searcher_),
+          read_only(!config.replica_of.empty()), heavy_limiter(config.heavy_concurrency, config.heavy_max_waiting), heavy_wait(config.heavy_wait_milliseconds) {}
 
     Poco::Net::HTTPRequestHandler * createRequestHandler(const Poco::Net::HTTPServerRequest &request) override
     {
         // some useful: https://stackoverflow.com/questions/13386837/get-url-params-with-poco-library
-        if (request.getMethod() != "GET" && request.getMethod() != "POST" && request.getMethod() != "DOWNLOAD")
+        if (request.getMethod() != "GET" && request.getMethod() != "HEAD" && request.getMethod() != "POST" && request.getMethod() != "DOWNLOAD")
         {
             httpLog("unsupported method: " + request.getMethod());
             THROW(Poco::NotImplementedException());
@@ -26,6 +31,17 @@ public:
         // get /path
         std::string uri_path = Poco::URI(request.getURI()).getPath();
 
+        // HEAD 只用于静态资源：其他 handler 不区分 HEAD，会照常执行并返回响应体
+        if (request.getMethod() == "HEAD")
+        {
+            if (uri_path == "/" || uri_path == "/login" || database_routes.contains(uri_path))
+            {
+                httpLog("unsupported method: HEAD " + uri_path);
+                THROW(Poco::NotImplementedException());
+            }
+            return new GetFileHandler(asset_cache);
+        }
+
         if (uri_path == "/login")
         {
             return new LoginHandler();
@@ -35,22 +51,64 @@ public:
         Poco::Net::HTMLForm form(request);
         auto id_iter = form.find("id");
         if (id_iter == form.end())
-            return new GetFileHandler();
+            return new GetFileHandler(asset_cache);
         std::string id = decrypt(id_iter->second);
 
-        if (!user_data.contains(id))
+        auto db_iter = user_databases.find(id);
+        if (db_iter == user_databases.end())
         {
             return new IllegalAccessHandler();
         }
 
-        Database &db = *user_data[id].first;
-        FileSystemDaemon& daemon = *user_data[id].second;
+        if (distributed_searcher && uri_path == "/start-query")
+        {
+            return limited(new DistributedQueryHandler(*distributed_searcher, id_iter->second));
+        }
 
+        // replica 的索引只由复制修改
+        if (read_only && (uri_path == "/add-index" || uri_path == "/remove-index" || uri_path == "/rebuild-all-index"))
+        {
+            return new ReadOnlyReplicaHandler();
+        }
 
-        if (uri_path == "/")
+        // 只有 database 相关的请求才加载 database
+        if (!database_routes.contains(uri_path))
         {
-            return new HelloHandler();
+            if (uri_path == "/")
+                return new HelloHandler();
+            return new GetFileHandler(asset_cache);
         }
+
+        std::optional<DatabaseRegistry::Lease> lease;
+        try
+        {
+            lease.emplace(registry.acquire(db_iter->second));
+        }
+        catch (Poco::Exception &e)
+        {
+            httpLog("failed to load database " + db_iter->second + ": " + e.displayText());
+            return new DatabaseUnavailableHandler();
+        }
+        catch (std::exception &e)
+        {
+            httpLog("failed to load database " + db_iter->second + ": " + e.what());
+            return new DatabaseUnavailableHandler();
+        }
+        auto *handler = createDatabaseHandler(uri_path, id, lease->getDatabase(), lease->getDaemon());
+        return new LeasedHandler(handler, std::move(*lease));
+    }
+
+private:
+    // 需要持有 database 的请求，与 createDatabaseHandler 中的路径一致
+    inline static const std::unordered_set<std::string> database_routes = {
+        "/add-index", "/remove-index", "/get-all-index", "/rebuild-all-index", "/job-status", "/get-index-info",
+        "/start-query", "/shard-stats", "/shard-search", "/replication/latest", "/replication/file", "/download-document",
+        "/get-type-statistics", "/get-query-statistics", "/get-document-freq-statistics", "/get-document-comment-rating",
+        "/score-document", "/comment-document", "/get-document-property"};
+
+    // uri_path 属于 database_routes
+    Poco::Net::HTTPRequestHandler *createDatabaseHandler(const std::string &uri_path, const std::string &id, Database &db, FileSystemDaemon &daemon)
+    {
         if (uri_path == "/add-index")
         {
             return new AddIndexHandler(daemon);
@@ -67,13 +125,33 @@ public:
         {
             return new RebuildAllIndexHandler(daemon);
         }
+        if (uri_path == "/job-status")
+        {
+            return new GetJobStatusHandler(daemon);
+        }
         if (uri_path == "/get-index-info")
         {
             return new GetIndexInfoHandler(daemon);
         }
         if (uri_path == "/start-query")
         {
-            return new StartQueryHandler(db);
+            return limited(new StartQueryHandler(db));
+        }
+        if (uri_path == "/shard-stats")
+        {
+            return limited(new ShardStatsHandler(db));
+        }
+        if (uri_path == "/shard-search")
+        {
+            return limited(new ShardSearchHandler(db));
+        }
+        if (uri_path == "/replication/latest")
+        {
+            return new ReplicationLatestHandler(db);
+        }
+        if (uri_path == "/replication/file")
+        {
+            return limited(new ReplicationFileHandler(db));
         }
         if (uri_path == "/download-document")
         {
@@ -81,7 +159,7 @@ public:
         }
         if (uri_path == "/get-type-statistics")
         {
-            return new GetTypeStatisticsHandler(daemon);
+            return limited(new GetTypeStatisticsHandler(daemon));
         }
         if (uri_path == "/get-query-statistics")
         {
@@ -107,9 +185,20 @@ public:
         {
             return new GetDocumentPropertyHandler(db);
         }
-        return new GetFileHandler();
+        THROW(UnreachableException());
     }
 
-private:
-    std::unordered_map<std::string, std::pair<DatabasePtr, FileSystemDaemonPtr>> user_data;
+    // 查询、索引增删重建等请求占用工作线程较久，限制同时执行的数量
+    Poco::Net::HTTPRequestHandler *limited(Poco::Net::HTTPRequestHandler *handler)
+    {
+        return new LimitedHandler(handler, heavy_limiter, heavy_wait);
+    }
+
+    std::unordered_map<std::string, std::string> user_databases;
+    DatabaseRegistry &registry;
+    const StaticAssetCache &asset_cache;
+    DistributedSearcher *distributed_searcher;
+    bool read_only;
+    ConcurrencyLimiter heavy_limiter;
+    std::chrono::milliseconds heavy_wait;
 };
\ No newline at end of file
@@ -52,11 +52,11 @@ public:
             out << makeStandardResponse(-1, InvalidParameterMessage, nlohmann::json::object());
             return;
         }
-        httpLog("addIndexPath - " + iter->second + " success.");
+        // 索引在后台执行，通过 /job-status 查询进度
+        auto job_id = daemon.submitAddPath(iter->second);
+        httpLog("addIndexPath - " + iter->second + " submitted, job " + std::to_string(job_id));
 
-        daemon.addPath(iter->second);
-
-        out << makeStandardResponse(0, SuccessMessage, nlohmann::json::object());
+        out << makeStandardResponse(0, SuccessMessage, {{"job_id", job_id}});
     }
 
 private:
@@ -98,26 +98,25 @@ public:
 
     void handleRequest(HTTPServerRequest &request, HTTPServerResponse &response) override
     {
-        auto &out = makeResponseOK(response);
+        auto &out = makeStreamingResponseOK(response);
 
         httpLog("getAllIndex");
 
-        nlohmann::json::array_t path_names;
-        for (const auto &path : daemon.getPaths())
-        {
-            auto path_in_disk = std::filesystem::path(path.first);
-            if (!exists(path_in_disk)) // 忽略已失效的索引条目
-                continue;
-            path_names.push_back(std::unordered_map<std::string, nlohmann::json>{{"path",            path.first},
-                                                                                 {"document_number", path.second.size()},
-                                                                                 {"mtime",           getModifiedLastDateTime(
-                                                                                         path_in_disk).string(true)}});
-        }
-
-        nlohmann::json data(
-                {{"paths", path_names}}
-        );
-        out << makeStandardResponse(0, SuccessMessage, data);
+        writeStandardResponse(out, 0, SuccessMessage, [this](JsonWriter &writer) {
+            writer.key("paths").beginArray();
+            for (const auto &path : daemon.getPaths())
+            {
+                auto path_in_disk = std::filesystem::path(path.first);
+                if (!exists(path_in_disk)) // 忽略已失效的索引条目
+                    continue;
+                writer.beginObject()
+                      .key("path").value(path.first)
+                      .key("document_number").value(path.second.size())
+                      .key("mtime").value(getModifiedLastDateTime(path_in_disk).string(true))
+                      .endObject();
+            }
+            writer.endArray();
+        });
     }
 
 private:
@@ -133,10 +132,10 @@ public:
     {
         auto &out = makeResponseOK(response);
 
-        httpLog("rebuildAllIndex");
+        auto job_id = daemon.submitRebuildAllPaths();
+        httpLog("rebuildAllIndex - submitted, job " + std::to_string(job_id));
 
-        daemon.rebuildAllPaths();
-        out << makeStandardResponse(0, SuccessMessage, nlohmann::json::object());
+        out << makeStandardResponse(0, SuccessMessage, {{"job_id", job_id}});
     }
 
 private:
@@ -150,7 +149,7 @@ public:
 
     void handleRequest(HTTPServerRequest &request, HTTPServerResponse &response) override
     {
-        auto &out = makeResponseOK(response);
+        auto &out = makeStreamingResponseOK(response);
 
         // 获取 GET 方法的参数
         Poco::Net::HTMLForm form(request);
@@ -170,16 +169,63 @@ public:
             ordered_paths_infos.emplace(path_info.second, path_info.first);
         }
 
-        std::vector<nlohmann::json> data;
-        for (const auto &path_info : ordered_paths_infos)
+        writeStandardResponse(out, 0, SuccessMessage, [&ordered_paths_infos](JsonWriter &writer) {
+            writer.key("infos").beginArray();
+            for (const auto &path_info : ordered_paths_infos)
+                writer.beginObject().key("doc_id").value(path_info.first).key("doc_path").value(path_info.second).endObject();
+            writer.endArray();
+        });
+    }
+
+private:
+    FileSystemDaemon &daemon;
+};
+
+// 查询后台索引任务的进度. 指定 job 时返回单个任务，否则返回最近的所有任务
+class GetJobStatusHandler : public HTTPRequestHandler
+{
+public:
+    GetJobStatusHandler(FileSystemDaemon &daemon_) : daemon(daemon_) {}
+
+    void handleRequest(HTTPServerRequest &request, HTTPServerResponse &response) override
+    {
+        Poco::Net::HTMLForm form(request);
+        auto iter = form.find("job");
+        if (iter == form.end())
         {
-            data.emplace_back(std::unordered_map<std::string, nlohmann::json>{{"doc_id",   path_info.first},
-                                                                              {"doc_path", path_info.second}});
+            auto &out = makeStreamingResponseOK(response);
+            auto jobs = daemon.getJobs();
+            writeStandardResponse(out, 0, SuccessMessage, [&jobs](JsonWriter &writer) {
+                writer.key("jobs").beginArray();
+                for (const auto &job : jobs)
+                    writeJson(writer, job);
+                writer.endArray();
+            });
+            return;
         }
 
-        out << makeStandardResponse(0, SuccessMessage, std::unordered_map<std::string, nlohmann::json>{{"infos", data}});
+        auto &out = makeResponseOK(response);
+        std::optional<IndexJobProgress> job;
+        try
+        {
+            job = daemon.getJob(restrictStoi<uint64_t>(iter->second));
+        }
+        catch (Poco::InvalidArgumentException &)
+        {
+            out << makeStandardResponse(-1, InvalidParameterMessage, nlohmann::json::object());
+            return;
+        }
+        if (!job)
+        {
+            out << makeStandardResponse(-1, NotFoundMessage, nlohmann::json::object());
+            return;
+        }
+        writeStandardResponse(out, 0, SuccessMessage, [&job](JsonWriter &writer) {
+            writer.key("job");
+            writeJson(writer, *job);
+        });
     }
 
 private:
     FileSystemDaemon &daemon;
-};
\ No newline at end of file
+};
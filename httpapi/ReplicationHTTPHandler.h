@@ -0,0 +1,71 @@
+#pragma once
+
+#include "../typedefs.h"
+#include "HTTPHandler.h"
+#include "storage/Replication.h"
+
+const char * ReadOnlyReplicaMessage = R"(只读副本，请在主节点上修改索引)";
+
+// primary 上最新快照的文件列表，还没有快照时 data 为空对象
+class ReplicationLatestHandler : public HTTPRequestHandler
+{
+public:
+    ReplicationLatestHandler(Database &db_) : db(db_) {}
+
+    void handleRequest(HTTPServerRequest &request, HTTPServerResponse &response) override
+    {
+        auto &out = makeResponseOK(response, "application/json; charset=utf-8");
+        auto manifest = SnapshotDirectory(db.getPath()).latest();
+        out << makeStandardResponse(0, SuccessMessage, manifest ? nlohmann::json(*manifest) : nlohmann::json::object());
+    }
+
+private:
+    Database &db;
+};
+
+// 下载快照中的一个文件，支持 Range 断点续传
+class ReplicationFileHandler : public HTTPRequestHandler
+{
+public:
+    ReplicationFileHandler(Database &db_) : db(db_) {}
+
+    void handleRequest(HTTPServerRequest &request, HTTPServerResponse &response) override
+    {
+        Poco::Net::HTMLForm form(request);
+        auto version_iter = form.find("version"), name_iter = form.find("name");
+
+        std::optional<std::filesystem::path> path;
+        try
+        {
+            if (version_iter != form.end() && name_iter != form.end())
+                path = SnapshotDirectory(db.getPath()).filePath(restrictStoi<uint64_t>(version_iter->second), name_iter->second);
+        }
+        catch (Poco::InvalidArgumentException &e)
+        {
+        }
+
+        // 快照可能已经被更新的快照替换，replica 下一轮会重新获取最新的文件列表
+        if (!path || !sendFileResponse(request, response, *path, "application/octet-stream"))
+        {
+            response.setStatus(HTTPResponse::HTTP_NOT_FOUND);
+            response.setContentType("application/json; charset=utf-8");
+            setAccessControlHeaders(response);
+            response.send() << makeStandardResponse(-1, NotFoundMessage, nlohmann::json::object());
+        }
+    }
+
+private:
+    Database &db;
+};
+
+// replica 上修改索引的请求
+class ReadOnlyReplicaHandler : public HTTPRequestHandler
+{
+public:
+    void handleRequest(HTTPServerRequest &request, HTTPServerResponse &response) override
+    {
+        auto &out = makeResponseOK(response);
+        httpLog("rejected on read-only replica: " + request.getURI());
+        out << makeStandardResponse(-1, ReadOnlyReplicaMessage, nlohmann::json::object());
+    }
+};
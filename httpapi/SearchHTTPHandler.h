@@ -3,35 +3,54 @@
 #include "../typedefs.h"
 #include "HTTPHandler.h"
 #include "searcher/Searcher.h"
+#include "searcher/DistributedSearcher.h"
 
-class StartQueryHandler : public HTTPRequestHandler
+// GET 参数与 POST 的 JSON 参数合并到一起
+Poco::Net::HTMLForm readQueryParameters(HTTPServerRequest &request)
 {
-public:
-    StartQueryHandler(Database &db_) : db(db_) {}
+    Poco::Net::HTMLForm form(request);
 
-    void handleRequest(HTTPServerRequest &request, HTTPServerResponse &response) override
+    auto len = request.getContentLength();
+    if (len > 0)
     {
-        auto &out = makeResponseOK(response);
-
-        // 获取 GET 方法的参数
-        Poco::Net::HTMLForm form(request);
-
-        // 获取 POST 方法的参数
-        auto len = request.getContentLength();
-        if (len > 0)
+        std::string buf(len, '\0');
+        request.stream().read(buf.data(), len);
+        nlohmann::json data = nlohmann::json::parse(buf);
+        if (data.is_object())
         {
-            char *buf = new char[len];
-            request.stream().read(buf, len);
-            nlohmann::json data = nlohmann::json::parse(std::string(buf, len));
-            if (data.is_object())
+            for (auto iter = data.begin(); iter != data.end(); ++iter)
             {
-                for (auto iter = data.begin(); iter != data.end(); ++iter)
-                {
-                    form.add(iter.key(), iter.value());
-                }
+                // offset/limit 等参数可能是 JSON 数字
+                form.add(iter.key(), iter.value().is_string() ? iter.value().get<std::string>() : iter.value().dump());
             }
         }
+    }
+    return form;
+}
+
+// 分页参数：offset/limit，或者上一页返回的 cursor. 参数不合法时抛出 InvalidArgumentException
+PageRequest readPageRequest(const Poco::Net::HTMLForm &form)
+{
+    PageRequest page_request;
+    if (auto offset_iter = form.find("offset"); offset_iter != form.end())
+        page_request.offset = restrictStoi<size_t>(offset_iter->second);
+    if (auto limit_iter = form.find("limit"); limit_iter != form.end())
+        page_request.limit = std::min(restrictStoi<size_t>(limit_iter->second), SEARCH_MAX_PAGE_SIZE);
+    if (auto cursor_iter = form.find("cursor"); cursor_iter != form.end() && !cursor_iter->second.empty())
+        page_request.cursor = cursor_iter->second;
+    return page_request;
+}
+
+class StartQueryHandler : public HTTPRequestHandler
+{
+public:
+    StartQueryHandler(Database &db_) : db(db_) {}
 
+    void handleRequest(HTTPServerRequest &request, HTTPServerResponse &response) override
+    {
+        auto &out = makeStreamingResponseOK(response);
+
+        auto form = readQueryParameters(request);
         auto iter = form.find("query");
         if (iter == form.end())
         {
@@ -40,27 +59,204 @@ public:
         }
         std::string query = iter->second;
 
+        PageRequest page_request;
+        try
+        {
+            page_request = readPageRequest(form);
+        }
+        catch (Poco::InvalidArgumentException& e)
+        {
+            out << makeStandardResponse(-1, InvalidParameterMessage, nlohmann::json::object());
+            return;
+        }
+
         httpLog("starting query - " + query);
 
-        SearchResultSet result_set;
+        SearchPage page;
         try
         {
-            result_set = Searcher(db).search(query);
+            page = Searcher(db).search(query, page_request);
         }
         catch (const QueryException& e)
         {
             httpLog("query syntax error, return empty result");
         }
+        catch (const Poco::InvalidArgumentException& e)
+        {
+            out << makeStandardResponse(-1, InvalidParameterMessage, nlohmann::json::object());
+            return;
+        }
+
+        writeStandardResponse(out, 0, SuccessMessage, [&page](JsonWriter& writer) {
+            writer.key("results").beginArray();
+            for (const auto& result : page.results)
+                writeJson(writer, result);
+            writer.endArray().key("total").value(page.total).key("next_cursor");
+            if (page.next_cursor.has_value())
+                writer.value(*page.next_cursor);
+            else
+                writer.null();
+        });
+    }
+
+private:
+    Database &db;
+};
+
+// 协调节点合并后的前缀扩展结果，没有时返回空. 格式错误时抛出 nlohmann::json::exception
+std::optional<std::vector<std::string>> readExpandedTerms(const Poco::Net::HTMLForm &form)
+{
+    auto iter = form.find("terms");
+    if (iter == form.end())
+        return std::nullopt;
+    return nlohmann::json::parse(iter->second).get<std::vector<std::string>>();
+}
+
+// 分布式查询第一轮，由协调节点调用：返回本分片的统计量. 单个词的查询没有给定 terms 时，
+// 按本分片的前缀扩展结果统计，并在 terms 中返回扩展结果供协调节点合并
+class ShardStatsHandler : public HTTPRequestHandler
+{
+public:
+    ShardStatsHandler(Database &db_) : db(db_) {}
+
+    void handleRequest(HTTPServerRequest &request, HTTPServerResponse &response) override
+    {
+        auto &out = makeResponseOK(response, "application/json; charset=utf-8");
+
+        auto form = readQueryParameters(request);
+        auto iter = form.find("query");
+        if (iter == form.end())
+        {
+            out << makeStandardResponse(-1, InvalidParameterMessage, nlohmann::json::object());
+            return;
+        }
+
+        nlohmann::json data = nlohmann::json(CollectionStatistics{});
+        try
+        {
+            auto terms = readExpandedTerms(form);
+            auto expanded_terms = terms ? terms : Searcher(db).expandPrefix(iter->second);
+            data = nlohmann::json(Searcher(db, nullptr, expanded_terms).collectStatistics(iter->second));
+            if (!terms && expanded_terms)
+                data["terms"] = *expanded_terms;
+        }
+        catch (const QueryException& e)
+        {
+            httpLog("query syntax error, return empty statistics");
+        }
+        catch (const nlohmann::json::exception& e)
+        {
+            out << makeStandardResponse(-1, InvalidParameterMessage, nlohmann::json::object());
+            return;
+        }
+        out << makeStandardResponse(0, SuccessMessage, data);
+    }
+
+private:
+    Database &db;
+};
 
-        nlohmann::json::array_t data;
-        for (const auto& result : result_set)
-            data.push_back(nlohmann::json(result));
+// 分布式查询第二轮，由协调节点调用：按全局统计量与合并后的 terms 计算分数，返回前 limit 个结果
+class ShardSearchHandler : public HTTPRequestHandler
+{
+public:
+    ShardSearchHandler(Database &db_) : db(db_) {}
+
+    void handleRequest(HTTPServerRequest &request, HTTPServerResponse &response) override
+    {
+        auto &out = makeStreamingResponseOK(response, "application/json; charset=utf-8");
+
+        auto form = readQueryParameters(request);
+        auto query_iter = form.find("query"), limit_iter = form.find("limit"), stats_iter = form.find("stats");
+        if (query_iter == form.end() || limit_iter == form.end() || stats_iter == form.end())
+        {
+            out << makeStandardResponse(-1, InvalidParameterMessage, nlohmann::json::object());
+            return;
+        }
 
-        nlohmann::json json;
-        json["results"] = data;
-        out << makeStandardResponse(0, SuccessMessage, json);
+        SearchPage page;
+        try
+        {
+            auto stats = std::make_shared<const CollectionStatistics>(nlohmann::json::parse(stats_iter->second).get<CollectionStatistics>());
+            PageRequest page_request{.limit = std::min(restrictStoi<size_t>(limit_iter->second), SEARCH_MAX_RESULTS)};
+            page = Searcher(db, std::move(stats), readExpandedTerms(form)).search(query_iter->second, page_request);
+        }
+        catch (const QueryException& e)
+        {
+            httpLog("query syntax error, return empty result");
+        }
+        catch (const Poco::InvalidArgumentException& e)
+        {
+            out << makeStandardResponse(-1, InvalidParameterMessage, nlohmann::json::object());
+            return;
+        }
+        catch (const nlohmann::json::exception& e)
+        {
+            out << makeStandardResponse(-1, InvalidParameterMessage, nlohmann::json::object());
+            return;
+        }
+
+        writeStandardResponse(out, 0, SuccessMessage, [&page](JsonWriter& writer) {
+            writer.key("results").beginArray();
+            for (const auto& result : page.results)
+                writeJson(writer, result);
+            writer.endArray().key("total").value(page.total);
+        });
     }
 
 private:
     Database &db;
 };
+
+// 协调节点上的 /start-query：把查询分发到各分片并合并结果. id 原样转发给分片
+class DistributedQueryHandler : public HTTPRequestHandler
+{
+public:
+    DistributedQueryHandler(DistributedSearcher &searcher_, std::string id_) : searcher(searcher_), id(std::move(id_)) {}
+
+    void handleRequest(HTTPServerRequest &request, HTTPServerResponse &response) override
+    {
+        auto &out = makeStreamingResponseOK(response);
+
+        auto form = readQueryParameters(request);
+        auto iter = form.find("query");
+        if (iter == form.end())
+        {
+            out << makeStandardResponse(-1, InvalidParameterMessage, nlohmann::json::object());
+            return;
+        }
+
+        httpLog("starting distributed query - " + iter->second);
+
+        DistributedSearchPage page;
+        try
+        {
+            page = searcher.search(iter->second, readPageRequest(form), id);
+        }
+        catch (const Poco::InvalidArgumentException& e)
+        {
+            out << makeStandardResponse(-1, InvalidParameterMessage, nlohmann::json::object());
+            return;
+        }
+        if (page.isPartial())
+            httpLog("distributed query returned partial results, " + std::to_string(page.failed_shards.size()) + " shards failed");
+
+        writeStandardResponse(out, 0, SuccessMessage, [&page](JsonWriter& writer) {
+            writer.key("results").beginArray();
+            for (const auto& result : page.results)
+                writeJson(writer, result);
+            writer.endArray()
+                  .key("total").value(page.total)
+                  .key("next_cursor").null()
+                  .key("partial").value(page.isPartial())
+                  .key("failed_shards").beginArray();
+            for (size_t shard : page.failed_shards)
+                writer.value(shard);
+            writer.endArray();
+        });
+    }
+
+private:
+    DistributedSearcher &searcher;
+    std::string id;
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "../typedefs.h"
+#include "utils/StringUtils.h"
+#include <Poco/Net/HTTPServerParams.h>
+#include <Poco/Timespan.h>
+
+// HTTP 服务的并发配置，可以用命令行参数 --name=value 覆盖默认值，例如 --max-threads=32 --heavy-concurrency=4
+struct ServerConfig
+{
+    uint16_t port = 8080;
+    int min_threads = 2;
+    int max_threads = static_cast<int>(std::max(16u, std::thread::hardware_concurrency() * 2));
+    int max_queued = 64; // 等待工作线程的连接数，超出后新连接被拒绝
+    int thread_idle_seconds = 60;
+
+    bool keep_alive = true; // 同一连接上的请求按顺序处理，支持 pipelining
+    int max_keep_alive_requests = 100;
+    int keep_alive_timeout_seconds = 10;
+
+    // 查询、重建索引等开销大的请求最多同时执行的数量，其余工作线程留给静态文件等轻量请求
+    int heavy_concurrency = std::max(1, max_threads / 2);
+    int heavy_wait_milliseconds = 2000; // 等待超过该时间返回 503
+    // 排队等待的请求也占着工作线程，超出时立即返回 503
+    int heavy_max_waiting = std::max(0, max_threads - heavy_concurrency - HTTP_LIGHT_RESERVED_THREADS);
+
+    // database 在第一次访问时加载，空闲超时或超出内存预算时卸载
+    int database_idle_seconds = DATABASE_IDLE_SECONDS;
+    int database_memory_mb = static_cast<int>(DATABASE_MEMORY_BUDGET_BYTES / 1024 / 1024);
+
+    // 非空时作为协调节点，把查询分发到这些分片（host:port，逗号分隔）
+    std::vector<std::string> shards;
+    int shard_timeout_milliseconds = 3000; // 每个分片每一轮请求的超时，超时的分片不计入结果
+
+    // 主从复制：primary 开启 publish_snapshots 定时生成快照；replica 指定 replica_of（host:port），只读并定时拉取快照
+    bool publish_snapshots = false;
+    std::string replica_of;
+    int replication_interval_seconds = REPLICATION_INTERVAL_SECONDS;
+
+    static ServerConfig parse(const std::vector<std::string>& args)
+    {
+        ServerConfig config;
+        bool heavy_concurrency_set = false, heavy_max_waiting_set = false;
+        const std::unordered_map<std::string, int*> int_options = {
+                {"min-threads",             &config.min_threads},
+                {"max-threads",             &config.max_threads},
+                {"max-queued",              &config.max_queued},
+                {"thread-idle-seconds",     &config.thread_idle_seconds},
+                {"max-keep-alive-requests", &config.max_keep_alive_requests},
+                {"keep-alive-timeout",      &config.keep_alive_timeout_seconds},
+                {"heavy-concurrency",       &config.heavy_concurrency},
+                {"heavy-wait-ms",           &config.heavy_wait_milliseconds},
+                {"heavy-max-waiting",       &config.heavy_max_waiting},
+                {"db-idle-seconds",         &config.database_idle_seconds},
+                {"db-memory-mb",            &config.database_memory_mb},
+                {"shard-timeout-ms",        &config.shard_timeout_milliseconds},
+                {"replication-interval",    &config.replication_interval_seconds}};
+
+        for (const auto& arg : args)
+        {
+            auto eq = arg.find('=');
+            if (!arg.starts_with("--") || eq == std::string::npos)
+                THROW(Poco::InvalidArgumentException("expect --name=value, got " + arg));
+            auto name = arg.substr(2, eq - 2), value = arg.substr(eq + 1);
+
+            if (name == "port")
+                config.port = restrictStoi<uint16_t>(value);
+            else if (name == "shards")
+            {
+                Poco::StringTokenizer tokens(value, ",", Poco::StringTokenizer::TOK_TRIM | Poco::StringTokenizer::TOK_IGNORE_EMPTY);
+                config.shards.assign(tokens.begin(), tokens.end());
+            }
+            else if (name == "publish-snapshots")
+                config.publish_snapshots = value == "true" || value == "1";
+            else if (name == "replica-of")
+                config.replica_of = value;
+            else if (name == "keep-alive")
+                config.keep_alive = value == "true" || value == "1";
+            else if (auto iter = int_options.find(name); iter != int_options.end())
+            {
+                *iter->second = restrictStoi<int>(value);
+                if (*iter->second < 0)
+                    THROW(Poco::InvalidArgumentException("negative value for --" + name));
+                heavy_concurrency_set |= name == "heavy-concurrency";
+                heavy_max_waiting_set |= name == "heavy-max-waiting";
+            }
+            else
+                THROW(Poco::InvalidArgumentException("unknown option --" + name));
+        }
+
+        if (!heavy_concurrency_set)
+            config.heavy_concurrency = std::max(1, config.max_threads / 2);
+        if (!heavy_max_waiting_set)
+            config.heavy_max_waiting = std::max(0, config.max_threads - config.heavy_concurrency - HTTP_LIGHT_RESERVED_THREADS);
+        if (config.max_threads < 1 || config.min_threads > config.max_threads || config.heavy_concurrency < 1)
+            THROW(Poco::InvalidArgumentException("invalid thread configuration"));
+        if (config.replication_interval_seconds < 1 || (config.publish_snapshots && !config.replica_of.empty()))
+            THROW(Poco::InvalidArgumentException("invalid replication configuration"));
+        return config;
+    }
+
+    // HTTPServer 接管返回的指针
+    Poco::Net::HTTPServerParams* makeParams() const
+    {
+        auto* params = new Poco::Net::HTTPServerParams;
+        params->setMaxThreads(max_threads);
+        params->setMaxQueued(max_queued);
+        params->setThreadIdleTime(Poco::Timespan(thread_idle_seconds, 0));
+        params->setKeepAlive(keep_alive);
+        params->setMaxKeepAliveRequests(max_keep_alive_requests);
+        params->setKeepAliveTimeout(Poco::Timespan(keep_alive_timeout_seconds, 0));
+        return params;
+    }
+};
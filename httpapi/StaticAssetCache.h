@@ -0,0 +1,155 @@
+#pragma once
+
+#include "../typedefs.h"
+#include <Poco/DeflatingStream.h>
+
+struct StaticAsset
+{
+    std::string content_type;
+    std::string cache_control;
+    std::string body;
+    std::string etag;
+    std::string gzip_body; // 压缩收益不大（图片、音频等）时为空
+    std::string gzip_etag;
+};
+
+// 前端静态资源在启动时一次性读入内存，之后只读，请求时不访问磁盘.
+// 文本类资源预先 gzip 压缩；超过 STATIC_ASSET_MAX_FILE_SIZE 的文件不缓存，由 GetFileHandler 从磁盘发送.
+class StaticAssetCache
+{
+public:
+    StaticAssetCache() = default;
+
+    explicit StaticAssetCache(const std::filesystem::path &root)
+    {
+        if (!is_directory(root))
+            return;
+        for (const auto &entry : std::filesystem::recursive_directory_iterator(root, std::filesystem::directory_options::skip_permission_denied))
+        {
+            if (!entry.is_regular_file() || entry.file_size() > STATIC_ASSET_MAX_FILE_SIZE)
+                continue;
+            std::ifstream fin(entry.path(), std::ios::binary);
+            if (!fin.is_open())
+                continue;
+
+            StaticAsset asset;
+            asset.body = std::string(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+            asset.content_type = contentType(entry.path());
+            // html 引用其他资源且文件名不带版本号，需要每次验证；其余资源允许短期缓存
+            asset.cache_control = entry.path().extension() == ".html" ? "no-cache" : "public, max-age=3600";
+            asset.etag = makeETag(asset.body);
+            if (isCompressible(asset.content_type))
+            {
+                auto compressed = gzip(asset.body);
+                if (compressed.size() < asset.body.size() * 9 / 10)
+                {
+                    asset.gzip_body = std::move(compressed);
+                    asset.gzip_etag = asset.etag.substr(0, asset.etag.size() - 1) + "-gz\"";
+                }
+            }
+            total_bytes += asset.body.size() + asset.gzip_body.size();
+            assets.emplace("/" + relative(entry.path(), root).generic_string(), std::move(asset));
+        }
+    }
+
+    // uri_path 形如 "/app.html"，找不到时返回 nullptr
+    const StaticAsset *find(const std::string &uri_path) const
+    {
+        auto iter = assets.find(uri_path);
+        return iter == assets.end() ? nullptr : &iter->second;
+    }
+
+    size_t size() const
+    {
+        return assets.size();
+    }
+
+    size_t getBytes() const
+    {
+        return total_bytes;
+    }
+
+    static std::string contentType(const std::filesystem::path &path)
+    {
+        static const std::unordered_map<std::string, std::string> content_types = {
+                {".html", "text/html;charset=UTF-8"},
+                {".css",  "text/css; charset=utf-8"},
+                {".js",   "text/javascript; charset=utf-8"},
+                {".json", "application/json; charset=utf-8"},
+                {".svg",  "image/svg+xml"},
+                {".png",  "image/png"},
+                {".jpg",  "image/jpeg"},
+                {".jpeg", "image/jpeg"},
+                {".gif",  "image/gif"},
+                {".ico",  "image/x-icon"},
+                {".mp3",  "audio/mpeg"},
+                {".woff", "font/woff"},
+                {".woff2", "font/woff2"},
+                {".ttf",  "font/ttf"},
+                {".txt",  "text/plain; charset=utf-8"}};
+        auto iter = content_types.find(path.extension().string());
+        return iter == content_types.end() ? "application/octet-stream" : iter->second;
+    }
+
+    // 按 Accept-Encoding 的 q 值判断客户端是否接受 gzip："gzip;q=0" 表示拒绝；没有单独列出 gzip 时看 "*"
+    static bool acceptsGzip(const std::string &accept_encoding)
+    {
+        std::optional<bool> gzip, any;
+        Poco::StringTokenizer codings(accept_encoding, ",", Poco::StringTokenizer::TOK_TRIM | Poco::StringTokenizer::TOK_IGNORE_EMPTY);
+        for (const auto &coding : codings)
+        {
+            Poco::StringTokenizer parts(coding, ";", Poco::StringTokenizer::TOK_TRIM | Poco::StringTokenizer::TOK_IGNORE_EMPTY);
+            if (parts.count() == 0)
+                continue;
+            double q = 1;
+            for (size_t i = 1; i < parts.count(); i++)
+            {
+                auto param = Poco::toLower(parts[i]);
+                if (!param.starts_with("q="))
+                    continue;
+                char *end = nullptr;
+                q = std::strtod(param.c_str() + 2, &end);
+                if (end == param.c_str() + 2 || *end != '\0')
+                    q = 0; // 无法解析的 q 值按不接受处理
+            }
+            auto name = Poco::toLower(parts[0]);
+            if (name == "gzip" || name == "x-gzip")
+                gzip = q > 0;
+            else if (name == "*")
+                any = q > 0;
+        }
+        return gzip.value_or(any.value_or(false));
+    }
+
+private:
+    static bool isCompressible(const std::string &content_type)
+    {
+        return content_type.starts_with("text/") || content_type.starts_with("application/json") || content_type == "image/svg+xml";
+    }
+
+    static std::string gzip(const std::string &data)
+    {
+        std::ostringstream oss;
+        Poco::DeflatingOutputStream deflater(oss, Poco::DeflatingStreamBuf::STREAM_GZIP, 9);
+        deflater.write(data.data(), static_cast<std::streamsize>(data.size()));
+        deflater.close();
+        return oss.str();
+    }
+
+    // 强 ETag：内容的 FNV-1a 哈希
+    static std::string makeETag(const std::string &data)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (char ch : data)
+        {
+            hash ^= static_cast<unsigned char>(ch);
+            hash *= 1099511628211ull;
+        }
+        std::ostringstream oss;
+        oss << '"' << std::hex << hash << '-' << data.size() << '"';
+        return oss.str();
+    }
+
+    std::unordered_map<std::string, StaticAsset> assets;
+    size_t total_bytes = 0;
+};
@@ -35,25 +35,29 @@ public:
 
     void handleRequest(HTTPServerRequest &request, HTTPServerResponse &response) override
     {
-        auto &out = makeResponseOK(response);
+        auto &out = makeStreamingResponseOK(response);
 
         httpLog("getQueryStatistics");
 
         QueryStatisticsMap stat_map = db.getAllQueryStatistics();
-
-        nlohmann::json::array_t x_data, query_array, elapsed_time_array, result_num_array;
-        for (const auto&[time, stat] : stat_map)
-        {
-            x_data.push_back(time.string(true));
-            query_array.push_back(stat->query);
-            elapsed_time_array.push_back(stat->elapsed_time);
-            result_num_array.push_back(stat->result_num);
-        }
-        out << makeStandardResponse(0, SuccessMessage,
-                                    {{"x_strings",         x_data},
-                                     {"query_vals",        query_array},
-                                     {"elapsed_time_vals", elapsed_time_array},
-                                     {"result_num_vals",   result_num_array}});
+        const auto &query_cache = db.getQueryCache();
+
+        // 每个数组单独遍历一次 stat_map，不需要在内存中构造完整的 json
+        auto writeArray = [&stat_map](JsonWriter &writer, const char *name, auto&& writeElement) {
+            writer.key(name).beginArray();
+            for (const auto&[time, stat] : stat_map)
+                writeElement(writer, time, stat);
+            writer.endArray();
+        };
+        writeStandardResponse(out, 0, SuccessMessage, [&](JsonWriter &writer) {
+            writeArray(writer, "x_strings", [](JsonWriter &w, const DateTime &time, const QueryStatisticsPtr &) { w.value(time.string(true)); });
+            writeArray(writer, "query_vals", [](JsonWriter &w, const DateTime &, const QueryStatisticsPtr &stat) { w.value(stat->query); });
+            writeArray(writer, "elapsed_time_vals", [](JsonWriter &w, const DateTime &, const QueryStatisticsPtr &stat) { w.value(stat->elapsed_time); });
+            writeArray(writer, "result_num_vals", [](JsonWriter &w, const DateTime &, const QueryStatisticsPtr &stat) { w.value(stat->result_num); });
+            writer.key("cache_hits").value(query_cache.getHits())
+                  .key("cache_misses").value(query_cache.getMisses())
+                  .key("cache_hit_rate").value(query_cache.getHitRate());
+        });
     }
 
 private:
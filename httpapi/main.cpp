@@ -1,31 +1,23 @@
 #include "HTTPHandlerFactory.h"
 #include "ErrorHandler.h"
+#include "daemon/ReplicationService.h"
+#include <Poco/ThreadPool.h>
 #include <iostream>
 
 using namespace Poco::Net;
 
-void run()
+void run(const ServerConfig &config)
 {
-    std::unordered_map<std::string, std::pair<DatabasePtr, FileSystemDaemonPtr>> user_database;
     FileSystemDaemons daemons;
+    // database 在第一次被访问时加载，空闲或超出内存预算时卸载. replica 不监听文件变化
+    DatabaseRegistry registry(ROOT_PATH + "/database", daemons, std::chrono::seconds(config.database_idle_seconds),
+                              static_cast<uint64_t>(config.database_memory_mb) * 1024 * 1024, !config.replica_of.empty());
 
-    // db_name -> (username, password)
-    std::unordered_map<std::string, std::vector<std::pair<std::string, std::string>>> db_with_users;
-
+    // username -> db_name
+    std::unordered_map<std::string, std::string> user_databases;
     for (const UserAttribute &user_attribute : USERNAME_PASSWORDS)
     {
-        db_with_users[user_attribute.database_name].push_back(std::make_pair(user_attribute.username, user_attribute.password));
-    }
-
-    for (const auto&[db_name, users] : db_with_users)
-    {
-        auto db = std::make_shared<Database>(ROOT_PATH + "/database/" + db_name, true);
-
-        auto daemon = std::make_shared<FileSystemDaemon>(*db);
-        daemons.add(daemon);
-
-        for (const auto& [username, _] : users)
-            user_database.emplace(username, std::make_pair(db, daemon));
+        user_databases.emplace(user_attribute.username, user_attribute.database_name);
     }
 
     // 启动 Daemon
@@ -33,13 +25,68 @@ void run()
     Poco::TimerCallback<FileSystemDaemons> callback(daemons, &FileSystemDaemons::run);
     daemon_timer.start(callback);
 
+    Poco::Timer eviction_timer(DAEMON_INTERVAL_SECONDS * 1000, DAEMON_INTERVAL_SECONDS * 1000);
+    Poco::TimerCallback<DatabaseRegistry> eviction_callback(registry, &DatabaseRegistry::run);
+    eviction_timer.start(eviction_callback);
+
+    // 主从复制
+    std::unique_ptr<SnapshotPublishers> snapshot_publishers;
+    std::unique_ptr<SnapshotFollowers> snapshot_followers;
+    Poco::Timer replication_timer(0, config.replication_interval_seconds * 1000);
+    if (config.publish_snapshots)
+    {
+        snapshot_publishers = std::make_unique<SnapshotPublishers>(registry);
+        replication_timer.start(Poco::TimerCallback<SnapshotPublishers>(*snapshot_publishers, &SnapshotPublishers::run));
+    }
+    else if (!config.replica_of.empty())
+    {
+        auto colon = config.replica_of.rfind(':');
+        if (colon == std::string::npos || colon == 0)
+            THROW(Poco::InvalidArgumentException("expect --replica-of=host:port, got " + config.replica_of));
+        std::string host = config.replica_of.substr(0, colon);
+        auto port = restrictStoi<uint16_t>(config.replica_of.substr(colon + 1));
+
+        // 以该 database 的任一用户身份访问 primary
+        std::unordered_map<std::string, std::string> database_ids;
+        for (const auto& [username, db_name] : user_databases)
+            database_ids.emplace(db_name, encrypt(username));
+
+        snapshot_followers = std::make_unique<SnapshotFollowers>(registry, [host, port, database_ids](const std::string& db_name) -> std::unique_ptr<ReplicationSource> {
+            auto iter = database_ids.find(db_name);
+            if (iter == database_ids.end())
+                return nullptr;
+            return std::make_unique<HTTPReplicationSource>(host, port, iter->second, std::chrono::seconds(REPLICATION_TIMEOUT_SECONDS));
+        });
+        replication_timer.start(Poco::TimerCallback<SnapshotFollowers>(*snapshot_followers, &SnapshotFollowers::run));
+        httpLog("replicating from " + config.replica_of);
+    }
+
     // 注册异常handler
     MyErrorHandler my_error_handler;
     Poco::ErrorHandler::set(&my_error_handler);
 
     // 注册 http 服务
-    HTTPServer server(new HTTPHandlerFactory(user_database), ServerSocket(8080), new HTTPServerParams);
+    // 前端资源只在启动时读取一次
+    StaticAssetCache asset_cache(RESOURCE_PATH);
+    httpLog("loaded " + std::to_string(asset_cache.size()) + " static assets, " + std::to_string(asset_cache.getBytes()) + " bytes");
+
+    // 连接由独立的线程池处理，工作线程数、排队连接数和 keep-alive 由 config 决定
+    Poco::ThreadPool thread_pool("http", config.min_threads, config.max_threads, config.thread_idle_seconds);
+    // 配置了分片时作为协调节点
+    std::unique_ptr<HTTPShardTransport> shard_transport;
+    std::unique_ptr<DistributedSearcher> distributed_searcher;
+    if (!config.shards.empty())
+    {
+        shard_transport = std::make_unique<HTTPShardTransport>(config.shards, std::chrono::milliseconds(config.shard_timeout_milliseconds));
+        distributed_searcher = std::make_unique<DistributedSearcher>(*shard_transport, std::chrono::milliseconds(config.shard_timeout_milliseconds));
+        httpLog("coordinating " + std::to_string(config.shards.size()) + " shards");
+    }
+
+    HTTPServer server(new HTTPHandlerFactory(user_databases, registry, asset_cache, config, distributed_searcher.get()),
+                      thread_pool, ServerSocket(config.port), config.makeParams());
     server.start();
+    httpLog("listening on port " + std::to_string(config.port) + ", max threads " + std::to_string(config.max_threads)
+            + ", heavy concurrency " + std::to_string(config.heavy_concurrency) + ", heavy max waiting " + std::to_string(config.heavy_max_waiting));
 
     std::string instruction;
     while (std::cin >> instruction)
@@ -51,13 +98,20 @@ void run()
         }
     }
     server.stopAll(true);
+    replication_timer.stop();
+    eviction_timer.stop();
+    daemon_timer.stop();
 }
 
 int main(int argc, char **argv)
 {
     if (argc < 3)
     {
-        std::cout << "usage: ./server <articles_path> <frontend_path>" << std::endl;
+        std::cout << "usage: ./server <articles_path> <frontend_path> [--port=8080] [--max-threads=N] [--max-queued=N] "
+                     "[--keep-alive=true] [--max-keep-alive-requests=N] [--keep-alive-timeout=SECONDS] "
+                     "[--heavy-concurrency=N] [--heavy-wait-ms=N] [--db-idle-seconds=N] [--db-memory-mb=N] "
+                     "[--shards=host:port,host:port] [--shard-timeout-ms=N] "
+                     "[--publish-snapshots=true | --replica-of=host:port] [--replication-interval=SECONDS]" << std::endl;
         exit(1);
     }
 
@@ -66,7 +120,7 @@ int main(int argc, char **argv)
 
     try
     {
-        run();
+        run(ServerConfig::parse(std::vector<std::string>(argv + 3, argv + argc)));
     } catch (Poco::Exception &e)
     {
         std::cout << "exception " << e.what() << " " << e.message() << std::endl;
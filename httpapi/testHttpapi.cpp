@@ -0,0 +1,339 @@
+#include "../typedefs.h"
+#include "HTTPHandlerFactory.h"
+
+// 不经过网络的请求与响应，响应内容写入 body
+class MockServerResponse : public HTTPServerResponse
+{
+public:
+    void sendContinue() {}
+    std::ostream& send() { is_sent = true; return body; }
+    std::pair<std::ostream *, std::ostream *> beginSend() { is_sent = true; return {&body, &body}; }
+    void sendFile(const std::string &, const std::string &) {}
+    void sendBuffer(const void *buffer, std::size_t length) { is_sent = true; body.write(static_cast<const char *>(buffer), length); }
+    void redirect(const std::string &, HTTPStatus = HTTP_FOUND) {}
+    void requireAuthentication(const std::string &) {}
+    bool sent() const { return is_sent; }
+
+    std::ostringstream body;
+    bool is_sent = false;
+};
+
+class MockServerRequest : public HTTPServerRequest
+{
+public:
+    explicit MockServerRequest(const std::string &method = "GET", const std::string &uri = "/")
+    {
+        setMethod(method);
+        setURI(uri);
+    }
+
+    std::istream& stream() { return in; }
+    bool expectContinue() const { return false; }
+    const SocketAddress& clientAddress() const { return address; }
+    const SocketAddress& serverAddress() const { return address; }
+    const HTTPServerParams& serverParams() const { return *params; }
+    HTTPServerResponse& response() const { return mock_response; }
+    bool secure() const { return false; }
+
+    mutable MockServerResponse mock_response;
+
+private:
+    std::istringstream in;
+    SocketAddress address;
+    HTTPServerParams *params = nullptr;
+};
+
+TEST(HTTPHandler, parseByteRange)
+{
+    auto range = parseByteRange("bytes=0-9", 100);
+    ASSERT_TRUE(range.has_value());
+    ASSERT_EQ(range->begin, 0);
+    ASSERT_EQ(range->end, 9);
+
+    range = parseByteRange("bytes=90-", 100);
+    ASSERT_EQ(range->begin, 90);
+    ASSERT_EQ(range->end, 99);
+
+    range = parseByteRange("bytes=-10", 100);
+    ASSERT_EQ(range->begin, 90);
+    ASSERT_EQ(range->end, 99);
+
+    range = parseByteRange("bytes=-1000", 100); // 超过文件大小时返回整个文件
+    ASSERT_EQ(range->begin, 0);
+    ASSERT_EQ(range->end, 99);
+
+    range = parseByteRange("bytes=50-1000", 100); // 结尾越界时截断
+    ASSERT_EQ(range->end, 99);
+
+    // 不可满足
+    range = parseByteRange("bytes=100-", 100);
+    ASSERT_GT(range->begin, range->end);
+    range = parseByteRange("bytes=-0", 100);
+    ASSERT_GT(range->begin, range->end);
+    range = parseByteRange("bytes=-5", 0);
+    ASSERT_GT(range->begin, range->end);
+
+    // 语法错误与多区间忽略 Range
+    ASSERT_FALSE(parseByteRange("", 100).has_value());
+    ASSERT_FALSE(parseByteRange("items=0-9", 100).has_value());
+    ASSERT_FALSE(parseByteRange("bytes=0-9,20-29", 100).has_value());
+    ASSERT_FALSE(parseByteRange("bytes=9-0", 100).has_value());
+    ASSERT_FALSE(parseByteRange("bytes=a-9", 100).has_value());
+    ASSERT_FALSE(parseByteRange("bytes=-", 100).has_value());
+    ASSERT_FALSE(parseByteRange("bytes=5", 100).has_value());
+}
+
+TEST(HTTPHandler, parseHttpDate)
+{
+    const time_t time = 784111777; // Sun, 06 Nov 1994 08:49:37 GMT
+    ASSERT_EQ(formatHttpDate(time), "Sun, 06 Nov 1994 08:49:37 GMT");
+    ASSERT_EQ(parseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT"), time);
+    ASSERT_EQ(parseHttpDate("Sunday, 06-Nov-94 08:49:37 GMT"), time);
+    ASSERT_EQ(parseHttpDate("Sun Nov  6 08:49:37 1994"), time);
+    ASSERT_FALSE(parseHttpDate("").has_value());
+    ASSERT_FALSE(parseHttpDate("yesterday").has_value());
+    ASSERT_FALSE(parseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT trailing").has_value());
+
+    ASSERT_TRUE(matchEntityTag("\"a\"", "\"a\""));
+    ASSERT_TRUE(matchEntityTag("\"x\", W/\"a\"", "\"a\""));
+    ASSERT_TRUE(matchEntityTag("*", "\"a\""));
+    ASSERT_FALSE(matchEntityTag("\"x\", \"y\"", "\"a\""));
+}
+
+TEST(HTTPHandler, makeContentDisposition)
+{
+    ASSERT_EQ(makeContentDisposition("a b.txt"), "attachment; filename=\"a b.txt\"");
+    ASSERT_EQ(makeContentDisposition("a\"b\\c\r\n.txt"), "attachment; filename=\"a_b_c.txt\"; filename*=UTF-8''a%22b%5Cc.txt");
+    ASSERT_EQ(makeContentDisposition("文档 1.txt"),
+              "attachment; filename=\"______ 1.txt\"; filename*=UTF-8''%E6%96%87%E6%A1%A3%201.txt");
+}
+
+TEST(HTTPHandler, sendFileResponse)
+{
+    auto path = std::filesystem::temp_directory_path() / "zsearch-send-file.txt";
+    std::string content;
+    for (int i = 0; i < 1000; i++)
+        content += static_cast<char>('a' + i % 26);
+    std::ofstream(path) << content;
+    auto mtime = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::file_clock::to_sys(std::filesystem::last_write_time(path)).time_since_epoch()).count();
+    auto last_modified = formatHttpDate(mtime);
+
+    {
+        MockServerRequest request;
+        auto &response = request.mock_response;
+        ASSERT_TRUE(sendFileResponse(request, response, path, "text/plain", "a.txt"));
+        ASSERT_EQ(response.getStatus(), HTTPResponse::HTTP_OK);
+        ASSERT_EQ(response.body.str(), content);
+        ASSERT_EQ(response.getContentLength64(), content.size());
+        ASSERT_EQ(response.get("Last-Modified"), last_modified);
+        ASSERT_EQ(response.get("Content-Disposition"), "attachment; filename=\"a.txt\"");
+    }
+    const auto etag = [&] {
+        MockServerRequest request("HEAD");
+        sendFileResponse(request, request.mock_response, path, "text/plain");
+        EXPECT_TRUE(request.mock_response.body.str().empty());
+        EXPECT_EQ(request.mock_response.getContentLength64(), content.size());
+        return request.mock_response.get("ETag");
+    }();
+
+    auto send = [&](const std::vector<std::pair<std::string, std::string>> &headers) {
+        auto request = std::make_unique<MockServerRequest>();
+        for (const auto &[name, value] : headers)
+            request->set(name, value);
+        EXPECT_TRUE(sendFileResponse(*request, request->mock_response, path, "text/plain"));
+        return request;
+    };
+
+    // Range
+    auto request = send({{"Range", "bytes=10-19"}});
+    ASSERT_EQ(request->mock_response.getStatus(), HTTPResponse::HTTP_PARTIAL_CONTENT);
+    ASSERT_EQ(request->mock_response.body.str(), content.substr(10, 10));
+    ASSERT_EQ(request->mock_response.get("Content-Range"), "bytes 10-19/1000");
+    request = send({{"Range", "bytes=-5"}});
+    ASSERT_EQ(request->mock_response.body.str(), content.substr(995));
+    request = send({{"Range", "bytes=1000-"}});
+    ASSERT_EQ(request->mock_response.getStatus(), HTTPResponse::HTTP_REQUESTED_RANGE_NOT_SATISFIABLE);
+    ASSERT_EQ(request->mock_response.get("Content-Range"), "bytes */1000");
+    request = send({{"Range", "bytes=0-1,5-6"}}); // 多区间时返回整个文件
+    ASSERT_EQ(request->mock_response.getStatus(), HTTPResponse::HTTP_OK);
+    ASSERT_EQ(request->mock_response.body.str(), content);
+
+    // If-Range 与当前版本一致时才按 Range 返回
+    request = send({{"Range", "bytes=0-9"}, {"If-Range", etag}});
+    ASSERT_EQ(request->mock_response.getStatus(), HTTPResponse::HTTP_PARTIAL_CONTENT);
+    request = send({{"Range", "bytes=0-9"}, {"If-Range", last_modified}});
+    ASSERT_EQ(request->mock_response.getStatus(), HTTPResponse::HTTP_PARTIAL_CONTENT);
+    request = send({{"Range", "bytes=0-9"}, {"If-Range", "\"stale\""}});
+    ASSERT_EQ(request->mock_response.getStatus(), HTTPResponse::HTTP_OK);
+    ASSERT_EQ(request->mock_response.body.str(), content);
+
+    // If-None-Match
+    request = send({{"If-None-Match", etag}});
+    ASSERT_EQ(request->mock_response.getStatus(), HTTPResponse::HTTP_NOT_MODIFIED);
+    ASSERT_TRUE(request->mock_response.body.str().empty());
+    request = send({{"If-None-Match", "\"other\", W/" + etag}});
+    ASSERT_EQ(request->mock_response.getStatus(), HTTPResponse::HTTP_NOT_MODIFIED);
+    request = send({{"If-None-Match", "*"}});
+    ASSERT_EQ(request->mock_response.getStatus(), HTTPResponse::HTTP_NOT_MODIFIED);
+    request = send({{"If-None-Match", "\"other\""}, {"If-Modified-Since", last_modified}}); // If-None-Match 优先
+    ASSERT_EQ(request->mock_response.getStatus(), HTTPResponse::HTTP_OK);
+
+    // If-Modified-Since 按时间比较，而不是比较字符串
+    request = send({{"If-Modified-Since", last_modified}});
+    ASSERT_EQ(request->mock_response.getStatus(), HTTPResponse::HTTP_NOT_MODIFIED);
+    request = send({{"If-Modified-Since", formatHttpDate(mtime + 3600)}});
+    ASSERT_EQ(request->mock_response.getStatus(), HTTPResponse::HTTP_NOT_MODIFIED);
+    request = send({{"If-Modified-Since", formatHttpDate(mtime - 3600)}});
+    ASSERT_EQ(request->mock_response.getStatus(), HTTPResponse::HTTP_OK);
+    request = send({{"If-Modified-Since", "not a date"}});
+    ASSERT_EQ(request->mock_response.getStatus(), HTTPResponse::HTTP_OK);
+
+    MockServerRequest missing;
+    ASSERT_FALSE(sendFileResponse(missing, missing.mock_response, path.string() + ".missing", "text/plain"));
+    ASSERT_FALSE(missing.mock_response.sent());
+    std::filesystem::remove(path);
+}
+
+TEST(StaticAssetCache, acceptsGzip)
+{
+    ASSERT_TRUE(StaticAssetCache::acceptsGzip("gzip"));
+    ASSERT_TRUE(StaticAssetCache::acceptsGzip("deflate, gzip, br"));
+    ASSERT_TRUE(StaticAssetCache::acceptsGzip("br;q=1.0, GZIP;q=0.5"));
+    ASSERT_TRUE(StaticAssetCache::acceptsGzip("x-gzip"));
+    ASSERT_TRUE(StaticAssetCache::acceptsGzip("*"));
+    ASSERT_FALSE(StaticAssetCache::acceptsGzip(""));
+    ASSERT_FALSE(StaticAssetCache::acceptsGzip("identity"));
+    ASSERT_FALSE(StaticAssetCache::acceptsGzip("gzip;q=0"));
+    ASSERT_FALSE(StaticAssetCache::acceptsGzip("gzip; q=0.000, deflate"));
+    ASSERT_FALSE(StaticAssetCache::acceptsGzip("*, gzip;q=0")); // 单独列出的 gzip 优先于 *
+    ASSERT_FALSE(StaticAssetCache::acceptsGzip("*;q=0"));
+    ASSERT_FALSE(StaticAssetCache::acceptsGzip("gzip;q=abc"));
+}
+
+TEST(StaticAssetCache, GetFileHandler)
+{
+    auto root = std::filesystem::temp_directory_path() / "zsearch-static";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+    const std::string html(4096, 'a');
+    std::ofstream(root / "app.html") << html;
+    StaticAssetCache cache(root);
+    const auto *asset = cache.find("/app.html");
+    ASSERT_NE(asset, nullptr);
+    ASSERT_FALSE(asset->gzip_body.empty());
+
+    auto handle = [&](const std::string &method, const std::vector<std::pair<std::string, std::string>> &headers) {
+        auto request = std::make_unique<MockServerRequest>(method, "/app.html");
+        for (const auto &[name, value] : headers)
+            request->set(name, value);
+        GetFileHandler(cache).handleRequest(*request, request->mock_response);
+        return request;
+    };
+
+    auto request = handle("GET", {{"Accept-Encoding", "gzip, deflate"}});
+    ASSERT_EQ(request->mock_response.get("Content-Encoding"), "gzip");
+    ASSERT_EQ(request->mock_response.body.str(), asset->gzip_body);
+
+    request = handle("GET", {{"Accept-Encoding", "gzip;q=0, deflate"}});
+    ASSERT_FALSE(request->mock_response.has("Content-Encoding"));
+    ASSERT_EQ(request->mock_response.body.str(), html);
+    ASSERT_EQ(request->mock_response.get("Vary"), "Accept-Encoding");
+
+    request = handle("GET", {{"If-None-Match", "\"stale\", " + asset->etag}});
+    ASSERT_EQ(request->mock_response.getStatus(), HTTPResponse::HTTP_NOT_MODIFIED);
+
+    request = handle("HEAD", {});
+    ASSERT_EQ(request->mock_response.getStatus(), HTTPResponse::HTTP_OK);
+    ASSERT_EQ(request->mock_response.getContentLength64(), html.size());
+    ASSERT_TRUE(request->mock_response.body.str().empty());
+
+    // HEAD 只交给静态资源的 handler
+    FileSystemDaemons daemons(1);
+    DatabaseRegistry registry(root / "databases", daemons);
+    HTTPHandlerFactory factory({}, registry, cache, ServerConfig());
+    std::unique_ptr<HTTPRequestHandler> handler(factory.createRequestHandler(MockServerRequest("HEAD", "/app.html")));
+    ASSERT_NE(dynamic_cast<GetFileHandler *>(handler.get()), nullptr);
+    ASSERT_THROW(factory.createRequestHandler(MockServerRequest("HEAD", "/download-document")), Poco::NotImplementedException);
+    ASSERT_THROW(factory.createRequestHandler(MockServerRequest("HEAD", "/login")), Poco::NotImplementedException);
+    std::filesystem::remove_all(root);
+}
+
+TEST(LimitedHandler, queueFull)
+{
+    using namespace std::chrono_literals;
+    struct CountingHandler : public HTTPRequestHandler
+    {
+        int &calls;
+        explicit CountingHandler(int &calls_) : calls(calls_) {}
+        void handleRequest(HTTPServerRequest &, HTTPServerResponse &) override { ++calls; }
+    };
+
+    int calls = 0;
+    ConcurrencyLimiter limiter(1, 0);
+    MockServerRequest request("POST", "/start-query");
+    LimitedHandler(new CountingHandler(calls), limiter, 5000ms).handleRequest(request, request.mock_response);
+    ASSERT_EQ(calls, 1);
+    ASSERT_EQ(limiter.getRunning(), 0);
+
+    // 许可被占用且不允许排队：不等待 heavy_wait，立即返回 503
+    ASSERT_TRUE(limiter.tryAcquire(0ms));
+    auto begin = std::chrono::steady_clock::now();
+    LimitedHandler(new CountingHandler(calls), limiter, 5000ms).handleRequest(request, request.mock_response);
+    ASSERT_LT(std::chrono::steady_clock::now() - begin, 1000ms);
+    ASSERT_EQ(calls, 1);
+    ASSERT_EQ(request.mock_response.getStatus(), HTTPResponse::HTTP_SERVICE_UNAVAILABLE);
+    limiter.release();
+}
+
+TEST(ServerConfig, parse)
+{
+    auto config = ServerConfig::parse({});
+    ServerConfig defaults;
+    ASSERT_EQ(config.port, 8080);
+    ASSERT_EQ(config.max_threads, defaults.max_threads);
+    ASSERT_EQ(config.heavy_concurrency, std::max(1, config.max_threads / 2));
+    ASSERT_EQ(config.heavy_max_waiting, std::max(0, config.max_threads - config.heavy_concurrency - HTTP_LIGHT_RESERVED_THREADS));
+    ASSERT_TRUE(config.keep_alive);
+    ASSERT_TRUE(config.shards.empty());
+    ASSERT_FALSE(config.publish_snapshots);
+    ASSERT_EQ(config.database_idle_seconds, DATABASE_IDLE_SECONDS);
+
+    config = ServerConfig::parse({"--port=9000", "--max-threads=8", "--keep-alive=false", "--shards= a:1, ,b:2 ",
+                                  "--replica-of=primary:8080", "--db-memory-mb=512"});
+    ASSERT_EQ(config.port, 9000);
+    ASSERT_EQ(config.max_threads, 8);
+    ASSERT_EQ(config.heavy_concurrency, 4); // 未指定时跟随 max-threads
+    ASSERT_EQ(config.heavy_max_waiting, 2);
+    ASSERT_FALSE(config.keep_alive);
+    ASSERT_EQ(config.shards, std::vector<std::string>({"a:1", "b:2"}));
+    ASSERT_EQ(config.replica_of, "primary:8080");
+    ASSERT_EQ(config.database_memory_mb, 512);
+
+    config = ServerConfig::parse({"--heavy-concurrency=3", "--max-threads=32", "--publish-snapshots=1", "--heavy-max-waiting=0"});
+    ASSERT_EQ(config.heavy_concurrency, 3);
+    ASSERT_EQ(config.heavy_max_waiting, 0);
+    ASSERT_TRUE(config.publish_snapshots);
+
+    auto invalid = [](std::vector<std::string> args) {
+        ASSERT_THROW(ServerConfig::parse(args), Poco::InvalidArgumentException) << args.front();
+    };
+    invalid({"max-threads=8"});
+    invalid({"--max-threads"});
+    invalid({"--unknown=1"});
+    invalid({"--max-threads=abc"});
+    invalid({"--max-queued=-1"});
+    invalid({"--port=70000"});
+    invalid({"--port=-1"});
+    invalid({"--max-threads=0"});
+    invalid({"--min-threads=8", "--max-threads=4"});
+    invalid({"--heavy-concurrency=0"});
+    invalid({"--replication-interval=0"});
+    invalid({"--publish-snapshots=true", "--replica-of=primary:8080"});
+}
+
+int main()
+{
+    testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
@@ -35,7 +35,7 @@ public:
         if (file_path.extension() == ".json")
         {
             std::unique_ptr<Reader> reader = std::make_unique<TxtLineReader>(file_path);
-            std::unique_ptr<Extractor> extractor = std::make_unique<JsonExtractor>(std::move(reader));
+            std::unique_ptr<Extractor> extractor = std::make_unique<JsonExtractor>(std::move(reader), db.getAnalyzer());
 
             ExtractResult words_and_kvs = extractor->extract();
 
@@ -43,31 +43,37 @@ public:
                 return 0;
 
             size_t doc_id = db.newDocId();
-            for (const auto &word_in_file : words_and_kvs.words)
+            for (size_t position = 0; position < words_and_kvs.words.size(); position++)
             {
-                db.addTerm(word_in_file.str, doc_id, word_in_file.offset_in_file);
+                const auto &word_in_file = words_and_kvs.words[position];
+                db.addTerm(word_in_file.str, doc_id, word_in_file.offset_in_file, position);
             }
 
-            db.addDocument(doc_id, file_path, words_and_kvs.words.size(), words_and_kvs.kvs);
+            if (auto document_store = db.getDocumentStore())
+                document_store->addFile(doc_id, file_path);
+            db.addDocument(doc_id, file_path, words_and_kvs.words.size(), std::move(words_and_kvs.kvs));
             return doc_id;
         }
         else if (ALLOWED_FILE_EXTENSIONS.contains(file_path.extension())) // 白名单中的文本类型都视为 .txt
         {
             std::unique_ptr<Reader> reader = std::make_unique<TxtLineReader>(file_path);
-            std::unique_ptr<Extractor> extractor = std::make_unique<WordExtractor>(std::move(reader));
+            std::unique_ptr<Extractor> extractor = std::make_unique<WordExtractor>(std::move(reader), db.getAnalyzer());
 
             auto word_in_files = extractor->extract();
             if (!word_in_files.is_valid)
                 return 0;
 
             size_t doc_id = db.newDocId();
-            for (const auto &word_in_file : word_in_files.words)
+            for (size_t position = 0; position < word_in_files.words.size(); position++)
             {
-                db.addTerm(word_in_file.str, doc_id, word_in_file.offset_in_file);
+                const auto &word_in_file = word_in_files.words[position];
+                db.addTerm(word_in_file.str, doc_id, word_in_file.offset_in_file, position);
             }
 
             assert(word_in_files.kvs.empty());
-            db.addDocument(doc_id, file_path, word_in_files.words.size(), word_in_files.kvs);
+            if (auto document_store = db.getDocumentStore())
+                document_store->addFile(doc_id, file_path);
+            db.addDocument(doc_id, file_path, word_in_files.words.size(), std::move(word_in_files.kvs));
             return doc_id;
         }
         return 0;
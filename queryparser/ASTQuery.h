@@ -26,24 +26,24 @@ public:
     }
 
     // for displayed results detail generation.
-    std::optional<std::string> getTerm() const
+    std::vector<std::string> getTerms(const Analyzer &analyzer) const
     {
         if (!word_list)
-            return std::nullopt;
-        return word_list->as<ASTWord>()->getWord();
+            return {};
+        return word_list->as<ASTWordList>()->getTerms(analyzer);
     }
 
-    ExecutePipeline toExecutorPipeline(Database & db) const
+    ExecutePipeline toExecutorPipeline(Database & db, CollectionStatisticsPtr global_stats = nullptr) const
     {
         ExecutePipeline pipeline;
 
         std::unordered_map<std::string, double> word_freq;
-        if (word_list)
-            word_freq.emplace(word_list->as<ASTWord>()->getWord(), 1.0);
+        for (const auto& term : getTerms(db.getAnalyzer()))
+            word_freq.emplace(term, 1.0);
 
         pipeline.addExecutor(toExecutorHelper<TermsExecutor>(db, word_list))
                 .addExecutor(toExecutorHelper<HavingExecutor>(db, having_expression))
-                .addExecutor(std::make_shared<ScoreExecutor>(db, word_freq))
+                .addExecutor(std::make_shared<ScoreExecutor>(db, word_freq, std::move(global_stats)))
                 .addExecutor(toExecutorHelper<LimitExecutor>(db, limit_length));
 
         return pipeline;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "IParser.h"
+#include "CommonParsers.h"
 #include "utils/StringUtils.h"
 
 class ParserWordList : public IParserBase
@@ -11,15 +12,159 @@ public:
         return "WordList";
     }
 
+    // 'word' | "exact phrase" | 'word' NEAR/k 'word'
     bool parseImpl(Pos &pos, ASTPtr &node, Expected &expected) override
     {
-        if (pos->type == TokenType::StringLiteral)
+        if (pos->type == TokenType::PhraseLiteral)
+        {
+            node = std::make_shared<ASTPhrase>(std::vector<std::string>{trimQuote(pos->string())}, 0, true);
+            ++pos;
+            return true;
+        }
+
+        if (pos->type != TokenType::StringLiteral)
+            return false;
+        std::string word = trimQuote(pos->string());
+        ++pos;
+
+        ParserKeyWord s_near("NEAR");
+        if (!s_near.ignore(pos, expected))
+        {
+            node = std::make_shared<ASTWord>(word);
+            return true;
+        }
+
+        // NEAR/k 'word'，两个词之间最多间隔 k 个词，不要求顺序
+        if (pos->type != TokenType::Slash)
+            return false;
+        ++pos;
+        if (pos->type != TokenType::Number || pos->begin[0] == '-')
+            return false;
+        auto slop = restrictStoi<size_t>(pos->string());
+        ++pos;
+        if (pos->type != TokenType::StringLiteral)
+            return false;
+        std::string near_word = trimQuote(pos->string());
+        ++pos;
+
+        node = std::make_shared<ASTPhrase>(std::vector<std::string>{word, near_word}, slop, false);
+        return true;
+    }
+};
+
+/*
+terms_expression : and_expression ('OR' and_expression)*
+and_expression : not_expression (['AND'] not_expression)*   // 相邻的两个操作对象之间默认是 AND
+not_expression : 'NOT' not_expression | '(' terms_expression ')' | word_list
+*/
+class ParserTermsExpression : public IParserBase
+{
+public:
+    const char *getName() const override
+    {
+        return "TermsExpression";
+    }
+
+    bool parseImpl(Pos &pos, ASTPtr &node, Expected &expected) override
+    {
+        return parseOr(pos, node, expected, 0);
+    }
+
+private:
+    // 括号嵌套不经过 IParser::parse，避免占用 Pos 的 max_depth，这里单独限制
+    static constexpr size_t MAX_NESTING = 16;
+
+    bool parseOr(Pos &pos, ASTPtr &node, Expected &expected, size_t nesting)
+    {
+        ASTs operands(1);
+        if (!parseAnd(pos, operands[0], expected, nesting))
+            return false;
+
+        ParserKeyWord s_or("OR");
+        while (s_or.ignore(pos, expected))
+        {
+            operands.emplace_back();
+            if (!parseAnd(pos, operands.back(), expected, nesting))
+                return false;
+        }
+        node = combine(ConjunctionType::OR, operands);
+        return true;
+    }
+
+    bool parseAnd(Pos &pos, ASTPtr &node, Expected &expected, size_t nesting)
+    {
+        ASTs operands(1);
+        if (!parseNot(pos, operands[0], expected, nesting))
+            return false;
+
+        ParserKeyWord s_and("AND");
+        ParserKeyWord s_not("NOT");
+        while (true)
+        {
+            if (s_and.ignore(pos, expected))
+            {
+                operands.emplace_back();
+                if (!parseNot(pos, operands.back(), expected, nesting))
+                    return false;
+            }
+            else if (pos->type == TokenType::StringLiteral || pos->type == TokenType::PhraseLiteral
+                     || pos->type == TokenType::OpeningRoundBracket || s_not.checkWithoutMoving(pos, expected))
+            {
+                operands.emplace_back();
+                if (!parseNot(pos, operands.back(), expected, nesting))
+                    return false;
+            }
+            else
+                break;
+        }
+        node = combine(ConjunctionType::AND, operands);
+        return true;
+    }
+
+    bool parseNot(Pos &pos, ASTPtr &node, Expected &expected, size_t nesting)
+    {
+        ParserKeyWord s_not("NOT");
+        if (s_not.ignore(pos, expected))
+        {
+            ASTPtr operand;
+            if (nesting >= MAX_NESTING || !parseNot(pos, operand, expected, nesting + 1))
+                return false;
+            node = combine(ConjunctionType::NOT, {operand});
+            return true;
+        }
+
+        if (pos->type == TokenType::OpeningRoundBracket)
         {
-            node = std::make_shared<ASTWord>(trimQuote(pos->string()));
+            ++pos;
+            if (nesting >= MAX_NESTING || !parseOr(pos, node, expected, nesting + 1))
+                return false;
+            if (pos->type != TokenType::ClosingRoundBracket)
+                return false;
             ++pos;
             return true;
         }
-        return false;
+
+        ParserWordList s_word_list;
+        return s_word_list.parse(pos, node, expected);
+    }
+
+    // 同类连接词拉平：'a' AND 'b' AND 'c' 只产生一个 AND 节点
+    static ASTPtr combine(ConjunctionType type, const ASTs &operands)
+    {
+        if (type != ConjunctionType::NOT && operands.size() == 1)
+            return operands[0];
+
+        auto conjunction = std::make_shared<ASTConjunction>(type);
+        for (const auto &operand : operands)
+        {
+            auto child = operand->as<ASTConjunction>();
+            if (type != ConjunctionType::NOT && child && child->getType() == type)
+                for (const auto &grand_child : child->getChildren())
+                    conjunction->addChild(grand_child);
+            else
+                conjunction->addChild(operand);
+        }
+        return conjunction;
     }
 };
 
@@ -96,7 +241,6 @@ public:
 
                 if (pos->type == TokenType::Number)
                 {
-                    compare_value = Value(ArrayLabel{}, ValueType::Number);
                     std::vector<double> doubles;
                     while (pos->type == TokenType::Number)
                     {
@@ -106,14 +250,10 @@ public:
                             break;
                         ++pos;
                     }
-                    ValueArrayHandler<double> double_array_handler = [&](std::vector<double>* vec) {
-                        *vec = doubles;
-                    };
-                    compare_value.doArrayHandler(double_array_handler);
+                    compare_value = Value(ArrayLabel{}, std::move(doubles));
                 }
                 else if (pos->type == TokenType::StringLiteral)
                 {
-                    compare_value = Value(ArrayLabel{}, ValueType::String);
                     std::vector<std::string> strings;
                     while (pos->type == TokenType::StringLiteral)
                     {
@@ -123,10 +263,7 @@ public:
                             break;
                         ++pos;
                     }
-                    ValueArrayHandler<std::string> string_array_handler = [&](std::vector<std::string>* vec) {
-                        *vec = strings;
-                    };
-                    compare_value.doArrayHandler(string_array_handler);
+                    compare_value = Value(ArrayLabel{}, std::move(strings));
                 }
 
                 if (pos->type != TokenType::ClosingRoundBracket)
@@ -36,7 +36,23 @@ private:
     ASTs children;
 };
 
-class ASTWord : public IAST
+// 查询中描述 terms 的节点
+class ASTWordList : public IAST
+{
+public:
+    // 与索引时使用同一个 analyzer 切分，返回参与打分与生成高亮的词（不含 NOT 下的词）
+    virtual std::vector<std::string> getTerms(const Analyzer &analyzer) const = 0;
+
+    // 返回的节点由调用方管理
+    virtual ConjunctionNode* toConjunctionNode(const Analyzer &analyzer) const = 0;
+
+    ExecutorPtr toExecutor(Database &db) const override
+    {
+        return std::make_shared<TermsExecutor>(db, ConjunctionTree(toConjunctionNode(db.getAnalyzer()), true));
+    }
+};
+
+class ASTWord : public ASTWordList
 {
 public:
     ASTWord(const std::string &word_) : word(word_) {}
@@ -46,15 +62,94 @@ public:
         return word;
     }
 
-    ExecutorPtr toExecutor(Database &db) const override
+    // 一个查询词可能被切成多个词（例如中文）
+    std::vector<std::string> getTerms(const Analyzer &analyzer) const override
+    {
+        auto terms = analyzer.analyzeQuery(word);
+        if (terms.empty())
+            terms.push_back(word);
+        return terms;
+    }
+
+    ConjunctionNode* toConjunctionNode(const Analyzer &analyzer) const override
     {
-        return std::make_shared<TermsExecutor>(db, ConjunctionTree(new LeafNode<std::string>(word), true));
+        return TermsExecutor::makeNode(getTerms(analyzer));
     }
 
 private:
     std::string word;
 };
 
+// "exact phrase" 或 'a' NEAR/k 'b'
+class ASTPhrase : public ASTWordList
+{
+public:
+    ASTPhrase(std::vector<std::string> texts_, size_t slop_, bool in_order_)
+        : texts(std::move(texts_)), slop(slop_), in_order(in_order_) {}
+
+    std::vector<std::string> getTerms(const Analyzer &analyzer) const override
+    {
+        std::vector<std::string> terms;
+        for (const auto &text : texts)
+        {
+            auto text_terms = analyzer.analyzeQuery(text);
+            terms.insert(terms.end(), text_terms.begin(), text_terms.end());
+        }
+        return terms;
+    }
+
+    ConjunctionNode* toConjunctionNode(const Analyzer &analyzer) const override
+    {
+        auto terms = getTerms(analyzer);
+        if (terms.size() <= 1) // 单个词的短语退化为普通查询
+            return TermsExecutor::makeNode(terms.empty() ? texts : terms);
+        return new LeafNode<PhraseQuery>(PhraseQuery{.words = std::move(terms), .slop = slop, .in_order = in_order});
+    }
+
+private:
+    std::vector<std::string> texts;
+    size_t slop;
+    bool in_order;
+};
+
+// 'a' AND ('b' OR NOT 'c')，children 都是 ASTWordList
+class ASTConjunction : public ASTWordList
+{
+public:
+    ASTConjunction(ConjunctionType type_) : type(type_) {}
+
+    ConjunctionType getType() const
+    {
+        return type;
+    }
+
+    std::vector<std::string> getTerms(const Analyzer &analyzer) const override
+    {
+        std::vector<std::string> terms;
+        if (type == ConjunctionType::NOT) // 被排除的词不参与打分
+            return terms;
+        for (const auto &child : getChildren())
+        {
+            auto child_terms = child->as<ASTWordList>()->getTerms(analyzer);
+            for (auto &term : child_terms)
+                if (std::find(terms.begin(), terms.end(), term) == terms.end())
+                    terms.push_back(std::move(term));
+        }
+        return terms;
+    }
+
+    ConjunctionNode* toConjunctionNode(const Analyzer &analyzer) const override
+    {
+        auto inter = new InterNode(type);
+        for (const auto &child : getChildren())
+            inter->adoptChild(child->as<ASTWordList>()->toConjunctionNode(analyzer));
+        return inter;
+    }
+
+private:
+    ConjunctionType type;
+};
+
 class ASTHaving : public IAST
 {
 public:
@@ -64,10 +159,26 @@ public:
     ExecutorPtr toExecutor(Database &db) const override
     {
         return std::make_shared<HavingExecutor>(db, ConjunctionTree(
-                    new LeafNode<Predicate>(Predicate(getAggByName(func_name), column_name, getCompByType(compare_type), compare_value)
+                    new LeafNode<Predicate>(Predicate(getAggByName(func_name), column_name, getCompByType(compare_type), compare_value, getCacheKey())
                 ), true));
     }
 
+    // e.g. having:MIN\0web-app.i-arr\0<compare_type>\0<serialized compare_value>
+    std::string getCacheKey() const
+    {
+        std::ostringstream value_out;
+        WriteBuffer buf;
+        WriteBufferHelper helper(buf);
+        compare_value.serialize(helper);
+        buf.dumpAllToStream(value_out);
+
+        std::string key = "having:" + Poco::toUpper(func_name);
+        key += '\0' + column_name;
+        key += '\0' + std::to_string(static_cast<int>(compare_type));
+        key += '\0' + value_out.str();
+        return key;
+    }
+
 private:
     std::string func_name;
     std::string column_name; // can be empty —— AUTHOR(), MTIME(), EXISTS(), VALUE()
@@ -8,6 +8,7 @@ enum class TokenType
     BareWord, // keyword or identifier
     Number,
     StringLiteral,
+    PhraseLiteral, // "exact phrase"
     QuotedIdentifier,
     OpeningRoundBracket, // (
     ClosingRoundBracket, // )
@@ -170,6 +171,8 @@ private:
 
             case '\'':
                 return quotedString<'\'', TokenType::StringLiteral>(pos, token_begin, end);
+            case '"':
+                return quotedString<'"', TokenType::PhraseLiteral>(pos, token_begin, end);
             case '`':
                 return quotedString<'`', TokenType::QuotedIdentifier>(pos, token_begin, end);
 
@@ -205,8 +208,8 @@ private:
 //                return Token(TokenType::Minus, token_begin, ++pos);
 //            case '*':
 //                return Token(TokenType::Asterisk, token_begin, ++pos);
-//            case '/':
-//                return Token(TokenType::Slash, token_begin, ++pos);
+            case '/':
+                return Token(TokenType::Slash, token_begin, ++pos);
             case '=':
                 return Token(TokenType::Equals, token_begin, ++pos);
             case '!':
@@ -12,12 +12,12 @@ protected:
 
     bool parseImpl(Pos &pos, ASTPtr &node, Expected &expected) override
     {
-        // word_list [LIMIT number];
+        // terms_expression [LIMIT number];
         // or
-        // [word_list] HAVING exp_elem [LIMIT number];
-        // 注意，word_list 需要用 '' 括起
+        // [terms_expression] HAVING exp_elem [LIMIT number];
+        // 注意，word 需要用 '' 括起，短语用 "" 括起，例如 'a' AND ('b' OR NOT "c d")
 
-        ParserWordList s_word_list;
+        ParserTermsExpression s_word_list;
 
         ParserKeyWord s_having("HAVING");
         ParserAggregatedExpression exp_elem;
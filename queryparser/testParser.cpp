@@ -75,17 +75,63 @@ TEST(ParserQuery, base)
     judge("\'word\' LIMIT 10", true);
     judge("\'word\' limit 10", true);
     judge("\'word\' HAVING LIMIT 10", false);
-    judge("\"word\" LIMIT 10", false);
+    judge("\"word\" LIMIT 10", true); // phrase
+    judge("\"exact phrase\" HAVING EXISTS('a')", true);
+    judge("\"exact phrase LIMIT 10", false);
+
+    judge("\'word\' NEAR/3 \'another\' LIMIT 10", true);
+    judge("\'word\' near/0 \'another\'", true);
+    judge("\'word\' NEAR \'another\'", false);
+    judge("\'word\' NEAR/-1 \'another\'", false);
+    judge("\'word\' NEAR/3", false);
 
     judge("\'word\' HAVING sum('hello') = 0 LIMIT 10", true);
     judge("\'word\' HAVING min('word') >= 'hello' LIMIT 10", true);
     judge("\'word\' HAVING AUTHOR() = 'hello' LIMIT 10", true);
 
+    judge("\'a\' AND (\'b\' OR NOT \'c\') LIMIT 10", true);
+    judge("\'a\' \'b\' OR \"c d\" HAVING EXISTS('a')", true);
+    judge("NOT \'a\'", true);
+    judge("\'a\' AND", false);
+    judge("(\'a\' OR \'b\'", false);
+    judge("\'a\' OR () LIMIT 10", false);
+
     judge("word LIMIT 10", false);
     judge("\'word\' LIMIT", false);
     judge("\'word\' LIMIT 10", true);
 }
 
+TEST(ParserTermsExpression, base)
+{
+    auto parse = [](const std::string& str) {
+        ASTPtr ast;
+        Tokens tokens(str.data(), str.data() + str.size(), 100);
+        Pos pos(tokens, 5);
+        Expected expected;
+        ParserTermsExpression parser;
+        EXPECT_TRUE(parser.parse(pos, ast, expected));
+        return ast;
+    };
+
+    // 'a' AND ('b' OR NOT 'c')
+    auto root = parse("'a' ('b' OR NOT 'c')")->as<ASTConjunction>();
+    ASSERT_NE(root, nullptr);
+    ASSERT_EQ(root->getType(), ConjunctionType::AND);
+    ASSERT_EQ(root->getChildren().size(), 2);
+    auto or_node = root->getChildren()[1]->as<ASTConjunction>();
+    ASSERT_EQ(or_node->getType(), ConjunctionType::OR);
+    ASSERT_EQ(or_node->getChildren()[1]->as<ASTConjunction>()->getType(), ConjunctionType::NOT);
+    // NOT 下的词不参与打分
+    ASSERT_EQ(root->getTerms(Analyzer()), std::vector<std::string>({"a", "b"}));
+
+    // 同类连接词被拉平, AND 优先级高于 OR
+    root = parse("'a' AND 'b' AND 'c' OR 'd'")->as<ASTConjunction>();
+    ASSERT_EQ(root->getType(), ConjunctionType::OR);
+    ASSERT_EQ(root->getChildren()[0]->as<ASTConjunction>()->getChildren().size(), 3);
+
+    ASSERT_NE(parse("'a'")->as<ASTWord>(), nullptr);
+}
+
 template<typename T>
 concept HasSingleArgConstructorC = requires(T a) {
     T{a}; // T must have a single argument constructor
@@ -0,0 +1,334 @@
+#pragma once
+
+#include "../typedefs.h"
+#include "core/CollectionStatistics.h"
+#include "SearchResult.h"
+#include "utils/JsonUtils.h"
+#include "utils/StringUtils.h"
+#include <Poco/Net/HTTPClientSession.h>
+#include <Poco/Net/HTTPRequest.h>
+#include <Poco/Net/HTTPResponse.h>
+#include <Poco/URI.h>
+#include <future>
+#include <set>
+
+void to_json(nlohmann::json &j, const CollectionStatistics &stats)
+{
+    j = nlohmann::json{{"doc_count",        stats.doc_count},
+                       {"total_word_count", stats.total_word_count},
+                       {"doc_freqs",        stats.doc_freqs}};
+}
+
+void from_json(const nlohmann::json &j, CollectionStatistics &stats)
+{
+    j.at("doc_count").get_to(stats.doc_count);
+    j.at("total_word_count").get_to(stats.total_word_count);
+    j.at("doc_freqs").get_to(stats.doc_freqs);
+}
+
+// 分片上的结果，doc_id 只在分片内唯一
+struct ShardSearchResult
+{
+    size_t shard;
+    SearchResult result;
+};
+
+void writeJson(JsonWriter &writer, const ShardSearchResult &shard_result)
+{
+    const auto &result = shard_result.result;
+    writer.beginObject()
+          .key("shard").value(shard_result.shard)
+          .key("doc_id").value(result.doc_id)
+          .key("doc_path").value(result.doc_path)
+          .key("first_highlight_text").value(result.highlight_texts[0])
+          .key("highlight_texts").beginArray();
+    for (const auto &text : result.highlight_texts)
+        writer.beginObject().key("text").value(text).endObject();
+    writer.endArray()
+          .key("score").value(result.score)
+          .endObject();
+}
+
+struct DistributedSearchPage
+{
+    std::vector<ShardSearchResult> results;
+    size_t total = 0; // 成功返回的分片上的结果数之和
+    std::vector<size_t> failed_shards; // 超时或出错的分片，结果中不含它们的文档
+
+    bool isPartial() const
+    {
+        return !failed_shards.empty();
+    }
+};
+
+// 向分片发送请求. 失败（连接、超时、分片返回错误）时抛出异常.
+class ShardTransport
+{
+public:
+    virtual ~ShardTransport() = default;
+
+    virtual size_t getShardCount() const = 0;
+
+    // 返回分片标准响应中的 data
+    virtual nlohmann::json post(size_t shard, const std::string &path, const std::string &id, const nlohmann::json &body) = 0;
+};
+
+// 分片是独立运行的 ZSearch 实例，使用与协调节点相同的用户配置
+class HTTPShardTransport : public ShardTransport
+{
+public:
+    // shards: host:port
+    HTTPShardTransport(const std::vector<std::string> &shards, std::chrono::milliseconds timeout_) : timeout(timeout_)
+    {
+        for (const auto &shard : shards)
+        {
+            auto colon = shard.rfind(':');
+            if (colon == std::string::npos || colon == 0)
+                THROW(Poco::InvalidArgumentException("expect host:port, got " + shard));
+            addresses.emplace_back(shard.substr(0, colon), restrictStoi<uint16_t>(shard.substr(colon + 1)));
+        }
+    }
+
+    size_t getShardCount() const override
+    {
+        return addresses.size();
+    }
+
+    nlohmann::json post(size_t shard, const std::string &path, const std::string &id, const nlohmann::json &body) override
+    {
+        const auto &[host, port] = addresses.at(shard);
+        // 连接、发送、接收分别受 timeout 限制，整轮请求的期限由 DistributedSearcher 控制
+        Poco::Net::HTTPClientSession session(host, port);
+        session.setTimeout(Poco::Timespan(std::chrono::duration_cast<std::chrono::microseconds>(timeout).count()));
+
+        Poco::URI uri(path);
+        uri.addQueryParameter("id", id);
+        auto content = body.dump();
+        Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, uri.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
+        request.setContentType("application/json");
+        request.setContentLength(static_cast<std::streamsize>(content.size()));
+        session.sendRequest(request) << content;
+
+        Poco::Net::HTTPResponse response;
+        auto &in = session.receiveResponse(response);
+        std::string text;
+        Poco::StreamCopier::copyToString64(in, text);
+        if (response.getStatus() != Poco::Net::HTTPResponse::HTTP_OK)
+            THROW(Poco::IOException("shard " + host + ":" + std::to_string(port) + " returned " + std::to_string(response.getStatus())));
+
+        auto json = nlohmann::json::parse(text);
+        if (json.at("status").get<int>() != 0)
+            THROW(Poco::IOException("shard " + host + ":" + std::to_string(port) + " failed: " + json.at("msg").get<std::string>()));
+        return json.at("data");
+    }
+
+private:
+    std::vector<std::pair<std::string, uint16_t>> addresses;
+    std::chrono::milliseconds timeout;
+};
+
+// 协调节点：把查询分发到所有分片，合并各分片的 top-k.
+// 第一轮收集各分片的文档数、总词数和查询词的文档频率，相加得到全局统计量；
+// 第二轮各分片按全局统计量计算 BM25 分数并返回 offset + limit 个结果，因此不同分片的分数可以直接比较.
+// 单个词的查询在各分片上按前缀扩展出的词可能不同：协调节点合并成同一组词，统计量与分数都只按这组词计算.
+// 每一轮在 round_timeout 内没有返回或出错的分片被跳过，返回其余分片的结果并在 failed_shards 中列出.
+class DistributedSearcher
+{
+public:
+    explicit DistributedSearcher(ShardTransport &transport_, std::chrono::milliseconds round_timeout_ = std::chrono::seconds(3))
+        : transport(transport_), round_timeout(round_timeout_), outstanding(std::make_shared<Outstanding>()) {}
+
+    DistributedSearcher(const DistributedSearcher&) = delete;
+    DistributedSearcher& operator=(const DistributedSearcher&) = delete;
+
+    // 等待超时后仍在执行的请求结束，它们使用 transport
+    ~DistributedSearcher()
+    {
+        std::unique_lock ul(outstanding->lock);
+        outstanding->finished.wait(ul, [this] { return outstanding->count == 0; });
+    }
+
+    // 分布式查询不支持 cursor，只按 offset/limit 翻页
+    DistributedSearchPage search(const std::string &query, const PageRequest &page_request, const std::string &id)
+    {
+        if (page_request.cursor.has_value())
+            THROW(Poco::InvalidArgumentException("cursor is not supported by distributed search"));
+
+        DistributedSearchPage page;
+        if (query.empty())
+            return page;
+
+        std::vector<size_t> shards(transport.getShardCount());
+        std::iota(shards.begin(), shards.end(), 0);
+
+        // 第一轮
+        auto stats_responses = scatter(shards, "/shard-stats", id, nlohmann::json{{"query", query}}, page.failed_shards);
+        auto expanded_terms = mergeExpandedTerms(stats_responses);
+        if (expanded_terms)
+        {
+            // 本地扩展结果与合并结果不同的分片按合并后的词重新统计
+            std::vector<size_t> recollect;
+            std::erase_if(stats_responses, [&](const std::pair<size_t, nlohmann::json> &response) {
+                auto iter = response.second.find("terms");
+                bool same = iter != response.second.end() && iter->is_array() && *iter == nlohmann::json(*expanded_terms);
+                if (!same)
+                    recollect.push_back(response.first);
+                return !same;
+            });
+            auto recollected = scatter(recollect, "/shard-stats", id, nlohmann::json{{"query", query}, {"terms", *expanded_terms}}, page.failed_shards);
+            std::move(recollected.begin(), recollected.end(), std::back_inserter(stats_responses));
+        }
+
+        CollectionStatistics global_stats;
+        std::vector<size_t> alive_shards;
+        for (auto &[shard, data] : stats_responses)
+        {
+            try
+            {
+                global_stats.merge(data.get<CollectionStatistics>());
+                alive_shards.push_back(shard);
+            }
+            catch (nlohmann::json::exception &e)
+            {
+                httpLog("shard " + std::to_string(shard) + " returned malformed statistics: " + e.what());
+                page.failed_shards.push_back(shard);
+            }
+        }
+        std::sort(alive_shards.begin(), alive_shards.end());
+
+        // 第二轮
+        size_t top_k = std::min(page_request.offset + std::min(page_request.limit, SEARCH_MAX_PAGE_SIZE), SEARCH_MAX_RESULTS);
+        nlohmann::json search_body{{"query", query}, {"limit", top_k}, {"stats", global_stats}};
+        if (expanded_terms)
+            search_body["terms"] = *expanded_terms;
+        auto search_responses = scatter(alive_shards, "/shard-search", id, search_body, page.failed_shards);
+
+        std::vector<ShardSearchResult> merged;
+        for (auto &[shard, data] : search_responses)
+        {
+            try
+            {
+                std::vector<ShardSearchResult> shard_results;
+                for (const auto &item : data.at("results"))
+                    shard_results.push_back(ShardSearchResult{shard, parseResult(item)});
+                page.total += data.at("total").get<size_t>();
+                std::move(shard_results.begin(), shard_results.end(), std::back_inserter(merged));
+            }
+            catch (nlohmann::json::exception &e)
+            {
+                httpLog("shard " + std::to_string(shard) + " returned malformed results: " + e.what());
+                page.failed_shards.push_back(shard);
+            }
+        }
+        std::sort(merged.begin(), merged.end(), [](const ShardSearchResult &a, const ShardSearchResult &b) {
+            if (a.result.score != b.result.score)
+                return a.result.score > b.result.score;
+            if (a.shard != b.shard)
+                return a.shard < b.shard;
+            return a.result.doc_id < b.result.doc_id;
+        });
+
+        auto begin = merged.begin() + std::min(page_request.offset, merged.size());
+        auto end = begin + std::min<size_t>(page_request.limit, merged.end() - begin);
+        page.results.assign(std::make_move_iterator(begin), std::make_move_iterator(end));
+        std::sort(page.failed_shards.begin(), page.failed_shards.end());
+        return page;
+    }
+
+private:
+    // 超时后不再等待的请求仍在后台执行，DistributedSearcher 析构前等待它们结束
+    struct Outstanding
+    {
+        std::mutex lock;
+        std::condition_variable finished;
+        size_t count = 0;
+    };
+
+    // 并发请求 shards，返回在 round_timeout 内成功的 (shard, data)，超时或失败的分片加入 failed_shards
+    std::vector<std::pair<size_t, nlohmann::json>> scatter(const std::vector<size_t> &shards, const std::string &path, const std::string &id,
+                                                           const nlohmann::json &body, std::vector<size_t> &failed_shards)
+    {
+        // std::async 返回的 future 析构时会等待请求结束，超时的请求改为在分离的线程中执行
+        auto deadline = std::chrono::steady_clock::now() + round_timeout;
+        std::vector<std::future<nlohmann::json>> futures;
+        for (size_t shard : shards)
+        {
+            std::packaged_task<nlohmann::json()> task([&transport = transport, shard, path, id, body] { return transport.post(shard, path, id, body); });
+            futures.push_back(task.get_future());
+            {
+                std::lock_guard lg(outstanding->lock);
+                ++outstanding->count;
+            }
+            std::thread([task = std::move(task), outstanding = outstanding]() mutable {
+                task();
+                std::lock_guard lg(outstanding->lock);
+                if (--outstanding->count == 0)
+                    outstanding->finished.notify_all();
+            }).detach();
+        }
+
+        std::vector<std::pair<size_t, nlohmann::json>> responses;
+        for (size_t i = 0; i < shards.size(); i++)
+        {
+            if (futures[i].wait_until(deadline) != std::future_status::ready)
+            {
+                httpLog("shard " + std::to_string(shards[i]) + " timed out " + path);
+                failed_shards.push_back(shards[i]);
+                continue;
+            }
+            try
+            {
+                responses.emplace_back(shards[i], futures[i].get());
+            }
+            catch (Poco::Exception &e)
+            {
+                httpLog("shard " + std::to_string(shards[i]) + " failed " + path + ": " + e.displayText());
+                failed_shards.push_back(shards[i]);
+            }
+            catch (std::exception &e)
+            {
+                httpLog("shard " + std::to_string(shards[i]) + " failed " + path + ": " + e.what());
+                failed_shards.push_back(shards[i]);
+            }
+        }
+        return responses;
+    }
+
+    // 各分片返回的前缀扩展结果（"terms"）合并后按字典序取前 SEARCH_PREFIX_EXPANSIONS 个；不是单个词的查询返回空
+    static std::optional<std::vector<std::string>> mergeExpandedTerms(const std::vector<std::pair<size_t, nlohmann::json>> &responses)
+    {
+        std::optional<std::set<std::string>> merged;
+        for (const auto &[shard, data] : responses)
+        {
+            auto iter = data.find("terms");
+            if (iter == data.end() || !iter->is_array())
+                continue;
+            if (!merged)
+                merged.emplace();
+            for (const auto &term : *iter)
+                if (term.is_string())
+                    merged->insert(term.get<std::string>());
+        }
+        if (!merged)
+            return std::nullopt;
+        std::vector<std::string> terms(merged->begin(), merged->end());
+        terms.resize(std::min<size_t>(terms.size(), SEARCH_PREFIX_EXPANSIONS));
+        return terms;
+    }
+
+    static SearchResult parseResult(const nlohmann::json &item)
+    {
+        SearchResult result{.doc_id = item.at("doc_id").get<size_t>(),
+                            .doc_path = item.at("doc_path").get<std::string>(),
+                            .score = item.at("score").get<double>()};
+        for (const auto &text : item.at("highlight_texts"))
+            result.highlight_texts.push_back(text.at("text").get<std::string>());
+        if (result.highlight_texts.empty())
+            result.highlight_texts.emplace_back();
+        return result;
+    }
+
+    ShardTransport &transport;
+    const std::chrono::milliseconds round_timeout;
+    std::shared_ptr<Outstanding> outstanding;
+};
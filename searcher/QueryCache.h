@@ -0,0 +1,112 @@
+#pragma once
+
+#include "../typedefs.h"
+#include "SearchResult.h"
+
+// 查询排序结果的 LRU 缓存，key 是规范化后的查询文本.
+// 每个条目记录生成时索引的 generation，索引变化后旧条目自然失效，不需要主动清理.
+class QueryCache
+{
+public:
+    explicit QueryCache(size_t capacity_ = QUERY_CACHE_CAPACITY) : capacity(capacity_) {}
+
+    // 合并连续空白、去掉首尾空白，使 "'a'  LIMIT 10" 与 "'a' LIMIT 10" 命中同一个条目
+    static std::string normalize(const std::string& query)
+    {
+        std::string res;
+        for (char ch : query)
+        {
+            if (Poco::Ascii::isSpace(ch))
+            {
+                if (!res.empty() && res.back() != ' ')
+                    res.push_back(' ');
+            }
+            else
+                res.push_back(ch);
+        }
+        if (!res.empty() && res.back() == ' ')
+            res.pop_back();
+        return res;
+    }
+
+    RankedResultsPtr get(const std::string& query, uint64_t generation)
+    {
+        std::lock_guard lg(lock);
+        auto iter = entries.find(query);
+        if (iter == entries.end() || iter->second.generation != generation)
+        {
+            if (iter != entries.end()) // 过期条目
+            {
+                lru_list.erase(iter->second.lru_iter);
+                entries.erase(iter);
+            }
+            ++misses;
+            return nullptr;
+        }
+        lru_list.splice(lru_list.begin(), lru_list, iter->second.lru_iter);
+        ++hits;
+        return iter->second.results;
+    }
+
+    void put(const std::string& query, uint64_t generation, RankedResultsPtr results)
+    {
+        if (capacity == 0)
+            return;
+        std::lock_guard lg(lock);
+        auto iter = entries.find(query);
+        if (iter != entries.end())
+        {
+            iter->second.generation = generation;
+            iter->second.results = std::move(results);
+            lru_list.splice(lru_list.begin(), lru_list, iter->second.lru_iter);
+            return;
+        }
+
+        if (entries.size() >= capacity)
+        {
+            entries.erase(lru_list.back());
+            lru_list.pop_back();
+        }
+        lru_list.push_front(query);
+        entries.emplace(query, Entry{.generation = generation, .results = std::move(results), .lru_iter = lru_list.begin()});
+    }
+
+    void clear()
+    {
+        std::lock_guard lg(lock);
+        entries.clear();
+        lru_list.clear();
+    }
+
+    uint64_t getHits() const
+    {
+        return hits;
+    }
+
+    uint64_t getMisses() const
+    {
+        return misses;
+    }
+
+    double getHitRate() const
+    {
+        uint64_t total = hits + misses;
+        return total == 0 ? 0.0 : 1.0 * hits / total;
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t generation;
+        RankedResultsPtr results;
+        std::list<std::string>::iterator lru_iter;
+    };
+
+    const size_t capacity;
+
+    mutable std::mutex lock;
+    std::list<std::string> lru_list; // 头部是最近使用的 query
+    std::unordered_map<std::string, Entry> entries;
+
+    std::atomic_uint64_t hits = 0, misses = 0;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "../typedefs.h"
+#include "utils/JsonUtils.h"
+#include "utils/JsonWriter.h"
+
+struct SearchResult
+{
+    size_t doc_id;
+    std::string doc_path;
+    std::vector<std::string> highlight_texts;
+    double score;
+
+    bool operator<(const SearchResult &rhs) const
+    {
+        return score > rhs.score || doc_id < rhs.doc_id;
+    }
+};
+
+void to_json(nlohmann::json &j, const SearchResult &result)
+{
+    nlohmann::json::array_t texts;
+    for (const auto &text : result.highlight_texts)
+    {
+        texts.push_back(std::unordered_map<std::string, std::string>{{"text", text}});
+    }
+    j = nlohmann::json{{"doc_id",               result.doc_id},
+                       {"doc_path",                 result.doc_path},
+                       {"first_highlight_text", result.highlight_texts[0]},
+                       {"highlight_texts",      texts},
+                       {"score",                result.score}};
+}
+
+// 与 to_json 输出相同的字段，用于流式响应
+void writeJson(JsonWriter &writer, const SearchResult &result)
+{
+    writer.beginObject()
+          .key("doc_id").value(result.doc_id)
+          .key("doc_path").value(result.doc_path)
+          .key("first_highlight_text").value(result.highlight_texts[0])
+          .key("highlight_texts").beginArray();
+    for (const auto &text : result.highlight_texts)
+        writer.beginObject().key("text").value(text).endObject();
+    writer.endArray()
+          .key("score").value(result.score)
+          .endObject();
+}
+
+using SearchResultSet = std::vector<SearchResult>;
+
+// 一次查询完整的排序结果，不含高亮文本. 缓存的是它而不是 SearchResultSet，翻页时只为当前页生成高亮文本.
+struct RankedResults
+{
+    struct Entry
+    {
+        size_t doc_id;
+        size_t score; // 乘以 SCORE_GRANULARITY 之后的分数
+        size_t words_index; // 生成高亮文本使用 words[words_index]
+    };
+
+    std::vector<Entry> entries; // 按 score 降序、doc_id 升序，保证翻页时顺序稳定
+    std::vector<std::vector<std::string>> words;
+
+    // 排序规则下 a 是否在 b 之前
+    static bool before(const Entry& a, const Entry& b)
+    {
+        if (a.score != b.score)
+            return a.score > b.score;
+        return a.doc_id < b.doc_id;
+    }
+};
+using RankedResultsPtr = std::shared_ptr<const RankedResults>;
+
+// cursor 是上一页返回的 next_cursor，给出时从 cursor 之后开始，忽略 offset
+struct PageRequest
+{
+    size_t offset = 0;
+    size_t limit = SEARCH_DEFAULT_PAGE_SIZE;
+    std::optional<std::string> cursor;
+};
+
+struct SearchPage
+{
+    SearchResultSet results;
+    size_t total = 0; // 全部结果数（受 LIMIT 与 SEARCH_MAX_RESULTS 限制）
+    std::optional<std::string> next_cursor; // 没有下一页时为空
+};
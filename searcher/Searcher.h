@@ -7,135 +7,263 @@
 #include "executor/LimitExecutor.h"
 #include "core/Database.h"
 #include "QueryStatistics.h"
+#include "SearchResult.h"
+#include "SnippetGenerator.h"
 #include "queryparser/Parser.h"
 
-struct OldSearchResult
+class Searcher
 {
-    DocumentPtr document;
-    size_t offset_in_file;
-    size_t related_text_len;
+public:
+    // global_stats 不为空时按全局统计量计算分数（分布式查询的第二轮），此时不使用查询缓存.
+    // expanded_terms 不为空时，单个词的查询不在本地按前缀扩展，而是使用协调节点合并后的这组词
+    explicit Searcher(Database &db_, CollectionStatisticsPtr global_stats_ = nullptr,
+                      std::optional<std::vector<std::string>> expanded_terms_ = std::nullopt)
+            : db(db_), global_stats(std::move(global_stats_)), expanded_terms(std::move(expanded_terms_)) {}
+
+    // 返回全部结果（受 LIMIT 与 SEARCH_MAX_RESULTS 限制）
+    SearchResultSet search(const std::string &query)
+    {
+        return search(query, PageRequest{.limit = std::numeric_limits<size_t>::max()}).results;
+    }
+
+    SearchPage search(const std::string &query, const PageRequest &page_request)
+    {
+        if (query.empty())
+            return {};
+
+        StopWatch search_timer;
+
+        // 持有到结果生成完毕，期间索引不会被整体替换
+        auto index_lock = db.lockIndexShared();
+
+        // generation 必须在执行查询前读取：执行期间索引发生变化时，结果以旧 generation 缓存，不会被后续查询命中
+        auto& query_cache = db.getQueryCache();
+        auto normalized_query = QueryCache::normalize(query);
+        auto generation = db.getGeneration();
+
+        bool use_cache = !global_stats && !expanded_terms;
+        RankedResultsPtr ranked = use_cache ? query_cache.get(normalized_query, generation) : nullptr;
+        if (!ranked)
+        {
+            ranked = std::make_shared<const RankedResults>(rank(query));
+            if (use_cache)
+                query_cache.put(normalized_query, generation, ranked);
+        }
+        auto page = makePage(*ranked, page_request);
+
+        // 收集查询本身的统计信息
+        if (search_timer.elapsedMilliseconds() > 0 || page.total > 0)
+            db.addQueryStatistics(search_timer.getStartTime(),
+                                  std::make_shared<QueryStatistics>(query, search_timer.elapsedMilliseconds(), page.total));
+
+        // 收集最经常被查询到的文档的编号
+        std::vector<size_t> doc_ids;
+        for (const auto& search_result : page.results)
+        {
+            doc_ids.push_back(search_result.doc_id);
+        }
+        db.addDocumentQueryFreq(doc_ids);
 
-    double score = 0.0;
+        return page;
+    }
 
-    bool operator<(const OldSearchResult &rhs) const
+    // 分布式查询的第一轮：本分片的文档数、总词数，以及查询会用来计算分数的词的文档频率
+    CollectionStatistics collectStatistics(const std::string &query)
     {
-        if (score != rhs.score)
-            return score < rhs.score;
-        if (!document || !rhs.document)
-            return false;
-        if (document->getId() != rhs.document->getId())
-            return document->getId() < rhs.document->getId();
-        return offset_in_file < rhs.offset_in_file;
+        if (query.empty())
+            return {};
+        auto index_lock = db.lockIndexShared();
+        return db.collectStatistics(scoringTerms(query));
     }
-};
 
-struct SearchResult
-{
-    size_t doc_id;
-    std::string doc_path;
-    std::vector<std::string> highlight_texts;
-    double score;
+    // 分布式查询的第一轮：单个词的查询在本分片按前缀扩展出的、确实存在的词，由协调节点合并；其他查询返回空
+    std::optional<std::vector<std::string>> expandPrefix(const std::string &query)
+    {
+        auto word = prefixQueryWord(query);
+        if (!word)
+            return std::nullopt;
+        auto index_lock = db.lockIndexShared();
+        std::vector<std::string> terms;
+        for (auto &term : db.matchTerm(*word, SEARCH_PREFIX_EXPANSIONS))
+            if (auto term_ptr = db.findTerm(term); term_ptr && !term_ptr->posting_list.empty())
+                terms.push_back(std::move(term));
+        return terms;
+    }
 
-    bool operator<(const SearchResult &rhs) const
+    // cursor 只编码上一页最后一个结果的 (score, doc_id)，索引变化后仍然可以定位
+    static std::string encodeCursor(const RankedResults::Entry& entry)
     {
-        return score > rhs.score || doc_id < rhs.doc_id;
+        std::ostringstream oss;
+        oss << std::hex << entry.score << '.' << entry.doc_id;
+        return oss.str();
     }
-};
 
-void to_json(nlohmann::json &j, const SearchResult &result)
-{
-    nlohmann::json::array_t texts;
-    for (const auto &text : result.highlight_texts)
+    static RankedResults::Entry decodeCursor(const std::string& cursor)
     {
-        texts.push_back(std::unordered_map<std::string, std::string>{{"text", text}});
+        auto dot = cursor.find('.');
+        if (dot == std::string::npos || dot == 0 || dot + 1 == cursor.size() || cursor.size() > 33 || cursor.find('.', dot + 1) != std::string::npos
+            || !std::all_of(cursor.begin(), cursor.end(), [](char c) { return c == '.' || std::isxdigit(static_cast<unsigned char>(c)); }))
+            THROW(Poco::InvalidArgumentException("invalid cursor " + cursor));
+        return RankedResults::Entry{.doc_id = std::stoull(cursor.substr(dot + 1), nullptr, 16),
+                                    .score = std::stoull(cursor.substr(0, dot), nullptr, 16)};
     }
-    j = nlohmann::json{{"doc_id",               result.doc_id},
-                       {"doc_path",                 result.doc_path},
-                       {"first_highlight_text", result.highlight_texts[0]},
-                       {"highlight_texts",      texts},
-                       {"score",                result.score}};
-}
 
-using SearchResultSet = std::vector<SearchResult>;
+private:
+    // limit 为 0 时只统计 total：不返回结果，也没有 next_cursor（游标需要本页最后一个结果来定位）
+    SearchPage makePage(const RankedResults& ranked, const PageRequest& page_request)
+    {
+        SearchPage page{.total = ranked.entries.size()};
+
+        auto iter = ranked.entries.begin() + std::min(page_request.offset, ranked.entries.size());
+        if (page_request.cursor.has_value())
+            iter = std::upper_bound(ranked.entries.begin(), ranked.entries.end(), decodeCursor(*page_request.cursor), RankedResults::before);
 
-class Searcher
-{
-public:
-    explicit Searcher(Database &db_)
-            : db(db_) {}
+        for (; iter != ranked.entries.end() && page.results.size() < page_request.limit; ++iter)
+        {
+            auto document_ptr = db.findDocument(iter->doc_id);
+            if (!document_ptr) // 结果缓存之后被删除
+                continue;
+            page.results.push_back(SearchResult{
+                    .doc_id = iter->doc_id,
+                    .doc_path = document_ptr->getPath().string(),
+                    .highlight_texts = makeHighlightTexts(*document_ptr, ranked.words[iter->words_index]),
+                    .score = 1.0 * iter->score / SCORE_GRANULARITY
+            });
+        }
+        if (iter != ranked.entries.end() && !page.results.empty())
+            page.next_cursor = encodeCursor(*std::prev(iter));
+        return page;
+    }
 
-    SearchResultSet search(const std::string &query)
+    std::vector<std::string> makeHighlightTexts(const Document& document, const std::vector<std::string>& words)
     {
-        if (query.empty())
+        if (words.empty()) // query 中有 having 子句，而没有 terms
+            return {"未产生匹配文本 —— 因为查询未指定 term"};
+
+        std::vector<SnippetHit> hits;
+        for (size_t i = 0; i < words.size(); i++)
+        {
+            // 找不到的 term（已被删除，或者只在 OR 的某个分支中）不产生高亮
+            auto term_ptr = db.findTerm(words[i]);
+            if (!term_ptr)
+                continue;
+            auto doc_iter = std::lower_bound(term_ptr->posting_list.begin(), term_ptr->posting_list.end(), document.getId());
+            if (doc_iter == term_ptr->posting_list.end() || *doc_iter != document.getId()) // OR/NOT 查询中该词不一定出现在文档中
+                continue;
+            auto cur_doc_index = doc_iter - term_ptr->posting_list.begin();
+            assert(cur_doc_index < term_ptr->statistics_list.size());
+
+            // offsets 有序，只取文件中靠前的部分
+            const auto& offsets = term_ptr->statistics_list[cur_doc_index].offsets_in_file;
+            auto offset_end = std::next(offsets.begin(), std::min(offsets.size(), SNIPPET_MAX_HITS));
+            for (auto offset_iter = offsets.begin(); offset_iter != offset_end; ++offset_iter)
+                hits.push_back(SnippetHit{.offset = *offset_iter, .len = words[i].size(), .term_index = i});
+        }
+        auto highlight_texts = snippet_generator.generate(document, std::move(hits), db.getDocumentStore());
+        if (highlight_texts.empty()) // 例如只由 NOT 子句匹配的文档
+            highlight_texts.emplace_back("未产生匹配文本 —— 因为文档不包含查询中的 term");
+        return highlight_texts;
+    }
+
+    // 不含空白与引号的查询直接分词，否则交给 parser
+    static bool isSimpleQuery(const std::string &query)
+    {
+        return std::all_of(query.begin(), query.end(), [](char c) { return !Poco::Ascii::isSpace(c) && c != '\'' && c != '"'; });
+    }
+
+    // 不含空白与引号、分词后不超过一个词的查询按前缀扩展，返回被扩展的词
+    std::optional<std::string> prefixQueryWord(const std::string &query) const
+    {
+        if (!isSimpleQuery(query))
+            return std::nullopt;
+        auto words = db.getAnalyzer().analyzeQuery(query);
+        if (words.size() > 1)
+            return std::nullopt;
+        return words.empty() ? query : words[0];
+    }
+
+    // 单个词的查询按前缀扩展出的词，给定 expanded_terms 时直接使用
+    std::vector<std::string> prefixTerms(const std::string &word) const
+    {
+        if (expanded_terms)
+            return *expanded_terms;
+        return db.matchTerm(word, SEARCH_PREFIX_EXPANSIONS);
+    }
+
+    // 与 rank 中 ScoreExecutor 使用的词一致
+    std::vector<std::string> scoringTerms(const std::string &query)
+    {
+        if (isSimpleQuery(query))
+        {
+            if (auto word = prefixQueryWord(query))
+                return prefixTerms(*word);
+            return db.getAnalyzer().analyzeQuery(query);
+        }
+        auto [type, ast] = parseQuery(query);
+        if (type != QueryErrorType::Non)
             return {};
+        return ast->as<ASTQuery>()->getTerms(db.getAnalyzer());
+    }
 
-        SearchResultSet res;
+    // 执行查询，得到按 (score desc, doc_id asc) 排序的全部结果
+    RankedResults rank(const std::string &query)
+    {
+        RankedResults res;
+        std::unordered_map<size_t, size_t> entry_index; // doc_id -> res.entries 下标
 
-        auto transformScoresToResult = [this, &res](ExecutePipeline& pipeline, const std::string& word) -> void {
+        // 多个 pipeline 命中同一个文档时保留最高分
+        auto collectScores = [&res, &entry_index](ExecutePipeline& pipeline, const std::vector<std::string>& words) -> void {
             auto execution_res = pipeline.execute();
             if (!execution_res.has_value())
                 return;
 
-            auto scores = std::any_cast<Scores>(execution_res);
-
-            auto term_ptr = db.findTerm(word);
-            if (!word.empty() && !term_ptr) // term_ptr 被删除，结果集失效 ———— 无法描述结果集
-                return;
-
-            for (const auto &iter : scores)
+            res.words.push_back(words);
+            for (const auto &[score, doc_id] : std::any_cast<Scores>(execution_res))
             {
-                auto document_ptr = db.findDocument(iter.second);
-                if (!document_ptr)
-                    continue;
-
-                std::vector<std::string> highlight_texts;
-                if (!word.empty()) // query 中有 terms
-                {
-                    auto cur_doc_index =
-                            std::lower_bound(term_ptr->posting_list.begin(), term_ptr->posting_list.end(),
-                                             iter.second) - term_ptr->posting_list.begin();
-                    assert(cur_doc_index < term_ptr->statistics_list.size());
-
-                    for (auto offset_in_file : term_ptr->statistics_list[cur_doc_index].offsets_in_file)
-                    {
-                        std::string string_in_file = document_ptr->getString(offset_in_file, word.size(), 80);
-                        auto highlight_text = outputSmooth(string_in_file);
-                        highlight_texts.push_back(highlight_text);
-                    }
-                }
-                else // query 中有 having 子句，而没有 terms
-                {
-                    highlight_texts.emplace_back("未产生匹配文本 —— 因为查询未指定 term");
-                }
-
-                res.push_back(SearchResult{
-                        .doc_id = iter.second,
-                        .doc_path = document_ptr->getPath().string(),
-                        .highlight_texts = highlight_texts,
-                        .score = 1.0 * iter.first / SCORE_GRANULARITY
-                });
+                RankedResults::Entry entry{.doc_id = doc_id, .score = score, .words_index = res.words.size() - 1};
+                auto [iter, inserted] = entry_index.emplace(doc_id, res.entries.size());
+                if (inserted)
+                    res.entries.push_back(entry);
+                else if (res.entries[iter->second].score < score)
+                    res.entries[iter->second] = entry;
             }
         };
 
-        StopWatch search_timer;
-
-        if (std::all_of(query.begin(), query.end(), [](char c) { return !Poco::Ascii::isSpace(c); }))
+        // 带引号的查询（短语、邻近查询）交给 parser
+        if (isSimpleQuery(query))
         {
-            // TODO: 在这里用 trie 处理后缀匹配吗
-            std::vector<std::string> querys = db.matchTerm(query, 3);
-
-            for (int query_id = 0; query_id < querys.size(); query_id++)
+            auto words = db.getAnalyzer().analyzeQuery(query);
+            if (words.size() > 1) // 例如中文查询被切成多个二元组，要求同时出现
             {
-                LeafNode<std::string> leaf_node(querys[query_id]);
-                auto terms_executor = std::make_shared<TermsExecutor>(db, ConjunctionTree(&leaf_node));
-                auto score_executor = std::make_shared<ScoreExecutor>(db, std::unordered_map<std::string, double>{{querys[query_id], 1.0}});
-                auto limit_executor = std::make_shared<LimitExecutor> (db, 10);
+                std::unordered_map<std::string, double> word_freq;
+                for (const auto& word : words)
+                    word_freq.emplace(word, 1.0);
 
-                // TODO: 考虑执行 DAG，比如多个 score_executor 作为一个 limit_executor 的输入.
                 ExecutePipeline pipeline;
-                pipeline.addExecutor(terms_executor).addExecutor(score_executor).addExecutor(limit_executor);
+                pipeline.addExecutor(std::make_shared<TermsExecutor>(db, TermsExecutor::makeTree(words)))
+                        .addExecutor(std::make_shared<ScoreExecutor>(db, word_freq, global_stats))
+                        .addExecutor(std::make_shared<LimitExecutor>(db));
+
+                collectScores(pipeline, words);
+            }
+            else
+            {
+                // TODO: 在这里用 trie 处理后缀匹配吗
+                std::vector<std::string> querys = prefixTerms(words.empty() ? query : words[0]);
+
+                for (int query_id = 0; query_id < querys.size(); query_id++)
+                {
+                    LeafNode<std::string> leaf_node(querys[query_id]);
+                    auto terms_executor = std::make_shared<TermsExecutor>(db, ConjunctionTree(&leaf_node));
+                    auto score_executor = std::make_shared<ScoreExecutor>(db, std::unordered_map<std::string, double>{{querys[query_id], 1.0}}, global_stats);
+                    auto limit_executor = std::make_shared<LimitExecutor>(db);
+
+                    // TODO: 考虑执行 DAG，比如多个 score_executor 作为一个 limit_executor 的输入.
+                    ExecutePipeline pipeline;
+                    pipeline.addExecutor(terms_executor).addExecutor(score_executor).addExecutor(limit_executor);
 
-                transformScoresToResult(pipeline, querys[query_id]);
+                    collectScores(pipeline, {querys[query_id]});
+                }
             }
         }
         else
@@ -144,27 +272,17 @@ public:
             if (type == QueryErrorType::Non)
             {
                 auto query_ast = ast->as<ASTQuery>();
-                ExecutePipeline pipeline = query_ast->toExecutorPipeline(db);
-                transformScoresToResult(pipeline, query_ast->getTerm().value_or(""));
+                ExecutePipeline pipeline = query_ast->toExecutorPipeline(db, global_stats);
+                collectScores(pipeline, query_ast->getTerms(db.getAnalyzer()));
             }
         }
 
-        // 收集查询本身的统计信息
-        if (search_timer.elapsedMilliseconds() > 0 || !res.empty())
-            db.addQueryStatistics(search_timer.getStartTime(),
-                                  std::make_shared<QueryStatistics>(query, search_timer.elapsedMilliseconds(), res.size()));
-
-        // 收集最经常被查询到的文档的编号
-        std::vector<size_t> doc_ids;
-        for (const auto& search_result : res)
-        {
-            doc_ids.push_back(search_result.doc_id);
-        }
-        db.addDocumentQueryFreq(doc_ids);
-
+        std::sort(res.entries.begin(), res.entries.end(), RankedResults::before);
         return res;
     }
 
-private:
     Database &db;
+    CollectionStatisticsPtr global_stats;
+    std::optional<std::vector<std::string>> expanded_terms;
+    SnippetGenerator snippet_generator;
 };
\ No newline at end of file
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "../typedefs.h"
+#include "core/Document.h"
+#include "storage/DocumentStore.h"
+#include "utils/StringUtils.h"
+
+// 文档中 [offset, offset + len) 命中了查询中的第 term_index 个词
+struct SnippetHit
+{
+    size_t offset;
+    size_t len;
+    size_t term_index;
+};
+
+// 从一个文档的全部命中中挑选最多 max_snippets 个互不重叠的窗口作为高亮文本.
+// 窗口先按覆盖的不同查询词数、再按命中次数打分；每个文档只打开一次文件，
+// 命中数超过 max_hits 时只考虑文件中靠前的部分，限制单个结果的开销.
+class SnippetGenerator
+{
+public:
+    explicit SnippetGenerator(size_t window_size_ = SNIPPET_WINDOW_SIZE, size_t max_snippets_ = SNIPPET_MAX_NUM, size_t max_hits_ = SNIPPET_MAX_HITS)
+        : window_size(window_size_), max_snippets(max_snippets_), max_hits(max_hits_) {}
+
+    // document_store 中有该文档时从 store 读取，否则读原文件
+    std::vector<std::string> generate(const Document& document, std::vector<SnippetHit> hits, const DocumentStore* document_store = nullptr) const
+    {
+        auto windows = selectWindows(std::move(hits));
+        if (windows.empty())
+            return {};
+
+        std::optional<std::vector<std::string>> stored_texts;
+        if (document_store)
+            stored_texts = document_store->getStrings(document.getId(), windows);
+        auto texts = stored_texts ? std::move(*stored_texts) : document.getStrings(windows);
+        for (auto& text : texts)
+            text = outputSmooth(text);
+        return texts;
+    }
+
+    // 返回 (offset, len)，按得分从高到低排列
+    std::vector<std::pair<size_t, size_t>> selectWindows(std::vector<SnippetHit> hits) const
+    {
+        std::sort(hits.begin(), hits.end(), [](const SnippetHit& a, const SnippetHit& b) { return a.offset < b.offset; });
+        if (hits.size() > max_hits)
+            hits.resize(max_hits);
+
+        std::vector<std::pair<size_t, size_t>> windows;
+        std::vector<bool> used(hits.size(), false);
+        std::unordered_set<size_t> terms;
+        while (windows.size() < max_snippets)
+        {
+            // 以每个未使用的命中作为窗口起点，向右尽可能多地纳入命中
+            size_t best_score = 0, best_begin = 0, best_end = 0;
+            std::pair<size_t, size_t> best_window;
+            for (size_t i = 0; i < hits.size(); i++)
+            {
+                if (used[i])
+                    continue;
+                terms.clear();
+                size_t j = i, end_offset = hits[i].offset + hits[i].len;
+                for (; j < hits.size() && !used[j]; j++)
+                {
+                    size_t hit_end = std::max(end_offset, hits[j].offset + hits[j].len);
+                    if (j > i && hit_end - hits[i].offset > window_size)
+                        break;
+                    end_offset = hit_end;
+                    terms.insert(hits[j].term_index);
+                }
+                auto window = placeWindow(hits[i].offset, end_offset);
+                if (overlaps(windows, window))
+                    continue;
+                size_t score = terms.size() * (max_hits + 1) + (j - i);
+                if (score > best_score)
+                {
+                    best_score = score;
+                    best_begin = i;
+                    best_end = j;
+                    best_window = window;
+                }
+            }
+            if (best_score == 0)
+                break;
+
+            windows.push_back(best_window);
+            std::fill(used.begin() + best_begin, used.begin() + best_end, true);
+        }
+        return windows;
+    }
+
+private:
+    // 命中区间 [begin, end) 放在窗口中间，左侧不足时从文件开头输出
+    std::pair<size_t, size_t> placeWindow(size_t begin, size_t end) const
+    {
+        size_t len = std::max(window_size, end - begin);
+        size_t left_len = (len - (end - begin)) / 2;
+        return {begin >= left_len ? begin - left_len : 0, len};
+    }
+
+    static bool overlaps(const std::vector<std::pair<size_t, size_t>>& windows, std::pair<size_t, size_t> window)
+    {
+        return std::any_of(windows.begin(), windows.end(), [&window](const auto& w) {
+            return window.first < w.first + w.second && w.first < window.first + window.second;
+        });
+    }
+
+    const size_t window_size;
+    const size_t max_snippets;
+    const size_t max_hits;
+};
@@ -1,5 +1,6 @@
 #include "../typedefs.h"
 #include "Searcher.h"
+#include "DistributedSearcher.h"
 #include "indexer/Indexer.h"
 
 TEST(Searcher, base)
@@ -56,6 +57,275 @@ TEST(DocumentFreq, base)
     ASSERT_EQ((++(++freq_to_documents.begin()))->first, std::make_pair(0ull, 16ull));
 }
 
+TEST(QueryCache, base)
+{
+    ASSERT_EQ(QueryCache::normalize("  'a'   LIMIT\t10 "), "'a' LIMIT 10");
+
+    QueryCache cache(2);
+    auto result = std::make_shared<const RankedResults>(RankedResults{.entries = {{.doc_id = 1, .score = 1000, .words_index = 0}}, .words = {{"a"}}});
+    cache.put("a", 1, result);
+    ASSERT_EQ(cache.get("a", 1), result);
+    // 索引发生变化后条目失效
+    ASSERT_EQ(cache.get("a", 2), nullptr);
+    ASSERT_EQ(cache.get("a", 1), nullptr);
+
+    cache.put("a", 2, result);
+    cache.put("b", 2, result);
+    ASSERT_NE(cache.get("a", 2), nullptr);
+    cache.put("c", 2, result); // 淘汰最久未使用的 "b"
+    ASSERT_EQ(cache.get("b", 2), nullptr);
+    ASSERT_NE(cache.get("a", 2), nullptr);
+    ASSERT_NE(cache.get("c", 2), nullptr);
+
+    ASSERT_EQ(cache.getHits(), 4);
+    ASSERT_EQ(cache.getMisses(), 3);
+}
+
+TEST(Searcher, QueryCache)
+{
+    Database db(ROOT_PATH + "/database1", true);
+    Indexer indexer(db);
+    indexer.index(ROOT_PATH + "/articles");
+    Searcher searcher(db);
+
+    auto res = searcher.search("'love'  LIMIT 10");
+    ASSERT_EQ(searcher.search("'love' LIMIT 10").size(), res.size());
+    ASSERT_EQ(db.getQueryCache().getHits(), 1);
+
+    // 索引变化后重新执行
+    indexer.indexFile(ROOT_PATH + "/articles-cnn/1452.story");
+    searcher.search("'love' LIMIT 10");
+    ASSERT_EQ(db.getQueryCache().getHits(), 1);
+}
+
+TEST(Searcher, Paging)
+{
+    Database db(ROOT_PATH + "/database1", true);
+    Indexer indexer(db);
+    indexer.index(ROOT_PATH + "/articles");
+    Searcher searcher(db);
+
+    auto all = searcher.search("'you'");
+    ASSERT_GE(all.size(), 3);
+
+    auto first = searcher.search("'you'", PageRequest{.limit = 2});
+    ASSERT_EQ(first.total, all.size());
+    ASSERT_EQ(first.results.size(), 2);
+    ASSERT_TRUE(first.next_cursor.has_value());
+
+    // cursor 与 offset 翻到同一页
+    auto by_cursor = searcher.search("'you'", PageRequest{.limit = 2, .cursor = first.next_cursor});
+    auto by_offset = searcher.search("'you'", PageRequest{.offset = 2, .limit = 2});
+    ASSERT_EQ(by_cursor.results[0].doc_id, all[2].doc_id);
+    ASSERT_EQ(by_offset.results[0].doc_id, all[2].doc_id);
+
+    ASSERT_THROW(searcher.search("'you'", PageRequest{.cursor = "zz"}), Poco::InvalidArgumentException);
+}
+
+TEST(Searcher, Cursor)
+{
+    RankedResults::Entry entry{.doc_id = 42, .score = 12345};
+    auto decoded = Searcher::decodeCursor(Searcher::encodeCursor(entry));
+    ASSERT_EQ(decoded.doc_id, 42);
+    ASSERT_EQ(decoded.score, 12345);
+    ASSERT_THROW(Searcher::decodeCursor("12"), Poco::InvalidArgumentException);
+    ASSERT_THROW(Searcher::decodeCursor(".1"), Poco::InvalidArgumentException);
+    ASSERT_THROW(Searcher::decodeCursor("1.2.3"), Poco::InvalidArgumentException);
+    ASSERT_THROW(Searcher::decodeCursor("1..2"), Poco::InvalidArgumentException);
+}
+
+TEST(Searcher, CountOnlyPage)
+{
+    auto root = ROOT_PATH + "/articles-count";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+    Database db(ROOT_PATH + "/database1", true);
+    Indexer indexer(db);
+    for (const auto &name : {"1.txt", "2.txt", "3.txt"})
+    {
+        std::ofstream(root + "/" + name) << "apple banana";
+        indexer.indexFile(root + "/" + name);
+    }
+    Searcher searcher(db);
+
+    // limit 为 0 时只返回 total，没有结果也没有 next_cursor
+    auto page = searcher.search("'apple'", PageRequest{.limit = 0});
+    ASSERT_EQ(page.total, 3);
+    ASSERT_TRUE(page.results.empty());
+    ASSERT_FALSE(page.next_cursor.has_value());
+
+    auto first = searcher.search("'apple'", PageRequest{.limit = 1});
+    ASSERT_TRUE(first.next_cursor.has_value());
+    page = searcher.search("'apple'", PageRequest{.limit = 0, .cursor = first.next_cursor});
+    ASSERT_EQ(page.total, 3);
+    ASSERT_FALSE(page.next_cursor.has_value());
+    std::filesystem::remove_all(root);
+}
+
+// 在本进程内调用各分片的 Searcher，请求与响应经过和 HTTP 相同的 JSON 编解码
+class LocalShardTransport : public ShardTransport
+{
+public:
+    explicit LocalShardTransport(std::vector<Database*> shards_) : shards(std::move(shards_)) {}
+
+    size_t getShardCount() const override
+    {
+        return shards.size();
+    }
+
+    nlohmann::json post(size_t shard, const std::string &path, const std::string &, const nlohmann::json &body) override
+    {
+        if (!shards[shard]) // 模拟超时的分片
+            THROW(Poco::TimeoutException("shard " + std::to_string(shard)));
+        if (shard < delays.size())
+            std::this_thread::sleep_for(delays[shard]);
+        auto query = body.at("query").get<std::string>();
+        std::optional<std::vector<std::string>> terms;
+        if (body.contains("terms"))
+            terms = body.at("terms").get<std::vector<std::string>>();
+        if (path == "/shard-stats")
+        {
+            ++stats_requests;
+            auto expanded_terms = terms ? terms : Searcher(*shards[shard]).expandPrefix(query);
+            nlohmann::json data = Searcher(*shards[shard], nullptr, expanded_terms).collectStatistics(query);
+            if (!terms && expanded_terms)
+                data["terms"] = *expanded_terms;
+            return data;
+        }
+
+        auto stats = std::make_shared<const CollectionStatistics>(body.at("stats").get<CollectionStatistics>());
+        auto page = Searcher(*shards[shard], stats, terms).search(query, PageRequest{.limit = body.at("limit").get<size_t>()});
+        return nlohmann::json{{"results", page.results}, {"total", page.total}};
+    }
+
+    std::vector<std::chrono::milliseconds> delays; // 分片响应前的延迟
+    std::atomic_size_t stats_requests = 0;
+
+private:
+    std::vector<Database*> shards;
+};
+
+TEST(DistributedSearcher, GlobalStatistics)
+{
+    auto root = ROOT_PATH + "/articles-shards";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+    const std::vector<std::pair<std::string, std::string>> files_a = {
+            {"a1.txt", "apple banana apple"}, {"a2.txt", "banana cherry"}, {"a3.txt", "fig grape"}};
+    const std::vector<std::pair<std::string, std::string>> files_b = {
+            {"b1.txt", "apple cherry cherry date"}, {"b2.txt", "date elder"}, {"b3.txt", "grape honey"}, {"b4.txt", "kiwi lemon"}};
+
+    Database full(ROOT_PATH + "/database1", true), shard_a(ROOT_PATH + "/database2", true), shard_b(ROOT_PATH + "/database3", true);
+    Indexer full_indexer(full), indexer_a(shard_a), indexer_b(shard_b);
+    for (const auto &[files, indexer] : {std::make_pair(&files_a, &indexer_a), std::make_pair(&files_b, &indexer_b)})
+    {
+        for (const auto &[name, content] : *files)
+        {
+            std::ofstream(root + "/" + name) << content;
+            indexer->indexFile(root + "/" + name);
+            full_indexer.indexFile(root + "/" + name);
+        }
+    }
+
+    // 各分片按全局统计量计算的分数与所有文档在同一个 database 中时相同
+    std::map<std::string, double> expected;
+    for (const auto &result : Searcher(full).search("apple"))
+        expected[result.doc_path] = result.score;
+    ASSERT_EQ(expected.size(), 2);
+
+    LocalShardTransport transport({&shard_a, &shard_b});
+    auto page = DistributedSearcher(transport).search("apple", PageRequest{}, "");
+    ASSERT_FALSE(page.isPartial());
+    ASSERT_EQ(page.total, 2);
+    std::map<std::string, double> actual;
+    for (const auto &result : page.results)
+        actual[result.result.doc_path] = result.result.score;
+    ASSERT_EQ(actual, expected);
+    ASSERT_GE(page.results[0].result.score, page.results[1].result.score);
+
+    // 超时的分片被跳过，返回其余分片的结果
+    LocalShardTransport partial_transport({&shard_a, nullptr});
+    auto partial = DistributedSearcher(partial_transport).search("apple", PageRequest{}, "");
+    ASSERT_TRUE(partial.isPartial());
+    ASSERT_EQ(partial.failed_shards, std::vector<size_t>{1});
+    ASSERT_EQ(partial.results.size(), 1);
+    ASSERT_EQ(partial.results[0].shard, 0);
+
+    // 每一轮的期限覆盖整个请求，而不是每次收发
+    LocalShardTransport slow_transport({&shard_a, &shard_b});
+    slow_transport.delays = {std::chrono::milliseconds(0), std::chrono::milliseconds(500)};
+    {
+        DistributedSearcher slow_searcher(slow_transport, std::chrono::milliseconds(100)); // 析构时等待未完成的请求
+        auto begin = std::chrono::steady_clock::now();
+        auto slow = slow_searcher.search("apple", PageRequest{}, "");
+        EXPECT_LT(std::chrono::steady_clock::now() - begin, std::chrono::milliseconds(400));
+        EXPECT_EQ(slow.failed_shards, std::vector<size_t>{1});
+        EXPECT_EQ(slow.results.size(), 1);
+    }
+
+    std::filesystem::remove_all(root);
+}
+
+TEST(DistributedSearcher, PrefixExpansion)
+{
+    auto root = ROOT_PATH + "/articles-shards";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+    // 两个分片上以 ap 开头的词不同
+    const std::vector<std::pair<std::string, std::string>> files_a = {{"a1.txt", "apple apex"}, {"a2.txt", "apple banana"}};
+    const std::vector<std::pair<std::string, std::string>> files_b = {{"b1.txt", "apricot"}, {"b2.txt", "apple cherry"}, {"b3.txt", "applet"}};
+
+    Database shard_a(ROOT_PATH + "/database2", true), shard_b(ROOT_PATH + "/database3", true);
+    Indexer indexer_a(shard_a), indexer_b(shard_b);
+    for (const auto &[files, indexer] : {std::make_pair(&files_a, &indexer_a), std::make_pair(&files_b, &indexer_b)})
+    {
+        for (const auto &[name, content] : *files)
+        {
+            std::ofstream(root + "/" + name) << content;
+            indexer->indexFile(root + "/" + name);
+        }
+    }
+
+    // 各分片按合并后的同一组词统计与计算分数
+    auto expected_terms = std::vector<std::string>{"apex", "apple", "applet"};
+    auto merged = Searcher(shard_a, nullptr, expected_terms).collectStatistics("ap");
+    merged.merge(Searcher(shard_b, nullptr, expected_terms).collectStatistics("ap"));
+    auto stats = std::make_shared<const CollectionStatistics>(merged);
+    std::map<std::string, double> expected;
+    for (auto *db : {&shard_a, &shard_b})
+        for (const auto &result : Searcher(*db, stats, expected_terms).search("ap"))
+            expected[result.doc_path] = result.score;
+
+    LocalShardTransport transport({&shard_a, &shard_b});
+    auto page = DistributedSearcher(transport).search("ap", PageRequest{}, "");
+    ASSERT_FALSE(page.isPartial());
+    std::map<std::string, double> actual;
+    for (const auto &result : page.results)
+        actual[result.result.doc_path] = result.result.score;
+    EXPECT_EQ(actual, expected);
+    EXPECT_EQ(actual.size(), 4); // b1 只含 apricot，不在合并后的词中
+    EXPECT_EQ(transport.stats_requests, 4); // 两个分片的本地扩展结果都与合并结果不同，重新统计
+
+    std::filesystem::remove_all(root);
+}
+
+TEST(SnippetGenerator, selectWindows)
+{
+    SnippetGenerator generator(20, 2, 100);
+    // 300 附近同时命中两个词，优先于只命中一个词但次数更多的 100 附近
+    std::vector<SnippetHit> hits{{100, 4, 0}, {105, 4, 0}, {110, 4, 0}, {300, 4, 0}, {306, 3, 1}, {1000, 4, 0}};
+    auto windows = generator.selectWindows(hits);
+    ASSERT_EQ(windows.size(), 2);
+    ASSERT_EQ(windows[0], std::make_pair(size_t(295), size_t(20))); // [300, 309) 居中
+    ASSERT_EQ(windows[1], std::make_pair(size_t(97), size_t(20))); // [100, 114) 居中
+
+    // 靠近文件开头时从 0 开始
+    auto head_windows = generator.selectWindows({{3, 4, 0}});
+    ASSERT_EQ(head_windows.size(), 1);
+    ASSERT_EQ(head_windows[0], std::make_pair(size_t(0), size_t(20)));
+    ASSERT_TRUE(generator.selectWindows({}).empty());
+}
+
 int main()
 {
     testing::InitGoogleTest();
@@ -0,0 +1,378 @@
+#pragma once
+
+#include "../typedefs.h"
+#include "utils/Compression.h"
+#include "utils/SerializeUtils.h"
+#include "utils/StringUtils.h"
+#include <unistd.h>
+#include <cerrno>
+
+// 文档原文的压缩存储，位于 database 目录下：store.data 只追加写入压缩块，store.index 记录 doc_id -> 块位置.
+// 每个文档按 DOCUMENT_STORE_BLOCK_SIZE 切块并独立压缩，按偏移读取时只解压涉及的块.
+// 删除文档只删除索引项，store.data 中的空间不回收. 已写入 store.data 的字节不会再被修改.
+class DocumentStore
+{
+public:
+    explicit DocumentStore(const std::filesystem::path& dir)
+        : data_path(dir / "store.data"), index_path(dir / "store.index")
+    {
+        fd = ::open(data_path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+            THROW(Poco::CreateFileException("can't open document store " + data_path.string()));
+        deserialize();
+    }
+
+    DocumentStore(const DocumentStore&) = delete;
+    DocumentStore& operator=(const DocumentStore&) = delete;
+
+    ~DocumentStore()
+    {
+        serialize();
+        ::close(fd);
+    }
+
+    static bool exists(const std::filesystem::path& dir)
+    {
+        return std::filesystem::exists(dir / "store.index");
+    }
+
+    void add(size_t doc_id, std::string_view content)
+    {
+        Entry entry{.raw_size = content.size()};
+        std::string pending;
+        for (size_t begin = 0; begin < content.size(); begin += DOCUMENT_STORE_BLOCK_SIZE)
+            compressBlock(content.substr(begin, DOCUMENT_STORE_BLOCK_SIZE), entry, pending);
+
+        std::lock_guard lg(lock);
+        writePending(entry, 0, pending);
+        entries[doc_id] = std::move(entry);
+        dirty = true;
+    }
+
+    // 按块读取文件并存入，内存中最多保留 DOCUMENT_STORE_WRITE_BYTES 的压缩数据. 文件不可读时返回 false
+    bool addFile(size_t doc_id, const std::filesystem::path& file_path)
+    {
+        std::ifstream fin(file_path, std::ios::binary);
+        if (!fin.is_open())
+            return false;
+
+        Entry entry{.raw_size = 0};
+        std::string block(DOCUMENT_STORE_BLOCK_SIZE, '\0'), pending;
+        size_t first_pending = 0;
+        std::optional<uint64_t> file_epoch; // 期间 clear 过时已写入的块位于旧文件中，放弃这次存入
+        auto flush = [&] {
+            std::lock_guard lg(lock);
+            if (file_epoch && *file_epoch != epoch)
+                return false;
+            file_epoch = epoch;
+            writePending(entry, first_pending, pending);
+            first_pending = entry.block_sizes.size();
+            pending.clear();
+            return true;
+        };
+
+        while (fin)
+        {
+            fin.read(block.data(), static_cast<std::streamsize>(block.size()));
+            auto n = static_cast<size_t>(fin.gcount());
+            if (n == 0)
+                break;
+            entry.raw_size += n;
+            compressBlock(std::string_view(block.data(), n), entry, pending);
+            if (pending.size() >= DOCUMENT_STORE_WRITE_BYTES && !flush())
+                return false;
+        }
+        if (fin.bad())
+            return false;
+
+        std::lock_guard lg(lock);
+        if (file_epoch && *file_epoch != epoch)
+            return false;
+        writePending(entry, first_pending, pending);
+        entries[doc_id] = std::move(entry);
+        dirty = true;
+        return true;
+    }
+
+    void remove(size_t doc_id)
+    {
+        std::lock_guard lg(lock);
+        dirty |= entries.erase(doc_id) > 0;
+    }
+
+    bool contains(size_t doc_id) const
+    {
+        std::lock_guard lg(lock);
+        return entries.contains(doc_id);
+    }
+
+    // 与 Document::getStrings 语义相同，文档不在 store 中时返回 std::nullopt
+    std::optional<std::vector<std::string>> getStrings(size_t doc_id, const std::vector<std::pair<size_t, size_t>>& ranges) const
+    {
+        auto entry = findEntry(doc_id);
+        if (!entry)
+            return std::nullopt;
+
+        std::vector<std::string> res;
+        for (auto [offset, len] : ranges)
+        {
+            if (offset + len > entry->raw_size)
+                offset = entry->raw_size > len ? entry->raw_size - len : 0;
+            res.push_back(fix_utf8(read(*entry, offset, std::min(len, entry->raw_size - offset))));
+        }
+        return res;
+    }
+
+    // 文档原文的字节数，文档不在 store 中时返回 std::nullopt
+    std::optional<uint64_t> getSize(size_t doc_id) const
+    {
+        std::lock_guard lg(lock);
+        auto iter = entries.find(doc_id);
+        if (iter == entries.end())
+            return std::nullopt;
+        return iter->second.raw_size;
+    }
+
+    // 依次解压文档的每个块，用于下载时流式输出. 文档不在 store 中时返回 false
+    bool forEachBlock(size_t doc_id, const std::function<void(const std::string&)>& callback) const
+    {
+        return forEachBlock(doc_id, 0, std::numeric_limits<uint64_t>::max(), callback);
+    }
+
+    // 只输出原文中 [offset, offset + len) 的部分，用于 Range 请求，只解压涉及的块
+    bool forEachBlock(size_t doc_id, uint64_t offset, uint64_t len, const std::function<void(const std::string&)>& callback) const
+    {
+        auto entry = findEntry(doc_id);
+        if (!entry)
+            return false;
+        if (offset >= entry->raw_size)
+            return true;
+        len = std::min<uint64_t>(len, entry->raw_size - offset);
+        for (size_t i = offset / DOCUMENT_STORE_BLOCK_SIZE; len > 0; i++)
+        {
+            auto block = readBlock(*entry, i);
+            size_t begin = offset - i * DOCUMENT_STORE_BLOCK_SIZE;
+            size_t n = std::min<uint64_t>(len, block.size() - begin);
+            callback(begin == 0 && n == block.size() ? block : block.substr(begin, n));
+            offset += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    // 析构时不再写入 store.index，用于随后整体删除的 store
+    void discard()
+    {
+        std::lock_guard lg(lock);
+        dirty = false;
+    }
+
+    // 索引有变化时写入 store.index. 由 Database 与 meta 一起持久化，析构时也会调用
+    void serialize()
+    {
+        std::lock_guard lg(lock);
+        if (dirty && writeIndex(index_path, data_size, entries))
+            dirty = false;
+    }
+
+    // 把 store 的文件移动到 dir 下（同一文件系统内 rename），已打开的 fd 继续有效
+    void moveTo(const std::filesystem::path& dir)
+    {
+        std::filesystem::create_directories(dir);
+        {
+            std::lock_guard lg(lock);
+            std::filesystem::rename(data_path, dir / "store.data");
+            std::filesystem::remove(index_path);
+            data_path = dir / "store.data";
+            index_path = dir / "store.index";
+            dirty = true;
+        }
+        serialize();
+    }
+
+    // 在 dir 下生成当前内容的快照，返回快照中 store.data 的有效长度. store.data 只在末尾追加（clear 换用新文件），
+    // 所以直接硬链接：快照不复制数据，之后追加的内容位于有效长度之后. 无法硬链接（例如跨文件系统）时复制
+    uint64_t snapshotTo(const std::filesystem::path& dir) const
+    {
+        std::filesystem::create_directories(dir);
+        auto snapshot_data_path = dir / "store.data";
+        std::filesystem::remove(snapshot_data_path);
+
+        std::unordered_map<size_t, Entry> entries_copy;
+        size_t size;
+        int copy_fd = -1;
+        {
+            std::lock_guard lg(lock);
+            entries_copy = entries;
+            size = data_size;
+            std::error_code ec;
+            std::filesystem::create_hard_link(data_path, snapshot_data_path, ec);
+            if (ec && (copy_fd = ::dup(fd)) < 0)
+                THROW(Poco::ReadFileException(data_path.string()));
+        }
+
+        if (copy_fd >= 0)
+        {
+            // 复制期间不阻塞写入，只复制开始时 data_size 之内的部分
+            std::ofstream fout(snapshot_data_path, std::ios::binary | std::ios::trunc);
+            std::string block(1 << 20, '\0');
+            for (size_t offset = 0; offset < size;)
+            {
+                size_t n = std::min(block.size(), size - offset);
+                if (::pread(copy_fd, block.data(), n, static_cast<off_t>(offset)) != static_cast<ssize_t>(n))
+                {
+                    ::close(copy_fd);
+                    THROW(Poco::ReadFileException(data_path.string()));
+                }
+                fout.write(block.data(), static_cast<std::streamsize>(n));
+                offset += n;
+            }
+            ::close(copy_fd);
+            if (!fout)
+                THROW(Poco::WriteFileException(snapshot_data_path.string()));
+        }
+        if (!writeIndex(dir / "store.index", size, entries_copy))
+            THROW(Poco::WriteFileException((dir / "store.index").string()));
+        return size;
+    }
+
+    // 不截断 store.data，快照可能通过硬链接引用它，改为换用一个新文件
+    void clear()
+    {
+        std::lock_guard lg(lock);
+        entries.clear();
+        data_size = 0;
+        ++epoch;
+        dirty = true;
+        if (::unlink(data_path.c_str()) != 0 && errno != ENOENT)
+            THROW(Poco::WriteFileException(data_path.string()));
+        int new_fd = ::open(data_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (new_fd < 0)
+            THROW(Poco::CreateFileException("can't open document store " + data_path.string()));
+        // dup2 原子地替换 fd 指向的文件，不持锁的读取不会看到已关闭的 fd
+        bool replaced = ::dup2(new_fd, fd) >= 0;
+        ::close(new_fd);
+        if (!replaced)
+            THROW(Poco::CreateFileException("can't open document store " + data_path.string()));
+    }
+
+private:
+    struct Entry
+    {
+        size_t raw_size;
+        std::vector<uint64_t> block_offsets; // 在 store.data 中的偏移
+        std::vector<uint32_t> block_sizes; // 压缩后的长度
+    };
+
+    std::optional<Entry> findEntry(size_t doc_id) const
+    {
+        std::lock_guard lg(lock);
+        auto iter = entries.find(doc_id);
+        if (iter == entries.end())
+            return std::nullopt;
+        return iter->second;
+    }
+
+    std::string readBlock(const Entry& entry, size_t block_index) const
+    {
+        std::string compressed(entry.block_sizes[block_index], '\0');
+        auto read_number = ::pread(fd, compressed.data(), compressed.size(), static_cast<off_t>(entry.block_offsets[block_index]));
+        if (read_number != static_cast<ssize_t>(compressed.size()))
+            THROW(Poco::ReadFileException(data_path.string()));
+        size_t raw_size = std::min(DOCUMENT_STORE_BLOCK_SIZE, entry.raw_size - block_index * DOCUMENT_STORE_BLOCK_SIZE);
+        return lz::decompress(compressed, raw_size);
+    }
+
+    // [offset, offset + len) 必须在文档范围内
+    std::string read(const Entry& entry, size_t offset, size_t len) const
+    {
+        std::string res;
+        for (size_t i = offset / DOCUMENT_STORE_BLOCK_SIZE; len > 0; i++)
+        {
+            auto block = readBlock(entry, i);
+            size_t begin = offset - i * DOCUMENT_STORE_BLOCK_SIZE;
+            size_t n = std::min(len, block.size() - begin);
+            res.append(block, begin, n);
+            offset += n;
+            len -= n;
+        }
+        return res;
+    }
+
+    // 压缩一个块追加到 pending，块偏移暂时相对于 pending 的开头
+    static void compressBlock(std::string_view raw, Entry& entry, std::string& pending)
+    {
+        auto block = lz::compress(raw);
+        entry.block_offsets.push_back(pending.size());
+        entry.block_sizes.push_back(static_cast<uint32_t>(block.size()));
+        pending += block;
+    }
+
+    // 把 pending 写到 store.data 末尾，entry 中从 first_block 开始的块偏移改为在文件中的偏移
+    // caller holds lock
+    void writePending(Entry& entry, size_t first_block, const std::string& pending)
+    {
+        if (::pwrite(fd, pending.data(), pending.size(), static_cast<off_t>(data_size)) != static_cast<ssize_t>(pending.size()))
+            THROW(Poco::WriteFileException(data_path.string()));
+        for (size_t i = first_block; i < entry.block_offsets.size(); i++)
+            entry.block_offsets[i] += data_size;
+        data_size += pending.size();
+    }
+
+    // 先写入临时文件再改名，崩溃时磁盘上总有一份完整的索引. 写入失败时返回 false，原有的索引保持不变
+    static bool writeIndex(const std::filesystem::path& path, size_t data_size, const std::unordered_map<size_t, Entry>& entries)
+    {
+        auto tmp_path = path.string() + ".tmp";
+        std::ofstream fout(tmp_path, std::ios::binary | std::ios::trunc);
+        WriteBuffer buf;
+        WriteBufferHelper helper(buf);
+        helper.writeNumber(data_size);
+        helper.writeNumber(entries.size());
+        for (const auto& [doc_id, entry] : entries)
+        {
+            helper.writeNumber(doc_id);
+            helper.writeNumber(entry.raw_size);
+            helper.writeLinearContainer(entry.block_offsets);
+            helper.writeLinearContainer(entry.block_sizes);
+        }
+        buf.dumpAllToStream(fout);
+        fout.close();
+        std::error_code ec;
+        if (fout)
+            std::filesystem::rename(tmp_path, path, ec);
+        return fout && !ec;
+    }
+
+    void deserialize()
+    {
+        std::ifstream fin(index_path);
+        if (!fin.is_open())
+        {
+            dirty = true; // 新建的 store 也要写出索引，exists 以它判断 store 是否存在
+            return;
+        }
+
+        ReadBuffer buf;
+        buf.readAllFromStream(fin);
+        ReadBufferHelper helper(buf);
+        data_size = helper.readNumber<size_t>();
+        auto size = helper.readNumber<size_t>();
+        for (size_t i = 0; i < size; i++)
+        {
+            auto doc_id = helper.readNumber<size_t>();
+            Entry entry{.raw_size = helper.readNumber<size_t>()};
+            entry.block_offsets = helper.readLinearContainer<std::vector, uint64_t>();
+            entry.block_sizes = helper.readLinearContainer<std::vector, uint32_t>();
+            entries.emplace(doc_id, std::move(entry));
+        }
+    }
+
+    std::filesystem::path data_path, index_path;
+    int fd;
+
+    mutable std::mutex lock;
+    std::unordered_map<size_t, Entry> entries;
+    size_t data_size = 0; // store.data 的有效长度，之后的内容是未写完索引的残留
+    uint64_t epoch = 0; // clear 换用新文件的次数
+    bool dirty = false; // entries 在上次 serialize 之后有变化
+};
@@ -61,8 +61,9 @@ public:
             {
                 std::getline(fin, line);
                 read_number = line.size() + 1;
+                // 只裁剪 ASCII 空白/控制字符，保留 UTF-8 多字节字符（否则整行中文会被裁成空行而跳过）
                 left_trim_number = trimInPlace(line, [](char ch) {
-                    return Poco::Ascii::isSpace(ch) || !Poco::Ascii::isPrintable(ch);
+                    return Poco::Ascii::isSpace(ch) || (Poco::Ascii::isAscii(ch) && !Poco::Ascii::isPrintable(ch));
                 }).first;
                 offset_in_file += read_number;
             }
@@ -0,0 +1,412 @@
+#pragma once
+
+#include "../typedefs.h"
+#include "core/Database.h"
+#include "utils/JsonUtils.h"
+#include "utils/StringUtils.h"
+#include <Poco/Net/HTTPClientSession.h>
+#include <Poco/Net/HTTPRequest.h>
+#include <Poco/Net/HTTPResponse.h>
+#include <Poco/URI.h>
+
+// 主从复制以快照为单位：primary 在索引变化后把 database 写成一个只读的快照目录，
+// replica 拉取比自己新的快照，校验后用 replaceIndexWith 整体替换索引. replica 从不读取被索引的源文件.
+//
+// 快照位于 primary 的 <database>/snapshots/<version>/，包含 meta、analyzer、store.data、store.index 与 MANIFEST.
+// 先写入临时目录再改名，MANIFEST 存在的目录一定是完整的. store.data 是 database 中同名文件的硬链接，
+// 之后还会在末尾追加，MANIFEST 中的 size 是它在快照中的有效长度，replica 只拉取这一部分.
+
+struct SnapshotFile
+{
+    std::string name;
+    uint64_t size = 0; // 有效长度，文件本身可能更长
+    uint64_t checksum = 0; // 前 size 个字节的校验和
+};
+
+struct SnapshotManifest
+{
+    uint64_t version = 0;
+    std::vector<SnapshotFile> files;
+};
+
+void to_json(nlohmann::json &j, const SnapshotFile &file)
+{
+    j = nlohmann::json{{"name", file.name}, {"size", file.size}, {"checksum", file.checksum}};
+}
+
+void from_json(const nlohmann::json &j, SnapshotFile &file)
+{
+    j.at("name").get_to(file.name);
+    j.at("size").get_to(file.size);
+    j.at("checksum").get_to(file.checksum);
+}
+
+void to_json(nlohmann::json &j, const SnapshotManifest &manifest)
+{
+    j = nlohmann::json{{"version", manifest.version}, {"files", manifest.files}};
+}
+
+void from_json(const nlohmann::json &j, SnapshotManifest &manifest)
+{
+    j.at("version").get_to(manifest.version);
+    j.at("files").get_to(manifest.files);
+}
+
+// 文件前 limit 个字节的 FNV-1a 64，用于发现传输中损坏或截断的文件
+uint64_t checksumFile(const std::filesystem::path &path, uint64_t limit = UINT64_MAX)
+{
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin.is_open())
+        THROW(Poco::ReadFileException(path.string()));
+    uint64_t hash = 14695981039346656037ull;
+    std::vector<char> buf(1 << 16);
+    while (limit > 0)
+    {
+        fin.read(buf.data(), static_cast<std::streamsize>(std::min<uint64_t>(buf.size(), limit)));
+        auto read_number = fin.gcount();
+        if (read_number <= 0)
+            break;
+        for (std::streamsize i = 0; i < read_number; i++)
+        {
+            hash ^= static_cast<unsigned char>(buf[i]);
+            hash *= 1099511628211ull;
+        }
+        limit -= read_number;
+    }
+    return hash;
+}
+
+// 从 in 复制至多 len 个字节到 out，返回实际复制的字节数
+uint64_t copyStreamPrefix(std::istream &in, std::ostream &out, uint64_t len)
+{
+    std::vector<char> buf(1 << 16);
+    uint64_t copied = 0;
+    while (copied < len)
+    {
+        in.read(buf.data(), static_cast<std::streamsize>(std::min<uint64_t>(buf.size(), len - copied)));
+        auto read_number = in.gcount();
+        if (read_number <= 0)
+            break;
+        out.write(buf.data(), read_number);
+        copied += read_number;
+    }
+    return copied;
+}
+
+// primary 端快照目录的读写
+class SnapshotDirectory
+{
+public:
+    explicit SnapshotDirectory(const std::filesystem::path &database_path) : root(database_path / "snapshots") {}
+
+    // 最新的完整快照
+    std::optional<SnapshotManifest> latest() const
+    {
+        auto versions = listVersions();
+        if (versions.empty())
+            return std::nullopt;
+        std::ifstream fin(root / std::to_string(versions.back()) / "MANIFEST");
+        std::string text;
+        Poco::StreamCopier::copyToString64(fin, text);
+        return nlohmann::json::parse(text).get<SnapshotManifest>();
+    }
+
+    // version 与 name 来自请求，只允许访问快照中列出的文件. 快照已被清理时返回空.
+    // 同时把快照标记为刚被访问，正在被 replica 下载的快照在保留时间内不会被 create 删除
+    std::optional<std::filesystem::path> filePath(uint64_t version, const std::string &name) const
+    {
+        auto dir = root / std::to_string(version);
+        std::ifstream fin(dir / "MANIFEST");
+        if (!fin.is_open())
+            return std::nullopt;
+        std::error_code ec;
+        std::filesystem::last_write_time(dir, std::filesystem::file_time_type::clock::now(), ec);
+        std::string text;
+        Poco::StreamCopier::copyToString64(fin, text);
+        auto manifest = nlohmann::json::parse(text).get<SnapshotManifest>();
+        if (std::none_of(manifest.files.begin(), manifest.files.end(), [&](const SnapshotFile &file) { return file.name == name; }))
+            return std::nullopt;
+        return dir / name;
+    }
+
+    // 生成新快照并返回其版本号. 较旧的快照在最新的 keep 个之外，并且超过 retention 没有被访问时删除
+    uint64_t create(const Database &db, size_t keep = REPLICATION_SNAPSHOTS_KEPT,
+                    std::chrono::seconds retention = std::chrono::seconds(REPLICATION_SNAPSHOT_RETENTION_SECONDS))
+    {
+        auto versions = listVersions();
+        uint64_t version = versions.empty() ? 1 : versions.back() + 1;
+
+        auto tmp_dir = root / (".tmp-" + std::to_string(version));
+        std::filesystem::remove_all(tmp_dir);
+        auto shared_lengths = db.saveSnapshot(tmp_dir);
+
+        SnapshotManifest manifest{.version = version};
+        for (const auto &entry : std::filesystem::directory_iterator(tmp_dir))
+        {
+            if (!entry.is_regular_file())
+                continue;
+            auto name = entry.path().filename().string();
+            auto iter = shared_lengths.find(name);
+            uint64_t size = iter != shared_lengths.end() ? iter->second : entry.file_size();
+            manifest.files.push_back(SnapshotFile{.name = name, .size = size, .checksum = checksumFile(entry.path(), size)});
+        }
+        std::sort(manifest.files.begin(), manifest.files.end(), [](const auto &a, const auto &b) { return a.name < b.name; });
+        std::ofstream(tmp_dir / "MANIFEST") << nlohmann::json(manifest).dump();
+        std::filesystem::rename(tmp_dir, root / std::to_string(version));
+
+        versions.push_back(version);
+        auto now = std::filesystem::file_time_type::clock::now();
+        for (size_t i = 0; i + keep < versions.size(); i++)
+        {
+            auto dir = root / std::to_string(versions[i]);
+            std::error_code ec;
+            auto last_access = std::filesystem::last_write_time(dir, ec);
+            if (ec || now - last_access > retention)
+                std::filesystem::remove_all(dir, ec);
+        }
+        return version;
+    }
+
+private:
+    std::vector<uint64_t> listVersions() const
+    {
+        std::vector<uint64_t> versions;
+        std::error_code ec;
+        for (std::filesystem::directory_iterator iter(root, ec), end; !ec && iter != end; iter.increment(ec))
+        {
+            auto name = iter->path().filename().string();
+            if (!name.empty() && std::all_of(name.begin(), name.end(), ::isdigit) && std::filesystem::exists(iter->path() / "MANIFEST"))
+                versions.push_back(std::stoull(name));
+        }
+        std::sort(versions.begin(), versions.end());
+        return versions;
+    }
+
+    std::filesystem::path root;
+};
+
+// primary 端：索引发生变化后生成新快照
+class SnapshotPublisher
+{
+public:
+    explicit SnapshotPublisher(const Database &db_) : db(db_), directory(db_.getPath()) {}
+
+    // 返回新快照的版本号，索引没有变化时返回空
+    std::optional<uint64_t> publish()
+    {
+        auto generation = db.getGeneration();
+        if (last_generation == generation)
+            return std::nullopt;
+        auto version = directory.create(db);
+        last_generation = generation;
+        return version;
+    }
+
+private:
+    const Database &db;
+    SnapshotDirectory directory;
+    std::optional<uint64_t> last_generation; // 进程重启后第一次总会生成快照
+};
+
+// replica 获取快照的来源. 失败时抛出异常
+class ReplicationSource
+{
+public:
+    virtual ~ReplicationSource() = default;
+
+    // primary 还没有快照时返回空
+    virtual std::optional<SnapshotManifest> latest() = 0;
+
+    // 把快照文件的 [offset, size) 追加到 to 的末尾，to 中已有前 offset 个字节（断点续传）
+    virtual void fetch(uint64_t version, const std::string &name, const std::filesystem::path &to, uint64_t offset, uint64_t size) = 0;
+};
+
+// primary 的 database 目录可以直接访问，例如同一台机器或共享存储
+class DirectoryReplicationSource : public ReplicationSource
+{
+public:
+    explicit DirectoryReplicationSource(const std::filesystem::path &primary_database_path) : directory(primary_database_path) {}
+
+    std::optional<SnapshotManifest> latest() override
+    {
+        return directory.latest();
+    }
+
+    void fetch(uint64_t version, const std::string &name, const std::filesystem::path &to, uint64_t offset, uint64_t size) override
+    {
+        auto path = directory.filePath(version, name);
+        std::ifstream fin;
+        if (path)
+            fin.open(*path, std::ios::binary);
+        if (!fin.is_open())
+            THROW(Poco::FileNotFoundException("snapshot " + std::to_string(version) + "/" + name));
+        fin.seekg(static_cast<std::streamoff>(offset));
+        std::ofstream fout(to, std::ios::binary | std::ios::app);
+        copyStreamPrefix(fin, fout, size - offset);
+        if (!fout)
+            THROW(Poco::WriteFileException(to.string()));
+    }
+
+private:
+    SnapshotDirectory directory;
+};
+
+// 通过 primary 的 /replication/latest 与 /replication/file 获取快照，id 是该 database 某个用户的登录 id
+class HTTPReplicationSource : public ReplicationSource
+{
+public:
+    HTTPReplicationSource(std::string host_, uint16_t port_, std::string id_, std::chrono::milliseconds timeout_)
+        : host(std::move(host_)), port(port_), id(std::move(id_)), timeout(timeout_) {}
+
+    std::optional<SnapshotManifest> latest() override
+    {
+        std::string text;
+        get("/replication/latest", {}, [&text](std::istream &in, const Poco::Net::HTTPResponse &) { Poco::StreamCopier::copyToString64(in, text); });
+        auto json = nlohmann::json::parse(text);
+        if (json.at("status").get<int>() != 0)
+            THROW(Poco::IOException("primary " + host + " failed: " + json.at("msg").get<std::string>()));
+        const auto &data = json.at("data");
+        if (!data.contains("version"))
+            return std::nullopt;
+        return data.get<SnapshotManifest>();
+    }
+
+    void fetch(uint64_t version, const std::string &name, const std::filesystem::path &to, uint64_t offset, uint64_t size) override
+    {
+        std::ofstream fout(to, std::ios::binary | std::ios::app);
+        if (offset < size)
+        {
+            // primary 上的文件可能比快照中的有效长度更长，只请求还没有下载的有效部分
+            get("/replication/file", {{"version", std::to_string(version)}, {"name", name}},
+                [&fout, offset, size](std::istream &in, const Poco::Net::HTTPResponse &response) {
+                    // 不支持 Range 的 primary 返回整个文件，跳过已有的部分
+                    if (response.getStatus() == Poco::Net::HTTPResponse::HTTP_OK)
+                        in.ignore(static_cast<std::streamsize>(offset));
+                    copyStreamPrefix(in, fout, size - offset);
+                },
+                "bytes=" + std::to_string(offset) + "-" + std::to_string(size - 1));
+        }
+        if (!fout)
+            THROW(Poco::WriteFileException(to.string()));
+    }
+
+private:
+    template <typename ReadBody>
+    void get(const std::string &path, const std::vector<std::pair<std::string, std::string>> &params, ReadBody &&read_body,
+             const std::string &range = "")
+    {
+        Poco::Net::HTTPClientSession session(host, port);
+        session.setTimeout(Poco::Timespan(std::chrono::duration_cast<std::chrono::microseconds>(timeout).count()));
+
+        Poco::URI uri(path);
+        uri.addQueryParameter("id", id);
+        for (const auto &[key, value] : params)
+            uri.addQueryParameter(key, value);
+        Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_GET, uri.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
+        if (!range.empty())
+            request.set("Range", range);
+        session.sendRequest(request);
+
+        Poco::Net::HTTPResponse response;
+        auto &in = session.receiveResponse(response);
+        if (response.getStatus() != Poco::Net::HTTPResponse::HTTP_OK && response.getStatus() != Poco::Net::HTTPResponse::HTTP_PARTIAL_CONTENT)
+            THROW(Poco::IOException("primary " + host + ":" + std::to_string(port) + path + " returned " + std::to_string(response.getStatus())));
+        read_body(in, response);
+    }
+
+    std::string host;
+    uint16_t port;
+    std::string id;
+    std::chrono::milliseconds timeout;
+};
+
+// replica 端：拉取比当前新的快照并替换 db 的索引. 下载与校验在 <database>/replica/<version>/ 下进行，不影响正在执行的查询.
+// 下载失败时保留已下载的部分，下一次 sync 同一版本时从断点继续. 已应用的版本记录在 <database>/replica.version，
+// 进程重启或 database 重新加载后不会重新下载.
+class SnapshotFollower
+{
+public:
+    SnapshotFollower(Database &db_, ReplicationSource &source_) : db(db_), source(source_)
+    {
+        std::ifstream fin(versionPath());
+        uint64_t version;
+        if (fin >> version)
+            applied_version = version;
+    }
+
+    // 返回是否应用了新快照. 下载或校验失败时抛出异常，db 保持不变
+    bool sync()
+    {
+        auto manifest = source.latest();
+        if (!manifest || manifest->version <= applied_version)
+            return false;
+
+        auto staging_root = db.getPath() / "replica";
+        auto staging = staging_root / std::to_string(manifest->version);
+        std::error_code ec;
+        for (std::filesystem::directory_iterator iter(staging_root, ec), end; !ec && iter != end; iter.increment(ec))
+            if (iter->path() != staging)
+                std::filesystem::remove_all(iter->path());
+        std::filesystem::create_directories(staging);
+
+        for (const auto &file : manifest->files)
+        {
+            if (file.name.empty() || file.name.find('/') != std::string::npos || file.name == "." || file.name == "..")
+                THROW(Poco::DataFormatException("invalid snapshot file name " + file.name));
+            auto path = staging / file.name;
+            uint64_t have = std::filesystem::exists(path) ? std::filesystem::file_size(path) : 0;
+            if (have > file.size)
+            {
+                std::filesystem::remove(path);
+                have = 0;
+            }
+            if (have < file.size)
+                source.fetch(manifest->version, file.name, path, have, file.size);
+            if (std::filesystem::file_size(path) != file.size || checksumFile(path) != file.checksum)
+            {
+                std::filesystem::remove(path);
+                THROW(Poco::DataFormatException("snapshot " + std::to_string(manifest->version) + "/" + file.name + " is corrupted"));
+            }
+        }
+
+        {
+            Database shadow(staging, false);
+            if (db.getDocumentStore())
+                shadow.enableDocumentStore();
+            db.replaceIndexWith(shadow);
+        }
+        std::filesystem::remove_all(staging_root);
+        saveVersion(manifest->version);
+        applied_version = manifest->version;
+        return true;
+    }
+
+    uint64_t getAppliedVersion() const
+    {
+        return applied_version;
+    }
+
+private:
+    std::filesystem::path versionPath() const
+    {
+        return db.getPath() / "replica.version";
+    }
+
+    // 写入失败只会导致重启后多下载一次
+    void saveVersion(uint64_t version) const
+    {
+        auto tmp_path = versionPath().string() + ".tmp";
+        {
+            std::ofstream fout(tmp_path, std::ios::trunc);
+            fout << version;
+            if (!fout)
+                return;
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp_path, versionPath(), ec);
+    }
+
+    Database &db;
+    ReplicationSource &source;
+    std::atomic_uint64_t applied_version = 0;
+};
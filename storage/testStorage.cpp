@@ -1,4 +1,6 @@
 #include "Reader.h"
+#include "DocumentStore.h"
+#include "Replication.h"
 #include <fcntl.h>
 
 void check_string_in_file(TxtLineReader &reader, int file_fd, const char *expected_str, size_t expected_offset)
@@ -38,6 +40,261 @@ TEST(reader, TxtReader)
     ASSERT_EQ(line.str, "");
 }
 
+TEST(DocumentStore, base)
+{
+    auto dir = std::filesystem::temp_directory_path() / "zsearch_document_store";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+
+    // 跨越多个块，并且包含大量重复内容
+    std::string content;
+    for (size_t i = 0; content.size() < DOCUMENT_STORE_BLOCK_SIZE * 2 + 100; i++)
+        content += "line " + std::to_string(i % 1000) + " of the document\n";
+    {
+        DocumentStore store(dir);
+        store.add(1, content);
+        store.add(2, "short");
+        ASSERT_TRUE(store.contains(1));
+        ASSERT_FALSE(store.getStrings(3, {{0, 5}}).has_value());
+    }
+
+    DocumentStore store(dir);
+    size_t offset = DOCUMENT_STORE_BLOCK_SIZE - 10; // 跨块读取
+    auto texts = store.getStrings(1, {{offset, 20}, {content.size() - 5, 20}});
+    ASSERT_TRUE(texts.has_value());
+    ASSERT_EQ((*texts)[0], content.substr(offset, 20));
+    ASSERT_EQ((*texts)[1], content.substr(content.size() - 20)); // 越过文件尾时左移
+    ASSERT_EQ(store.getStrings(2, {{0, 80}})->at(0), "short");
+
+    std::string all;
+    ASSERT_TRUE(store.forEachBlock(1, [&all](const std::string& block) { all += block; }));
+    ASSERT_EQ(all, content);
+    ASSERT_EQ(store.getSize(1), content.size());
+    std::string part;
+    ASSERT_TRUE(store.forEachBlock(1, offset, 20, [&part](const std::string& block) { part += block; }));
+    ASSERT_EQ(part, content.substr(offset, 20)); // 跨块的区间
+    ASSERT_LT(std::filesystem::file_size(dir / "store.data"), content.size() / 2);
+
+    store.remove(1);
+    ASSERT_FALSE(store.contains(1));
+
+    // 大文件按块读取，跨越多次写入
+    std::string large;
+    for (size_t i = 0; large.size() < DOCUMENT_STORE_WRITE_BYTES * 3; i++)
+        large += std::to_string(i * 7919) + (i % 13 == 0 ? "\n" : " ");
+    auto large_path = dir / "large.txt";
+    std::ofstream(large_path) << large;
+    ASSERT_TRUE(store.addFile(3, large_path));
+    ASSERT_FALSE(store.addFile(4, dir / "missing.txt"));
+    std::string read_back;
+    store.forEachBlock(3, [&read_back](const std::string& block) { read_back += block; });
+    ASSERT_EQ(read_back, large);
+    std::filesystem::remove_all(dir);
+}
+
+TEST(DocumentStore, PersistWithDatabase)
+{
+    auto path = ROOT_PATH + "/database1";
+    std::filesystem::remove_all(path);
+    {
+        Database db(path, true);
+        db.enableDocumentStore();
+        db.getDocumentStore()->add(1, "kept");
+        db.serialize();
+        // database 持久化时 store 的索引一起写入，不等到析构
+        ASSERT_TRUE(DocumentStore::exists(path));
+        DocumentStore reopened(path);
+        ASSERT_EQ(reopened.getStrings(1, {{0, 4}})->at(0), "kept");
+    }
+    Database::destroyDatabase(path);
+}
+
+TEST(Replication, SnapshotFollow)
+{
+    auto primary_path = std::filesystem::temp_directory_path() / "zsearch_primary";
+    auto replica_path = std::filesystem::temp_directory_path() / "zsearch_replica";
+    std::filesystem::remove_all(primary_path);
+    std::filesystem::remove_all(replica_path);
+
+    Database primary(primary_path, true);
+    primary.enableDocumentStore();
+    auto doc_id = primary.newDocId();
+    primary.addTerm("hello", doc_id, 0);
+    primary.addDocument(doc_id, ROOT_PATH + "/articles/ABC.txt", 1, {});
+    primary.getDocumentStore()->add(doc_id, "hello world");
+
+    SnapshotPublisher publisher(primary);
+    ASSERT_EQ(publisher.publish(), 1);
+    ASSERT_FALSE(publisher.publish().has_value()); // 索引没有变化
+    // store.data 硬链接到快照中，之后的追加不影响快照
+    EXPECT_EQ(std::filesystem::hard_link_count(primary_path / "store.data"), 2);
+    primary.getDocumentStore()->add(doc_id + 1, "appended after the snapshot");
+
+    Database replica(replica_path, true);
+    replica.enableDocumentStore();
+    DirectoryReplicationSource source(primary_path);
+    SnapshotFollower follower(replica, source);
+    ASSERT_TRUE(follower.sync());
+    ASSERT_FALSE(follower.sync());
+    EXPECT_EQ(follower.getAppliedVersion(), 1);
+    EXPECT_EQ(replica.getDocumentCount(), 1);
+    ASSERT_NE(replica.findTerm("hello"), nullptr);
+    EXPECT_EQ(replica.getDocumentStore()->getStrings(doc_id, {{0, 5}})->at(0), "hello");
+
+    // 传输中损坏的文件不会被应用
+    primary.deleteDocument(doc_id);
+    ASSERT_EQ(publisher.publish(), 2);
+    {
+        std::fstream meta(primary_path / "snapshots" / "2" / "meta", std::ios::in | std::ios::out | std::ios::binary);
+        meta.seekp(0);
+        meta << "garbage";
+    }
+    EXPECT_THROW(follower.sync(), Poco::DataFormatException);
+    EXPECT_EQ(follower.getAppliedVersion(), 1);
+    EXPECT_EQ(replica.getDocumentCount(), 1);
+
+    std::filesystem::remove_all(primary_path);
+    std::filesystem::remove_all(replica_path);
+}
+
+TEST(Replication, SnapshotRetention)
+{
+    auto primary_path = std::filesystem::temp_directory_path() / "zsearch_primary";
+    std::filesystem::remove_all(primary_path);
+    Database primary(primary_path, true);
+    SnapshotDirectory directory(primary_path);
+    auto snapshots = primary_path / "snapshots";
+
+    // 保留时间内的旧快照不删除
+    ASSERT_EQ(directory.create(primary, 1, std::chrono::hours(1)), 1);
+    ASSERT_EQ(directory.create(primary, 1, std::chrono::hours(1)), 2);
+    EXPECT_TRUE(std::filesystem::exists(snapshots / "1"));
+
+    // 超过保留时间没有被访问的旧快照删除，被访问过的保留
+    auto long_ago = std::filesystem::file_time_type::clock::now() - std::chrono::hours(2);
+    std::filesystem::last_write_time(snapshots / "1", long_ago);
+    std::filesystem::last_write_time(snapshots / "2", long_ago);
+    ASSERT_TRUE(directory.filePath(2, "meta").has_value());
+    ASSERT_EQ(directory.create(primary, 1, std::chrono::hours(1)), 3);
+    EXPECT_FALSE(std::filesystem::exists(snapshots / "1"));
+    EXPECT_TRUE(std::filesystem::exists(snapshots / "2"));
+    EXPECT_EQ(directory.latest()->version, 3);
+
+    std::filesystem::remove_all(primary_path);
+}
+
+TEST(Replication, FollowWithoutSourceFiles)
+{
+    auto primary_path = std::filesystem::temp_directory_path() / "zsearch_primary";
+    auto replica_path = std::filesystem::temp_directory_path() / "zsearch_replica";
+    auto source_path = std::filesystem::temp_directory_path() / "zsearch_sources";
+    std::filesystem::remove_all(primary_path);
+    std::filesystem::remove_all(replica_path);
+    std::filesystem::remove_all(source_path);
+    std::filesystem::create_directory(source_path);
+    std::ofstream(source_path / "a.txt") << "hello world";
+
+    Database primary(primary_path, true);
+    auto doc_id = primary.newDocId();
+    primary.addTerm("hello", doc_id, 0);
+    primary.addDocument(doc_id, (source_path / "a.txt").string(), 2, {});
+    auto modify_time = primary.findDocument(doc_id)->getModifyTime();
+    SnapshotPublisher publisher(primary);
+    ASSERT_EQ(publisher.publish(), 1);
+
+    // replica 所在的机器上没有源文件
+    std::filesystem::remove_all(source_path);
+
+    Database replica(replica_path, true);
+    DirectoryReplicationSource source(primary_path);
+    SnapshotFollower follower(replica, source);
+    ASSERT_TRUE(follower.sync());
+    auto document_ptr = replica.findDocument(doc_id);
+    ASSERT_NE(document_ptr, nullptr);
+    EXPECT_EQ(document_ptr->getPath(), source_path / "a.txt");
+    EXPECT_EQ(document_ptr->getModifyTime(), modify_time);
+    EXPECT_EQ(document_ptr->getWordCount(), 2);
+
+    std::filesystem::remove_all(primary_path);
+    std::filesystem::remove_all(replica_path);
+}
+
+// 第一次下载 store.data 时只写入一半就失败
+class FlakyReplicationSource : public ReplicationSource
+{
+public:
+    explicit FlakyReplicationSource(const std::filesystem::path &primary_path) : source(primary_path) {}
+
+    std::optional<SnapshotManifest> latest() override
+    {
+        return source.latest();
+    }
+
+    void fetch(uint64_t version, const std::string &name, const std::filesystem::path &to, uint64_t offset, uint64_t size) override
+    {
+        if (name == "store.data")
+            offsets.push_back(offset);
+        if (name == "store.data" && offsets.size() == 1)
+        {
+            source.fetch(version, name, to, offset, size / 2);
+            THROW(Poco::IOException("connection reset"));
+        }
+        source.fetch(version, name, to, offset, size);
+    }
+
+    DirectoryReplicationSource source;
+    std::vector<uint64_t> offsets;
+};
+
+TEST(Replication, ResumeAndPersistVersion)
+{
+    auto primary_path = std::filesystem::temp_directory_path() / "zsearch_primary";
+    auto replica_path = std::filesystem::temp_directory_path() / "zsearch_replica";
+    std::filesystem::remove_all(primary_path);
+    std::filesystem::remove_all(replica_path);
+
+    Database primary(primary_path, true);
+    primary.enableDocumentStore();
+    auto doc_id = primary.newDocId();
+    primary.addTerm("hello", doc_id, 0);
+    primary.addDocument(doc_id, ROOT_PATH + "/articles/ABC.txt", 1, {});
+    std::string content;
+    for (size_t i = 0; content.size() < DOCUMENT_STORE_BLOCK_SIZE * 4; i++)
+        content += std::to_string(i * 7919 % 100003) + " ";
+    primary.getDocumentStore()->add(doc_id, content);
+    SnapshotPublisher publisher(primary);
+    ASSERT_EQ(publisher.publish(), 1);
+
+    {
+        Database replica(replica_path, true);
+        replica.enableDocumentStore();
+        FlakyReplicationSource source(primary_path);
+        SnapshotFollower follower(replica, source);
+        EXPECT_THROW(follower.sync(), Poco::IOException);
+        EXPECT_EQ(follower.getAppliedVersion(), 0);
+
+        // 从上次中断的位置继续下载
+        ASSERT_TRUE(follower.sync());
+        ASSERT_EQ(source.offsets.size(), 2);
+        EXPECT_EQ(source.offsets[0], 0);
+        EXPECT_GT(source.offsets[1], 0);
+        EXPECT_EQ(source.offsets[1], std::filesystem::file_size(primary_path / "snapshots" / "1" / "store.data") / 2);
+        EXPECT_EQ(replica.getDocumentStore()->getStrings(doc_id, {{0, content.size()}})->at(0), content);
+    }
+
+    // 重新打开 replica 后不再下载已应用的版本
+    Database replica(replica_path, false);
+    replica.enableDocumentStore();
+    DirectoryReplicationSource source(primary_path);
+    SnapshotFollower follower(replica, source);
+    EXPECT_EQ(follower.getAppliedVersion(), 1);
+    EXPECT_FALSE(follower.sync());
+    EXPECT_EQ(replica.getDocumentCount(), 1);
+
+    std::filesystem::remove_all(primary_path);
+    std::filesystem::remove_all(replica_path);
+}
+
 int main()
 {
     testing::InitGoogleTest();
@@ -14,6 +14,7 @@
 #include <numeric>
 #include <fstream>
 #include <unordered_set>
+#include <queue>
 
 #include <Poco/Exception.h>
 #include <Poco/String.h>
@@ -85,8 +86,45 @@ const std::unordered_set<std::string> ALLOWED_FILE_EXTENSIONS = {".txt", ".h", "
 
 const int SCORE_GRANULARITY = 1000;
 const int DAEMON_INTERVAL_SECONDS = 10;
-const int MAX_FILE_NUMBER_EVERY_INDEX = 5000;
+const size_t DAEMON_THREADS = 2; // 所有 database 共用的索引线程数
+// 每轮定时索引的资源预算，超出的文件留到下一轮
+const double DAEMON_DB_SECONDS_PER_CYCLE = 6;
+const uint64_t DAEMON_DB_BYTES_PER_CYCLE = 256 * 1024 * 1024;
+const uint64_t DAEMON_DB_FILES_PER_CYCLE = 10000;
+const double DAEMON_PATH_SECONDS_PER_CYCLE = 3;
+const uint64_t DAEMON_PATH_BYTES_PER_CYCLE = 128 * 1024 * 1024;
+const uint64_t DAEMON_PATH_FILES_PER_CYCLE = 2000;
+const uint64_t DAEMON_PATH_MIN_FILES_PER_CYCLE = 16; // 扫描本身就用完时间预算时，每轮仍至少索引的文件数
+const double DAEMON_RECENT_CHANGE_HALF_LIFE_SECONDS = 600;
+const size_t GATHER_FILES_THREADS = 4; // 遍历目录的线程数
+const int DATABASE_IDLE_SECONDS = 30 * 60; // database 超过该时间没有被访问则持久化并卸载
+const uint64_t DATABASE_MEMORY_BUDGET_BYTES = 4ull * 1024 * 1024 * 1024; // 所有已加载 database 的索引估计内存之和的上限
+const int REPLICATION_INTERVAL_SECONDS = 10; // primary 生成快照、replica 拉取快照的间隔
+const int REPLICATION_TIMEOUT_SECONDS = 30; // replica 请求 primary 时每次收发的超时
+const size_t REPLICATION_SNAPSHOTS_KEPT = 2; // primary 至少保留的快照数
+const int REPLICATION_SNAPSHOT_RETENTION_SECONDS = 30 * 60; // 更旧的快照最后一次被 replica 访问后仍保留的时间
+const int HTTP_LIGHT_RESERVED_THREADS = 2; // 开销大的请求执行与排队时都不会占用的工作线程数
+const size_t INDEX_JOB_HISTORY_SIZE = 64; // 保留状态以供查询的已结束索引任务数
+const double REBUILD_MAX_BYTES_PER_SECOND = 32.0 * 1024 * 1024; // 重建索引时读取文件的速度上限
+const double REBUILD_BURST_BYTES = 8.0 * 1024 * 1024;
 const int DEFAULT_PATCH_SIZE = 4;
+const size_t QUERY_CACHE_CAPACITY = 512;
+const size_t FILTER_CACHE_CAPACITY_BYTES = 64 * 1024 * 1024;
+const size_t FILTER_CACHE_MIN_ADMISSION_COST = 64; // posting list 长度或需要评估的文档数
+const size_t SNIPPET_WINDOW_SIZE = 80;
+const size_t SNIPPET_MAX_NUM = 3; // 每个结果最多输出的高亮文本数
+const size_t SNIPPET_MAX_HITS = 512; // 每个结果最多考虑的命中数
+const size_t SEARCH_MAX_RESULTS = 1000; // 未指定 LIMIT 时一次查询最多排序的结果数
+const size_t SEARCH_DEFAULT_PAGE_SIZE = 10;
+const size_t SEARCH_MAX_PAGE_SIZE = 100;
+const int SEARCH_PREFIX_EXPANSIONS = 3; // 单个词的查询按前缀扩展出的词数
+const size_t STATIC_ASSET_MAX_FILE_SIZE = 16 * 1024 * 1024; // 更大的前端资源不缓存在内存中
+const size_t DOCUMENT_STORE_BLOCK_SIZE = 64 * 1024; // 文档存储中独立压缩的块大小
+const size_t DOCUMENT_STORE_WRITE_BYTES = 1024 * 1024; // 存入大文件时每攒够这么多压缩数据写入一次
+const uint64_t META_MAGIC = 0x4154454d48435253; // "SRCHMETA"，没有该文件头的 meta 是加入格式版本之前写入的
+const size_t MAX_DOC_ID = UINT32_MAX - 1; // RoaringBitmap 只能存 32 位 doc_id，且全集区间 [1, max + 1) 的右端也要放得下
+const uint32_t META_FORMAT_VERSION = 2; // meta 中 term、文档的格式或分词结果变化时递增
+const size_t KEY_DICTIONARY_MAX_ENTRIES = 1 << 20; // 进程内不同 json 字段名的上限，超出后新字段的 kv 不建索引
 
 struct UserAttribute
 {
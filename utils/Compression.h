@@ -0,0 +1,130 @@
+#pragma once
+
+#include "../typedefs.h"
+#include <cstring>
+
+// LZ4 风格的块压缩：只做单块压缩，不带帧格式，解压时需要知道原始长度.
+// 每个 sequence 为 token(高 4 位字面量长度, 低 4 位匹配长度 - 4) [字面量长度扩展] 字面量 offset(2 bytes, LE) [匹配长度扩展]，
+// 最后一个 sequence 只有字面量.
+namespace lz
+{
+
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t MAX_OFFSET = 65535;
+constexpr size_t HASH_BITS = 12;
+
+inline void writeLength(std::string& dst, size_t len)
+{
+    while (len >= 255)
+    {
+        dst.push_back(static_cast<char>(255));
+        len -= 255;
+    }
+    dst.push_back(static_cast<char>(len));
+}
+
+inline void writeSequence(std::string& dst, std::string_view literals, size_t offset, size_t match_len)
+{
+    size_t extra_match = match_len >= MIN_MATCH ? match_len - MIN_MATCH : 0;
+    auto token = static_cast<uint8_t>((std::min<size_t>(literals.size(), 15) << 4) | std::min<size_t>(extra_match, 15));
+    dst.push_back(static_cast<char>(token));
+    if (literals.size() >= 15)
+        writeLength(dst, literals.size() - 15);
+    dst.append(literals);
+    if (match_len == 0) // 最后一个 sequence
+        return;
+    dst.push_back(static_cast<char>(offset & 0xFF));
+    dst.push_back(static_cast<char>(offset >> 8));
+    if (extra_match >= 15)
+        writeLength(dst, extra_match - 15);
+}
+
+inline std::string compress(std::string_view src)
+{
+    std::string dst;
+    dst.reserve(src.size() / 2 + 16);
+
+    auto read32 = [&src](size_t pos) {
+        uint32_t v;
+        std::memcpy(&v, src.data() + pos, sizeof(v));
+        return v;
+    };
+    std::vector<uint32_t> table(1 << HASH_BITS, UINT32_MAX); // hash(4 bytes) -> 最近一次出现的位置
+
+    size_t anchor = 0, i = 0;
+    while (i + MIN_MATCH <= src.size())
+    {
+        uint32_t v = read32(i);
+        uint32_t h = (v * 2654435761u) >> (32 - HASH_BITS);
+        uint32_t candidate = table[h];
+        table[h] = static_cast<uint32_t>(i);
+        if (candidate == UINT32_MAX || i - candidate > MAX_OFFSET || read32(candidate) != v)
+        {
+            ++i;
+            continue;
+        }
+
+        size_t match_len = MIN_MATCH;
+        while (i + match_len < src.size() && src[candidate + match_len] == src[i + match_len])
+            ++match_len;
+        writeSequence(dst, src.substr(anchor, i - anchor), i - candidate, match_len);
+        i += match_len;
+        anchor = i;
+    }
+    writeSequence(dst, src.substr(anchor), 0, 0);
+    return dst;
+}
+
+inline std::string decompress(std::string_view src, size_t raw_size)
+{
+    std::string dst;
+    dst.reserve(raw_size);
+    size_t i = 0;
+
+    auto readLength = [&src, &i](size_t len) {
+        uint8_t b;
+        do
+        {
+            if (i >= src.size())
+                THROW(Poco::DataFormatException("corrupted compressed block"));
+            b = static_cast<uint8_t>(src[i++]);
+            len += b;
+        } while (b == 255);
+        return len;
+    };
+
+    while (true)
+    {
+        if (i >= src.size())
+            THROW(Poco::DataFormatException("corrupted compressed block"));
+        auto token = static_cast<uint8_t>(src[i++]);
+
+        size_t literal_len = token >> 4;
+        if (literal_len == 15)
+            literal_len = readLength(literal_len);
+        if (i + literal_len > src.size() || dst.size() + literal_len > raw_size)
+            THROW(Poco::DataFormatException("corrupted compressed block"));
+        dst.append(src.substr(i, literal_len));
+        i += literal_len;
+        if (dst.size() == raw_size)
+            return dst;
+
+        if (i + 2 > src.size())
+            THROW(Poco::DataFormatException("corrupted compressed block"));
+        size_t offset = static_cast<uint8_t>(src[i]) | (static_cast<size_t>(static_cast<uint8_t>(src[i + 1])) << 8);
+        i += 2;
+        size_t match_len = token & 0x0F;
+        if (match_len == 15)
+            match_len = readLength(match_len);
+        match_len += MIN_MATCH;
+        if (offset == 0 || offset > dst.size() || dst.size() + match_len > raw_size)
+            THROW(Poco::DataFormatException("corrupted compressed block"));
+
+        // 匹配区间可能与输出重叠（重复模式），只能逐字节复制
+        size_t from = dst.size() - offset;
+        for (size_t k = 0; k < match_len; k++)
+            dst.push_back(dst[from + k]);
+    }
+}
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "../typedefs.h"
+#include <condition_variable>
+#include <limits>
+
+// 限制同时执行的请求数，超出时排队等待，等待超时则放弃.
+// 用于把开销大的请求（查询、重建索引）限制在工作线程的一部分，使轻量请求不会被饿死.
+// 排队的请求同样占着工作线程，因此排队数也有上限，超出时立即放弃.
+class ConcurrencyLimiter
+{
+public:
+    explicit ConcurrencyLimiter(size_t max_concurrency_, size_t max_waiting_ = std::numeric_limits<size_t>::max())
+        : max_concurrency(max_concurrency_), max_waiting(max_waiting_) {}
+
+    bool tryAcquire(std::chrono::milliseconds timeout)
+    {
+        std::unique_lock lk(lock);
+        if (running >= max_concurrency && waiting >= max_waiting)
+        {
+            ++rejected;
+            return false;
+        }
+        ++waiting;
+        bool acquired = cv.wait_for(lk, timeout, [this] { return running < max_concurrency; });
+        --waiting;
+        if (!acquired)
+        {
+            ++rejected;
+            return false;
+        }
+        ++running;
+        return true;
+    }
+
+    void release()
+    {
+        {
+            std::lock_guard lg(lock);
+            assert(running > 0);
+            --running;
+        }
+        cv.notify_one();
+    }
+
+    size_t getRunning() const
+    {
+        std::lock_guard lg(lock);
+        return running;
+    }
+
+    size_t getWaiting() const
+    {
+        std::lock_guard lg(lock);
+        return waiting;
+    }
+
+    uint64_t getRejected() const
+    {
+        std::lock_guard lg(lock);
+        return rejected;
+    }
+
+private:
+    const size_t max_concurrency;
+    const size_t max_waiting;
+
+    mutable std::mutex lock;
+    std::condition_variable cv;
+    size_t running = 0;
+    size_t waiting = 0;
+    uint64_t rejected = 0;
+};
@@ -67,6 +67,24 @@ public:
         return *this;
     }
 
+    // 第 i 位是否为 true，i start from 1.
+    bool test(size_t i) const
+    {
+        assert(i >= 1);
+        i -= 1;
+        return bit_set[i / ByteNum] & (One << (i % ByteNum));
+    }
+
+    size_t getSize() const
+    {
+        return size;
+    }
+
+    size_t getBytes() const
+    {
+        return bit_set.size() * sizeof(uint64_t);
+    }
+
     std::set<size_t> toSet(uint64_t start_index = 0) const
     {
         std::set<size_t> ret;
@@ -1,28 +1,351 @@
 #pragma once
 
 #include "../typedefs.h"
+#include "utils/TimeUtils.h"
+#include <deque>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <dirent.h>
+#include <sys/syscall.h>
+#endif
 
-std::unordered_set<std::string> gatherExistedFiles(const std::filesystem::path &path)
+struct WalkResult
 {
-    if (!exists(path))
-        return {};
+    std::unordered_set<std::string> files;
+    std::vector<std::string> failed_directories; // 无法打开或读取的目录，其中文件的状态未知
+
+    // 文件是否位于读取失败的目录之下：这些文件没有出现在 files 中，但不能认为已被删除
+    bool isInFailedDirectory(const std::string &file_path) const
+    {
+        for (const auto &dir : failed_directories)
+        {
+            if (file_path.size() > dir.size() && file_path.starts_with(dir)
+                && (dir.back() == '/' || file_path[dir.size()] == '/'))
+                return true;
+        }
+        return false;
+    }
+};
+
+// 目录中的条目，只记录名字
+struct DirectoryListing
+{
+    int64_t mtime_ns = 0;
+    uint64_t inode = 0;
+    std::vector<std::string> files;   // 类型允许索引的普通文件
+    std::vector<std::string> subdirs; // 不含符号链接指向的目录
+    bool complete = true; // 有条目的类型无法确定时为 false，这样的结果不缓存
+};
+
+// 目录 mtime 与 inode 未变化时复用上次读到的条目，省去读取目录与逐项 stat.
+// 目录的 mtime 只反映直接条目的增删改名，子目录仍需逐个检查，文件内容是否修改由调用方另行判断.
+class DirectoryCache
+{
+public:
+    std::optional<DirectoryListing> find(const std::string &dir, int64_t mtime_ns, uint64_t inode) const
+    {
+        std::lock_guard lg(lock);
+        auto iter = listings.find(dir);
+        if (iter == listings.end() || iter->second.mtime_ns != mtime_ns || iter->second.inode != inode)
+            return std::nullopt;
+        return iter->second;
+    }
 
-    if (!is_directory(path)) // 如果 path 指向一个文件，那么不在判断类型是否允许 —— 直接加入索引
-        return {path.string()};
+    void put(const std::string &dir, DirectoryListing listing)
+    {
+        std::lock_guard lg(lock);
+        listings[dir] = std::move(listing);
+    }
 
-    std::unordered_set<std::string> res;
-    try
+    // 删除 root 之下本次遍历没有访问到的目录（已删除或已无法读取）
+    void prune(const std::string &root, const std::unordered_set<std::string> &visited)
     {
-        for (const auto &path_entry : std::filesystem::recursive_directory_iterator(path))
+        std::lock_guard lg(lock);
+        for (auto iter = listings.begin(); iter != listings.end();)
         {
-            if (path_entry.is_regular_file() && ALLOWED_FILE_EXTENSIONS.contains(path_entry.path().extension()))
+            bool under_root = iter->first == root
+                    || (iter->first.starts_with(root) && (root.back() == '/' || iter->first[root.size()] == '/'));
+            if (under_root && !visited.contains(iter->first))
+                iter = listings.erase(iter);
+            else
+                ++iter;
+        }
+    }
+
+    size_t size() const
+    {
+        std::lock_guard lg(lock);
+        return listings.size();
+    }
+
+private:
+    mutable std::mutex lock;
+    std::unordered_map<std::string, DirectoryListing> listings;
+};
+
+// 多线程遍历目录树. 每个线程优先处理自己队列尾部的目录（深度优先，打开的目录 fd 较少），
+// 空闲时从其他线程队列头部窃取. Linux 下通过 getdents64 读取目录，子目录用 openat 相对父目录 fd 打开.
+// 某个目录无法读取时只记录到 failed_directories，不影响其他目录.
+class DirectoryWalker
+{
+public:
+    explicit DirectoryWalker(size_t thread_num_ = GATHER_FILES_THREADS, DirectoryCache *cache_ = nullptr)
+        : thread_num(std::max<size_t>(1, thread_num_)), cache(cache_) {}
+
+    WalkResult walk(const std::filesystem::path &root) const
+    {
+        std::error_code ec;
+        auto status = std::filesystem::status(root, ec);
+        if (ec || !std::filesystem::exists(status))
+            return {};
+        if (!std::filesystem::is_directory(status)) // 如果 path 指向一个文件，那么不在判断类型是否允许 —— 直接加入索引
+            return {.files = {root.string()}};
+
+        std::vector<Worker> workers(thread_num);
+        std::atomic_size_t pending = 1; // 已入队但还未处理完的目录数
+        workers[0].tasks.push_back(Task{nullptr, "", root.string()});
+
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < thread_num; i++)
+            threads.emplace_back([&, i] { work(workers, i, pending); });
+        work(workers, 0, pending);
+        for (auto &thread : threads)
+            thread.join();
+
+        WalkResult result;
+        std::unordered_set<std::string> visited;
+        for (auto &worker : workers)
+        {
+            result.files.merge(worker.result.files);
+            result.failed_directories.insert(result.failed_directories.end(),
+                                             worker.result.failed_directories.begin(), worker.result.failed_directories.end());
+            visited.merge(worker.visited);
+        }
+        if (cache)
+            cache->prune(root.string(), visited);
+        if (!result.failed_directories.empty())
+            httpLog("gatherExistedFiles - " + std::to_string(result.failed_directories.size()) + " directories unreadable under " + root.string());
+        return result;
+    }
+
+private:
+    struct DirectoryHandle
+    {
+        explicit DirectoryHandle(int fd_) : fd(fd_) {}
+        DirectoryHandle(const DirectoryHandle &) = delete;
+        ~DirectoryHandle() { ::close(fd); }
+        int fd;
+    };
+
+    struct Task
+    {
+        std::shared_ptr<DirectoryHandle> parent; // 为空时按 path 打开
+        std::string name;
+        std::string path;
+    };
+
+    struct Worker
+    {
+        std::mutex lock;
+        std::deque<Task> tasks;
+        WalkResult result;
+        std::unordered_set<std::string> visited;
+    };
+
+    static std::string join(const std::string &dir, const std::string &name)
+    {
+        return dir.ends_with('/') ? dir + name : dir + "/" + name;
+    }
+
+    static bool isAllowedFile(const std::string &name)
+    {
+        return ALLOWED_FILE_EXTENSIONS.contains(std::filesystem::path(name).extension().string());
+    }
+
+    void work(std::vector<Worker> &workers, size_t index, std::atomic_size_t &pending) const
+    {
+        size_t idle_rounds = 0;
+        while (true)
+        {
+            std::optional<Task> task;
+            {
+                std::lock_guard lg(workers[index].lock);
+                if (!workers[index].tasks.empty())
+                {
+                    task = std::move(workers[index].tasks.back());
+                    workers[index].tasks.pop_back();
+                }
+            }
+            for (size_t i = 1; !task && i < workers.size(); i++)
+            {
+                auto &victim = workers[(index + i) % workers.size()];
+                std::lock_guard lg(victim.lock);
+                if (!victim.tasks.empty())
+                {
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                }
+            }
+
+            if (!task)
+            {
+                if (pending == 0)
+                    return;
+                if (++idle_rounds < 64)
+                    std::this_thread::yield();
+                else
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+            idle_rounds = 0;
+
+            std::vector<Task> subdirs;
+            visitDirectory(*task, workers[index], subdirs);
+            if (!subdirs.empty())
+            {
+                pending += subdirs.size();
+                std::lock_guard lg(workers[index].lock);
+                for (auto &subdir : subdirs)
+                    workers[index].tasks.push_back(std::move(subdir));
+            }
+            --pending;
+        }
+    }
+
+    void visitDirectory(const Task &task, Worker &worker, std::vector<Task> &subdirs) const
+    {
+#ifdef __linux__
+        int fd = task.parent ? ::openat(task.parent->fd, task.name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)
+                             : ::open(task.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            worker.result.failed_directories.push_back(task.path);
+            return;
+        }
+        auto handle = std::make_shared<DirectoryHandle>(fd);
+
+        struct stat st{};
+        if (::fstat(fd, &st) != 0)
+        {
+            worker.result.failed_directories.push_back(task.path);
+            return;
+        }
+        int64_t mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+
+        std::optional<DirectoryListing> listing;
+        if (cache)
+            listing = cache->find(task.path, mtime_ns, st.st_ino);
+        if (!listing)
+        {
+            listing = readDirectory(fd);
+            if (!listing)
             {
-                res.insert(path_entry.path().string());
+                worker.result.failed_directories.push_back(task.path);
+                return;
             }
+            listing->mtime_ns = mtime_ns;
+            listing->inode = st.st_ino;
+            // 刚修改过的目录不缓存：同一 mtime 精度内的后续修改无法被发现
+            auto now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            if (cache && listing->complete && now_ns - mtime_ns > 1000000000)
+                cache->put(task.path, *listing);
+        }
+        // 其余条目照常使用，但遗漏的条目可能是文件，目录下的文件不能认为已被删除
+        if (!listing->complete)
+            worker.result.failed_directories.push_back(task.path);
+#else
+        auto listing = readDirectory(task.path);
+        if (!listing)
+        {
+            worker.result.failed_directories.push_back(task.path);
+            return;
+        }
+        std::shared_ptr<DirectoryHandle> handle;
+#endif
+        worker.visited.insert(task.path);
+        for (const auto &file : listing->files)
+            worker.result.files.insert(join(task.path, file));
+        for (const auto &subdir : listing->subdirs)
+            subdirs.push_back(Task{handle, subdir, join(task.path, subdir)});
+    }
 
+#ifdef __linux__
+    struct LinuxDirent64
+    {
+        ino64_t d_ino;
+        off64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+
+    static std::optional<DirectoryListing> readDirectory(int fd)
+    {
+        DirectoryListing listing;
+        alignas(LinuxDirent64) char buf[32 * 1024];
+        while (true)
+        {
+            auto n = ::syscall(SYS_getdents64, fd, buf, sizeof(buf));
+            if (n < 0)
+                return std::nullopt;
+            if (n == 0)
+                break;
+            for (long offset = 0; offset < n;)
+            {
+                auto *entry = reinterpret_cast<LinuxDirent64 *>(buf + offset);
+                offset += entry->d_reclen;
+                std::string name = entry->d_name;
+                if (name == "." || name == "..")
+                    continue;
+
+                auto type = entry->d_type;
+                struct stat st{};
+                if (type == DT_UNKNOWN) // 部分文件系统不提供 d_type
+                {
+                    if (::fstatat(fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0)
+                    {
+                        listing.complete = false;
+                        continue;
+                    }
+                    type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : S_ISLNK(st.st_mode) ? DT_LNK : DT_UNKNOWN;
+                }
+                // 与 recursive_directory_iterator 一致：跟随指向文件的符号链接，不进入指向目录的符号链接
+                if (type == DT_LNK && isAllowedFile(name) && ::fstatat(fd, name.c_str(), &st, 0) == 0 && S_ISREG(st.st_mode))
+                    type = DT_REG;
+
+                if (type == DT_DIR)
+                    listing.subdirs.push_back(std::move(name));
+                else if (type == DT_REG && isAllowedFile(name))
+                    listing.files.push_back(std::move(name));
+            }
         }
-    } catch (std::exception &e) // TODO: 解决遍历文件时的权限问题，而不是跳过之
+        return listing;
+    }
+#else
+    static std::optional<DirectoryListing> readDirectory(const std::string &path)
     {
+        DirectoryListing listing;
+        std::error_code ec;
+        for (std::filesystem::directory_iterator iter(path, ec), end; !ec && iter != end; iter.increment(ec))
+        {
+            auto name = iter->path().filename().string();
+            if (iter->is_directory(ec) && !iter->is_symlink(ec))
+                listing.subdirs.push_back(std::move(name));
+            else if (iter->is_regular_file(ec) && isAllowedFile(name))
+                listing.files.push_back(std::move(name));
+        }
+        if (ec)
+            return std::nullopt;
+        return listing;
     }
-    return res;
-}
\ No newline at end of file
+#endif
+
+    const size_t thread_num;
+    DirectoryCache *cache;
+};
+
+std::unordered_set<std::string> gatherExistedFiles(const std::filesystem::path &path)
+{
+    return DirectoryWalker().walk(path).files;
+}
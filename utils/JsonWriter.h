@@ -0,0 +1,160 @@
+#pragma once
+
+#include "../typedefs.h"
+#include "utils/json.hpp"
+#include <charconv>
+#include <array>
+#include <cmath>
+
+// 直接向输出流写 JSON，不构造 nlohmann::json 树，用于返回大量数据的 HTTP 响应.
+// 调用方保证 begin/end 配对、对象中 key 与 value 交替出现.
+class JsonWriter
+{
+public:
+    explicit JsonWriter(std::ostream& out_) : out(out_) {}
+
+    JsonWriter& beginObject()
+    {
+        beforeValue();
+        out << '{';
+        has_elements.push_back(false);
+        return *this;
+    }
+
+    JsonWriter& endObject()
+    {
+        assert(!has_elements.empty());
+        has_elements.pop_back();
+        out << '}';
+        return *this;
+    }
+
+    JsonWriter& beginArray()
+    {
+        beforeValue();
+        out << '[';
+        has_elements.push_back(false);
+        return *this;
+    }
+
+    JsonWriter& endArray()
+    {
+        assert(!has_elements.empty());
+        has_elements.pop_back();
+        out << ']';
+        return *this;
+    }
+
+    JsonWriter& key(std::string_view name)
+    {
+        beforeValue();
+        writeString(name);
+        out << ':';
+        after_key = true;
+        return *this;
+    }
+
+    JsonWriter& value(std::string_view str)
+    {
+        beforeValue();
+        writeString(str);
+        return *this;
+    }
+
+    JsonWriter& value(const char* str)
+    {
+        return value(std::string_view(str));
+    }
+
+    JsonWriter& value(const std::string& str)
+    {
+        return value(std::string_view(str));
+    }
+
+    JsonWriter& value(bool b)
+    {
+        beforeValue();
+        out << (b ? "true" : "false");
+        return *this;
+    }
+
+    template<typename T> requires std::is_arithmetic_v<T>
+    JsonWriter& value(T number)
+    {
+        beforeValue();
+        if constexpr (std::is_floating_point_v<T>)
+        {
+            if (!std::isfinite(number))
+            {
+                out << "null";
+                return *this;
+            }
+            std::array<char, 32> buf{};
+            auto [end, ec] = std::to_chars(buf.data(), buf.data() + buf.size(), number);
+            out.write(buf.data(), end - buf.data());
+        }
+        else
+            out << +number;
+        return *this;
+    }
+
+    JsonWriter& null()
+    {
+        beforeValue();
+        out << "null";
+        return *this;
+    }
+
+    // 较小的已有 json 值直接输出
+    JsonWriter& value(const nlohmann::json& j)
+    {
+        beforeValue();
+        out << j.dump();
+        return *this;
+    }
+
+private:
+    void beforeValue()
+    {
+        if (after_key)
+        {
+            after_key = false;
+            return;
+        }
+        if (!has_elements.empty())
+        {
+            if (has_elements.back())
+                out << ',';
+            has_elements.back() = true;
+        }
+    }
+
+    void writeString(std::string_view str)
+    {
+        static const char* hex = "0123456789abcdef";
+        out << '"';
+        for (char ch : str)
+        {
+            switch (ch)
+            {
+                case '"': out << "\\\""; break;
+                case '\\': out << "\\\\"; break;
+                case '\n': out << "\\n"; break;
+                case '\r': out << "\\r"; break;
+                case '\t': out << "\\t"; break;
+                case '\b': out << "\\b"; break;
+                case '\f': out << "\\f"; break;
+                default:
+                    if (static_cast<unsigned char>(ch) < 0x20)
+                        out << "\\u00" << hex[ch >> 4] << hex[ch & 0xF];
+                    else
+                        out << ch;
+            }
+        }
+        out << '"';
+    }
+
+    std::ostream& out;
+    std::vector<bool> has_elements; // 每层 object/array 是否已经输出过元素
+    bool after_key = false;
+};
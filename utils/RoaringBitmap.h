@@ -0,0 +1,611 @@
+#pragma once
+
+#include "../typedefs.h"
+#include <bit>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Roaring 压缩位图. 32 位整数按高 16 位分桶，每个桶是一个 container：
+//   Array  —— 有序的低 16 位数组，元素不超过 4096 个
+//   Bitmap —— 65536 位的位图，元素超过 4096 个
+//   Run    —— [start, start + length] 区间序列，适合连续的 doc id（例如全集、已删除的区间）
+// 与 DynamicBitSet 不同，它不需要按 maxAllocatedDocId 分配空间，稀疏的 posting list 只占用实际元素的空间.
+class RoaringBitmap
+{
+    static constexpr size_t ArrayMaxSize = 4096;
+    static constexpr size_t BitmapWords = 1024; // 65536 / 64
+
+    struct Container
+    {
+        enum class Type : uint8_t
+        {
+            Array,
+            Bitmap,
+            Run
+        };
+
+        Type type = Type::Array;
+        uint32_t cardinality = 0;
+        std::vector<uint16_t> values; // Array: 有序元素；Run: (start, length) 交替存放，区间为 [start, start + length]
+        std::vector<uint64_t> words; // Bitmap
+
+        static Container makeBitmap()
+        {
+            Container c;
+            c.type = Type::Bitmap;
+            c.words.assign(BitmapWords, 0);
+            return c;
+        }
+
+        static Container makeRun(uint16_t start, uint16_t last)
+        {
+            Container c;
+            c.type = Type::Run;
+            c.values = {start, static_cast<uint16_t>(last - start)};
+            c.cardinality = last - start + 1;
+            return c;
+        }
+
+        size_t runCount() const
+        {
+            return values.size() / 2;
+        }
+
+        bool contains(uint16_t low) const
+        {
+            switch (type)
+            {
+                case Type::Array:
+                    return std::binary_search(values.begin(), values.end(), low);
+                case Type::Bitmap:
+                    return words[low >> 6] & (uint64_t(1) << (low & 63));
+                case Type::Run:
+                {
+                    // 找到最后一个 start <= low 的区间
+                    size_t lo = 0, hi = runCount();
+                    while (lo < hi)
+                    {
+                        size_t mid = (lo + hi) / 2;
+                        if (values[mid * 2] <= low)
+                            lo = mid + 1;
+                        else
+                            hi = mid;
+                    }
+                    if (lo == 0)
+                        return false;
+                    size_t i = lo - 1;
+                    return low - values[i * 2] <= values[i * 2 + 1];
+                }
+            }
+            return false;
+        }
+
+        void add(uint16_t low)
+        {
+            if (type == Type::Run)
+                toBitmap();
+            if (type == Type::Array)
+            {
+                auto iter = std::lower_bound(values.begin(), values.end(), low);
+                if (iter != values.end() && *iter == low)
+                    return;
+                if (values.size() < ArrayMaxSize)
+                {
+                    values.insert(iter, low);
+                    ++cardinality;
+                    return;
+                }
+                toBitmap();
+            }
+            uint64_t mask = uint64_t(1) << (low & 63);
+            if (!(words[low >> 6] & mask))
+            {
+                words[low >> 6] |= mask;
+                ++cardinality;
+            }
+        }
+
+        void remove(uint16_t low)
+        {
+            if (!contains(low))
+                return;
+            if (type == Type::Run)
+                toBitmap();
+            if (type == Type::Array)
+                values.erase(std::lower_bound(values.begin(), values.end(), low));
+            else
+                words[low >> 6] &= ~(uint64_t(1) << (low & 63));
+            --cardinality;
+            normalize();
+        }
+
+        template<typename F>
+        void forEach(uint32_t high, F&& f) const
+        {
+            switch (type)
+            {
+                case Type::Array:
+                    for (uint16_t low : values)
+                        f(high | low);
+                    break;
+                case Type::Bitmap:
+                    for (size_t i = 0; i < BitmapWords; i++)
+                    {
+                        // 每次取出最低位的 1，只访问被设置的位
+                        for (uint64_t w = words[i]; w; w &= w - 1)
+                            f(high | static_cast<uint32_t>(i * 64 + std::countr_zero(w)));
+                    }
+                    break;
+                case Type::Run:
+                    for (size_t i = 0; i < runCount(); i++)
+                        for (uint32_t v = values[i * 2]; v <= uint32_t(values[i * 2]) + values[i * 2 + 1]; v++)
+                            f(high | v);
+                    break;
+            }
+        }
+
+        void toBitmap()
+        {
+            if (type == Type::Bitmap)
+                return;
+            Container c = makeBitmap();
+            forEach(0, [&c](uint32_t v) { c.words[v >> 6] |= uint64_t(1) << (v & 63); });
+            c.cardinality = cardinality;
+            *this = std::move(c);
+        }
+
+        // Array 与 Bitmap 之间按元素个数互相转换
+        void normalize()
+        {
+            if (type == Type::Bitmap && cardinality <= ArrayMaxSize)
+            {
+                std::vector<uint16_t> array;
+                array.reserve(cardinality);
+                forEach(0, [&array](uint32_t v) { array.push_back(static_cast<uint16_t>(v)); });
+                type = Type::Array;
+                values = std::move(array);
+                words.clear();
+                words.shrink_to_fit();
+            }
+            else if (type == Type::Array && values.size() > ArrayMaxSize)
+                toBitmap();
+            else if (type == Type::Run && runCount() * 4 > std::min<size_t>(cardinality * 2, BitmapWords * 8))
+            {
+                // 区间太碎时不如 Array / Bitmap 紧凑
+                toBitmap();
+                normalize();
+            }
+        }
+
+        // 在区间更紧凑时转为 Run
+        void runOptimize()
+        {
+            if (type == Type::Run || cardinality == 0)
+                return;
+            std::vector<uint16_t> runs;
+            forEach(0, [&runs](uint32_t v) {
+                if (!runs.empty() && uint32_t(runs[runs.size() - 2]) + runs.back() + 1 == v)
+                    ++runs.back();
+                else
+                {
+                    runs.push_back(static_cast<uint16_t>(v));
+                    runs.push_back(0);
+                }
+            });
+            size_t run_bytes = runs.size() * sizeof(uint16_t);
+            if (run_bytes < getBytes())
+            {
+                type = Type::Run;
+                values = std::move(runs);
+                words.clear();
+                words.shrink_to_fit();
+            }
+        }
+
+        size_t getBytes() const
+        {
+            return values.capacity() * sizeof(uint16_t) + words.capacity() * sizeof(uint64_t);
+        }
+
+        void recount()
+        {
+            if (type == Type::Bitmap)
+                cardinality = bitmapCardinality(words.data());
+            else if (type == Type::Array)
+                cardinality = values.size();
+            else
+            {
+                cardinality = 0;
+                for (size_t i = 0; i < runCount(); i++)
+                    cardinality += values[i * 2 + 1] + 1;
+            }
+        }
+
+        bool operator==(const Container& rhs) const
+        {
+            if (cardinality != rhs.cardinality)
+                return false;
+            if (type == rhs.type && type == Type::Array)
+                return values == rhs.values;
+            Container l = *this, r = rhs;
+            l.toBitmap();
+            r.toBitmap();
+            return l.words == r.words;
+        }
+    };
+
+    enum class Op
+    {
+        And,
+        Or,
+        AndNot
+    };
+
+public:
+    RoaringBitmap() = default;
+
+    // ids 必须升序，例如 posting list. 超过 32 位的 id 抛出 Poco::RangeException
+    explicit RoaringBitmap(const std::vector<size_t>& sorted_ids)
+    {
+        for (size_t id : sorted_ids)
+        {
+            if (id > UINT32_MAX)
+                THROW(Poco::RangeException("doc id does not fit in 32 bits: " + std::to_string(id)));
+            auto high = static_cast<uint16_t>(id >> 16);
+            if (keys.empty() || keys.back() != high)
+            {
+                assert(keys.empty() || keys.back() < high);
+                keys.push_back(high);
+                containers.emplace_back();
+            }
+            auto& c = containers.back();
+            if (c.type == Container::Type::Array && !c.values.empty() && c.values.back() == static_cast<uint16_t>(id))
+                continue;
+            if (c.type == Container::Type::Array && c.values.size() < ArrayMaxSize)
+            {
+                c.values.push_back(static_cast<uint16_t>(id));
+                ++c.cardinality;
+            }
+            else
+                c.add(static_cast<uint16_t>(id));
+        }
+    }
+
+    // [begin, end)
+    static RoaringBitmap range(uint32_t begin, uint32_t end)
+    {
+        RoaringBitmap res;
+        if (begin >= end)
+            return res;
+        uint32_t last = end - 1;
+        for (uint32_t high = begin >> 16; high <= (last >> 16); high++)
+        {
+            uint16_t start = high == (begin >> 16) ? static_cast<uint16_t>(begin) : 0;
+            uint16_t stop = high == (last >> 16) ? static_cast<uint16_t>(last) : UINT16_MAX;
+            res.keys.push_back(static_cast<uint16_t>(high));
+            res.containers.push_back(Container::makeRun(start, stop));
+        }
+        return res;
+    }
+
+    void add(uint32_t x)
+    {
+        auto high = static_cast<uint16_t>(x >> 16);
+        auto iter = std::lower_bound(keys.begin(), keys.end(), high);
+        size_t i = iter - keys.begin();
+        if (iter == keys.end() || *iter != high)
+        {
+            keys.insert(iter, high);
+            containers.insert(containers.begin() + i, Container{});
+        }
+        containers[i].add(static_cast<uint16_t>(x));
+    }
+
+    void remove(uint32_t x)
+    {
+        auto high = static_cast<uint16_t>(x >> 16);
+        auto iter = std::lower_bound(keys.begin(), keys.end(), high);
+        if (iter == keys.end() || *iter != high)
+            return;
+        size_t i = iter - keys.begin();
+        containers[i].remove(static_cast<uint16_t>(x));
+        if (containers[i].cardinality == 0)
+        {
+            keys.erase(iter);
+            containers.erase(containers.begin() + i);
+        }
+    }
+
+    bool contains(uint32_t x) const
+    {
+        auto high = static_cast<uint16_t>(x >> 16);
+        auto iter = std::lower_bound(keys.begin(), keys.end(), high);
+        if (iter == keys.end() || *iter != high)
+            return false;
+        return containers[iter - keys.begin()].contains(static_cast<uint16_t>(x));
+    }
+
+    // 空的 container 会被立即移除，因此只需检查 container 个数
+    bool empty() const
+    {
+        return containers.empty();
+    }
+
+    size_t cardinality() const
+    {
+        size_t res = 0;
+        for (const auto& c : containers)
+            res += c.cardinality;
+        return res;
+    }
+
+    // 按升序访问每个元素
+    template<typename F>
+    void forEach(F&& f) const
+    {
+        for (size_t i = 0; i < containers.size(); i++)
+            containers[i].forEach(uint32_t(keys[i]) << 16, f);
+    }
+
+    std::vector<size_t> toVector() const
+    {
+        std::vector<size_t> res;
+        res.reserve(cardinality());
+        forEach([&res](uint32_t v) { res.push_back(v); });
+        return res;
+    }
+
+    std::unordered_set<size_t> toUnorderedSet() const
+    {
+        std::unordered_set<size_t> res;
+        res.reserve(cardinality());
+        forEach([&res](uint32_t v) { res.insert(v); });
+        return res;
+    }
+
+    size_t getBytes() const
+    {
+        size_t res = keys.capacity() * sizeof(uint16_t) + containers.capacity() * sizeof(Container);
+        for (const auto& c : containers)
+            res += c.getBytes();
+        return res;
+    }
+
+    // 把连续区间压缩成 Run container，适合长期驻留（缓存）的位图
+    RoaringBitmap& runOptimize()
+    {
+        for (auto& c : containers)
+            c.runOptimize();
+        return *this;
+    }
+
+    RoaringBitmap& operator&=(const RoaringBitmap& rhs)
+    {
+        return *this = combine(*this, rhs, Op::And);
+    }
+
+    RoaringBitmap& operator|=(const RoaringBitmap& rhs)
+    {
+        return *this = combine(*this, rhs, Op::Or);
+    }
+
+    // and not
+    RoaringBitmap& operator-=(const RoaringBitmap& rhs)
+    {
+        return *this = combine(*this, rhs, Op::AndNot);
+    }
+
+    friend RoaringBitmap operator&(const RoaringBitmap& lhs, const RoaringBitmap& rhs)
+    {
+        return combine(lhs, rhs, Op::And);
+    }
+
+    friend RoaringBitmap operator|(const RoaringBitmap& lhs, const RoaringBitmap& rhs)
+    {
+        return combine(lhs, rhs, Op::Or);
+    }
+
+    friend RoaringBitmap operator-(const RoaringBitmap& lhs, const RoaringBitmap& rhs)
+    {
+        return combine(lhs, rhs, Op::AndNot);
+    }
+
+    bool operator==(const RoaringBitmap& rhs) const
+    {
+        return keys == rhs.keys && containers == rhs.containers;
+    }
+
+private:
+    static RoaringBitmap combine(const RoaringBitmap& lhs, const RoaringBitmap& rhs, Op op)
+    {
+        RoaringBitmap res;
+        size_t i = 0, j = 0;
+        auto append = [&res](uint16_t key, Container&& c) {
+            if (c.cardinality == 0)
+                return;
+            res.keys.push_back(key);
+            res.containers.push_back(std::move(c));
+        };
+
+        while (i < lhs.keys.size() || j < rhs.keys.size())
+        {
+            if (j == rhs.keys.size() || (i < lhs.keys.size() && lhs.keys[i] < rhs.keys[j]))
+            {
+                if (op != Op::And)
+                    append(lhs.keys[i], Container(lhs.containers[i]));
+                i++;
+            }
+            else if (i == lhs.keys.size() || rhs.keys[j] < lhs.keys[i])
+            {
+                if (op == Op::Or)
+                    append(rhs.keys[j], Container(rhs.containers[j]));
+                j++;
+            }
+            else
+            {
+                append(lhs.keys[i], combineContainer(lhs.containers[i], rhs.containers[j], op));
+                i++;
+                j++;
+            }
+        }
+        return res;
+    }
+
+    static Container combineContainer(const Container& a, const Container& b, Op op)
+    {
+        using Type = Container::Type;
+
+        // Array 与任意 container 求交、求差：逐个检查 Array 中的元素
+        if (a.type == Type::Array && op != Op::Or)
+        {
+            if (op == Op::And && b.type == Type::Array)
+                return intersectArrays(a.values, b.values);
+            Container c;
+            for (uint16_t v : a.values)
+                if (b.contains(v) == (op == Op::And))
+                    c.values.push_back(v);
+            c.recount();
+            return c;
+        }
+        if (b.type == Type::Array && op == Op::And)
+            return combineContainer(b, a, op);
+
+        if (a.type == Type::Array && b.type == Type::Array) // Or
+        {
+            Container c;
+            c.values.reserve(a.values.size() + b.values.size());
+            std::set_union(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), std::back_inserter(c.values));
+            c.recount();
+            c.normalize();
+            return c;
+        }
+
+        if (a.type == Type::Run && b.type == Type::Run && op != Op::AndNot)
+            return combineRuns(a, b, op);
+
+        // 其余情况都转成 Bitmap 逐字运算
+        Container c = a, other = b;
+        c.toBitmap();
+        other.toBitmap();
+        bitmapOp(c.words.data(), other.words.data(), op);
+        c.recount();
+        c.normalize();
+        return c;
+    }
+
+    // 两个有序数组求交，大小悬殊时对大数组二分
+    static Container intersectArrays(const std::vector<uint16_t>& a, const std::vector<uint16_t>& b)
+    {
+        Container c;
+        const auto& small = a.size() <= b.size() ? a : b;
+        const auto& large = a.size() <= b.size() ? b : a;
+        if (small.size() * 32 < large.size())
+        {
+            auto from = large.begin();
+            for (uint16_t v : small)
+            {
+                from = std::lower_bound(from, large.end(), v);
+                if (from == large.end())
+                    break;
+                if (*from == v)
+                    c.values.push_back(v);
+            }
+        }
+        else
+            std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(c.values));
+        c.recount();
+        return c;
+    }
+
+    // Run 与 Run 直接按区间求交、求并，结果仍是 Run
+    static Container combineRuns(const Container& a, const Container& b, Op op)
+    {
+        using Interval = std::pair<uint32_t, uint32_t>; // [first, second]
+        auto intervals = [](const Container& c) {
+            std::vector<Interval> res;
+            for (size_t i = 0; i < c.runCount(); i++)
+                res.emplace_back(c.values[i * 2], uint32_t(c.values[i * 2]) + c.values[i * 2 + 1]);
+            return res;
+        };
+        auto ia = intervals(a), ib = intervals(b);
+        std::vector<Interval> merged;
+        if (op == Op::And)
+        {
+            for (size_t i = 0, j = 0; i < ia.size() && j < ib.size();)
+            {
+                uint32_t lo = std::max(ia[i].first, ib[j].first), hi = std::min(ia[i].second, ib[j].second);
+                if (lo <= hi)
+                    merged.emplace_back(lo, hi);
+                if (ia[i].second < ib[j].second)
+                    i++;
+                else
+                    j++;
+            }
+        }
+        else
+        {
+            std::vector<Interval> all;
+            std::merge(ia.begin(), ia.end(), ib.begin(), ib.end(), std::back_inserter(all));
+            for (const auto& interval : all)
+            {
+                if (!merged.empty() && interval.first <= merged.back().second + 1)
+                    merged.back().second = std::max(merged.back().second, interval.second);
+                else
+                    merged.push_back(interval);
+            }
+        }
+
+        Container c;
+        c.type = Container::Type::Run;
+        for (const auto& [lo, hi] : merged)
+        {
+            c.values.push_back(static_cast<uint16_t>(lo));
+            c.values.push_back(static_cast<uint16_t>(hi - lo));
+        }
+        c.recount();
+        c.normalize();
+        return c;
+    }
+
+    static void bitmapOp(uint64_t* dst, const uint64_t* src, Op op)
+    {
+        size_t i = 0;
+#ifdef __AVX2__
+        for (; i + 4 <= BitmapWords; i += 4)
+        {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            __m256i r;
+            if (op == Op::And)
+                r = _mm256_and_si256(x, y);
+            else if (op == Op::Or)
+                r = _mm256_or_si256(x, y);
+            else
+                r = _mm256_andnot_si256(y, x); // (~y) & x
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), r);
+        }
+#endif
+        for (; i < BitmapWords; i++)
+        {
+            if (op == Op::And)
+                dst[i] &= src[i];
+            else if (op == Op::Or)
+                dst[i] |= src[i];
+            else
+                dst[i] &= ~src[i];
+        }
+    }
+
+    static uint32_t bitmapCardinality(const uint64_t* words)
+    {
+        uint32_t res = 0;
+        for (size_t i = 0; i < BitmapWords; i++)
+            res += std::popcount(words[i]);
+        return res;
+    }
+
+    std::vector<uint16_t> keys; // 升序的高 16 位
+    std::vector<Container> containers;
+};
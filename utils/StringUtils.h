@@ -68,9 +68,14 @@ T restrictStoi(const std::string &str)
     size_t i = 0;
     if (str[0] == '-')
     {
+        // 无符号类型取负数会回绕成很大的值
+        if constexpr (std::is_unsigned_v<T>)
+            THROW(Poco::InvalidArgumentException("restrict_stoi requires a non-negative number! -- " + str));
         is_minus = true;
         ++i;
     }
+    if (i == str.size())
+        THROW(Poco::InvalidArgumentException("restrict_stoi requires at least one number char! -- " + str));
 
     for (; i < str.size(); i++)
     {
@@ -78,8 +83,9 @@ T restrictStoi(const std::string &str)
         if (!Poco::Ascii::isDigit(ch))
             THROW(Poco::InvalidArgumentException(
                     "restrict_stoi requires a string contains only number char! -- " + str));
-        else
-            base = base * 10 + ch - '0';
+        if (base > (std::numeric_limits<T>::max() - (ch - '0')) / 10)
+            THROW(Poco::InvalidArgumentException("restrict_stoi out of range! -- " + str));
+        base = base * 10 + ch - '0';
     }
 
     return is_minus ? 0 - base : base;
@@ -147,6 +153,46 @@ bool is_valid_utf8(const std::string &str)
     return true;
 }
 
+// 解码 str[pos] 开始的一个 UTF-8 字符，码点写入 code_point，返回其字节长度；非法编码返回 0
+size_t decodeUtf8(const std::string &str, size_t pos, uint32_t &code_point)
+{
+    auto c = static_cast<unsigned char>(str[pos]);
+    size_t len;
+    if ((c & 0x80) == 0x00)
+    {
+        code_point = c;
+        return 1;
+    }
+    else if ((c & 0xE0) == 0xC0)
+    {
+        len = 2;
+        code_point = c & 0x1F;
+    }
+    else if ((c & 0xF0) == 0xE0)
+    {
+        len = 3;
+        code_point = c & 0x0F;
+    }
+    else if ((c & 0xF8) == 0xF0)
+    {
+        len = 4;
+        code_point = c & 0x07;
+    }
+    else
+        return 0;
+
+    if (pos + len > str.size())
+        return 0;
+    for (size_t i = 1; i < len; i++)
+    {
+        auto cc = static_cast<unsigned char>(str[pos + i]);
+        if ((cc & 0xC0) != 0x80)
+            return 0;
+        code_point = (code_point << 6) | (cc & 0x3F);
+    }
+    return len;
+}
+
 std::string fix_utf8(const std::string &str)
 {
     if (is_valid_utf8(str))
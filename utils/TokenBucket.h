@@ -0,0 +1,48 @@
+#pragma once
+
+#include "../typedefs.h"
+
+// 令牌桶限速：令牌以 rate 每秒的速度补充，最多积攒 burst 个.
+// 允许一次消耗超过现有令牌（例如一个大文件），欠下的令牌由之后的等待偿还，因此长期速度不超过 rate.
+class TokenBucket
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TokenBucket(double rate_, double burst_) : rate(rate_), burst(burst_), tokens(burst_), last_refill(Clock::now())
+    {
+        if (rate <= 0 || burst <= 0)
+            THROW(Poco::InvalidArgumentException("token bucket requires positive rate and burst"));
+    }
+
+    // 消耗 n 个令牌，返回调用方需要等待的时间
+    std::chrono::nanoseconds consume(double n, Clock::time_point now = Clock::now())
+    {
+        std::lock_guard lg(lock);
+        if (now > last_refill)
+        {
+            tokens = std::min(burst, tokens + std::chrono::duration<double>(now - last_refill).count() * rate);
+            last_refill = now;
+        }
+        tokens -= n;
+        if (tokens >= 0)
+            return std::chrono::nanoseconds::zero();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(-tokens / rate));
+    }
+
+    // 消耗 n 个令牌，令牌不足时阻塞
+    void acquire(double n)
+    {
+        auto wait = consume(n);
+        if (wait > std::chrono::nanoseconds::zero())
+            std::this_thread::sleep_for(wait);
+    }
+
+private:
+    const double rate;
+    const double burst;
+
+    std::mutex lock;
+    double tokens;
+    Clock::time_point last_refill;
+};
@@ -3,7 +3,13 @@
 #include "StringUtils.h"
 #include "ContainerUtils.h"
 #include "JsonUtils.h"
+#include "JsonWriter.h"
 #include "DynamicBitSet.h"
+#include "RoaringBitmap.h"
+#include "Compression.h"
+#include "ConcurrencyLimiter.h"
+#include "TokenBucket.h"
+#include <random>
 #include <fcntl.h>
 
 TEST(WriteBuffer, dumpAllToStream)
@@ -119,6 +125,15 @@ TEST(stringUtils, stoi)
     ASSERT_THROW(restrictStoi<int>("  "), Poco::InvalidArgumentException);
     ASSERT_THROW(restrictStoi<int>("1 "), Poco::InvalidArgumentException);
     ASSERT_THROW(restrictStoi<int>(" -1"), Poco::InvalidArgumentException);
+    ASSERT_THROW(restrictStoi<int>("-"), Poco::InvalidArgumentException);
+
+    // 无符号类型不接受负数，超出范围时不回绕
+    ASSERT_EQ(restrictStoi<size_t>("18446744073709551615"), std::numeric_limits<size_t>::max());
+    ASSERT_THROW(restrictStoi<size_t>("-1"), Poco::InvalidArgumentException);
+    ASSERT_THROW(restrictStoi<size_t>("18446744073709551616"), Poco::InvalidArgumentException);
+    ASSERT_EQ(restrictStoi<uint16_t>("65535"), 65535);
+    ASSERT_THROW(restrictStoi<uint16_t>("65536"), Poco::InvalidArgumentException);
+    ASSERT_THROW(restrictStoi<int>("2147483648"), Poco::InvalidArgumentException);
 }
 
 TEST(sortUtils, SyncSort)
@@ -258,6 +273,25 @@ TEST(jsonUtils, dfs2)
     }
 }
 
+TEST(jsonWriter, base)
+{
+    std::ostringstream oss;
+    JsonWriter writer(oss);
+    writer.beginObject()
+          .key("status").value(0)
+          .key("msg").value("a\"b\n\x01")
+          .key("list").beginArray().value(1.5).value(true).null().beginObject().endObject().endArray()
+          .key("empty").beginArray().endArray()
+          .key("size").value(size_t(3))
+          .endObject();
+    auto parsed = nlohmann::json::parse(oss.str());
+    EXPECT_EQ(parsed["status"], 0);
+    EXPECT_EQ(parsed["msg"], "a\"b\n\x01");
+    EXPECT_EQ(parsed["list"].dump(), "[1.5,true,null,{}]");
+    EXPECT_TRUE(parsed["empty"].empty());
+    EXPECT_EQ(parsed["size"], 3);
+}
+
 TEST(dynamicBitSet, base)
 {
     DynamicBitSet s1(7);
@@ -302,6 +336,149 @@ TEST(dynamicBitSet, base)
     EXPECT_EQ(s5.toSet(1), std::set<size_t>({1, 64, 65, 128}));
 }
 
+TEST(roaringBitmap, base)
+{
+    RoaringBitmap r1(std::vector<size_t>{1, 5, 65536, 70000});
+    EXPECT_EQ(r1.cardinality(), 4);
+    EXPECT_TRUE(r1.contains(65536));
+    EXPECT_FALSE(r1.contains(2));
+    r1.remove(5);
+    r1.add(3);
+    EXPECT_EQ(r1.toVector(), std::vector<size_t>({1, 3, 65536, 70000}));
+
+    auto r2 = RoaringBitmap::range(2, 65540);
+    EXPECT_EQ(r2.cardinality(), 65538);
+    EXPECT_EQ((r1 & r2).toVector(), std::vector<size_t>({3, 65536}));
+    EXPECT_EQ((r1 - r2).toVector(), std::vector<size_t>({1, 70000}));
+    EXPECT_EQ((r1 | r2).cardinality(), 65540);
+    EXPECT_TRUE((r2 - r2).empty());
+
+    RoaringBitmap r3(r2.toVector()); // array + bitmap container
+    EXPECT_EQ(r3, r2);
+    const size_t bytes = r3.getBytes();
+    r3.runOptimize();
+    EXPECT_LT(r3.getBytes(), bytes);
+    EXPECT_EQ(r3, r2);
+
+    // 最大的 doc_id 仍能表示全集区间，超过 32 位的 id 在 release 构建中也会被拒绝
+    EXPECT_EQ(RoaringBitmap::range(1, MAX_DOC_ID + 1).cardinality(), MAX_DOC_ID);
+    EXPECT_THROW(RoaringBitmap(std::vector<size_t>{1, size_t(UINT32_MAX) + 1}), Poco::RangeException);
+}
+
+TEST(roaringBitmap, random)
+{
+    // 覆盖 array / bitmap / run 三种 container 之间的组合
+    std::mt19937 gen(42);
+    auto make = [&](size_t n, uint32_t max) {
+        std::set<size_t> s;
+        std::uniform_int_distribution<uint32_t> dist(0, max);
+        for (size_t i = 0; i < n; i++)
+            s.insert(dist(gen));
+        return s;
+    };
+    std::vector<std::set<size_t>> sets{make(100, 200000), make(20000, 200000), make(50000, 70000), {}};
+    std::set<size_t> dense;
+    for (size_t i = 1000; i < 100000; i++)
+        dense.insert(i);
+    sets.push_back(dense);
+
+    for (const auto& a : sets)
+    {
+        for (const auto& b : sets)
+        {
+            RoaringBitmap ra(std::vector<size_t>(a.begin(), a.end())), rb(std::vector<size_t>(b.begin(), b.end()));
+            rb.runOptimize();
+            std::vector<size_t> expect_and, expect_or, expect_andnot;
+            std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expect_and));
+            std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expect_or));
+            std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expect_andnot));
+            EXPECT_EQ((ra & rb).toVector(), expect_and);
+            EXPECT_EQ((ra | rb).toVector(), expect_or);
+            EXPECT_EQ((ra - rb).toVector(), expect_andnot);
+            EXPECT_EQ((ra & rb).cardinality(), expect_and.size());
+        }
+    }
+}
+
+TEST(compression, lz)
+{
+    std::mt19937 gen(7);
+    std::string random_bytes;
+    for (size_t i = 0; i < 10000; i++)
+        random_bytes.push_back(static_cast<char>(gen()));
+    std::string repeated;
+    for (size_t i = 0; i < 1000; i++)
+        repeated += "hello world " + std::to_string(i % 7);
+
+    for (const std::string& raw : {std::string(), std::string("abc"), std::string(1000, 'a'), random_bytes, repeated})
+    {
+        auto compressed = lz::compress(raw);
+        EXPECT_EQ(lz::decompress(compressed, raw.size()), raw);
+    }
+    EXPECT_LT(lz::compress(repeated).size(), repeated.size() / 10);
+    EXPECT_THROW(lz::decompress(lz::compress(repeated).substr(0, 20), repeated.size()), Poco::DataFormatException);
+}
+
+TEST(concurrencyLimiter, base)
+{
+    using namespace std::chrono_literals;
+    ConcurrencyLimiter limiter(2);
+    EXPECT_TRUE(limiter.tryAcquire(0ms));
+    EXPECT_TRUE(limiter.tryAcquire(0ms));
+    EXPECT_FALSE(limiter.tryAcquire(10ms));
+    EXPECT_EQ(limiter.getRunning(), 2);
+    EXPECT_EQ(limiter.getRejected(), 1);
+
+    // 等待中的请求在许可归还后拿到许可
+    std::thread t([&] { EXPECT_TRUE(limiter.tryAcquire(5000ms)); });
+    while (limiter.getWaiting() == 0)
+        std::this_thread::yield();
+    limiter.release();
+    t.join();
+    EXPECT_EQ(limiter.getRunning(), 2);
+
+    limiter.release();
+    limiter.release();
+    EXPECT_EQ(limiter.getRunning(), 0);
+    EXPECT_EQ(limiter.getWaiting(), 0);
+}
+
+TEST(concurrencyLimiter, maxWaiting)
+{
+    using namespace std::chrono_literals;
+    ConcurrencyLimiter limiter(1, 1);
+    EXPECT_TRUE(limiter.tryAcquire(0ms));
+
+    // 排队已满时不等待，立即放弃
+    std::thread t([&] { EXPECT_TRUE(limiter.tryAcquire(5000ms)); });
+    while (limiter.getWaiting() == 0)
+        std::this_thread::yield();
+    auto begin = std::chrono::steady_clock::now();
+    EXPECT_FALSE(limiter.tryAcquire(5000ms));
+    EXPECT_LT(std::chrono::steady_clock::now() - begin, 1000ms);
+    EXPECT_EQ(limiter.getRejected(), 1);
+
+    limiter.release();
+    t.join();
+    limiter.release();
+    EXPECT_EQ(limiter.getRunning(), 0);
+}
+
+TEST(tokenBucket, base)
+{
+    using namespace std::chrono_literals;
+    TokenBucket bucket(1000, 500);
+    auto now = TokenBucket::Clock::now();
+    EXPECT_EQ(bucket.consume(500, now), 0ns);
+
+    // 令牌不足时允许透支，欠下 1000 个令牌需要等待 1s
+    EXPECT_NEAR(std::chrono::duration<double>(bucket.consume(1000, now)).count(), 1.0, 1e-6);
+
+    // 1.5s 后还清欠款，积攒的令牌不超过 burst
+    EXPECT_EQ(bucket.consume(500, now + 1500ms), 0ns);
+    EXPECT_GT(bucket.consume(1, now + 1500ms), 0ns);
+}
+
 TEST(Timer, base)
 {
     StopWatch a;